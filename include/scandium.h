@@ -22,20 +22,37 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <exception>
+#include <fstream>
 #include <functional>
 #include <iterator>
+#include <limits>
 #include <memory>
 #include <stdexcept>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "sqlite3.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <unistd.h>
+#define SCANDIUM_HAS_FD_SINK 1
+#endif
+
 namespace scandium {
 
     class database;
@@ -53,565 +70,607 @@ namespace scandium {
     };
 
     /**
-     *  Describes the SQLite transaction modes.
+     *  Represents a text that is not owned.
+     *  Binding a text_view does not copy the text,
+     *  so the text must be alive until the statement is reset or the placeholder is rebound.
      */
-    enum class transaction_mode {
-        /**
-         *  No locks are acquired on the database until the database is first accessed.
-         */
-        deferred,
-
-        /**
-         *  Reserved locks are acquired on all databases as soon as the transaction began.
-         */
-        immediate,
-
-        /**
-         *  Exclusive locks to be acquired on all databases.
-         */
-        exclusive,
+    struct text_view {
+        const char *data;
+        int size;
     };
 
     /**
-     *  Represents an exception that is thrown when SQLite error occurred.
+     *  Represents a value of SQLite that owns its data, that is NULL, INTEGER, REAL, TEXT or BLOB.
      */
-    class sqlite_error : public std::runtime_error {
+    class value {
     public:
         /*
          *  Constructor.
+         *  Creates NULL.
          */
-        sqlite_error(const std::string &what, int rc);
+        value() noexcept;
+
+        /*
+         *  Constructor.
+         *  Creates NULL.
+         */
+        value(std::nullptr_t) noexcept;
+
+        /*
+         *  Constructor.
+         *  Creates INTEGER.
+         */
+        value(int integer) noexcept;
 
         /**
-         *  Returns the SQLite result code.
+         *  @copydoc value::value(int)
          */
-        int result_code() const;
+        value(sqlite3_int64 integer) noexcept;
 
-    private:
-        static std::string create_error_message(const std::string &what, int rc);
+        /*
+         *  Constructor.
+         *  Creates REAL.
+         */
+        value(double real) noexcept;
 
-        const int _rc;
-    };
+        /*
+         *  Constructor.
+         *  Creates TEXT.
+         */
+        value(const std::string &text);
 
-    /**
-     *  A wrapper for an sqlite3 using the RAII idiom.
-     */
-    class sqlite_holder {
-    public:
         /**
-         *  Destructor.
-         *  Closes the underlying sqlite3 if not closed, or do nothing otherwise.
+         *  @copydoc value::value(const std::string &)
          */
-        ~sqlite_holder() noexcept;
+        value(const char *text);
 
         /**
-         *  Opens the sqlite3 handle.
+         *  @copydoc value::value(const std::string &)
+         */
+        value(text_view text);
+
+        /*
+         *  Constructor.
+         *  Creates BLOB.
          */
-        void open_path(const std::string &path);
+        value(const std::vector<unsigned char> &bytes);
 
         /**
-         *  Closes the underlying sqlite3.
+         *  @copydoc value::value(const std::vector<unsigned char> &)
          */
-        void close();
+        value(blob bytes);
+
+        /*
+         *  Constructor.
+         *  Copies a protected or unprotected sqlite3_value, or creates NULL if nullptr.
+         */
+        explicit value(sqlite3_value *source);
 
         /**
-         *  Returns true if the underlying sqlite3 is closed, or false otherwise.
+         *  Returns the datatype code, SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL.
          */
-        bool is_closed() const;
+        int get_type() const;
 
         /**
-         *  Executes the SQL statement that does not return data.
-         *
-         *  @param sql the SQL statement.
+         *  Returns true if NULL, or false otherwise.
          */
-        void exec_sql(const std::string &sql);
+        bool is_null() const;
 
         /**
-         *  Begins a transaction.
-         *
-         *  @param mode the transaction mode
+         *  Returns the integer, or the converted value if the type is not INTEGER.
          */
-        void begin_transaction(transaction_mode mode = transaction_mode::deferred);
+        sqlite3_int64 get_int64() const;
 
         /**
-         *  Commits a transaction.
+         *  Returns the real, or the converted value if the type is not REAL.
          */
-        void commit_transaction();
+        double get_double() const;
 
         /**
-         *  Rollbacks a transaction.
+         *  Returns the text, the bytes of BLOB, or an empty string for NULL, INTEGER and REAL.
          */
-        void rollback_transaction();
+        const std::string &get_text() const;
 
         /**
-         *  Returns the underlying sqlite3 handle.
+         *  Returns the bytes of BLOB or TEXT that are alive while this value is alive.
          */
-        sqlite3 *get() const;
+        blob get_blob() const;
 
         /**
-         *  Returns the underlying sqlite3 handle if it is not closed,
-         *  or nullptr otherwise.
+         *  Returns the approximate bytes of memory used by this value.
          */
-        sqlite3 *get_noexcept() const noexcept;
+        std::size_t memory_size() const;
+
+        bool operator==(const value &other) const;
+
+        bool operator!=(const value &other) const;
 
     private:
-        sqlite3 *_db = nullptr;
+        int _type;
+        union {
+            sqlite3_int64 _integer;
+            double _real;
+        };
+        std::string _bytes;
     };
 
     /**
-     *  A wrapper for an sqlite3_stmt using the RAII idiom.
+     *  Represents an SQL string literal whose number of parameters is counted at compile time.
+     *  Use SCANDIUM_SQL("...") to create.
+     *
+     *  @tparam ParameterCount the number of parameters, that is the largest index of ?, ?NNN, :VVV, @VVV and $VVV.
      */
-    class sqlite_stmt_holder {
+    template<int ParameterCount>
+    class sql_literal {
     public:
         /*
          *  Constructor.
          */
-        sqlite_stmt_holder(sqlite3_stmt *stmt) noexcept;
+        constexpr sql_literal(const char *sql, std::size_t length);
 
         /**
-         *  Destructor.
-         *  Finalizes the underlying sqlite3_stmt if not finalized, or do nothing otherwise.
+         *  Returns the number of parameters.
          */
-        ~sqlite_stmt_holder() noexcept;
+        static constexpr int get_parameter_count();
 
         /**
-         *  Finalizes the underlying sqlite3_stmt.
+         *  Returns the SQL statement.
          */
-        void finalize();
+        constexpr const char *c_str() const;
 
         /**
-         *  Returns true if the underlying sqlite3_stmt is finalized, or false otherwise.
+         *  Returns the length of the SQL statement.
          */
-        bool is_finalized() const;
+        constexpr std::size_t length() const;
 
         /**
-         *  Steps the underlying sqlite3_stmt.
+         *  Returns the SQL statement.
          */
-        void step();
+        std::string str() const;
 
+    private:
+        const char *_sql;
+        std::size_t _length;
+    };
+
+    /**
+     *  Creates an sql_literal from a string literal.
+     *  A string literal or a quoted identifier that is not terminated is a compile error.
+     */
+#define SCANDIUM_SQL(sql) ::scandium::sql_literal<::scandium::detail::parameter_count(sql)>(sql, sizeof(sql) - 1)
+
+    /**
+     *  Holds true if a value of T can be bound to a placeholder, or false otherwise.
+     */
+    template<class T>
+    struct is_bindable : std::integral_constant<bool,
+            std::is_same<typename std::decay<T>::type, int>::value
+            || std::is_same<typename std::decay<T>::type, sqlite3_int64>::value
+            || std::is_same<typename std::decay<T>::type, double>::value
+            || std::is_same<typename std::decay<T>::type, std::string>::value
+            || std::is_same<typename std::decay<T>::type, const char *>::value
+            || std::is_same<typename std::decay<T>::type, char *>::value
+            || std::is_same<typename std::decay<T>::type, blob>::value
+            || std::is_same<typename std::decay<T>::type, text_view>::value
+            || std::is_same<typename std::decay<T>::type, std::vector<unsigned char>>::value
+            || std::is_same<typename std::decay<T>::type, std::nullptr_t>::value> {
+    };
+
+    /**
+     *  Describes the SQLite transaction modes.
+     */
+    enum class transaction_mode {
         /**
-         *  Resets the underlying sqlite3_stmt.
+         *  No locks are acquired on the database until the database is first accessed.
          */
-        void reset();
+        deferred,
 
         /**
-         *  The terminal function for variadic template functions.
+         *  Reserved locks are acquired on all databases as soon as the transaction began.
          */
-        void bind_values(int);
-
-        template<class... ArgType>
-        void bind_values(int index, int first_arg, ArgType &&... bind_args);
-
-        template<class... ArgType>
-        void bind_values(int index, sqlite3_int64 first_arg, ArgType &&... bind_args);
-
-        template<class... ArgType>
-        void bind_values(int index, double first_arg, ArgType &&... bind_args);
-
-        template<class... ArgType>
-        void bind_values(int index, const std::string &first_arg, ArgType &&... bind_args);
-
-        template<class... ArgType>
-        void bind_values(int index, const char *first_arg, ArgType &&... bind_args);
-
-        template<class... ArgType>
-        void bind_values(int index, blob first_arg, ArgType &&... bind_args);
-
-        template<class... ArgType>
-        void bind_values(int index, const std::vector<unsigned char> &first_arg, ArgType &&... bind_args);
+        immediate,
 
-        template<class... ArgType>
-        void bind_values(int index, std::nullptr_t, ArgType &&... bind_args);
+        /**
+         *  Exclusive locks to be acquired on all databases.
+         */
+        exclusive,
+    };
 
+    /**
+     *  Represents how to handle a database used by a thread other than its owner.
+     */
+    enum class thread_check_mode {
         /**
-         *  Returns the underlying sqlite3_stmt handle.
+         *  The thread is not checked.
          */
-        sqlite3_stmt *get() const;
+        off,
 
         /**
-         *  Returns the underlying sqlite3_stmt handle if it is not finalized,
-         *  or nullptr otherwise.
+         *  Violations are passed to the reporter, and the operations are executed.
          */
-        sqlite3_stmt *get_noexcept() const noexcept;
+        report,
 
-    private:
-        sqlite3_stmt *_stmt;
+        /**
+         *  Violations are thrown as thread_affinity_error.
+         */
+        raise,
     };
 
     /**
-     *  Represents a precompiled SQL statement.
+     *  Describes the thread affinity check of a database, see database::claim_thread().
+     *  The owner is the thread that opened the database, and is checked when statements are prepared,
+     *  executed or queried, and when transactions begin or end.
      */
-    class statement {
-    public:
+    struct thread_check_options {
+        thread_check_mode mode = thread_check_mode::off;
+
         /**
-         *  Finalizes this statement.
+         *  The callback to be called for each violation in report mode.
          */
-        void finalize();
+        std::function<void(std::thread::id owner, std::thread::id current)> reporter;
+    };
 
+    /**
+     *  Describes the options to open a database.
+     */
+    struct open_options {
         /**
-         *  Executes this statement.
+         *  The name of the registered VFS module to use, or empty to use the default VFS.
          */
-        void exec();
+        std::string vfs;
 
         /**
-         *  Executes this statement.
-         *  Removes all bindings that were given before
-         *  and rebind the arguments to the placeholders before the execution.
+         *  The flags of sqlite3_open_v2(), such as SQLITE_OPEN_NOMUTEX for a connection used by one thread at a time.
          */
-        template<class... ArgType>
-        void exec_with_bindings(ArgType &&... bind_args);
+        int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
 
         /**
-         *  Executes this statement and returns a result set.
+         *  The thread affinity check.
          */
-        result_set query();
+        thread_check_options thread_check;
 
         /**
-         *  Executes this statement and returns a result set.
-         *  Removes all bindings that were given before
-         *  and rebind the arguments to the placeholders before the execution.
+         *  The size in bytes of each lookaside slot, 0 to disable the lookaside, or -1 for the default.
+         *  If only lookaside_slot_count is set, this is the default of SQLite, 1200 bytes.
          */
-        template<class... ArgType>
-        result_set query_with_bindings(ArgType &&... bind_args);
+        int lookaside_slot_size = -1;
 
         /**
-         *  Resets this statement.
+         *  The number of lookaside slots, 0 to disable the lookaside, or -1 for the default.
+         *  If only lookaside_slot_size is set, this is the default of SQLite, 100 slots.
          */
-        void reset();
+        int lookaside_slot_count = -1;
 
         /**
-         *  Binds the values to the placeholders such as ?.
-         *
-         *  @param bind_args the values to bind to the placeholders.
+         *  The value of PRAGMA cache_size, that is pages if positive or KiB if negative, or 0 to keep the default.
          */
-        template<class... ArgType>
-        void bind_values(ArgType &&... bind_args);
+        int cache_size = 0;
+    };
 
+    /**
+     *  Represents the memory and page cache counters of a database connection, see sqlite3_db_status().
+     */
+    struct database_stats {
         /**
-         *  Binds the value to the placeholder such as ? or ?NNN (NNN represents an integer literal).
-         *
-         *  @param index the one-based index or the index equivalent to NNN.
-         *  @param value the value to bind to the placeholder.
+         *  The number of page cache hits.
          */
-        void bind(int index, int value);
+        int cache_hit = 0;
 
         /**
-         *  @copydoc statement::bind(int,int)
+         *  The number of page cache misses.
          */
-        void bind(int index, sqlite3_int64 value);
+        int cache_miss = 0;
 
         /**
-         *  @copydoc statement::bind(int,int)
+         *  The number of dirty pages written to the database file.
          */
-        void bind(int index, double value);
+        int cache_write = 0;
 
         /**
-         *  @copydoc statement::bind(int,int)
+         *  The number of dirty pages written to the database file in the middle of a transaction.
          */
-        void bind(int index, const std::string &value);
+        int cache_spill = 0;
 
         /**
-         *  @copydoc statement::bind(int,int)
+         *  The bytes of heap memory used by the page cache.
          */
-        void bind(int index, const char *value);
+        int cache_used = 0;
 
         /**
-         *  @copydoc statement::bind(int,int)
+         *  The number of lookaside slots currently in use.
          */
-        void bind(int index, blob value);
+        int lookaside_used = 0;
 
         /**
-         *  @copydoc statement::bind(int,int)
+         *  The highest number of lookaside slots in use at once.
          */
-        void bind(int index, const std::vector<unsigned char> &value);
+        int lookaside_highwater = 0;
 
         /**
-         *  Binds the blob value to the placeholder such as ? or ?NNN (NNN represents an integer literal).
-         *
-         *  @param index the one-based index or the index equivalent to NNN.
-         *  @param data  the blob value to bind to the placeholder.
-         *  @param size  the size of the blob value.
+         *  The number of allocations served by the lookaside.
          */
-        void bind(int index, const void *data, int size);
+        int lookaside_hit = 0;
 
         /**
-         *  @copydoc statement::bind(int,int)
+         *  The number of allocations not served by the lookaside because they were too large.
          */
-        void bind(int index, std::nullptr_t);
+        int lookaside_miss_size = 0;
 
         /**
-         *  Binds the value to the placeholder such as :VVV, @VVV or $VVV (VVV represents an alphanumeric identifier).
-         *
-         *  @tparam T int, sqlite3_int64, double, std::string, const char *, std::vector<unsigned char> or scandium::blob.
-         *
-         *  @param parameter_name the parameter name equivalent to :VVV, @VVV or $VVV
-         *  @param value          the value to bind to the placeholder
+         *  The number of allocations not served by the lookaside because all the slots were in use.
          */
-        template<class T>
-        void bind(const std::string &parameter_name, T &&value);
+        int lookaside_miss_full = 0;
 
         /**
-         *  Removes all binding values.
+         *  The bytes of heap memory used to store the schemas.
          */
-        void clear_bindings();
+        int schema_used = 0;
 
-    private:
-        statement(const std::shared_ptr<sqlite_holder> &db_holder, const std::string &sql);
+        /**
+         *  The bytes of heap memory used by the prepared statements.
+         */
+        int stmt_used = 0;
 
-        std::shared_ptr<sqlite_holder> _db_holder;
-        std::shared_ptr<sqlite_stmt_holder> _stmt_holder;
+        /**
+         *  Returns the ratio of page cache hits to page cache lookups, or 0 if no lookups.
+         */
+        double cache_hit_rate() const;
 
-        friend class database;
+        /**
+         *  Returns the ratio of lookaside hits to small allocations, or 0 if no allocations.
+         */
+        double lookaside_hit_rate() const;
     };
 
     /**
-     *  Represents a cursor to fetch data from a row.
+     *  Represents the runtime counters of a prepared statement, see sqlite3_stmt_status().
      */
-    class cursor {
-    public:
+    struct statement_stats {
         /**
-         *  Gets data from the current row.
-         *
-         *  @tparam T int, sqlite3_int64, double, std::string, const char *, std::vector<unsigned char> or scandium::blob.
-         *
-         *  @param column_index the zero-based column index.
+         *  The number of times that SQLite has stepped forward in a table as part of a full table scan.
          */
-        template<class T>
-        T get(int column_index) const;
+        int fullscan_step = 0;
 
         /**
-         *  Gets data for the given column name from the current row,
-         *  or throws an exception if the column name does not exist.
-         *
-         *  @tparam T int, sqlite3_int64, double, std::string, const char *, std::vector<unsigned char> or scandium::blob.
-         *
-         *  @param column_name the column name.
+         *  The number of sort operations.
          */
-        template<class T>
-        T get(const std::string &column_name) const;
+        int sort = 0;
 
         /**
-         *  Returns true if data from the current row is null, or false otherwise.
+         *  The number of rows inserted into transient indices that were created automatically.
          */
-        bool is_null(int column_index) const;
+        int autoindex = 0;
 
         /**
-         *  Returns true if data for the given column name from the current row is null, or false otherwise.
+         *  The number of virtual machine operations executed.
          */
-        bool is_null(const std::string &column_name) const;
+        int vm_step = 0;
 
         /**
-         *  Returns the column name at the given zero-based column index.
-         *
-         *  @param column_index the zero-based index.
+         *  The number of times that the statement has been regenerated due to schema changes and so on.
          */
-        std::string get_column_name(int column_index) const;
+        int reprepare = 0;
 
         /**
-         *  Returns the zero-based index for the given column name, or -1 if the column does not exist.
-         *
-         *  @param column_name the name of the target column.
+         *  The number of times that the statement has run to completion or been reset.
          */
-        int get_column_index(const char *column_name) const;
+        int run = 0;
 
         /**
-         *  @copydoc cursor::get_column_index(const char *)
+         *  The bytes of heap memory used by the statement.
          */
-        int get_column_index(const std::string &column_name) const;
+        int memused = 0;
 
         /**
-         *  Returns total number of columns.
+         *  Adds the counters of other to this, for aggregating the counters of statements.
          */
-        int get_column_count() const;
-
-    private:
-        cursor(const std::shared_ptr<sqlite_stmt_holder> &stmt_holder);
-
-        std::shared_ptr<sqlite_stmt_holder> _stmt_holder;
-
-        friend class iterator;
+        statement_stats &operator+=(const statement_stats &other);
     };
 
     /**
-     *  Provides an STL-style forward iterator to fetch data from an SQLite result set.
+     *  Represents a row of EXPLAIN QUERY PLAN and its child rows.
      */
-    class iterator : public std::iterator<std::forward_iterator_tag, cursor> {
-    public:
-        iterator &operator++();
-
-        cursor &operator*();
-
-        cursor *operator->();
-
-        bool operator==(const iterator &other) const;
-
-        bool operator!=(const iterator &other) const;
-
-    private:
-        iterator();
-
-        iterator(const std::shared_ptr<sqlite_stmt_holder> &stmt_holder,
-                 std::uint_fast64_t row_index,
-                 int rc);
-
-        std::shared_ptr<sqlite_stmt_holder> _stmt_holder;
-        cursor _cursor;
+    struct query_plan_node {
+        int id;
 
-        struct state {
-            std::uint_fast64_t row_index;
-            int rc;
-        };
+        /**
+         *  The id of the parent row, or 0 if a top-level row.
+         */
+        int parent;
 
-        std::shared_ptr<state> _state;
+        /**
+         *  The description of the step, such as "SCAN table_1" or "SEARCH table_1 USING INDEX index_1 (id=?)".
+         */
+        std::string detail;
 
-        friend class result_set;
+        std::vector<query_plan_node> children;
     };
 
     /**
-     *  Represents an SQLite result set.
+     *  Specifies the action of the query plan guard.
      */
-    class result_set {
-    public:
+    enum class plan_guard_mode {
         /**
-         *  Returns the iterator pointing to the first row.
-         *
-         *  @attention The iterator got in the past becomes invalid.
+         *  Query plans are not inspected.
          */
-        iterator begin();
+        off,
 
         /**
-         *  Returns the iterator to end.
+         *  Violations are passed to the reporter, and the statements are prepared.
          */
-        iterator end();
-
-    private:
-        result_set(const std::shared_ptr<sqlite_holder> &db_holder,
-                   const std::shared_ptr<sqlite_stmt_holder> &stmt_holder);
+        report,
 
-        std::shared_ptr<sqlite_holder> _db_holder;
-        std::shared_ptr<sqlite_stmt_holder> _stmt_holder;
-
-        friend class statement;
+        /**
+         *  Violations are thrown as query_plan_error.
+         */
+        raise,
     };
 
     /**
-     *  Represents a transaction using the RAII idiom.
+     *  Describes the query plan guard that inspects the plan of every statement created by database::prepare_statement().
      */
-    class transaction {
-    public:
+    struct plan_guard_options {
+        plan_guard_mode mode = plan_guard_mode::off;
+
         /**
-         *  Destructor.
-         *  Rollbacks this transaction if not committed, or does nothing if committed.
+         *  true to reject full table scans.
          */
-        ~transaction() noexcept;
+        bool forbid_scan = true;
 
         /**
-         *  Move constructor.
+         *  true to reject temp B-trees for ORDER BY, that is sorting without an index.
          */
-        transaction(transaction &&other) noexcept;
+        bool forbid_temp_b_tree = true;
 
         /**
-         *  Move assignment operator.
+         *  The tables that are small enough to be scanned, also when a query gives them an alias.
          */
-        transaction &operator=(transaction &&other) noexcept;
+        std::vector<std::string> scannable_tables;
 
         /**
-         *  Commits this transaction.
+         *  The callback to be called for each violation in report mode.
          */
-        void commit();
+        std::function<void(const std::string &sql, const std::string &detail)> reporter;
+    };
 
-    private:
-        /**
+    /**
+     *  Represents an exception that is thrown when SQLite error occurred.
+     */
+    class sqlite_error : public std::runtime_error {
+    public:
+        /*
          *  Constructor.
-         *  Begin a transaction.
          */
-        transaction(const std::shared_ptr<sqlite_holder> &db_holder, transaction_mode mode);
+        sqlite_error(const std::string &what, int rc);
 
-        transaction(const transaction &) = delete;
+        /**
+         *  Returns the SQLite result code.
+         */
+        int result_code() const;
 
-        transaction &operator=(const transaction &) = delete;
+    private:
+        static std::string create_error_message(const std::string &what, int rc);
 
-        std::shared_ptr<sqlite_holder> _db_holder;
-        bool _in_transaction;
+        const int _rc;
+    };
 
-        friend class database;
+    /**
+     *  Represents an exception that is thrown when a statement is interrupted,
+     *  by database::interrupt() or a progress listener, see sqlite_holder::add_progress_listener().
+     */
+    class interrupted_error : public sqlite_error {
+    public:
+        /*
+         *  Constructor.
+         */
+        explicit interrupted_error(const std::string &what);
     };
 
     /**
-     *  Represents an SQLite database.
+     *  Represents an exception that is thrown when a database is used by a thread other than its owner.
      */
-    class database {
+    class thread_affinity_error : public std::logic_error {
     public:
+        /*
+         *  Constructor.
+         */
+        thread_affinity_error(std::thread::id owner, std::thread::id current);
+
         /**
-         *  Constructor to create an in-memory database.
+         *  Returns the thread that owns the database.
          */
-        database();
+        std::thread::id get_owner() const;
 
         /**
+         *  Returns the thread that used the database.
+         */
+        std::thread::id get_current() const;
+
+    private:
+        static std::string create_error_message(std::thread::id owner, std::thread::id current);
+
+        const std::thread::id _owner;
+        const std::thread::id _current;
+    };
+
+    /**
+     *  Represents an exception that is thrown when the query plan guard rejects a statement.
+     */
+    class query_plan_error : public std::runtime_error {
+    public:
+        /*
          *  Constructor.
-         *
-         *  @param path the path of the SQLite database file to open and/or create.
          */
-        database(const std::string &path);
+        query_plan_error(const std::string &sql, const std::string &detail);
 
         /**
-         *  Opens the database and/or creates the SQLite database file.
+         *  Returns the SQL statement that was rejected.
          */
-        void open();
-
-#ifdef SQLITE_HAS_CODEC
+        const std::string &get_sql() const;
 
         /**
-         *  Opens the database and/or creates the SQLite database file.
-         *
-         *  @param passphrase the passphrase to encrypt the database if using sqlcipher and so on.
+         *  Returns the query plan row that was rejected.
          */
-        void open(const std::string &passphrase);
+        const std::string &get_detail() const;
 
-#endif
+    private:
+        const std::string _sql;
+        const std::string _detail;
+    };
 
+    /**
+     *  A wrapper for an sqlite3 using the RAII idiom.
+     */
+    class sqlite_holder {
+    public:
         /**
-         *  Closes this database.
+         *  Destructor.
+         *  Closes the underlying sqlite3 if not closed, or do nothing otherwise.
          */
-        void close();
+        ~sqlite_holder() noexcept;
 
         /**
-         *  Executes the SQL statement that does not return data.
+         *  Opens the sqlite3 handle.
+         *
+         *  @param path    the path of the SQLite database file.
+         *  @param options the options to open the database.
          */
-        void exec_sql(const std::string &sql);
+        void open_path(const std::string &path, const open_options &options = open_options());
 
         /**
-         *  Executes the SQL statement that does not return data.
-         *
-         *  @param sql       the single SQL statement.
-         *  @param bind_args the values to bind to the placeholders such as ?
+         *  Closes the underlying sqlite3.
          */
-        template<class... ArgType>
-        void exec_sql(const std::string &sql, ArgType &&... bind_args);
+        void close();
 
         /**
-         *  Runs the given SQL statement that returns data such as SELECT.
+         *  Returns true if the underlying sqlite3 is closed, or false otherwise.
          */
-        result_set query(const std::string &sql);
+        bool is_closed() const;
 
         /**
-         *  Runs the given SQL statement that returns data such as SELECT.
+         *  Executes the SQL statement that does not return data.
+         *  The statements after the first one are ignored, see exec_script().
          *
-         *  @param sql       the single SQL statement.
-         *  @param bind_args the values to bind to the placeholders such as ?
+         *  @param sql the SQL statement.
          */
-        template<class... ArgType>
-        result_set query(const std::string &sql, ArgType &&... bind_args);
+        void exec_sql(const std::string &sql);
 
         /**
-         *  Creates a precompiled SQL statement.
+         *  Executes all the SQL statements in order, discarding the rows they return.
+         *
+         *  @param sql      the SQL statements separated by semicolons.
+         *  @param length   the length of sql in bytes.
+         *  @param complete false if more text may follow, then the last statement is executed only if
+         *                  the parser ended it with a semicolon before the end of the text.
+         *
+         *  @return the end of the statements executed.
          */
-        statement prepare_statement(const std::string &sql);
+        const char *exec_script(const char *sql, std::size_t length, bool complete = true);
 
         /**
          *  Begins a transaction.
          *
-         *  @param mode the transaction mode.
+         *  @param mode the transaction mode
          */
         void begin_transaction(transaction_mode mode = transaction_mode::deferred);
 
@@ -626,624 +685,4370 @@ namespace scandium {
         void rollback_transaction();
 
         /**
-         *  Returns true if the database is open, or false otherwise.
+         *  Gets the user version of the database.
          */
-        bool is_open() const;
+        int get_user_version();
 
         /**
-         *  Begins a transaction, and Returns a RAII object.
+         *  Returns the underlying sqlite3 handle.
          */
-        transaction create_transaction(transaction_mode mode = transaction_mode::deferred);
+        sqlite3 *get() const;
 
         /**
-         *  Gets the user version of the database, or 0 that is a default value.
+         *  Returns the underlying sqlite3 handle if it is not closed,
+         *  or nullptr otherwise.
          */
-        int get_user_version();
+        sqlite3 *get_noexcept() const noexcept;
 
         /**
-         *  Updates the user version of the database in a transaction.
-         *
-         *  @param version the new version that must be > 0.
-         *  @param mode    the transaction mode.
+         *  The listener of row changes, see sqlite3_update_hook().
+         *  The operation is SQLITE_INSERT, SQLITE_UPDATE or SQLITE_DELETE.
          */
-        void update_user_version(int version, transaction_mode mode = transaction_mode::deferred);
+        typedef std::function<void(int operation, const char *database_name, const char *table_name,
+                                   sqlite3_int64 rowid)> update_listener;
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
 
         /**
-         *  Sets a callback to be called before an upgrade user version.
-         *
-         *  @tparam Callback void(*)(database *db, int old_version, int new_version)
-         *
-         *  @param callback the callback to be called before an upgrade user version.
+         *  The listener called before row changes, see sqlite3_preupdate_hook().
+         *  The old and new values are read with sqlite3_preupdate_old() and sqlite3_preupdate_new() on db.
          */
-        template<class Callback>
-        void set_before_upgrade_user_version(Callback &&callback);
+        typedef std::function<void(sqlite3 *db, int operation, const char *database_name, const char *table_name,
+                                   sqlite3_int64 old_rowid, sqlite3_int64 new_rowid)> preupdate_listener;
+
+#endif
 
         /**
-         *  Sets a callback to be called before a downgrade user version.
-         *
-         *  @tparam Callback void(*)(database *db, int old_version, int new_version)
-         *
-         *  @param callback the callback to be called before a downgrade user version.
+         *  The listener of commits and rollbacks, see sqlite3_commit_hook() and sqlite3_rollback_hook().
          */
-        template<class Callback>
-        void set_before_downgrade_user_version(Callback &&callback);
+        typedef std::function<void()> transaction_listener;
 
         /**
-         *  Returns the file path of the database, or ":memory:" if the in-memory database.
+         *  The authorizer called while statements are prepared, see sqlite3_set_authorizer().
+         *  Returns SQLITE_OK, SQLITE_DENY or SQLITE_IGNORE.
          */
-        const std::string &get_path() const;
+        typedef std::function<int(int action, const char *arg1, const char *arg2, const char *database_name,
+                                  const char *trigger_or_view)> authorizer;
 
-    private:
-        std::string _path;
-        std::shared_ptr<sqlite_holder> _db_holder;
-        std::function<void(database *, int, int)> _before_upgrade_user_version;
-        std::function<void(database *, int, int)> _before_downgrade_user_version;
+        /**
+         *  The listener called periodically during long running statements, see sqlite3_progress_handler().
+         *  Returns true to interrupt the statement.
+         */
+        typedef std::function<bool()> progress_listener;
 
         /**
-         *  Sets a busy handler that sleeps for a specified amount of time when a table is locked.
-         *
-         *  @ param ms max sleep time(milliseconds).
+         *  The listener called when a statement starts running (SQLITE_TRACE_STMT)
+         *  and when it finishes (SQLITE_TRACE_PROFILE), see sqlite3_trace_v2().
          */
-        void set_busy_timeout(int ms);
+        typedef std::function<void(unsigned event, sqlite3_stmt *stmt)> trace_listener;
 
-    };
+        /**
+         *  The number of virtual machine instructions between calls of the progress listeners.
+         */
+        static const int progress_interval = 1000;
 
-#pragma mark ## sqlite_error ##
+        /**
+         *  Adds a listener of row changes, and returns the id to remove it.
+         *  The hooks of SQLite are shared by all the listeners, and must not be set directly.
+         *  The listeners must not use the database, and exceptions thrown by them are ignored
+         *  except by the commit listeners, which turn the commit into a rollback.
+         */
+        std::size_t add_update_listener(update_listener listener);
 
-    inline sqlite_error::sqlite_error(const std::string &what, int rc)
-            : std::runtime_error(create_error_message(what, rc)), _rc(rc) {
-    }
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
 
-    inline int sqlite_error::result_code() const {
-        return _rc;
-    }
+        /**
+         *  Adds a listener called before row changes, and returns the id to remove it.
+         *  Unlike the update hook, it is called for WITHOUT ROWID tables and DELETE without WHERE.
+         */
+        std::size_t add_preupdate_listener(preupdate_listener listener);
 
-    inline std::string sqlite_error::create_error_message(const std::string &what, int rc) {
-        std::stringstream ss;
-        ss << "(" << rc << ")" << sqlite3_errstr(rc) << ", " << what;
+#endif
 
-        return ss.str();
-    }
+        /**
+         *  Adds a listener called before a transaction is committed, and returns the id to remove it.
+         */
+        std::size_t add_commit_listener(transaction_listener listener);
 
-#pragma mark ## sqlite_holder ##
+        /**
+         *  Adds a listener called when a transaction is rolled back, and returns the id to remove it.
+         */
+        std::size_t add_rollback_listener(transaction_listener listener);
+
+        /**
+         *  Adds an authorizer, and returns the id to remove it.
+         *  An action is denied if any authorizer denies it.
+         */
+        std::size_t add_authorizer(authorizer listener);
+
+        /**
+         *  Adds a progress listener, and returns the id to remove it.
+         *  A statement is interrupted if any listener returns true or throws an exception.
+         */
+        std::size_t add_progress_listener(progress_listener listener);
+
+        /**
+         *  Adds a listener of the statements, and returns the id to remove it.
+         *  Statements cost a little more while any trace listener is added, because SQLite times them.
+         */
+        std::size_t add_trace_listener(trace_listener listener);
+
+        /**
+         *  Removes the listener or the authorizer of the given id.
+         *  Must not be called from a listener.
+         */
+        void remove_listener(std::size_t id);
+
+        /**
+         *  Checks that the calling thread owns the sqlite3 handle, according to the thread check mode.
+         */
+        void check_thread() const;
+
+        /**
+         *  Makes the calling thread the owner of the sqlite3 handle.
+         */
+        void claim_thread();
+
+        /**
+         *  Clears the owner, so that the next thread using the sqlite3 handle becomes the owner.
+         */
+        void release_thread();
+
+    private:
+        /**
+         *  The indexes of the statements prepared once and kept until closed.
+         */
+        enum cached_statement {
+            begin_deferred_statement,
+            begin_immediate_statement,
+            begin_exclusive_statement,
+            commit_statement,
+            rollback_statement,
+            user_version_statement,
+            cached_statement_count,
+        };
+
+        sqlite3 *_db = nullptr;
+        sqlite3_stmt *_cached_statements[cached_statement_count] = {};
+
+        /**
+         *  Returns the cached statement, and prepares it if not prepared yet.
+         */
+        sqlite3_stmt *get_cached_statement(cached_statement index, const char *sql);
+
+        /**
+         *  Executes the cached statement that does not return data.
+         */
+        void exec_cached_statement(cached_statement index, const char *sql);
+
+        /**
+         *  Finalizes the cached statements.
+         */
+        void finalize_cached_statements() noexcept;
+
+        thread_check_options _thread_check;
+        mutable std::atomic<std::thread::id> _owner_thread{std::thread::id()};
+
+        /**
+         *  Reports or throws a violation of the thread affinity, or claims the handle if not owned.
+         */
+        void on_thread_mismatch(std::thread::id owner, std::thread::id current) const;
+
+        std::size_t _last_listener_id = 0;
+        std::vector<std::pair<std::size_t, update_listener>> _update_listeners;
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+        std::vector<std::pair<std::size_t, preupdate_listener>> _preupdate_listeners;
+#endif
+        std::vector<std::pair<std::size_t, transaction_listener>> _commit_listeners;
+        std::vector<std::pair<std::size_t, transaction_listener>> _rollback_listeners;
+        std::vector<std::pair<std::size_t, authorizer>> _authorizers;
+        std::vector<std::pair<std::size_t, progress_listener>> _progress_listeners;
+        std::vector<std::pair<std::size_t, trace_listener>> _trace_listeners;
+
+        enum hook {
+            update_hook = 1 << 0,
+            preupdate_hook = 1 << 1,
+            commit_hook = 1 << 2,
+            rollback_hook = 1 << 3,
+            authorizer_hook = 1 << 4,
+            progress_hook = 1 << 5,
+            trace_hook = 1 << 6,
+            all_hooks = (1 << 7) - 1,
+        };
+
+        /**
+         *  Sets or clears the given hooks of SQLite according to the listeners.
+         *  Only the hooks whose listeners became empty or non-empty should be given,
+         *  because setting the authorizer expires all the prepared statements.
+         */
+        void install_hooks(int hooks);
+
+        /**
+         *  Removes the listener of the given id, and returns true if the last listener is removed.
+         */
+        template<class Listener>
+        static bool erase_listener(std::vector<std::pair<std::size_t, Listener>> &listeners, std::size_t id);
+    };
+
+    /**
+     *  A wrapper for an sqlite3_stmt using the RAII idiom.
+     */
+    class sqlite_stmt_holder {
+    public:
+        /*
+         *  Constructor.
+         */
+        sqlite_stmt_holder(sqlite3_stmt *stmt) noexcept;
+
+        /**
+         *  Destructor.
+         *  Finalizes the underlying sqlite3_stmt if not finalized, or do nothing otherwise.
+         */
+        ~sqlite_stmt_holder() noexcept;
+
+        /**
+         *  Finalizes the underlying sqlite3_stmt.
+         */
+        void finalize();
+
+        /**
+         *  Returns true if the underlying sqlite3_stmt is finalized, or false otherwise.
+         */
+        bool is_finalized() const;
+
+        /**
+         *  Steps the underlying sqlite3_stmt.
+         */
+        void step();
+
+        /**
+         *  Resets the underlying sqlite3_stmt.
+         */
+        void reset();
+
+        /**
+         *  The terminal function for variadic template functions.
+         */
+        void bind_values(int);
+
+        template<class... ArgType>
+        void bind_values(int index, int first_arg, ArgType &&... bind_args);
+
+        template<class... ArgType>
+        void bind_values(int index, sqlite3_int64 first_arg, ArgType &&... bind_args);
+
+        template<class... ArgType>
+        void bind_values(int index, double first_arg, ArgType &&... bind_args);
+
+        template<class... ArgType>
+        void bind_values(int index, const std::string &first_arg, ArgType &&... bind_args);
+
+        template<class... ArgType>
+        void bind_values(int index, const char *first_arg, ArgType &&... bind_args);
+
+        template<class... ArgType>
+        void bind_values(int index, blob first_arg, ArgType &&... bind_args);
+
+        template<class... ArgType>
+        void bind_values(int index, const std::vector<unsigned char> &first_arg, ArgType &&... bind_args);
+
+        template<class... ArgType>
+        void bind_values(int index, text_view first_arg, ArgType &&... bind_args);
+
+        template<class... ArgType>
+        void bind_values(int index, std::nullptr_t, ArgType &&... bind_args);
+
+        /**
+         *  Returns the underlying sqlite3_stmt handle.
+         */
+        sqlite3_stmt *get() const;
+
+        /**
+         *  Returns the underlying sqlite3_stmt handle if it is not finalized,
+         *  or nullptr otherwise.
+         */
+        sqlite3_stmt *get_noexcept() const noexcept;
+
+    private:
+        sqlite3_stmt *_stmt;
+    };
+
+    /**
+     *  Represents a precompiled SQL statement.
+     */
+    class statement {
+    public:
+        /**
+         *  Finalizes this statement.
+         */
+        void finalize();
+
+        /**
+         *  Executes this statement.
+         */
+        void exec();
+
+        /**
+         *  Executes this statement.
+         *  Removes all bindings that were given before
+         *  and rebind the arguments to the placeholders before the execution.
+         */
+        template<class... ArgType>
+        void exec_with_bindings(ArgType &&... bind_args);
+
+        /**
+         *  Executes this statement and returns a result set.
+         */
+        result_set query();
+
+        /**
+         *  Executes this statement and returns a result set.
+         *  Removes all bindings that were given before
+         *  and rebind the arguments to the placeholders before the execution.
+         */
+        template<class... ArgType>
+        result_set query_with_bindings(ArgType &&... bind_args);
+
+        /**
+         *  Resets this statement.
+         */
+        void reset();
+
+        /**
+         *  Binds the values to the placeholders such as ?.
+         *
+         *  @param bind_args the values to bind to the placeholders.
+         */
+        template<class... ArgType>
+        void bind_values(ArgType &&... bind_args);
+
+        /**
+         *  Binds the value to the placeholder such as ? or ?NNN (NNN represents an integer literal).
+         *
+         *  @param index the one-based index or the index equivalent to NNN.
+         *  @param value the value to bind to the placeholder.
+         */
+        void bind(int index, int value);
+
+        /**
+         *  @copydoc statement::bind(int,int)
+         */
+        void bind(int index, sqlite3_int64 value);
+
+        /**
+         *  @copydoc statement::bind(int,int)
+         */
+        void bind(int index, double value);
+
+        /**
+         *  @copydoc statement::bind(int,int)
+         */
+        void bind(int index, const std::string &value);
+
+        /**
+         *  @copydoc statement::bind(int,int)
+         */
+        void bind(int index, const char *value);
+
+        /**
+         *  @copydoc statement::bind(int,int)
+         */
+        void bind(int index, blob value);
+
+        /**
+         *  @copydoc statement::bind(int,int)
+         */
+        void bind(int index, const std::vector<unsigned char> &value);
+
+        /**
+         *  Binds the text to the placeholder such as ? or ?NNN (NNN represents an integer literal) without copying.
+         *
+         *  @param index the one-based index or the index equivalent to NNN.
+         *  @param value the text that must be alive until this statement is reset or the placeholder is rebound.
+         */
+        void bind(int index, text_view value);
+
+        /**
+         *  Binds the blob value to the placeholder such as ? or ?NNN (NNN represents an integer literal).
+         *
+         *  @param index the one-based index or the index equivalent to NNN.
+         *  @param data  the blob value to bind to the placeholder.
+         *  @param size  the size of the blob value.
+         */
+        void bind(int index, const void *data, int size);
+
+        /**
+         *  @copydoc statement::bind(int,int)
+         */
+        void bind(int index, std::nullptr_t);
+
+        /**
+         *  Binds the value to the placeholder such as :VVV, @VVV or $VVV (VVV represents an alphanumeric identifier).
+         *
+         *  @tparam T int, sqlite3_int64, double, std::string, const char *, std::vector<unsigned char>, scandium::blob
+         *           or scandium::text_view.
+         *
+         *  @param parameter_name the parameter name equivalent to :VVV, @VVV or $VVV
+         *  @param value          the value to bind to the placeholder
+         */
+        template<class T>
+        void bind(const std::string &parameter_name, T &&value);
+
+        /**
+         *  Removes all binding values.
+         */
+        void clear_bindings();
+
+        /**
+         *  Returns the runtime counters of this statement.
+         *
+         *  @param reset true to reset the counters except memused.
+         */
+        statement_stats stats(bool reset = false);
+
+    private:
+        statement(const std::shared_ptr<sqlite_holder> &db_holder, const std::string &sql);
+
+        std::shared_ptr<sqlite_holder> _db_holder;
+        std::shared_ptr<sqlite_stmt_holder> _stmt_holder;
+
+        friend class database;
+    };
+
+    /**
+     *  Represents a monotonic allocator that hands out memory from large chunks, and frees all of it at once.
+     *  reset() keeps the chunks to recycle them, so a loop that resets the arena stops allocating from the heap.
+     *  The arena is not thread safe.
+     */
+    class arena {
+    public:
+        /**
+         *  Constructor.
+         *  Allocates nothing until the first allocation.
+         *
+         *  @param chunk_size the size of a chunk; a larger allocation gets a chunk of its own.
+         */
+        explicit arena(std::size_t chunk_size = 64 * 1024);
+
+        /**
+         *  Move constructor.
+         *  The memory allocated from the other arena stays valid.
+         */
+        arena(arena &&other) noexcept;
+
+        /**
+         *  Move assignment operator.
+         *  The memory allocated from this arena is freed, and the memory allocated from the other stays valid.
+         */
+        arena &operator=(arena &&other) noexcept;
+
+        /**
+         *  Destructor.
+         *  Frees all the chunks.
+         */
+        ~arena() noexcept;
+
+        /**
+         *  Allocates memory that is alive until the arena is reset or destroyed.
+         *
+         *  @param size      the size in bytes, may be 0.
+         *  @param alignment the alignment, a power of two.
+         *
+         *  @return the memory, never nullptr.
+         */
+        void *allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+
+        /**
+         *  Copies text into the arena with a terminating NUL character.
+         *
+         *  @return the view of the copy, or the empty view if data is nullptr.
+         */
+        text_view copy_text(const char *data, int size);
+
+        /**
+         *  Copies bytes into the arena.
+         *
+         *  @return the view of the copy, or the empty view if data is nullptr.
+         */
+        blob copy_blob(const void *data, int size);
+
+        /**
+         *  Invalidates all the memory allocated, keeping the chunks for the next allocations.
+         */
+        void reset() noexcept;
+
+        /**
+         *  Invalidates all the memory allocated, and frees all the chunks.
+         */
+        void release() noexcept;
+
+        /**
+         *  Returns the bytes allocated since the last reset, including the padding for the alignment.
+         */
+        std::size_t get_used_size() const;
+
+        /**
+         *  Returns the bytes of all the chunks, used or kept for recycling.
+         */
+        std::size_t get_capacity() const;
+
+    private:
+        arena(const arena &) = delete;
+
+        arena &operator=(const arena &) = delete;
+
+        struct chunk {
+            chunk *next;
+            std::size_t size;
+        };
+
+        static std::size_t get_header_size();
+
+        static char *get_data(chunk *chunk);
+
+        static void free_chunks(chunk *chunks) noexcept;
+
+        void next_chunk(std::size_t size);
+
+        std::size_t _chunk_size;
+        chunk *_chunks;
+        chunk *_free_chunks;
+        char *_position;
+        char *_end;
+        std::size_t _used_size;
+        std::size_t _capacity;
+    };
+
+    /**
+     *  Represents a copy of a row that is alive after the cursor moves, see cursor::snapshot().
+     *  The values are packed into one buffer of type tags, offsets and data,
+     *  that is stored inline for small rows, so a copy costs one allocation or none.
+     *  The values are converted like cursor::get(); the text of INTEGER and REAL is formatted like SQLite
+     *  when first read as a pointer or a view, into a buffer allocated then,
+     *  so such reads must not run concurrently on one row.
+     */
+    class row {
+    public:
+        /**
+         *  Constructor.
+         *  Creates a row without columns.
+         */
+        row() noexcept;
+
+        /**
+         *  Copy constructor.
+         */
+        row(const row &other);
+
+        /**
+         *  Move constructor.
+         */
+        row(row &&other) noexcept;
+
+        /**
+         *  Copy assignment operator.
+         */
+        row &operator=(const row &other);
+
+        /**
+         *  Move assignment operator.
+         */
+        row &operator=(row &&other) noexcept;
+
+        /**
+         *  Destructor.
+         */
+        ~row() noexcept;
+
+        /**
+         *  Gets data from this row, or throws an exception if the column index is out of range.
+         *
+         *  @tparam T int, sqlite3_int64, double, std::string, const char *, std::vector<unsigned char>, scandium::blob,
+         *           scandium::text_view or scandium::value.
+         *           The pointers and the views are alive while this row is alive and not assigned.
+         *
+         *  @param column_index the zero-based column index.
+         */
+        template<class T>
+        T get(int column_index) const;
+
+        /**
+         *  Returns true if data from this row is null, or false otherwise.
+         */
+        bool is_null(int column_index) const;
+
+        /**
+         *  Returns total number of columns.
+         */
+        int get_column_count() const;
+
+        /**
+         *  Returns the datatype code of the value at the given zero-based column index,
+         *  SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL.
+         */
+        int get_column_type(int column_index) const;
+
+        /**
+         *  Returns the bytes allocated on the heap, or 0 if the row is stored inline.
+         */
+        std::size_t heap_size() const;
+
+    private:
+        struct cell {
+            union {
+                sqlite3_int64 integer;
+                double real;
+                // the offset of the NUL-terminated bytes of TEXT and BLOB
+                std::size_t offset;
+            };
+            int type;
+            int size;
+        };
+
+        static const std::size_t inline_capacity = 128;
+
+        /**
+         *  Allocates the buffer for the columns and the bytes of TEXT and BLOB, and clears the cells.
+         */
+        void allocate(int column_count, std::size_t data_size);
+
+        void copy_from(const row &other);
+
+        void move_from(row &other) noexcept;
+
+        void release() noexcept;
+
+        const cell &get_cell(int column_index) const;
+
+        const char *get_bytes(const cell &cell) const;
+
+        cell *_cells;
+        std::size_t _size;
+        int _column_count;
+
+        // the text of INTEGER and REAL, number_text_capacity bytes per column, empty until one is read as text
+        mutable std::unique_ptr<char[]> _texts;
+        union {
+            cell _alignment;
+            unsigned char _inline[inline_capacity];
+        };
+
+        friend class cursor;
+    };
+
+    /**
+     *  Represents a cursor to fetch data from a row.
+     */
+    class cursor {
+    public:
+        /**
+         *  Gets data from the current row.
+         *
+         *  @tparam T int, sqlite3_int64, double, std::string, const char *, std::vector<unsigned char>, scandium::blob
+         *           or scandium::value.
+         *
+         *  @param column_index the zero-based column index.
+         */
+        template<class T>
+        T get(int column_index) const;
+
+        /**
+         *  Gets data for the given column name from the current row,
+         *  or throws an exception if the column name does not exist.
+         *
+         *  @tparam T int, sqlite3_int64, double, std::string, const char *, std::vector<unsigned char>, scandium::blob
+         *           or scandium::value.
+         *
+         *  @param column_name the column name.
+         */
+        template<class T>
+        T get(const std::string &column_name) const;
+
+        /**
+         *  Gets data from the current row, copying the bytes into the given arena,
+         *  so that the result is alive after the cursor moves without owning the bytes.
+         *
+         *  @tparam T scandium::text_view, scandium::blob or const char *.
+         *
+         *  @param column_index the zero-based column index.
+         *  @param arena        the arena to copy into.
+         *
+         *  @return the view of the copy, that is alive until the arena is reset or destroyed,
+         *          or the empty view if null.
+         */
+        template<class T>
+        T get(int column_index, arena &arena) const;
+
+        /**
+         *  Gets data for the given column name from the current row, copying the bytes into the given arena,
+         *  or throws an exception if the column name does not exist.
+         *
+         *  @copydetails cursor::get(int, arena &) const
+         */
+        template<class T>
+        T get(const std::string &column_name, arena &arena) const;
+
+        /**
+         *  Returns true if data from the current row is null, or false otherwise.
+         */
+        bool is_null(int column_index) const;
+
+        /**
+         *  Returns true if data for the given column name from the current row is null, or false otherwise.
+         */
+        bool is_null(const std::string &column_name) const;
+
+        /**
+         *  Returns the column name at the given zero-based column index.
+         *
+         *  @param column_index the zero-based index.
+         */
+        std::string get_column_name(int column_index) const;
+
+        /**
+         *  Returns the zero-based index for the given column name, or -1 if the column does not exist.
+         *
+         *  @param column_name the name of the target column.
+         */
+        int get_column_index(const char *column_name) const;
+
+        /**
+         *  @copydoc cursor::get_column_index(const char *)
+         */
+        int get_column_index(const std::string &column_name) const;
+
+        /**
+         *  Returns total number of columns.
+         */
+        int get_column_count() const;
+
+        /**
+         *  Returns the datatype code of the value at the given zero-based column index,
+         *  SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL.
+         *
+         *  @param column_index the zero-based index.
+         */
+        int get_column_type(int column_index) const;
+
+        /**
+         *  Copies the current row into a row that is alive after the cursor moves.
+         */
+        row snapshot() const;
+
+    private:
+        cursor(const std::shared_ptr<sqlite_stmt_holder> &stmt_holder);
+
+        std::shared_ptr<sqlite_stmt_holder> _stmt_holder;
+
+        friend class iterator;
+    };
+
+    /**
+     *  Provides an STL-style forward iterator to fetch data from an SQLite result set.
+     */
+    class iterator : public std::iterator<std::forward_iterator_tag, cursor> {
+    public:
+        iterator &operator++();
+
+        cursor &operator*();
+
+        cursor *operator->();
+
+        bool operator==(const iterator &other) const;
+
+        bool operator!=(const iterator &other) const;
+
+    private:
+        iterator();
+
+        iterator(const std::shared_ptr<sqlite_stmt_holder> &stmt_holder,
+                 std::uint_fast64_t row_index,
+                 int rc);
+
+        std::shared_ptr<sqlite_stmt_holder> _stmt_holder;
+        cursor _cursor;
+
+        struct state {
+            std::uint_fast64_t row_index;
+            int rc;
+        };
+
+        std::shared_ptr<state> _state;
+
+        friend class result_set;
+    };
+
+    /**
+     *  Represents a destination of bytes written by result_set::write_csv() and result_set::write_jsonl().
+     */
+    class sink {
+    public:
+        /**
+         *  Destructor.
+         */
+        virtual ~sink() noexcept = default;
+
+        /**
+         *  Writes all the given bytes, or throws an exception.
+         */
+        virtual void write(const char *data, std::size_t size) = 0;
+    };
+
+#ifdef SCANDIUM_HAS_FD_SINK
+
+    /**
+     *  A sink that writes to a file descriptor with write(2).
+     */
+    class fd_sink : public sink {
+    public:
+        /*
+         *  Constructor.
+         *
+         *  @param fd the file descriptor that is not closed by this sink.
+         */
+        explicit fd_sink(int fd);
+
+        void write(const char *data, std::size_t size) override;
+
+    private:
+        const int _fd;
+    };
+
+#endif
+
+    /**
+     *  Represents all the rows of a query, stored column by column and independent of the statement,
+     *  see result_set::materialize().
+     *  The numbers are stored in one array per column, and the bytes of TEXT and BLOB in an arena.
+     *  The values are converted like cursor::get(); the text of INTEGER and REAL is formatted like SQLite
+     *  when first read as a pointer or a view, and stored in the arena,
+     *  so such reads must not run concurrently on one result.
+     *  The result can be moved but not copied.
+     */
+    class materialized_result {
+    public:
+        /**
+         *  Represents a row of a materialized_result, that is valid while the result is alive.
+         */
+        class row_view {
+        public:
+            /**
+             *  Gets data from this row.
+             *
+             *  @tparam T int, sqlite3_int64, double, std::string, const char *, const unsigned char *,
+             *           const void *, std::vector<unsigned char>, scandium::blob, scandium::text_view
+             *           or scandium::value.
+             *           The pointers and the views are alive while the result and its arena are alive.
+             *
+             *  @param column_index the zero-based column index.
+             */
+            template<class T>
+            T get(int column_index) const;
+
+            /**
+             *  Returns true if data from this row is null, or false otherwise.
+             */
+            bool is_null(int column_index) const;
+
+            /**
+             *  Returns the datatype code of the value at the given zero-based column index.
+             */
+            int get_column_type(int column_index) const;
+
+            /**
+             *  Returns total number of columns.
+             */
+            int get_column_count() const;
+
+            /**
+             *  Returns the zero-based index of this row in the result.
+             */
+            std::size_t get_index() const;
+
+        private:
+            row_view(const materialized_result *result, std::size_t index);
+
+            const materialized_result *_result;
+            std::size_t _index;
+
+            friend class materialized_result;
+        };
+
+        /**
+         *  Represents a random-access iterator of the rows.
+         */
+        class iterator {
+        public:
+            typedef std::random_access_iterator_tag iterator_category;
+            typedef row_view value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const row_view *pointer;
+            typedef row_view reference;
+
+            iterator();
+
+            row_view operator*() const;
+
+            row_view operator[](difference_type offset) const;
+
+            iterator &operator++();
+
+            iterator operator++(int);
+
+            iterator &operator--();
+
+            iterator operator--(int);
+
+            iterator &operator+=(difference_type offset);
+
+            iterator &operator-=(difference_type offset);
+
+            iterator operator+(difference_type offset) const;
+
+            iterator operator-(difference_type offset) const;
+
+            difference_type operator-(const iterator &other) const;
+
+            bool operator==(const iterator &other) const;
+
+            bool operator!=(const iterator &other) const;
+
+            bool operator<(const iterator &other) const;
+
+            bool operator>(const iterator &other) const;
+
+            bool operator<=(const iterator &other) const;
+
+            bool operator>=(const iterator &other) const;
+
+        private:
+            iterator(const materialized_result *result, std::size_t index);
+
+            const materialized_result *_result;
+            std::size_t _index;
+
+            friend class materialized_result;
+        };
+
+        /**
+         *  Represents a range of the rows, that is valid while the result is alive.
+         */
+        class slice {
+        public:
+            iterator begin() const;
+
+            iterator end() const;
+
+            std::size_t size() const;
+
+            bool empty() const;
+
+            row_view operator[](std::size_t index) const;
+
+            /**
+             *  Returns the sub range, clamped to this range.
+             */
+            slice sub(std::size_t offset, std::size_t count) const;
+
+        private:
+            slice(const materialized_result *result, std::size_t first, std::size_t last);
+
+            const materialized_result *_result;
+            std::size_t _first;
+            std::size_t _last;
+
+            friend class materialized_result;
+        };
+
+        /**
+         *  Constructor.
+         *  Creates an empty result without columns.
+         */
+        materialized_result();
+
+        materialized_result(materialized_result &&) = default;
+
+        materialized_result &operator=(materialized_result &&) = default;
+
+        /**
+         *  Returns the number of rows.
+         */
+        std::size_t size() const;
+
+        /**
+         *  Returns true if no rows.
+         */
+        bool empty() const;
+
+        /**
+         *  Returns the row at the given index, or throws an exception if out of range.
+         */
+        row_view at(std::size_t index) const;
+
+        /**
+         *  Returns the row at the given index.
+         */
+        row_view operator[](std::size_t index) const;
+
+        iterator begin() const;
+
+        iterator end() const;
+
+        /**
+         *  Returns the range of the rows, clamped to the result.
+         *  The range does not copy the rows.
+         *
+         *  @param offset the index of the first row.
+         *  @param count  the maximum number of rows.
+         */
+        slice sub(std::size_t offset, std::size_t count) const;
+
+        /**
+         *  Returns total number of columns.
+         */
+        int get_column_count() const;
+
+        /**
+         *  Returns the column name at the given zero-based column index.
+         */
+        const std::string &get_column_name(int column_index) const;
+
+        /**
+         *  Returns the zero-based index for the given column name, or -1 if the column does not exist.
+         */
+        int get_column_index(const std::string &column_name) const;
+
+        /**
+         *  Returns the approximate bytes of memory used by the rows, excluding the arena given by the caller.
+         */
+        std::size_t memory_size() const;
+
+    private:
+        union number {
+            sqlite3_int64 integer;
+            double real;
+            const char *bytes;
+        };
+
+        struct column {
+            std::string name;
+            std::vector<unsigned char> types;
+            std::vector<number> numbers;
+            std::vector<int> sizes;
+
+            // the text of INTEGER and REAL formatted into the arena, empty until one is read as text
+            mutable std::vector<const char *> texts;
+        };
+
+        const column &get_column(int column_index) const;
+
+        const char *get_bytes(const column &column, std::size_t index) const;
+
+        std::vector<column> _columns;
+        std::unique_ptr<arena> _arena;
+        arena *_bytes_arena;
+        std::size_t _size;
+
+        friend class result_set;
+    };
+
+    /**
+     *  Represents an SQLite result set.
+     */
+    class result_set {
+    public:
+        /**
+         *  Returns the iterator pointing to the first row.
+         *
+         *  @attention The iterator got in the past becomes invalid.
+         */
+        iterator begin();
+
+        /**
+         *  Returns the iterator to end.
+         */
+        iterator end();
+
+        /**
+         *  Writes all the rows as CSV (RFC 4180) with CRLF line breaks.
+         *  The values are written from the column pointers of SQLite through a reusable buffer without allocations per cell.
+         *  NULL is written as an empty field, and BLOB is written in base64.
+         *
+         *  @attention The iterator got in the past becomes invalid.
+         *
+         *  @param out    the sink to write to.
+         *  @param header true to write the column names as the first row.
+         *
+         *  @return the number of rows written, excluding the header.
+         */
+        std::size_t write_csv(sink &out, bool header = true);
+
+        /**
+         *  Writes all the rows as JSON Lines, that is a JSON object keyed by the column names per line.
+         *  The values are written from the column pointers of SQLite through a reusable buffer without allocations per cell.
+         *  BLOB is written as a base64 string, and an infinite REAL is written as null.
+         *
+         *  @attention The iterator got in the past becomes invalid.
+         *
+         *  @param out the sink to write to.
+         *
+         *  @return the number of rows written.
+         */
+        std::size_t write_jsonl(sink &out);
+
+        /**
+         *  Reads all the rows into a materialized_result, that allows many passes and random access,
+         *  and resets the statement as soon as the rows are read, releasing its locks.
+         *  The bytes of TEXT and BLOB are copied into an arena owned by the result.
+         *
+         *  @attention The iterator got in the past becomes invalid.
+         *
+         *  @return the rows.
+         */
+        materialized_result materialize();
+
+        /**
+         *  Reads all the rows like materialize(), copying the bytes of TEXT and BLOB into the given arena,
+         *  so that many results share the chunks of the arena and are freed together with it.
+         *
+         *  @attention The result must not be used after the arena is reset or destroyed.
+         *
+         *  @param arena the arena to copy into.
+         *
+         *  @return the rows.
+         */
+        materialized_result materialize(arena &arena);
+
+    private:
+        result_set(const std::shared_ptr<sqlite_holder> &db_holder,
+                   const std::shared_ptr<sqlite_stmt_holder> &stmt_holder);
+
+        std::shared_ptr<sqlite_holder> _db_holder;
+        std::shared_ptr<sqlite_stmt_holder> _stmt_holder;
+
+        friend class statement;
+    };
+
+    /**
+     *  Represents a transaction using the RAII idiom.
+     */
+    class transaction {
+    public:
+        /**
+         *  Destructor.
+         *  Rollbacks this transaction if not committed, or does nothing if committed.
+         */
+        ~transaction() noexcept;
+
+        /**
+         *  Move constructor.
+         */
+        transaction(transaction &&other) noexcept;
+
+        /**
+         *  Move assignment operator.
+         */
+        transaction &operator=(transaction &&other) noexcept;
+
+        /**
+         *  Commits this transaction.
+         */
+        void commit();
+
+    private:
+        /**
+         *  Constructor.
+         *  Begin a transaction.
+         */
+        transaction(const std::shared_ptr<sqlite_holder> &db_holder, transaction_mode mode);
+
+        transaction(const transaction &) = delete;
+
+        transaction &operator=(const transaction &) = delete;
+
+        std::shared_ptr<sqlite_holder> _db_holder;
+        bool _in_transaction;
+
+        friend class database;
+    };
+
+#ifdef SQLITE_ENABLE_SESSION
+
+    /**
+     *  Describes a conflict found while applying a changeset, see sqlite3changeset_apply().
+     */
+    struct changeset_conflict {
+        /**
+         *  SQLITE_CHANGESET_DATA, SQLITE_CHANGESET_NOTFOUND, SQLITE_CHANGESET_CONFLICT,
+         *  SQLITE_CHANGESET_CONSTRAINT or SQLITE_CHANGESET_FOREIGN_KEY.
+         */
+        int type;
+
+        /**
+         *  The table name of the change, empty if SQLITE_CHANGESET_FOREIGN_KEY.
+         */
+        std::string table_name;
+
+        /**
+         *  SQLITE_INSERT, SQLITE_UPDATE or SQLITE_DELETE.
+         */
+        int operation;
+
+        /**
+         *  The values before the change if UPDATE or DELETE, NULL for the columns not changed by UPDATE.
+         */
+        std::vector<value> old_values;
+
+        /**
+         *  The values after the change if INSERT or UPDATE, NULL for the columns not changed by UPDATE.
+         */
+        std::vector<value> new_values;
+
+        /**
+         *  The values of the row in the target database if SQLITE_CHANGESET_DATA or SQLITE_CHANGESET_CONFLICT.
+         */
+        std::vector<value> conflicting_values;
+    };
+
+    /**
+     *  Represents how to resolve a conflict of a changeset.
+     */
+    enum class conflict_action {
+        /**
+         *  Skips the change.
+         */
+        omit,
+
+        /**
+         *  Overwrites the conflicting row, only for SQLITE_CHANGESET_DATA and SQLITE_CHANGESET_CONFLICT.
+         *  Returning it for other conflicts aborts with std::logic_error.
+         */
+        replace,
+
+        /**
+         *  Rollbacks all changes of the changeset, and throws an exception.
+         */
+        abort,
+    };
+
+    /**
+     *  The callback to resolve a conflict of a changeset.
+     */
+    typedef std::function<conflict_action(const changeset_conflict &conflict)> conflict_handler;
+
+    /**
+     *  Records the changes of the attached tables as a changeset, see sqlite3session_create().
+     *  Only tables with a PRIMARY KEY are recorded.
+     *  A session must be destroyed before its database is closed.
+     */
+    class session {
+    public:
+        /**
+         *  Destructor.
+         */
+        ~session() noexcept;
+
+        /**
+         *  Move constructor.
+         */
+        session(session &&other) noexcept;
+
+        /**
+         *  Move assignment operator.
+         */
+        session &operator=(session &&other) noexcept;
+
+        /**
+         *  Starts recording the changes of a table.
+         *
+         *  @param table_name the table name, or empty to record all tables.
+         */
+        void attach(const std::string &table_name = std::string());
+
+        /**
+         *  Enables or disables recording.
+         */
+        void set_enabled(bool enabled);
+
+        /**
+         *  Returns true if no changes are recorded.
+         */
+        bool is_empty() const;
+
+        /**
+         *  Returns the changeset of the changes recorded so far.
+         */
+        std::vector<unsigned char> changeset();
+
+        /**
+         *  Returns the patchset of the changes recorded so far,
+         *  that is smaller than the changeset but has no old values to detect conflicts.
+         */
+        std::vector<unsigned char> patchset();
+
+    private:
+        /**
+         *  Constructor.
+         *  Creates a session.
+         */
+        session(const std::shared_ptr<sqlite_holder> &db_holder, const std::string &database_name);
+
+        session(const session &) = delete;
+
+        session &operator=(const session &) = delete;
+
+        std::shared_ptr<sqlite_holder> _db_holder;
+        sqlite3_session *_session;
+
+        friend class database;
+    };
+
+#endif
+
+    /**
+     *  Represents an SQLite database.
+     */
+    class database {
+    public:
+        /**
+         *  Constructor to create an in-memory database.
+         */
+        database();
+
+        /**
+         *  Constructor.
+         *
+         *  @param path the path of the SQLite database file to open and/or create.
+         */
+        database(const std::string &path);
+
+        /**
+         *  Constructor.
+         *
+         *  @param path    the path of the SQLite database file to open and/or create.
+         *  @param options the options to open the database.
+         */
+        database(const std::string &path, const open_options &options);
+
+        /**
+         *  Opens the database and/or creates the SQLite database file.
+         */
+        void open();
+
+#ifdef SQLITE_HAS_CODEC
+
+        /**
+         *  Opens the database and/or creates the SQLite database file.
+         *
+         *  @param passphrase the passphrase to encrypt the database if using sqlcipher and so on.
+         */
+        void open(const std::string &passphrase);
+
+#endif
+
+        /**
+         *  Closes this database.
+         */
+        void close();
+
+        /**
+         *  Executes the SQL statement that does not return data.
+         *  The statements after the first one are ignored, see exec_script().
+         */
+        void exec_sql(const std::string &sql);
+
+        /**
+         *  Executes all the SQL statements in order, discarding the rows they return.
+         *  The statements executed before an error are not rolled back unless in_transaction is true.
+         *
+         *  @param sql            the SQL statements separated by semicolons.
+         *  @param in_transaction true to execute the script in one transaction,
+         *                        then the script must not begin or commit transactions.
+         */
+        void exec_script(const std::string &sql, bool in_transaction = false);
+
+        /**
+         *  Executes all the SQL statements of a file, like exec_script().
+         *  The file is read in chunks and each complete statement is executed as soon as it is read,
+         *  so the whole file is not kept in memory.
+         *
+         *  @param path           the path of the script file.
+         *  @param in_transaction true to execute the script in one transaction.
+         */
+        void exec_script_file(const std::string &path, bool in_transaction = false);
+
+        /**
+         *  Executes the SQL statement that does not return data.
+         *
+         *  @param sql       the single SQL statement.
+         *  @param bind_args the values to bind to the placeholders such as ?
+         */
+        template<class... ArgType>
+        void exec_sql(const std::string &sql, ArgType &&... bind_args);
+
+        /**
+         *  Executes the SQL statement that does not return data.
+         *  The number and the types of the arguments are checked at compile time.
+         *
+         *  @param sql       the single SQL statement created by SCANDIUM_SQL.
+         *  @param bind_args the values to bind to the placeholders such as ?
+         */
+        template<int ParameterCount, class... ArgType>
+        void exec_sql(const sql_literal<ParameterCount> &sql, ArgType &&... bind_args);
+
+        /**
+         *  Runs the given SQL statement that returns data such as SELECT.
+         */
+        result_set query(const std::string &sql);
+
+        /**
+         *  Runs the given SQL statement that returns data such as SELECT.
+         *
+         *  @param sql       the single SQL statement.
+         *  @param bind_args the values to bind to the placeholders such as ?
+         */
+        template<class... ArgType>
+        result_set query(const std::string &sql, ArgType &&... bind_args);
+
+        /**
+         *  Runs the given SQL statement that returns data such as SELECT.
+         *  The number and the types of the arguments are checked at compile time.
+         *
+         *  @param sql       the single SQL statement created by SCANDIUM_SQL.
+         *  @param bind_args the values to bind to the placeholders such as ?
+         */
+        template<int ParameterCount, class... ArgType>
+        result_set query(const sql_literal<ParameterCount> &sql, ArgType &&... bind_args);
+
+        /**
+         *  Creates a precompiled SQL statement.
+         *  The query plan is inspected if the query plan guard is enabled.
+         */
+        statement prepare_statement(const std::string &sql);
+
+        /**
+         *  Returns the top-level rows of EXPLAIN QUERY PLAN of the given SQL statement.
+         *
+         *  @param sql the single SQL statement.
+         */
+        std::vector<query_plan_node> explain(const std::string &sql);
+
+        /**
+         *  Sets the query plan guard.
+         *
+         *  @param options the options of the query plan guard.
+         */
+        void set_plan_guard(const plan_guard_options &options);
+
+        /**
+         *  Returns the options of the query plan guard.
+         */
+        const plan_guard_options &get_plan_guard() const;
+
+        /**
+         *  Begins a transaction.
+         *
+         *  @param mode the transaction mode.
+         */
+        void begin_transaction(transaction_mode mode = transaction_mode::deferred);
+
+        /**
+         *  Commits a transaction.
+         */
+        void commit_transaction();
+
+        /**
+         *  Rollbacks a transaction.
+         */
+        void rollback_transaction();
+
+        /**
+         *  Returns true if the database is open, or false otherwise.
+         */
+        bool is_open() const;
+
+        /**
+         *  Begins a transaction, and Returns a RAII object.
+         */
+        transaction create_transaction(transaction_mode mode = transaction_mode::deferred);
+
+#ifdef SQLITE_ENABLE_SESSION
+
+        /**
+         *  Creates a session to record changes, and Returns a RAII object.
+         *
+         *  @param database_name "main", "temp" or the name of an attached database.
+         */
+        session create_session(const std::string &database_name = "main");
+
+        /**
+         *  Applies a changeset or a patchset in a savepoint.
+         *
+         *  @param changeset the changeset created by session::changeset() or session::patchset().
+         *  @param handler   the callback to resolve conflicts, or empty to abort on any conflict.
+         */
+        void apply_changeset(const std::vector<unsigned char> &changeset,
+                             const conflict_handler &handler = conflict_handler());
+
+#endif
+
+        /**
+         *  Gets the user version of the database, or 0 that is a default value.
+         */
+        int get_user_version();
+
+        /**
+         *  Updates the user version of the database in a transaction.
+         *
+         *  @param version the new version that must be > 0.
+         *  @param mode    the transaction mode.
+         */
+        void update_user_version(int version, transaction_mode mode = transaction_mode::deferred);
+
+        /**
+         *  Sets a callback to be called before an upgrade user version.
+         *
+         *  @tparam Callback void(*)(database *db, int old_version, int new_version)
+         *
+         *  @param callback the callback to be called before an upgrade user version.
+         */
+        template<class Callback>
+        void set_before_upgrade_user_version(Callback &&callback);
+
+        /**
+         *  Sets a callback to be called before a downgrade user version.
+         *
+         *  @tparam Callback void(*)(database *db, int old_version, int new_version)
+         *
+         *  @param callback the callback to be called before a downgrade user version.
+         */
+        template<class Callback>
+        void set_before_downgrade_user_version(Callback &&callback);
+
+        /**
+         *  Returns the file path of the database, or ":memory:" if the in-memory database.
+         */
+        const std::string &get_path() const;
+
+        /**
+         *  Returns the options to open the database.
+         */
+        const open_options &get_options() const;
+
+        /**
+         *  Returns true if a transaction is active, or false if in autocommit mode.
+         */
+        bool in_transaction() const;
+
+        /**
+         *  Returns the number of rows inserted, updated or deleted since the database was opened.
+         */
+        sqlite3_int64 get_total_changes() const;
+
+        /**
+         *  @copydoc sqlite_holder::add_update_listener
+         */
+        std::size_t add_update_listener(sqlite_holder::update_listener listener);
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+
+        /**
+         *  @copydoc sqlite_holder::add_preupdate_listener
+         */
+        std::size_t add_preupdate_listener(sqlite_holder::preupdate_listener listener);
+
+#endif
+
+        /**
+         *  @copydoc sqlite_holder::add_commit_listener
+         */
+        std::size_t add_commit_listener(sqlite_holder::transaction_listener listener);
+
+        /**
+         *  @copydoc sqlite_holder::add_rollback_listener
+         */
+        std::size_t add_rollback_listener(sqlite_holder::transaction_listener listener);
+
+        /**
+         *  @copydoc sqlite_holder::add_authorizer
+         */
+        std::size_t add_authorizer(sqlite_holder::authorizer listener);
+
+        /**
+         *  @copydoc sqlite_holder::add_progress_listener
+         */
+        std::size_t add_progress_listener(sqlite_holder::progress_listener listener);
+
+        /**
+         *  @copydoc sqlite_holder::add_trace_listener
+         */
+        std::size_t add_trace_listener(sqlite_holder::trace_listener listener);
+
+        /**
+         *  @copydoc sqlite_holder::remove_listener
+         */
+        void remove_listener(std::size_t id);
+
+        /**
+         *  Makes the calling thread the owner of this database and its copies, for the thread check.
+         *  Call it on the thread that takes over the database.
+         */
+        void claim_thread();
+
+        /**
+         *  Clears the owner of this database and its copies,
+         *  so that the next thread using the database becomes the owner.
+         */
+        void release_thread();
+
+        /**
+         *  Interrupts the statements running on this database, see sqlite3_interrupt().
+         *  Can be called from any thread, but not concurrently with open() or close().
+         */
+        void interrupt();
+
+        /**
+         *  Returns the memory and page cache counters of this database.
+         *
+         *  @param reset true to reset the counters that support resetting, such as the hits and misses.
+         */
+        database_stats stats(bool reset = false);
+
+    private:
+        std::string _path;
+        open_options _options;
+        std::shared_ptr<sqlite_holder> _db_holder;
+        std::function<void(database *, int, int)> _before_upgrade_user_version;
+        std::function<void(database *, int, int)> _before_downgrade_user_version;
+        plan_guard_options _plan_guard;
+
+        /**
+         *  Sets a busy handler that sleeps for a specified amount of time when a table is locked.
+         *
+         *  @ param ms max sleep time(milliseconds).
+         */
+        void set_busy_timeout(int ms);
+
+        /**
+         *  Applies the options that are set by SQL statements.
+         */
+        void apply_options();
+
+        /**
+         *  Inspects the query plan of the SQL statement according to the query plan guard.
+         */
+        void check_plan(const std::string &sql);
+
+    };
+
+#pragma mark ## value ##
+
+    inline value::value() noexcept : _type(SQLITE_NULL), _integer(0) {
+    }
+
+    inline value::value(std::nullptr_t) noexcept : value() {
+    }
+
+    inline value::value(int integer) noexcept : _type(SQLITE_INTEGER), _integer(integer) {
+    }
+
+    inline value::value(sqlite3_int64 integer) noexcept : _type(SQLITE_INTEGER), _integer(integer) {
+    }
+
+    inline value::value(double real) noexcept : _type(SQLITE_FLOAT), _real(real) {
+    }
+
+    inline value::value(const std::string &text) : _type(SQLITE_TEXT), _integer(0), _bytes(text) {
+    }
+
+    inline value::value(const char *text) : _type(SQLITE_TEXT), _integer(0), _bytes(text) {
+    }
+
+    inline value::value(text_view text)
+            : _type(SQLITE_TEXT), _integer(0),
+              _bytes(text.data ? std::string(text.data, static_cast<std::size_t>(text.size)) : std::string()) {
+    }
+
+    inline value::value(const std::vector<unsigned char> &bytes)
+            : _type(SQLITE_BLOB), _integer(0), _bytes(bytes.begin(), bytes.end()) {
+    }
+
+    inline value::value(blob bytes)
+            : _type(SQLITE_BLOB), _integer(0),
+              _bytes(bytes.data ? std::string(static_cast<const char *>(bytes.data), static_cast<std::size_t>(bytes.size))
+                                : std::string()) {
+    }
+
+    inline value::value(sqlite3_value *source) : value() {
+        if (!source) {
+            return;
+        }
+        switch (sqlite3_value_type(source)) {
+            case SQLITE_INTEGER:
+                *this = value(sqlite3_value_int64(source));
+                break;
+            case SQLITE_FLOAT:
+                *this = value(sqlite3_value_double(source));
+                break;
+            case SQLITE_TEXT: {
+                text_view text;
+                text.data = reinterpret_cast<const char *>(sqlite3_value_text(source));
+                text.size = sqlite3_value_bytes(source);
+                *this = value(text);
+                break;
+            }
+            case SQLITE_BLOB: {
+                blob bytes;
+                bytes.data = sqlite3_value_blob(source);
+                bytes.size = sqlite3_value_bytes(source);
+                *this = value(bytes);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    inline int value::get_type() const {
+        return _type;
+    }
+
+    inline bool value::is_null() const {
+        return _type == SQLITE_NULL;
+    }
+
+    inline sqlite3_int64 value::get_int64() const {
+        switch (_type) {
+            case SQLITE_INTEGER:
+                return _integer;
+            case SQLITE_FLOAT:
+                return static_cast<sqlite3_int64>(_real);
+            case SQLITE_TEXT:
+                return std::strtoll(_bytes.c_str(), nullptr, 10);
+            default:
+                return 0;
+        }
+    }
+
+    inline double value::get_double() const {
+        switch (_type) {
+            case SQLITE_INTEGER:
+                return static_cast<double>(_integer);
+            case SQLITE_FLOAT:
+                return _real;
+            case SQLITE_TEXT:
+                return std::strtod(_bytes.c_str(), nullptr);
+            default:
+                return 0;
+        }
+    }
+
+    inline const std::string &value::get_text() const {
+        return _bytes;
+    }
+
+    inline blob value::get_blob() const {
+        blob bytes;
+        bytes.size = static_cast<int>(_bytes.size());
+        bytes.data = _bytes.data();
+        return bytes;
+    }
+
+    inline std::size_t value::memory_size() const {
+        return sizeof(value) + (_bytes.capacity() > 15 ? _bytes.capacity() : 0);
+    }
+
+    inline bool value::operator==(const value &other) const {
+        if (_type != other._type) {
+            return false;
+        }
+        switch (_type) {
+            case SQLITE_INTEGER:
+                return _integer == other._integer;
+            case SQLITE_FLOAT:
+                return _real == other._real;
+            case SQLITE_TEXT:
+            case SQLITE_BLOB:
+                return _bytes == other._bytes;
+            default:
+                return true;
+        }
+    }
+
+    inline bool value::operator!=(const value &other) const {
+        return !(*this == other);
+    }
+
+#pragma mark ## sql_literal ##
+
+    namespace detail {
+        enum class sql_state {
+            code,
+            single_quote,
+            double_quote,
+            bracket,
+            backtick,
+            line_comment,
+            block_comment_start,
+            block_comment,
+            block_comment_end,
+        };
+
+        /**
+         *  The result of scanning a range of SQL: the state after the range,
+         *  and the largest parameter index after the range, that is max(index before the range + add, floor).
+         *  The results of adjacent ranges are combined, so that the recursion depth is logarithmic.
+         */
+        struct sql_scan {
+            sql_state state;
+            int add;
+            int floor;
+        };
+
+        constexpr int max_of(int a, int b) {
+            return a < b ? b : a;
+        }
+
+        constexpr bool is_digit(char c) {
+            return c >= '0' && c <= '9';
+        }
+
+        constexpr bool is_identifier_char(char c) {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || is_digit(c) || c == '_'
+                   || static_cast<unsigned char>(c) >= 0x80;
+        }
+
+        constexpr int parse_number(const char *sql, std::size_t i, int value) {
+            return is_digit(sql[i]) ? parse_number(sql, i + 1, value * 10 + (sql[i] - '0')) : value;
+        }
+
+        /**
+         *  Returns the state after the character at i, looking ahead one character for the comment starts.
+         */
+        constexpr sql_state next_state(const char *sql, std::size_t i, sql_state state) {
+            return state == sql_state::code
+                   ? (sql[i] == '\'' ? sql_state::single_quote
+                      : sql[i] == '"' ? sql_state::double_quote
+                      : sql[i] == '[' ? sql_state::bracket
+                      : sql[i] == '`' ? sql_state::backtick
+                      : sql[i] == '-' && sql[i + 1] == '-' ? sql_state::line_comment
+                      : sql[i] == '/' && sql[i + 1] == '*' ? sql_state::block_comment_start
+                      : sql_state::code)
+                   : state == sql_state::single_quote ? (sql[i] == '\'' ? sql_state::code : state)
+                   : state == sql_state::double_quote ? (sql[i] == '"' ? sql_state::code : state)
+                   : state == sql_state::bracket ? (sql[i] == ']' ? sql_state::code : state)
+                   : state == sql_state::backtick ? (sql[i] == '`' ? sql_state::code : state)
+                   : state == sql_state::line_comment ? (sql[i] == '\n' ? sql_state::code : state)
+                   : state == sql_state::block_comment_start ? sql_state::block_comment
+                   : state == sql_state::block_comment
+                     ? (sql[i] == '*' && sql[i + 1] == '/' ? sql_state::block_comment_end : state)
+                   : sql_state::code;
+        }
+
+        constexpr sql_state scan_state(const char *sql, std::size_t begin, std::size_t end, sql_state state) {
+            return end - begin == 0 ? state
+                   : end - begin == 1 ? next_state(sql, begin, state)
+                   : scan_state(sql, begin + (end - begin) / 2, end,
+                                scan_state(sql, begin, begin + (end - begin) / 2, state));
+        }
+
+        constexpr bool is_named_parameter(const char *sql, std::size_t i) {
+            return (sql[i] == ':' || sql[i] == '@' || sql[i] == '$') && is_identifier_char(sql[i + 1])
+                   && (i == 0 || (!is_identifier_char(sql[i - 1]) && sql[i - 1] != '$'));
+        }
+
+        constexpr bool is_same_name(const char *sql, std::size_t a, std::size_t b) {
+            return !is_identifier_char(sql[a]) ? !is_identifier_char(sql[b])
+                   : sql[a] == sql[b] && is_same_name(sql, a + 1, b + 1);
+        }
+
+        /**
+         *  Returns true if the named parameter at i also appears in [begin, end).
+         */
+        constexpr bool is_declared_in(const char *sql, std::size_t begin, std::size_t end, std::size_t i) {
+            return end - begin == 0 ? false
+                   : end - begin == 1
+                     ? sql[begin] == sql[i] && is_named_parameter(sql, begin) && is_same_name(sql, begin + 1, i + 1)
+                       && scan_state(sql, 0, begin, sql_state::code) == sql_state::code
+                   : is_declared_in(sql, begin, begin + (end - begin) / 2, i)
+                     || is_declared_in(sql, begin + (end - begin) / 2, end, i);
+        }
+
+        constexpr sql_scan scan_char(const char *sql, std::size_t i, sql_state state) {
+            return state != sql_state::code ? sql_scan{next_state(sql, i, state), 0, 0}
+                   : sql[i] == '?' ? (is_digit(sql[i + 1]) ? sql_scan{state, 0, parse_number(sql, i + 1, 0)}
+                                                           : sql_scan{state, 1, 0})
+                   : is_named_parameter(sql, i) ? sql_scan{state, is_declared_in(sql, 0, i, i) ? 0 : 1, 0}
+                   : sql_scan{next_state(sql, i, state), 0, 0};
+        }
+
+        constexpr sql_scan combine(sql_scan left, sql_scan right) {
+            return sql_scan{right.state, left.add + right.add, max_of(left.floor + right.add, right.floor)};
+        }
+
+        constexpr sql_scan scan(const char *sql, std::size_t begin, std::size_t end, sql_state state);
+
+        constexpr sql_scan scan_after(const char *sql, sql_scan left, std::size_t begin, std::size_t end) {
+            return combine(left, scan(sql, begin, end, left.state));
+        }
+
+        constexpr sql_scan scan(const char *sql, std::size_t begin, std::size_t end, sql_state state) {
+            return end - begin == 0 ? sql_scan{state, 0, 0}
+                   : end - begin == 1 ? scan_char(sql, begin, state)
+                   : scan_after(sql, scan(sql, begin, begin + (end - begin) / 2, state),
+                                begin + (end - begin) / 2, end);
+        }
+
+        constexpr int parameter_count_of(sql_scan result) {
+            return result.state == sql_state::single_quote || result.state == sql_state::double_quote
+                   || result.state == sql_state::bracket || result.state == sql_state::backtick
+                   ? throw std::logic_error("unterminated string literal or quoted identifier")
+                   : max_of(result.add, result.floor);
+        }
+
+        template<std::size_t N>
+        constexpr int parameter_count(const char (&sql)[N]) {
+            return parameter_count_of(scan(sql, 0, N - 1, sql_state::code));
+        }
+
+        template<class... ArgType>
+        struct all_bindable;
+
+        template<>
+        struct all_bindable<> : std::true_type {
+        };
+
+        template<class First, class... Rest>
+        struct all_bindable<First, Rest...> : std::integral_constant<bool,
+                is_bindable<First>::value && all_bindable<Rest...>::value> {
+        };
+    }
+
+    template<int ParameterCount>
+    constexpr sql_literal<ParameterCount>::sql_literal(const char *sql, std::size_t length)
+            : _sql(sql), _length(length) {
+    }
+
+    template<int ParameterCount>
+    constexpr int sql_literal<ParameterCount>::get_parameter_count() {
+        return ParameterCount;
+    }
+
+    template<int ParameterCount>
+    constexpr const char *sql_literal<ParameterCount>::c_str() const {
+        return _sql;
+    }
+
+    template<int ParameterCount>
+    constexpr std::size_t sql_literal<ParameterCount>::length() const {
+        return _length;
+    }
+
+    template<int ParameterCount>
+    std::string sql_literal<ParameterCount>::str() const {
+        return std::string(_sql, _length);
+    }
+
+#pragma mark ## sqlite_error ##
+
+    inline sqlite_error::sqlite_error(const std::string &what, int rc)
+            : std::runtime_error(create_error_message(what, rc)), _rc(rc) {
+    }
+
+    inline int sqlite_error::result_code() const {
+        return _rc;
+    }
+
+    inline std::string sqlite_error::create_error_message(const std::string &what, int rc) {
+        std::stringstream ss;
+        ss << "(" << rc << ")" << sqlite3_errstr(rc) << ", " << what;
+
+        return ss.str();
+    }
+
+#pragma mark ## interrupted_error ##
+
+    inline interrupted_error::interrupted_error(const std::string &what)
+            : sqlite_error(what, SQLITE_INTERRUPT) {
+    }
+
+    namespace detail {
+        /**
+         *  Throws interrupted_error if rc is SQLITE_INTERRUPT, or sqlite_error otherwise.
+         */
+        [[noreturn]] inline void throw_step_error(const std::string &what, int rc) {
+            if (rc == SQLITE_INTERRUPT) {
+                throw interrupted_error(what);
+            }
+            throw sqlite_error(what, rc);
+        }
+
+        /**
+         *  Converts REAL to INTEGER like SQLite, clamping the values out of range.
+         */
+        inline sqlite3_int64 real_to_int64(double real) {
+            if (real <= -9223372036854775808.0) {
+                return std::numeric_limits<sqlite3_int64>::min();
+            }
+            if (real >= 9223372036854775808.0) {
+                return std::numeric_limits<sqlite3_int64>::max();
+            }
+            return static_cast<sqlite3_int64>(real);
+        }
+
+        /**
+         *  The size of the buffers for the text of INTEGER and REAL, with the NUL terminator.
+         */
+        const std::size_t number_text_capacity = 32;
+
+        /**
+         *  Formats INTEGER or REAL as text like SQLite converts them, and returns the length.
+         */
+        inline int format_number(int type, sqlite3_int64 integer, double real, char *buffer) {
+            if (type == SQLITE_INTEGER) {
+                sqlite3_snprintf(static_cast<int>(number_text_capacity), buffer, "%lld", integer);
+            } else {
+                sqlite3_snprintf(static_cast<int>(number_text_capacity), buffer, "%!.15g", real);
+            }
+            return static_cast<int>(std::strlen(buffer));
+        }
+
+        /**
+         *  Returns the identifier in double quotes, doubling the double quotes in it.
+         */
+        inline std::string quote_identifier(const std::string &identifier) {
+            std::string quoted = "\"";
+            for (auto c : identifier) {
+                quoted += c;
+                if (c == '"') {
+                    quoted += c;
+                }
+            }
+            return quoted + "\"";
+        }
+
+        /**
+         *  A table of a FROM clause: the name EXPLAIN QUERY PLAN shows, that is the alias if any,
+         *  and the table, or an empty string for a subquery.
+         */
+        struct from_item {
+            std::string shown;
+            std::string table;
+        };
+
+        struct sql_token {
+            std::string text;
+            bool quoted;
+        };
+
+        inline std::vector<sql_token> tokenize_sql(const std::string &sql) {
+            std::vector<sql_token> tokens;
+            std::size_t i = 0;
+            while (i < sql.size()) {
+                auto c = sql[i];
+                if (c == '-' && i + 1 < sql.size() && sql[i + 1] == '-') {
+                    i = std::min(sql.find('\n', i), sql.size());
+                } else if (c == '/' && i + 1 < sql.size() && sql[i + 1] == '*') {
+                    auto end = sql.find("*/", i + 2);
+                    i = end == std::string::npos ? sql.size() : end + 2;
+                } else if (c == '\'' || c == '"' || c == '`' || c == '[') {
+                    // the doubled quotes are read as two adjacent literals, which only matters for identifiers
+                    auto close = c == '[' ? ']' : c;
+                    auto end = std::min(sql.find(close, i + 1), sql.size());
+                    sql_token token = {sql.substr(i + 1, end - i - 1), true};
+                    while (close != ']' && end + 1 < sql.size() && sql[end + 1] == close) {
+                        auto next = std::min(sql.find(close, end + 2), sql.size());
+                        token.text += close + sql.substr(end + 2, next - end - 2);
+                        end = next;
+                    }
+                    if (c != '\'') {
+                        tokens.push_back(std::move(token));
+                    }
+                    i = end + 1;
+                } else if (is_identifier_char(c) || c == '$') {
+                    auto begin = i;
+                    while (i < sql.size() && (is_identifier_char(sql[i]) || sql[i] == '$')) {
+                        ++i;
+                    }
+                    tokens.push_back(sql_token{sql.substr(begin, i - begin), false});
+                } else {
+                    if (c == '(' || c == ')' || c == ',' || c == '.' || c == ';') {
+                        tokens.push_back(sql_token{std::string(1, c), false});
+                    }
+                    ++i;
+                }
+            }
+            return tokens;
+        }
+
+        inline bool is_keyword(const sql_token &token, const char *keyword) {
+            return !token.quoted && sqlite3_stricmp(token.text.c_str(), keyword) == 0;
+        }
+
+        inline bool ends_from_item(const sql_token &token) {
+            static const char *const keywords[] = {
+                    "WHERE", "ON", "USING", "JOIN", "LEFT", "RIGHT", "FULL", "INNER", "CROSS", "NATURAL", "OUTER",
+                    "GROUP", "ORDER", "LIMIT", "HAVING", "WINDOW", "UNION", "EXCEPT", "INTERSECT", "INDEXED", "NOT",
+                    "RETURNING", "SET", "VALUES", "SELECT", "DO",
+            };
+            for (auto &&keyword : keywords) {
+                if (is_keyword(token, keyword)) {
+                    return true;
+                }
+            }
+            return token.quoted ? false : !is_identifier_char(token.text[0]);
+        }
+
+        /**
+         *  Returns the tables of the FROM clauses and UPDATE statements of sql with their aliases.
+         */
+        inline std::vector<from_item> parse_from_items(const std::string &sql) {
+            auto tokens = tokenize_sql(sql);
+            auto token_at = [&tokens](std::size_t i) {
+                static const sql_token end = {";", false};
+                return i < tokens.size() ? tokens[i] : end;
+            };
+            auto parse_alias = [&token_at](std::size_t &i, std::string &shown) {
+                if (is_keyword(token_at(i), "AS")) {
+                    ++i;
+                }
+                if (!ends_from_item(token_at(i))) {
+                    shown = token_at(i++).text;
+                }
+            };
+
+            std::vector<from_item> items;
+            // per parenthesis depth, whether in a FROM clause, and whether the parenthesis is a subquery item
+            std::vector<std::pair<bool, bool>> levels(1, std::make_pair(false, false));
+            auto expect_item = false;
+            for (std::size_t i = 0; i < tokens.size(); ++i) {
+                auto &&token = tokens[i];
+                if (!token.quoted && token.text == "(") {
+                    levels.push_back(std::make_pair(false, expect_item));
+                    expect_item = false;
+                } else if (!token.quoted && token.text == ")") {
+                    auto subquery = levels.back().second;
+                    if (levels.size() > 1) {
+                        levels.pop_back();
+                    }
+                    if (subquery) {
+                        from_item item;
+                        ++i;
+                        parse_alias(i, item.shown);
+                        --i;
+                        if (!item.shown.empty()) {
+                            items.push_back(std::move(item));
+                        }
+                    }
+                } else if (is_keyword(token, "FROM") || is_keyword(token, "JOIN") || is_keyword(token, "UPDATE")) {
+                    levels.back().first = true;
+                    expect_item = true;
+                    if (is_keyword(token, "UPDATE") && is_keyword(token_at(i + 1), "OR")) {
+                        i += 2;
+                    }
+                } else if (!token.quoted && token.text == ",") {
+                    expect_item = levels.back().first;
+                } else if (expect_item && !ends_from_item(token)) {
+                    from_item item;
+                    item.table = item.shown = token.text;
+                    if (token_at(i + 1).text == "." && !token_at(i + 1).quoted) {
+                        item.table = token_at(i + 2).text;
+                        item.shown = token.text + "." + item.table;
+                        i += 2;
+                    }
+                    ++i;
+                    if (!token_at(i).quoted && token_at(i).text == "(") {
+                        // the arguments of a table-valued function
+                        for (auto depth = 0; i < tokens.size(); ++i) {
+                            auto &&text = tokens[i].quoted ? std::string() : tokens[i].text;
+                            depth += text == "(" ? 1 : text == ")" ? -1 : 0;
+                            if (depth == 0) {
+                                break;
+                            }
+                        }
+                        ++i;
+                    }
+                    parse_alias(i, item.shown);
+                    --i;
+                    items.push_back(std::move(item));
+                    expect_item = false;
+                } else {
+                    // the commas of the clauses after FROM do not separate tables
+                    for (auto &&keyword : {"WHERE", "GROUP", "ORDER", "LIMIT", "HAVING", "WINDOW", "SET", "RETURNING"}) {
+                        levels.back().first = levels.back().first && !is_keyword(token, keyword);
+                    }
+                    expect_item = false;
+                }
+            }
+            return items;
+        }
+    }
+
+#pragma mark ## query_plan_error ##
+
+    inline query_plan_error::query_plan_error(const std::string &sql, const std::string &detail)
+            : std::runtime_error("query plan rejected, " + detail + ", SQL: \"" + sql + "\""),
+              _sql(sql), _detail(detail) {
+    }
+
+    inline const std::string &query_plan_error::get_sql() const {
+        return _sql;
+    }
+
+    inline const std::string &query_plan_error::get_detail() const {
+        return _detail;
+    }
+
+#pragma mark ## thread_affinity_error ##
+
+    inline thread_affinity_error::thread_affinity_error(std::thread::id owner, std::thread::id current)
+            : std::logic_error(create_error_message(owner, current)), _owner(owner), _current(current) {
+    }
+
+    inline std::thread::id thread_affinity_error::get_owner() const {
+        return _owner;
+    }
+
+    inline std::thread::id thread_affinity_error::get_current() const {
+        return _current;
+    }
+
+    inline std::string thread_affinity_error::create_error_message(std::thread::id owner, std::thread::id current) {
+        std::stringstream ss;
+        ss << "database used by thread " << current << ", owned by thread " << owner;
+
+        return ss.str();
+    }
+
+#pragma mark ## sqlite_holder ##
+
+    inline sqlite_holder::~sqlite_holder() noexcept {
+        if (_db) {
+            finalize_cached_statements();
+            sqlite3_close_v2(_db);
+        }
+    }
+
+    inline void sqlite_holder::open_path(const std::string &path, const open_options &options) {
+        if (_db) {
+            return;
+        }
+
+        auto vfs = options.vfs.empty() ? nullptr : options.vfs.c_str();
+        auto rc = sqlite3_open_v2(path.c_str(), &_db, options.flags, vfs);
+        if (rc != SQLITE_OK) {
+            sqlite3_close(_db);
+            _db = nullptr;
+            throw sqlite_error("failed to open database", rc);
+        }
+
+        if (options.lookaside_slot_size >= 0 || options.lookaside_slot_count >= 0) {
+            // SQLite disables the lookaside for a negative value,
+            // so the unset one falls back to the value of SQLITE_DEFAULT_LOOKASIDE
+            auto slot_size = options.lookaside_slot_size >= 0 ? options.lookaside_slot_size : 1200;
+            auto slot_count = options.lookaside_slot_count >= 0 ? options.lookaside_slot_count : 100;
+            rc = sqlite3_db_config(_db, SQLITE_DBCONFIG_LOOKASIDE, nullptr, slot_size, slot_count);
+            if (rc != SQLITE_OK) {
+                sqlite3_close(_db);
+                _db = nullptr;
+                throw sqlite_error("failed to configure lookaside", rc);
+            }
+        }
+
+        _thread_check = options.thread_check;
+        claim_thread();
+        install_hooks(all_hooks);
+    }
+
+    inline void sqlite_holder::close() {
+        if (!_db) {
+            return;
+        }
+
+        finalize_cached_statements();
+        auto rc = sqlite3_close_v2(_db);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to close database", rc);
+        }
+
+        _db = nullptr;
+    }
+
+    inline bool sqlite_holder::is_closed() const {
+        return _db == nullptr;
+    }
+
+    inline void sqlite_holder::exec_sql(const std::string &sql) {
+        sqlite3_stmt *stmt;
+        auto rc = sqlite3_prepare_v2(get(), sql.c_str(), static_cast<int>(sql.length()), &stmt, nullptr);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to prepare statement, SQL: \"" + sql + "\"", rc);
+        }
+
+        rc = sqlite3_step(stmt);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+            sqlite3_finalize(stmt);
+            detail::throw_step_error("failed to step statement", rc);
+        }
+
+        rc = sqlite3_finalize(stmt);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to finalize statement", rc);
+        }
+    }
+
+    inline const char *sqlite_holder::exec_script(const char *sql, std::size_t length, bool complete) {
+        auto end = sql + length;
+        while (sql < end) {
+            sqlite3_stmt *stmt = nullptr;
+            const char *tail = nullptr;
+            // only the first statement is parsed, so a script over INT_MAX bytes is prepared through a window
+            // starting at each statement; a statement that long exceeds SQLITE_MAX_SQL_LENGTH anyway
+            auto window = std::min<std::size_t>(static_cast<std::size_t>(end - sql), INT_MAX);
+            auto rc = sqlite3_prepare_v2(get(), sql, static_cast<int>(window), &stmt, &tail);
+            if (!complete && (rc != SQLITE_OK || tail == sql + window)) {
+                // the statement or comment may go on in the text that follows
+                sqlite3_finalize(stmt);
+                return sql;
+            }
+            if (rc != SQLITE_OK) {
+                auto size = std::min<std::size_t>(static_cast<std::size_t>(end - sql), 200);
+                throw sqlite_error("failed to prepare statement, SQL: \"" + std::string(sql, size) + "\"", rc);
+            }
+            sql = tail;
+            if (!stmt) {
+                // only whitespace or comments
+                continue;
+            }
+
+            sqlite_stmt_holder holder(stmt);
+            do {
+                rc = sqlite3_step(stmt);
+            } while (rc == SQLITE_ROW);
+            if (rc != SQLITE_DONE) {
+                detail::throw_step_error("failed to step statement, SQL: \"" + std::string(sqlite3_sql(stmt)) + "\"",
+                                         rc);
+            }
+        }
+        return sql;
+    }
+
+    inline void sqlite_holder::begin_transaction(transaction_mode mode) {
+        switch (mode) {
+            case transaction_mode::deferred:
+                exec_cached_statement(begin_deferred_statement, "BEGIN DEFERRED;");
+                break;
+
+            case transaction_mode::immediate:
+                exec_cached_statement(begin_immediate_statement, "BEGIN IMMEDIATE;");
+                break;
+
+            case transaction_mode::exclusive:
+                exec_cached_statement(begin_exclusive_statement, "BEGIN EXCLUSIVE;");
+                break;
+        }
+    }
+
+    inline void sqlite_holder::commit_transaction() {
+        exec_cached_statement(commit_statement, "COMMIT;");
+    }
+
+    inline void sqlite_holder::rollback_transaction() {
+        exec_cached_statement(rollback_statement, "ROLLBACK;");
+    }
+
+    inline int sqlite_holder::get_user_version() {
+        auto stmt = get_cached_statement(user_version_statement, "PRAGMA user_version;");
+        auto rc = sqlite3_step(stmt);
+        auto version = rc == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+            detail::throw_step_error("failed to step statement", rc);
+        }
+        return version;
+    }
+
+    inline sqlite3_stmt *sqlite_holder::get_cached_statement(cached_statement index, const char *sql) {
+        auto db = get();
+        auto &&stmt = _cached_statements[index];
+        if (stmt) {
+            return stmt;
+        }
+
+#if SQLITE_VERSION_NUMBER >= 3020000
+        auto rc = sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+#else
+        auto rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+#endif
+        if (rc != SQLITE_OK) {
+            stmt = nullptr;
+            throw sqlite_error("failed to prepare statement, SQL: \"" + std::string(sql) + "\"", rc);
+        }
+        return stmt;
+    }
+
+    inline void sqlite_holder::exec_cached_statement(cached_statement index, const char *sql) {
+        auto stmt = get_cached_statement(index, sql);
+        auto rc = sqlite3_step(stmt);
+        // resets at once, so that a failed COMMIT can be retried and the statement holds no locks
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+            detail::throw_step_error("failed to step statement", rc);
+        }
+    }
+
+    inline void sqlite_holder::finalize_cached_statements() noexcept {
+        for (auto &&stmt : _cached_statements) {
+            if (stmt) {
+                sqlite3_finalize(stmt);
+                stmt = nullptr;
+            }
+        }
+    }
+
+    inline sqlite3 *sqlite_holder::get() const {
+        if (_db == nullptr) {
+            throw std::logic_error("database is closed");
+        }
+        check_thread();
+        return _db;
+    }
+
+    inline sqlite3 *sqlite_holder::get_noexcept() const noexcept {
+        return _db;
+    }
+
+    inline std::size_t sqlite_holder::add_update_listener(update_listener listener) {
+        _update_listeners.emplace_back(++_last_listener_id, std::move(listener));
+        if (_update_listeners.size() == 1) {
+            install_hooks(update_hook);
+        }
+        return _last_listener_id;
+    }
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+
+    inline std::size_t sqlite_holder::add_preupdate_listener(preupdate_listener listener) {
+        _preupdate_listeners.emplace_back(++_last_listener_id, std::move(listener));
+        if (_preupdate_listeners.size() == 1) {
+            install_hooks(preupdate_hook);
+        }
+        return _last_listener_id;
+    }
+
+#endif
+
+    inline std::size_t sqlite_holder::add_commit_listener(transaction_listener listener) {
+        _commit_listeners.emplace_back(++_last_listener_id, std::move(listener));
+        if (_commit_listeners.size() == 1) {
+            install_hooks(commit_hook);
+        }
+        return _last_listener_id;
+    }
+
+    inline std::size_t sqlite_holder::add_rollback_listener(transaction_listener listener) {
+        _rollback_listeners.emplace_back(++_last_listener_id, std::move(listener));
+        if (_rollback_listeners.size() == 1) {
+            install_hooks(rollback_hook);
+        }
+        return _last_listener_id;
+    }
+
+    inline std::size_t sqlite_holder::add_authorizer(authorizer listener) {
+        _authorizers.emplace_back(++_last_listener_id, std::move(listener));
+        if (_authorizers.size() == 1) {
+            install_hooks(authorizer_hook);
+        }
+        return _last_listener_id;
+    }
+
+    inline void sqlite_holder::check_thread() const {
+        if (_thread_check.mode == thread_check_mode::off) {
+            return;
+        }
+        auto owner = _owner_thread.load(std::memory_order_relaxed);
+        auto current = std::this_thread::get_id();
+        if (owner != current) {
+            on_thread_mismatch(owner, current);
+        }
+    }
+
+    inline void sqlite_holder::claim_thread() {
+        _owner_thread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    }
+
+    inline void sqlite_holder::release_thread() {
+        _owner_thread.store(std::thread::id(), std::memory_order_relaxed);
+    }
+
+    inline void sqlite_holder::on_thread_mismatch(std::thread::id owner, std::thread::id current) const {
+        if (owner == std::thread::id() && _owner_thread.compare_exchange_strong(owner, current)) {
+            return;
+        }
+        if (_thread_check.mode == thread_check_mode::raise) {
+            throw thread_affinity_error(owner, current);
+        }
+        if (_thread_check.reporter) {
+            _thread_check.reporter(owner, current);
+        }
+    }
+
+    inline std::size_t sqlite_holder::add_progress_listener(progress_listener listener) {
+        _progress_listeners.emplace_back(++_last_listener_id, std::move(listener));
+        if (_progress_listeners.size() == 1) {
+            install_hooks(progress_hook);
+        }
+        return _last_listener_id;
+    }
+
+    inline std::size_t sqlite_holder::add_trace_listener(trace_listener listener) {
+        _trace_listeners.emplace_back(++_last_listener_id, std::move(listener));
+        if (_trace_listeners.size() == 1) {
+            install_hooks(trace_hook);
+        }
+        return _last_listener_id;
+    }
+
+    inline void sqlite_holder::remove_listener(std::size_t id) {
+        auto hooks = 0;
+        hooks |= erase_listener(_update_listeners, id) ? update_hook : 0;
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+        hooks |= erase_listener(_preupdate_listeners, id) ? preupdate_hook : 0;
+#endif
+        hooks |= erase_listener(_commit_listeners, id) ? commit_hook : 0;
+        hooks |= erase_listener(_rollback_listeners, id) ? rollback_hook : 0;
+        hooks |= erase_listener(_authorizers, id) ? authorizer_hook : 0;
+        hooks |= erase_listener(_progress_listeners, id) ? progress_hook : 0;
+        hooks |= erase_listener(_trace_listeners, id) ? trace_hook : 0;
+        if (hooks != 0) {
+            install_hooks(hooks);
+        }
+    }
+
+    template<class Listener>
+    bool sqlite_holder::erase_listener(std::vector<std::pair<std::size_t, Listener>> &listeners, std::size_t id) {
+        for (auto it = listeners.begin(); it != listeners.end(); ++it) {
+            if (it->first == id) {
+                listeners.erase(it);
+                return listeners.empty();
+            }
+        }
+        return false;
+    }
+
+    inline void sqlite_holder::install_hooks(int hooks) {
+        if (!_db) {
+            return;
+        }
+
+        struct callbacks {
+            static void on_update(void *context, int operation, const char *database_name, const char *table_name,
+                                  sqlite3_int64 rowid) {
+                for (auto &&listener : static_cast<sqlite_holder *>(context)->_update_listeners) {
+                    try {
+                        listener.second(operation, database_name, table_name, rowid);
+                    } catch (...) {
+                        // ignore, SQLite cannot be notified
+                    }
+                }
+            }
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+
+            static void on_preupdate(void *context, sqlite3 *db, int operation, const char *database_name,
+                                     const char *table_name, sqlite3_int64 old_rowid, sqlite3_int64 new_rowid) {
+                for (auto &&listener : static_cast<sqlite_holder *>(context)->_preupdate_listeners) {
+                    try {
+                        listener.second(db, operation, database_name, table_name, old_rowid, new_rowid);
+                    } catch (...) {
+                        // ignore, SQLite cannot be notified
+                    }
+                }
+            }
+
+#endif
+
+            static int on_commit(void *context) {
+                try {
+                    for (auto &&listener : static_cast<sqlite_holder *>(context)->_commit_listeners) {
+                        listener.second();
+                    }
+                    return 0;
+                } catch (...) {
+                    // turns the commit into a rollback
+                    return 1;
+                }
+            }
+
+            static void on_rollback(void *context) {
+                for (auto &&listener : static_cast<sqlite_holder *>(context)->_rollback_listeners) {
+                    try {
+                        listener.second();
+                    } catch (...) {
+                        // ignore, SQLite cannot be notified
+                    }
+                }
+            }
+
+            static int on_authorize(void *context, int action, const char *arg1, const char *arg2,
+                                    const char *database_name, const char *trigger_or_view) {
+                auto result = SQLITE_OK;
+                try {
+                    for (auto &&listener : static_cast<sqlite_holder *>(context)->_authorizers) {
+                        auto rc = listener.second(action, arg1, arg2, database_name, trigger_or_view);
+                        if (rc == SQLITE_DENY) {
+                            return SQLITE_DENY;
+                        }
+                        if (rc == SQLITE_IGNORE) {
+                            result = SQLITE_IGNORE;
+                        }
+                    }
+                } catch (...) {
+                    return SQLITE_DENY;
+                }
+                return result;
+            }
+
+            static int on_progress(void *context) {
+                try {
+                    for (auto &&listener : static_cast<sqlite_holder *>(context)->_progress_listeners) {
+                        if (listener.second()) {
+                            return 1;
+                        }
+                    }
+                    return 0;
+                } catch (...) {
+                    return 1;
+                }
+            }
+
+            static int on_trace(unsigned event, void *context, void *stmt, void *) {
+                for (auto &&listener : static_cast<sqlite_holder *>(context)->_trace_listeners) {
+                    try {
+                        listener.second(event, static_cast<sqlite3_stmt *>(stmt));
+                    } catch (...) {
+                        // ignore, SQLite cannot be notified
+                    }
+                }
+                return 0;
+            }
+        };
+
+        if (hooks & update_hook) {
+            sqlite3_update_hook(_db, _update_listeners.empty() ? nullptr : &callbacks::on_update, this);
+        }
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+        if (hooks & preupdate_hook) {
+            sqlite3_preupdate_hook(_db, _preupdate_listeners.empty() ? nullptr : &callbacks::on_preupdate, this);
+        }
+#endif
+        if (hooks & commit_hook) {
+            sqlite3_commit_hook(_db, _commit_listeners.empty() ? nullptr : &callbacks::on_commit, this);
+        }
+        if (hooks & rollback_hook) {
+            sqlite3_rollback_hook(_db, _rollback_listeners.empty() ? nullptr : &callbacks::on_rollback, this);
+        }
+        if (hooks & authorizer_hook) {
+            sqlite3_set_authorizer(_db, _authorizers.empty() ? nullptr : &callbacks::on_authorize, this);
+        }
+        if (hooks & progress_hook) {
+            sqlite3_progress_handler(_db, progress_interval,
+                                     _progress_listeners.empty() ? nullptr : &callbacks::on_progress, this);
+        }
+        if (hooks & trace_hook) {
+            if (_trace_listeners.empty()) {
+                sqlite3_trace_v2(_db, 0, nullptr, nullptr);
+            } else {
+                sqlite3_trace_v2(_db, SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE, &callbacks::on_trace, this);
+            }
+        }
+    }
+
+#pragma mark ## sqlite_stmt_holder ##
+
+    inline sqlite_stmt_holder::sqlite_stmt_holder(sqlite3_stmt *stmt) noexcept
+            : _stmt(stmt) {
+    }
+
+    inline sqlite_stmt_holder::~sqlite_stmt_holder() noexcept {
+        if (_stmt) {
+            sqlite3_finalize(_stmt);
+        }
+    }
+
+    inline void sqlite_stmt_holder::finalize() {
+        auto rc = sqlite3_finalize(_stmt);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to finalize statement", rc);
+        }
+        _stmt = nullptr;
+    }
+
+    inline bool sqlite_stmt_holder::is_finalized() const {
+        return _stmt == nullptr;
+    }
+
+    inline void sqlite_stmt_holder::step() {
+        auto rc = sqlite3_step(get());
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+            detail::throw_step_error("failed to step statement", rc);
+        }
+    }
+
+    inline void sqlite_stmt_holder::reset() {
+        auto rc = sqlite3_reset(_stmt);
+        if (rc != SQLITE_OK) {
+            detail::throw_step_error("failed to reset statement", rc);
+        }
+    }
+
+    inline void sqlite_stmt_holder::bind_values(int) {
+    }
+
+    template<class... ArgType>
+    void sqlite_stmt_holder::bind_values(int index, int first_arg, ArgType &&... bind_args) {
+        auto rc = sqlite3_bind_int(get(), index, first_arg);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind int", rc);
+        }
+        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    }
+
+    template<class... ArgType>
+    void sqlite_stmt_holder::bind_values(int index, sqlite3_int64 first_arg, ArgType &&... bind_args) {
+        auto rc = sqlite3_bind_int64(get(), index, first_arg);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind int64", rc);
+        }
+        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    }
+
+    template<class... ArgType>
+    void sqlite_stmt_holder::bind_values(int index, double first_arg, ArgType &&... bind_args) {
+        auto rc = sqlite3_bind_double(get(), index, first_arg);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind double", rc);
+        }
+        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    }
+
+    template<class... ArgType>
+    void sqlite_stmt_holder::bind_values(int index, const std::string &first_arg, ArgType &&... bind_args) {
+        auto rc = sqlite3_bind_text(get(), index, first_arg.c_str(), static_cast<int>(first_arg.length()),
+                                    SQLITE_TRANSIENT);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind text", rc);
+        }
+        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    }
+
+    template<class... ArgType>
+    void sqlite_stmt_holder::bind_values(int index, const char *first_arg, ArgType &&... bind_args) {
+        auto rc = sqlite3_bind_text(get(), index, first_arg, static_cast<int>(std::strlen(first_arg)),
+                                    SQLITE_TRANSIENT);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind text", rc);
+        }
+        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    }
+
+    template<class... ArgType>
+    void sqlite_stmt_holder::bind_values(int index, blob first_arg, ArgType &&... bind_args) {
+        auto rc = sqlite3_bind_blob(get(), index, first_arg.data, first_arg.size, SQLITE_TRANSIENT);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind blob", rc);
+        }
+        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    }
+
+    template<class... ArgType>
+    void sqlite_stmt_holder::bind_values(int index, text_view first_arg, ArgType &&... bind_args) {
+        auto rc = sqlite3_bind_text(get(), index, first_arg.data, first_arg.size, SQLITE_STATIC);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind text", rc);
+        }
+        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    }
+
+    template<class... ArgType>
+    void sqlite_stmt_holder::bind_values(int index, const std::vector<unsigned char> &first_arg, ArgType &&... bind_args) {
+        auto rc = sqlite3_bind_blob(get(), index, first_arg.data(), static_cast<int>(first_arg.size()),
+                                    SQLITE_TRANSIENT);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind blob", rc);
+        }
+        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    }
+
+    template<class... ArgType>
+    void sqlite_stmt_holder::bind_values(int index, std::nullptr_t, ArgType &&... bind_args) {
+        auto rc = sqlite3_bind_null(get(), index);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind null", rc);
+        }
+        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    }
+
+    inline sqlite3_stmt *sqlite_stmt_holder::get() const {
+        if (_stmt == nullptr) {
+            throw std::logic_error("statement is finalized");
+        }
+        return _stmt;
+    }
+
+    inline sqlite3_stmt *sqlite_stmt_holder::get_noexcept() const noexcept {
+        return _stmt;
+    }
+
+#pragma mark ## statement ##
+
+    inline void statement::finalize() {
+        _stmt_holder->finalize();
+    }
+
+    inline void statement::exec() {
+        _db_holder->check_thread();
+        _stmt_holder->step();
+        reset();
+    }
+
+    template<class... ArgType>
+    void statement::exec_with_bindings(ArgType &&... bind_args) {
+        clear_bindings();
+        bind_values(std::forward<ArgType>(bind_args)...);
+        exec();
+    }
+
+    inline result_set statement::query() {
+        return result_set(_db_holder, _stmt_holder);
+    }
+
+    template<class... ArgType>
+    result_set statement::query_with_bindings(ArgType &&... bind_args) {
+        clear_bindings();
+        bind_values(std::forward<ArgType>(bind_args)...);
+        return query();
+    }
+
+    inline void statement::reset() {
+        _stmt_holder->reset();
+    }
+
+    template<class... ArgType>
+    void statement::bind_values(ArgType &&... bind_args) {
+        _stmt_holder->bind_values(1, std::forward<ArgType>(bind_args)...);
+    }
+
+    inline void statement::bind(int index, int value) {
+        auto rc = sqlite3_bind_int(_stmt_holder->get(), index, value);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind int", rc);
+        }
+    }
+
+    inline void statement::bind(int index, sqlite3_int64 value) {
+        auto rc = sqlite3_bind_int64(_stmt_holder->get(), index, value);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind int64", rc);
+        }
+    }
+
+    inline void statement::bind(int index, double value) {
+        auto rc = sqlite3_bind_double(_stmt_holder->get(), index, value);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind double", rc);
+        }
+    }
+
+    inline void statement::bind(int index, const std::string &value) {
+        auto rc = sqlite3_bind_text(_stmt_holder->get(), index, value.c_str(), static_cast<int>(value.length()),
+                                    SQLITE_TRANSIENT);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind text", rc);
+        }
+    }
+
+    inline void statement::bind(int index, const char *value) {
+        auto rc = sqlite3_bind_text(_stmt_holder->get(), index, value, static_cast<int>(std::strlen(value)),
+                                    SQLITE_TRANSIENT);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind text", rc);
+        }
+    }
+
+    inline void statement::bind(int index, blob value) {
+        auto rc = sqlite3_bind_blob(_stmt_holder->get(), index, value.data, value.size, SQLITE_TRANSIENT);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind blob", rc);
+        }
+    }
+
+    inline void statement::bind(int index, const std::vector<unsigned char> &value) {
+        auto rc = sqlite3_bind_blob(_stmt_holder->get(), index, value.data(), static_cast<int>(value.size()),
+                                    SQLITE_TRANSIENT);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind blob", rc);
+        }
+    }
+
+    inline void statement::bind(int index, text_view value) {
+        auto rc = sqlite3_bind_text(_stmt_holder->get(), index, value.data, value.size, SQLITE_STATIC);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind text", rc);
+        }
+    }
+
+    inline void statement::bind(int index, const void *data, int size) {
+        auto rc = sqlite3_bind_blob(_stmt_holder->get(), index, data, size, SQLITE_TRANSIENT);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind blob", rc);
+        }
+    }
+
+    inline void statement::bind(int index, std::nullptr_t) {
+        auto rc = sqlite3_bind_null(_stmt_holder->get(), index);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to bind blob", rc);
+        }
+    }
+
+    template<class T>
+    void statement::bind(const std::string &parameter_name, T &&value) {
+        auto index = sqlite3_bind_parameter_index(_stmt_holder->get(), parameter_name.c_str());
+        if (index == 0) {
+            std::string what;
+            what.append("no matching parameter named '");
+            what.append(parameter_name);
+            what.append("' is found");
+            throw std::logic_error(what);
+        }
+
+        bind(index, std::forward<T>(value));
+    }
+
+    inline void statement::clear_bindings() {
+        auto rc = sqlite3_clear_bindings(_stmt_holder->get());
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to clear bindings", rc);
+        }
+    }
+
+    inline statement_stats statement::stats(bool reset) {
+        auto stmt = _stmt_holder->get();
+        auto status = [stmt, reset](int op) {
+            return sqlite3_stmt_status(stmt, op, reset ? 1 : 0);
+        };
+
+        statement_stats stats;
+        stats.fullscan_step = status(SQLITE_STMTSTATUS_FULLSCAN_STEP);
+        stats.sort = status(SQLITE_STMTSTATUS_SORT);
+        stats.autoindex = status(SQLITE_STMTSTATUS_AUTOINDEX);
+        stats.vm_step = status(SQLITE_STMTSTATUS_VM_STEP);
+        stats.reprepare = status(SQLITE_STMTSTATUS_REPREPARE);
+        stats.run = status(SQLITE_STMTSTATUS_RUN);
+        stats.memused = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_MEMUSED, 0);
+        return stats;
+    }
+
+    inline statement::statement(const std::shared_ptr<sqlite_holder> &db_holder, const std::string &sql)
+            : _db_holder(db_holder) {
+        sqlite3_stmt *stmt;
+        auto rc = sqlite3_prepare_v2(_db_holder->get(), sql.c_str(), static_cast<int>(sql.length()), &stmt,
+                                     nullptr);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to prepare statement, SQL: \"" + sql + "\"",
+                               rc);
+        }
+        _stmt_holder = std::make_shared<sqlite_stmt_holder>(stmt);
+    }
+
+#pragma mark ## arena ##
+
+    inline arena::arena(std::size_t chunk_size)
+            : _chunk_size(chunk_size), _chunks(nullptr), _free_chunks(nullptr), _position(nullptr), _end(nullptr),
+              _used_size(0), _capacity(0) {
+        if (chunk_size == 0) {
+            throw std::logic_error("invalid chunk_size, must be > 0");
+        }
+    }
+
+    inline arena::arena(arena &&other) noexcept
+            : _chunk_size(other._chunk_size), _chunks(other._chunks), _free_chunks(other._free_chunks),
+              _position(other._position), _end(other._end), _used_size(other._used_size),
+              _capacity(other._capacity) {
+        other._chunks = nullptr;
+        other._free_chunks = nullptr;
+        other._position = nullptr;
+        other._end = nullptr;
+        other._used_size = 0;
+        other._capacity = 0;
+    }
+
+    inline arena &arena::operator=(arena &&other) noexcept {
+        if (this != &other) {
+            release();
+            _chunk_size = other._chunk_size;
+            std::swap(_chunks, other._chunks);
+            std::swap(_free_chunks, other._free_chunks);
+            std::swap(_position, other._position);
+            std::swap(_end, other._end);
+            std::swap(_used_size, other._used_size);
+            std::swap(_capacity, other._capacity);
+        }
+        return *this;
+    }
+
+    inline arena::~arena() noexcept {
+        release();
+    }
+
+    inline void *arena::allocate(std::size_t size, std::size_t alignment) {
+        if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment > alignof(std::max_align_t)) {
+            throw std::logic_error("invalid alignment: " + std::to_string(alignment));
+        }
+
+        auto address = reinterpret_cast<std::uintptr_t>(_position);
+        auto padding = (alignment - address % alignment) % alignment;
+        if (!_position || size + padding > static_cast<std::size_t>(_end - _position)) {
+            next_chunk(size);
+            padding = 0;
+        }
+
+        auto memory = _position + padding;
+        _position = memory + size;
+        _used_size += padding + size;
+        return memory;
+    }
+
+    inline text_view arena::copy_text(const char *data, int size) {
+        text_view text;
+        text.data = nullptr;
+        text.size = 0;
+        if (data) {
+            auto copy = static_cast<char *>(allocate(static_cast<std::size_t>(size) + 1, 1));
+            std::memcpy(copy, data, static_cast<std::size_t>(size));
+            copy[size] = '\0';
+            text.data = copy;
+            text.size = size;
+        }
+        return text;
+    }
+
+    inline blob arena::copy_blob(const void *data, int size) {
+        blob blob;
+        blob.data = nullptr;
+        blob.size = 0;
+        if (data) {
+            auto copy = allocate(static_cast<std::size_t>(size), 1);
+            std::memcpy(copy, data, static_cast<std::size_t>(size));
+            blob.data = copy;
+            blob.size = size;
+        }
+        return blob;
+    }
+
+    inline void arena::reset() noexcept {
+        while (_chunks) {
+            auto chunk = _chunks;
+            _chunks = chunk->next;
+            chunk->next = _free_chunks;
+            _free_chunks = chunk;
+        }
+        _position = nullptr;
+        _end = nullptr;
+        _used_size = 0;
+    }
+
+    inline void arena::release() noexcept {
+        free_chunks(_chunks);
+        free_chunks(_free_chunks);
+        _chunks = nullptr;
+        _free_chunks = nullptr;
+        _position = nullptr;
+        _end = nullptr;
+        _used_size = 0;
+        _capacity = 0;
+    }
+
+    inline std::size_t arena::get_used_size() const {
+        return _used_size;
+    }
+
+    inline std::size_t arena::get_capacity() const {
+        return _capacity;
+    }
+
+    inline std::size_t arena::get_header_size() {
+        // keeps the data of a chunk aligned for any type
+        auto alignment = alignof(std::max_align_t);
+        return (sizeof(chunk) + alignment - 1) / alignment * alignment;
+    }
+
+    inline char *arena::get_data(chunk *chunk) {
+        return reinterpret_cast<char *>(chunk) + get_header_size();
+    }
+
+    inline void arena::free_chunks(chunk *chunks) noexcept {
+        while (chunks) {
+            auto next = chunks->next;
+            ::operator delete(chunks);
+            chunks = next;
+        }
+    }
+
+    inline void arena::next_chunk(std::size_t size) {
+        // recycles the first free chunk large enough
+        chunk **link = &_free_chunks;
+        while (*link && (*link)->size < size) {
+            link = &(*link)->next;
+        }
+
+        auto chunk = *link;
+        if (chunk) {
+            *link = chunk->next;
+        } else {
+            auto chunk_size = std::max(size, _chunk_size);
+            chunk = static_cast<arena::chunk *>(::operator new(get_header_size() + chunk_size));
+            chunk->size = chunk_size;
+            _capacity += chunk_size;
+        }
+
+        chunk->next = _chunks;
+        _chunks = chunk;
+        _position = get_data(chunk);
+        _end = _position + chunk->size;
+    }
+
+#pragma mark ## row ##
+
+    inline row::row() noexcept : _cells(nullptr), _size(0), _column_count(0) {
+    }
+
+    inline row::row(const row &other) : row() {
+        copy_from(other);
+    }
+
+    inline row::row(row &&other) noexcept : row() {
+        move_from(other);
+    }
+
+    inline row &row::operator=(const row &other) {
+        if (this != &other) {
+            release();
+            copy_from(other);
+        }
+        return *this;
+    }
+
+    inline row &row::operator=(row &&other) noexcept {
+        if (this != &other) {
+            release();
+            move_from(other);
+        }
+        return *this;
+    }
+
+    inline row::~row() noexcept {
+        release();
+    }
+
+    template<>
+    inline sqlite3_int64 row::get(int column_index) const {
+        auto &&cell = get_cell(column_index);
+        switch (cell.type) {
+            case SQLITE_INTEGER:
+                return cell.integer;
+            case SQLITE_FLOAT:
+                return detail::real_to_int64(cell.real);
+            case SQLITE_TEXT:
+            case SQLITE_BLOB:
+                return std::strtoll(get_bytes(cell), nullptr, 10);
+            default:
+                return 0;
+        }
+    }
+
+    template<>
+    inline int row::get(int column_index) const {
+        return static_cast<int>(get<sqlite3_int64>(column_index));
+    }
+
+    template<>
+    inline double row::get(int column_index) const {
+        auto &&cell = get_cell(column_index);
+        switch (cell.type) {
+            case SQLITE_INTEGER:
+                return static_cast<double>(cell.integer);
+            case SQLITE_FLOAT:
+                return cell.real;
+            case SQLITE_TEXT:
+            case SQLITE_BLOB:
+                return std::strtod(get_bytes(cell), nullptr);
+            default:
+                return 0;
+        }
+    }
+
+    template<>
+    inline text_view row::get(int column_index) const {
+        auto &&cell = get_cell(column_index);
+        text_view text;
+        text.data = get_bytes(cell);
+        text.size = cell.type == SQLITE_INTEGER || cell.type == SQLITE_FLOAT ? static_cast<int>(std::strlen(text.data))
+                                                                             : cell.size;
+        return text;
+    }
+
+    template<>
+    inline const char *row::get(int column_index) const {
+        return get_bytes(get_cell(column_index));
+    }
+
+    template<>
+    inline const unsigned char *row::get(int column_index) const {
+        return reinterpret_cast<const unsigned char *>(get<const char *>(column_index));
+    }
+
+    template<>
+    inline std::string row::get(int column_index) const {
+        auto &&cell = get_cell(column_index);
+        if (cell.type == SQLITE_INTEGER || cell.type == SQLITE_FLOAT) {
+            // formatted without the buffer of the row
+            char buffer[detail::number_text_capacity];
+            auto size = detail::format_number(cell.type, cell.integer, cell.real, buffer);
+            return std::string(buffer, static_cast<std::size_t>(size));
+        }
+        auto text = get<text_view>(column_index);
+        return text.data ? std::string(text.data, static_cast<std::size_t>(text.size)) : std::string();
+    }
+
+    template<>
+    inline const void *row::get(int column_index) const {
+        return get<text_view>(column_index).data;
+    }
+
+    template<>
+    inline blob row::get(int column_index) const {
+        auto text = get<text_view>(column_index);
+        blob blob;
+        blob.size = text.size;
+        blob.data = text.data;
+        return blob;
+    }
+
+    template<>
+    inline std::vector<unsigned char> row::get(int column_index) const {
+        auto text = get<text_view>(column_index);
+        auto data = reinterpret_cast<const unsigned char *>(text.data);
+        return text.data ? std::vector<unsigned char>(data, data + text.size) : std::vector<unsigned char>();
+    }
+
+    template<>
+    inline value row::get(int column_index) const {
+        auto &&cell = get_cell(column_index);
+        switch (cell.type) {
+            case SQLITE_INTEGER:
+                return value(cell.integer);
+            case SQLITE_FLOAT:
+                return value(cell.real);
+            case SQLITE_TEXT:
+                return value(get<text_view>(column_index));
+            case SQLITE_BLOB:
+                return value(get<blob>(column_index));
+            default:
+                return value();
+        }
+    }
+
+    inline bool row::is_null(int column_index) const {
+        return get_cell(column_index).type == SQLITE_NULL;
+    }
+
+    inline int row::get_column_count() const {
+        return _column_count;
+    }
+
+    inline int row::get_column_type(int column_index) const {
+        return get_cell(column_index).type;
+    }
+
+    inline std::size_t row::heap_size() const {
+        return reinterpret_cast<const unsigned char *>(_cells) == _inline ? 0 : _size;
+    }
+
+    inline void row::allocate(int column_count, std::size_t data_size) {
+        auto size = static_cast<std::size_t>(column_count) * sizeof(cell) + data_size;
+        if (size <= inline_capacity) {
+            _cells = reinterpret_cast<cell *>(_inline);
+        } else {
+            // cell arrays, so that the buffer is aligned for the cells
+            _cells = new cell[(size + sizeof(cell) - 1) / sizeof(cell)];
+        }
+        _size = size;
+        _column_count = column_count;
+        for (int i = 0; i < column_count; ++i) {
+            _cells[i].integer = 0;
+            _cells[i].offset = 0;
+            _cells[i].type = SQLITE_NULL;
+            _cells[i].size = 0;
+        }
+    }
+
+    inline void row::copy_from(const row &other) {
+        if (!other._cells) {
+            return;
+        }
+        allocate(other._column_count, other._size - static_cast<std::size_t>(other._column_count) * sizeof(cell));
+        std::memcpy(_cells, other._cells, _size);
+    }
+
+    inline void row::move_from(row &other) noexcept {
+        if (!other._cells) {
+            return;
+        }
+        if (reinterpret_cast<unsigned char *>(other._cells) == other._inline) {
+            std::memcpy(_inline, other._inline, other._size);
+            _cells = reinterpret_cast<cell *>(_inline);
+        } else {
+            _cells = other._cells;
+        }
+        _size = other._size;
+        _column_count = other._column_count;
+        _texts = std::move(other._texts);
+        other._cells = nullptr;
+        other._size = 0;
+        other._column_count = 0;
+    }
+
+    inline void row::release() noexcept {
+        if (_cells && reinterpret_cast<unsigned char *>(_cells) != _inline) {
+            delete[] _cells;
+        }
+        _cells = nullptr;
+        _size = 0;
+        _column_count = 0;
+        _texts.reset();
+    }
+
+    inline const row::cell &row::get_cell(int column_index) const {
+        if (column_index < 0 || column_index >= _column_count) {
+            throw std::out_of_range("column index out of range: " + std::to_string(column_index));
+        }
+        return _cells[column_index];
+    }
+
+    inline const char *row::get_bytes(const cell &cell) const {
+        switch (cell.type) {
+            case SQLITE_TEXT:
+            case SQLITE_BLOB:
+                return reinterpret_cast<const char *>(_cells + _column_count) + cell.offset;
+            case SQLITE_INTEGER:
+            case SQLITE_FLOAT: {
+                // formatted on the first read, so that a snapshot copies only the numbers
+                if (!_texts) {
+                    auto size = static_cast<std::size_t>(_column_count) * detail::number_text_capacity;
+                    _texts.reset(new char[size]);
+                    std::memset(_texts.get(), 0, size);
+                }
+                // the text of a number is never empty, so an empty one is not formatted yet
+                auto text = _texts.get() + static_cast<std::size_t>(&cell - _cells) * detail::number_text_capacity;
+                if (!*text) {
+                    detail::format_number(cell.type, cell.integer, cell.real, text);
+                }
+                return text;
+            }
+            default:
+                return nullptr;
+        }
+    }
+
+#pragma mark ## cursor ##
+
+    template<>
+    inline int cursor::get(int column_index) const {
+        return sqlite3_column_int(_stmt_holder->get(), column_index);
+    }
+
+    template<>
+    inline sqlite3_int64 cursor::get(int column_index) const {
+        return sqlite3_column_int64(_stmt_holder->get(), column_index);
+    }
 
-    inline sqlite_holder::~sqlite_holder() noexcept {
-        if (_db) {
-            sqlite3_close_v2(_db);
+    template<>
+    inline double cursor::get(int column_index) const {
+        return sqlite3_column_double(_stmt_holder->get(), column_index);
+    }
+
+    template<>
+    inline const unsigned char *cursor::get(int column_index) const {
+        return sqlite3_column_text(_stmt_holder->get(), column_index);
+    }
+
+    template<>
+    inline const char *cursor::get(int column_index) const {
+        return reinterpret_cast<const char *>(sqlite3_column_text(_stmt_holder->get(), column_index));
+    }
+
+    template<>
+    inline std::string cursor::get(int column_index) const {
+        return reinterpret_cast<const char *>(sqlite3_column_text(_stmt_holder->get(), column_index));
+    }
+
+    template<>
+    inline const void *cursor::get(int column_index) const {
+        return sqlite3_column_blob(_stmt_holder->get(), column_index);
+    }
+
+    template<>
+    inline value cursor::get(int column_index) const {
+        auto stmt = _stmt_holder->get();
+        switch (sqlite3_column_type(stmt, column_index)) {
+            case SQLITE_INTEGER:
+                return value(sqlite3_column_int64(stmt, column_index));
+            case SQLITE_FLOAT:
+                return value(sqlite3_column_double(stmt, column_index));
+            case SQLITE_TEXT:
+                return value(std::string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, column_index)),
+                                         static_cast<std::size_t>(sqlite3_column_bytes(stmt, column_index))));
+            case SQLITE_BLOB: {
+                blob bytes;
+                bytes.data = sqlite3_column_blob(stmt, column_index);
+                bytes.size = sqlite3_column_bytes(stmt, column_index);
+                return value(bytes);
+            }
+            default:
+                return value();
         }
     }
 
-    inline void sqlite_holder::open_path(const std::string &path) {
-        if (_db) {
-            return;
+    template<>
+    inline blob cursor::get(int column_index) const {
+        blob blob;
+        blob.size = sqlite3_column_bytes(_stmt_holder->get(), column_index);
+        blob.data = sqlite3_column_blob(_stmt_holder->get(), column_index);
+        return blob;
+    }
+
+    template<>
+    inline std::vector<unsigned char> cursor::get(int column_index) const {
+        auto size = sqlite3_column_bytes(_stmt_holder->get(), column_index);
+        auto data = reinterpret_cast<const unsigned char *>(sqlite3_column_blob(_stmt_holder->get(), column_index));
+        std::vector<unsigned char> blob;
+
+        blob.reserve(size);
+        blob.assign(data, data + size);
+        return blob;
+    }
+
+    template<class T>
+    T cursor::get(const std::string &column_name) const {
+        auto index = get_column_index(column_name);
+        if (index == -1) {
+            std::string what;
+            what.append("column named '");
+            what.append(column_name);
+            what.append("' does not exist");
+            throw std::logic_error(what);
         }
+        return get<T>(index);
+    }
 
-        auto rc = sqlite3_open_v2(path.c_str(), &_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
-        if (rc != SQLITE_OK) {
-            sqlite3_close(_db);
-            _db = nullptr;
-            throw sqlite_error("failed to open database", rc);
+    template<>
+    inline text_view cursor::get(int column_index, arena &arena) const {
+        auto stmt = _stmt_holder->get();
+        auto text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, column_index));
+        return arena.copy_text(text, sqlite3_column_bytes(stmt, column_index));
+    }
+
+    template<>
+    inline const char *cursor::get(int column_index, arena &arena) const {
+        return get<text_view>(column_index, arena).data;
+    }
+
+    template<>
+    inline blob cursor::get(int column_index, arena &arena) const {
+        auto stmt = _stmt_holder->get();
+        auto data = sqlite3_column_blob(stmt, column_index);
+        return arena.copy_blob(data, sqlite3_column_bytes(stmt, column_index));
+    }
+
+    template<class T>
+    T cursor::get(const std::string &column_name, arena &arena) const {
+        auto index = get_column_index(column_name);
+        if (index == -1) {
+            std::string what;
+            what.append("column named '");
+            what.append(column_name);
+            what.append("' does not exist");
+            throw std::logic_error(what);
         }
+        return get<T>(index, arena);
     }
 
-    inline void sqlite_holder::close() {
-        if (!_db) {
-            return;
+    inline bool cursor::is_null(int column_index) const {
+        return sqlite3_column_blob(_stmt_holder->get(), column_index) == nullptr;
+    }
+
+    inline bool cursor::is_null(const std::string &column_name) const {
+        auto index = get_column_index(column_name);
+        if (index == -1) {
+            std::string what;
+            what.append("column named '");
+            what.append(column_name);
+            what.append("' does not exist");
+            throw std::logic_error(what);
         }
+        return is_null(index);
+    }
 
-        auto rc = sqlite3_close_v2(_db);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to close database", rc);
+    inline row cursor::snapshot() const {
+        auto stmt = _stmt_holder->get();
+        auto columns = sqlite3_column_count(stmt);
+
+        // the first pass sizes the buffer, the second one copies
+        std::size_t data_size = 0;
+        for (int i = 0; i < columns; ++i) {
+            switch (sqlite3_column_type(stmt, i)) {
+                case SQLITE_TEXT:
+                    sqlite3_column_text(stmt, i);
+                    data_size += static_cast<std::size_t>(sqlite3_column_bytes(stmt, i)) + 1;
+                    break;
+                case SQLITE_BLOB:
+                    data_size += static_cast<std::size_t>(sqlite3_column_bytes(stmt, i)) + 1;
+                    break;
+                default:
+                    break;
+            }
         }
 
-        _db = nullptr;
+        row result;
+        result.allocate(columns, data_size);
+        auto data = reinterpret_cast<unsigned char *>(result._cells + columns);
+        std::size_t offset = 0;
+        for (int i = 0; i < columns; ++i) {
+            auto &&cell = result._cells[i];
+            cell.type = sqlite3_column_type(stmt, i);
+            if (cell.type == SQLITE_NULL) {
+                continue;
+            }
+            if (cell.type == SQLITE_INTEGER) {
+                cell.integer = sqlite3_column_int64(stmt, i);
+                continue;
+            }
+            if (cell.type == SQLITE_FLOAT) {
+                cell.real = sqlite3_column_double(stmt, i);
+                continue;
+            }
+
+            // the bytes are NUL-terminated for BLOB too, like the ones of sqlite3_column_text()
+            auto bytes = cell.type == SQLITE_BLOB ? sqlite3_column_blob(stmt, i)
+                                                  : static_cast<const void *>(sqlite3_column_text(stmt, i));
+            cell.size = sqlite3_column_bytes(stmt, i);
+            cell.offset = offset;
+            if (cell.size > 0) {
+                std::memcpy(data + offset, bytes, static_cast<std::size_t>(cell.size));
+            }
+            offset += static_cast<std::size_t>(cell.size);
+            data[offset++] = '\0';
+        }
+        return result;
     }
 
-    inline bool sqlite_holder::is_closed() const {
-        return _db == nullptr;
+    inline std::string cursor::get_column_name(int column_index) const {
+        return sqlite3_column_name(_stmt_holder->get(), column_index);
     }
 
-    inline void sqlite_holder::exec_sql(const std::string &sql) {
-        sqlite3_stmt *stmt;
-        auto rc = sqlite3_prepare_v2(get(), sql.c_str(), static_cast<int>(sql.length()), &stmt, nullptr);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to prepare statement, SQL: \"" + sql + "\"", rc);
+    inline int cursor::get_column_index(const char *column_name) const {
+        for (int i = 0, n = sqlite3_column_count(_stmt_holder->get()); i < n; ++i) {
+            if (0 == std::strcmp(sqlite3_column_name(_stmt_holder->get(), i), column_name)) {
+                return i;
+            }
         }
+        return -1;
+    }
+
+    inline int cursor::get_column_index(const std::string &column_name) const {
+        return get_column_index(column_name.c_str());
+    }
+
+    inline int cursor::get_column_count() const {
+        return sqlite3_column_count(_stmt_holder->get());
+    }
+
+    inline int cursor::get_column_type(int column_index) const {
+        return sqlite3_column_type(_stmt_holder->get(), column_index);
+    }
+
+    inline cursor::cursor(const std::shared_ptr<sqlite_stmt_holder> &stmt_holder)
+            : _stmt_holder(stmt_holder) {
+    }
+
+#pragma mark ## iterator ##
+
+    inline iterator &iterator::operator++() {
+        auto rc = sqlite3_step(_stmt_holder->get());
 
-        rc = sqlite3_step(stmt);
         if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
-            throw sqlite_error("failed to step statement", rc);
+            detail::throw_step_error("failed to step statement", rc);
         }
 
-        rc = sqlite3_finalize(stmt);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to finalize statement", rc);
+        _state->rc = rc;
+        _state->row_index++;
+        return *this;
+    }
+
+    inline cursor &iterator::operator*() {
+        return _cursor;
+    }
+
+    inline cursor *iterator::operator->() {
+        return &_cursor;
+    }
+
+    inline bool iterator::operator==(const iterator &other) const {
+        if (_state->rc == SQLITE_DONE && !other._state) {
+            return true;
+        }
+
+        if (!_state && other._state->rc == SQLITE_DONE) {
+            return true;
         }
+
+        return _stmt_holder == other._stmt_holder
+               && _state == other._state;
     }
 
-    inline void sqlite_holder::begin_transaction(transaction_mode mode) {
-        const char *sql;
-        switch (mode) {
-            case transaction_mode::deferred:
-                sql = "BEGIN DEFERRED;";
-                break;
+    inline bool iterator::operator!=(const iterator &other) const {
+        return !operator==(other);
+    }
 
-            case transaction_mode::immediate:
-                sql = "BEGIN IMMEDIATE;";
-                break;
+    inline iterator::iterator()
+            : _stmt_holder(), _cursor(nullptr), _state() {
+    }
 
-            case transaction_mode::exclusive:
-                sql = "BEGIN EXCLUSIVE;";
-                break;
+    inline iterator::iterator(const std::shared_ptr<sqlite_stmt_holder> &stmt_holder,
+                              std::uint_fast64_t row_index,
+                              int rc)
+            : _stmt_holder(stmt_holder),
+              _cursor(stmt_holder),
+              _state(std::make_shared<state>()) {
+        _state->row_index = row_index;
+        _state->rc = rc;
+    }
+
+#pragma mark ## materialized_result ##
+
+    inline materialized_result::row_view::row_view(const materialized_result *result, std::size_t index)
+            : _result(result), _index(index) {
+    }
+
+    template<>
+    inline sqlite3_int64 materialized_result::row_view::get(int column_index) const {
+        auto &&column = _result->get_column(column_index);
+        switch (column.types[_index]) {
+            case SQLITE_INTEGER:
+                return column.numbers[_index].integer;
+            case SQLITE_FLOAT:
+                return detail::real_to_int64(column.numbers[_index].real);
+            case SQLITE_TEXT:
+            case SQLITE_BLOB:
+                return std::strtoll(_result->get_bytes(column, _index), nullptr, 10);
+            default:
+                return 0;
         }
+    }
 
-        exec_sql(sql);
+    template<>
+    inline int materialized_result::row_view::get(int column_index) const {
+        return static_cast<int>(get<sqlite3_int64>(column_index));
     }
 
-    inline void sqlite_holder::commit_transaction() {
-        exec_sql("COMMIT;");
+    template<>
+    inline double materialized_result::row_view::get(int column_index) const {
+        auto &&column = _result->get_column(column_index);
+        switch (column.types[_index]) {
+            case SQLITE_INTEGER:
+                return static_cast<double>(column.numbers[_index].integer);
+            case SQLITE_FLOAT:
+                return column.numbers[_index].real;
+            case SQLITE_TEXT:
+            case SQLITE_BLOB:
+                return std::strtod(_result->get_bytes(column, _index), nullptr);
+            default:
+                return 0;
+        }
     }
 
-    inline void sqlite_holder::rollback_transaction() {
-        exec_sql("ROLLBACK;");
+    template<>
+    inline text_view materialized_result::row_view::get(int column_index) const {
+        auto &&column = _result->get_column(column_index);
+        text_view text;
+        text.data = _result->get_bytes(column, _index);
+        auto type = column.types[_index];
+        text.size = type == SQLITE_INTEGER || type == SQLITE_FLOAT ? static_cast<int>(std::strlen(text.data))
+                                                                   : column.sizes[_index];
+        return text;
     }
 
-    inline sqlite3 *sqlite_holder::get() const {
-        if (_db == nullptr) {
-            throw std::logic_error("database is closed");
+    template<>
+    inline const char *materialized_result::row_view::get(int column_index) const {
+        return _result->get_bytes(_result->get_column(column_index), _index);
+    }
+
+    template<>
+    inline const unsigned char *materialized_result::row_view::get(int column_index) const {
+        return reinterpret_cast<const unsigned char *>(get<const char *>(column_index));
+    }
+
+    template<>
+    inline std::string materialized_result::row_view::get(int column_index) const {
+        auto &&column = _result->get_column(column_index);
+        auto type = column.types[_index];
+        if (type == SQLITE_INTEGER || type == SQLITE_FLOAT) {
+            // formatted without the arena
+            char buffer[detail::number_text_capacity];
+            auto &&number = column.numbers[_index];
+            auto size = detail::format_number(type, number.integer, number.real, buffer);
+            return std::string(buffer, static_cast<std::size_t>(size));
         }
-        return _db;
+        auto text = get<text_view>(column_index);
+        return text.data ? std::string(text.data, static_cast<std::size_t>(text.size)) : std::string();
     }
 
-    inline sqlite3 *sqlite_holder::get_noexcept() const noexcept {
-        return _db;
+    template<>
+    inline const void *materialized_result::row_view::get(int column_index) const {
+        return _result->get_bytes(_result->get_column(column_index), _index);
     }
 
-#pragma mark ## sqlite_stmt_holder ##
+    template<>
+    inline blob materialized_result::row_view::get(int column_index) const {
+        auto text = get<text_view>(column_index);
+        blob blob;
+        blob.size = text.size;
+        blob.data = text.data;
+        return blob;
+    }
 
-    inline sqlite_stmt_holder::sqlite_stmt_holder(sqlite3_stmt *stmt) noexcept
-            : _stmt(stmt) {
+    template<>
+    inline std::vector<unsigned char> materialized_result::row_view::get(int column_index) const {
+        auto text = get<text_view>(column_index);
+        auto data = reinterpret_cast<const unsigned char *>(text.data);
+        return text.data ? std::vector<unsigned char>(data, data + text.size) : std::vector<unsigned char>();
     }
 
-    inline sqlite_stmt_holder::~sqlite_stmt_holder() noexcept {
-        if (_stmt) {
-            sqlite3_finalize(_stmt);
+    template<>
+    inline value materialized_result::row_view::get(int column_index) const {
+        switch (get_column_type(column_index)) {
+            case SQLITE_INTEGER:
+                return value(get<sqlite3_int64>(column_index));
+            case SQLITE_FLOAT:
+                return value(get<double>(column_index));
+            case SQLITE_TEXT:
+                return value(get<text_view>(column_index));
+            case SQLITE_BLOB:
+                return value(get<blob>(column_index));
+            default:
+                return value();
         }
     }
 
-    inline void sqlite_stmt_holder::finalize() {
-        auto rc = sqlite3_finalize(_stmt);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to finalize statement", rc);
-        }
-        _stmt = nullptr;
+    inline bool materialized_result::row_view::is_null(int column_index) const {
+        return get_column_type(column_index) == SQLITE_NULL;
+    }
+
+    inline int materialized_result::row_view::get_column_type(int column_index) const {
+        return _result->get_column(column_index).types[_index];
+    }
+
+    inline int materialized_result::row_view::get_column_count() const {
+        return _result->get_column_count();
+    }
+
+    inline std::size_t materialized_result::row_view::get_index() const {
+        return _index;
+    }
+
+    inline materialized_result::iterator::iterator() : _result(nullptr), _index(0) {
+    }
+
+    inline materialized_result::iterator::iterator(const materialized_result *result, std::size_t index)
+            : _result(result), _index(index) {
+    }
+
+    inline materialized_result::row_view materialized_result::iterator::operator*() const {
+        return row_view(_result, _index);
+    }
+
+    inline materialized_result::row_view materialized_result::iterator::operator[](difference_type offset) const {
+        return row_view(_result, _index + offset);
+    }
+
+    inline materialized_result::iterator &materialized_result::iterator::operator++() {
+        ++_index;
+        return *this;
+    }
+
+    inline materialized_result::iterator materialized_result::iterator::operator++(int) {
+        auto it = *this;
+        ++_index;
+        return it;
+    }
+
+    inline materialized_result::iterator &materialized_result::iterator::operator--() {
+        --_index;
+        return *this;
     }
 
-    inline bool sqlite_stmt_holder::is_finalized() const {
-        return _stmt == nullptr;
+    inline materialized_result::iterator materialized_result::iterator::operator--(int) {
+        auto it = *this;
+        --_index;
+        return it;
     }
 
-    inline void sqlite_stmt_holder::step() {
-        auto rc = sqlite3_step(get());
-        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
-            throw sqlite_error("failed to step statement", rc);
-        }
+    inline materialized_result::iterator &materialized_result::iterator::operator+=(difference_type offset) {
+        _index += offset;
+        return *this;
     }
 
-    inline void sqlite_stmt_holder::reset() {
-        auto rc = sqlite3_reset(_stmt);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to reset statement", rc);
-        }
+    inline materialized_result::iterator &materialized_result::iterator::operator-=(difference_type offset) {
+        _index -= offset;
+        return *this;
     }
 
-    inline void sqlite_stmt_holder::bind_values(int) {
+    inline materialized_result::iterator materialized_result::iterator::operator+(difference_type offset) const {
+        return iterator(_result, _index + offset);
     }
 
-    template<class... ArgType>
-    void sqlite_stmt_holder::bind_values(int index, int first_arg, ArgType &&... bind_args) {
-        auto rc = sqlite3_bind_int(get(), index, first_arg);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind int", rc);
-        }
-        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    inline materialized_result::iterator materialized_result::iterator::operator-(difference_type offset) const {
+        return iterator(_result, _index - offset);
     }
 
-    template<class... ArgType>
-    void sqlite_stmt_holder::bind_values(int index, sqlite3_int64 first_arg, ArgType &&... bind_args) {
-        auto rc = sqlite3_bind_int64(get(), index, first_arg);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind int64", rc);
-        }
-        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    inline materialized_result::iterator::difference_type
+    materialized_result::iterator::operator-(const iterator &other) const {
+        return static_cast<difference_type>(_index) - static_cast<difference_type>(other._index);
     }
 
-    template<class... ArgType>
-    void sqlite_stmt_holder::bind_values(int index, double first_arg, ArgType &&... bind_args) {
-        auto rc = sqlite3_bind_double(get(), index, first_arg);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind double", rc);
-        }
-        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    inline bool materialized_result::iterator::operator==(const iterator &other) const {
+        return _result == other._result && _index == other._index;
     }
 
-    template<class... ArgType>
-    void sqlite_stmt_holder::bind_values(int index, const std::string &first_arg, ArgType &&... bind_args) {
-        auto rc = sqlite3_bind_text(get(), index, first_arg.c_str(), static_cast<int>(first_arg.length()),
-                                    SQLITE_TRANSIENT);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind text", rc);
-        }
-        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    inline bool materialized_result::iterator::operator!=(const iterator &other) const {
+        return !(*this == other);
     }
 
-    template<class... ArgType>
-    void sqlite_stmt_holder::bind_values(int index, const char *first_arg, ArgType &&... bind_args) {
-        auto rc = sqlite3_bind_text(get(), index, first_arg, static_cast<int>(std::strlen(first_arg)),
-                                    SQLITE_TRANSIENT);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind text", rc);
-        }
-        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    inline bool materialized_result::iterator::operator<(const iterator &other) const {
+        return _index < other._index;
     }
 
-    template<class... ArgType>
-    void sqlite_stmt_holder::bind_values(int index, blob first_arg, ArgType &&... bind_args) {
-        auto rc = sqlite3_bind_blob(get(), index, first_arg.data, first_arg.size, SQLITE_TRANSIENT);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind blob", rc);
-        }
-        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    inline bool materialized_result::iterator::operator>(const iterator &other) const {
+        return _index > other._index;
     }
 
-    template<class... ArgType>
-    void sqlite_stmt_holder::bind_values(int index, const std::vector<unsigned char> &first_arg, ArgType &&... bind_args) {
-        auto rc = sqlite3_bind_blob(get(), index, first_arg.data(), static_cast<int>(first_arg.size()),
-                                    SQLITE_TRANSIENT);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind blob", rc);
-        }
-        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    inline bool materialized_result::iterator::operator<=(const iterator &other) const {
+        return _index <= other._index;
     }
 
-    template<class... ArgType>
-    void sqlite_stmt_holder::bind_values(int index, std::nullptr_t, ArgType &&... bind_args) {
-        auto rc = sqlite3_bind_null(get(), index);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind null", rc);
-        }
-        bind_values(index + 1, std::forward<ArgType>(bind_args)...);
+    inline bool materialized_result::iterator::operator>=(const iterator &other) const {
+        return _index >= other._index;
     }
 
-    inline sqlite3_stmt *sqlite_stmt_holder::get() const {
-        if (_stmt == nullptr) {
-            throw std::logic_error("statement is finalized");
-        }
-        return _stmt;
+    inline materialized_result::slice::slice(const materialized_result *result, std::size_t first, std::size_t last)
+            : _result(result), _first(first), _last(last) {
     }
 
-    inline sqlite3_stmt *sqlite_stmt_holder::get_noexcept() const noexcept {
-        return _stmt;
+    inline materialized_result::iterator materialized_result::slice::begin() const {
+        return iterator(_result, _first);
     }
 
-#pragma mark ## statement ##
+    inline materialized_result::iterator materialized_result::slice::end() const {
+        return iterator(_result, _last);
+    }
 
-    inline void statement::finalize() {
-        _stmt_holder->finalize();
+    inline std::size_t materialized_result::slice::size() const {
+        return _last - _first;
     }
 
-    inline void statement::exec() {
-        _stmt_holder->step();
-        reset();
+    inline bool materialized_result::slice::empty() const {
+        return _first == _last;
     }
 
-    template<class... ArgType>
-    void statement::exec_with_bindings(ArgType &&... bind_args) {
-        clear_bindings();
-        bind_values(std::forward<ArgType>(bind_args)...);
-        exec();
+    inline materialized_result::row_view materialized_result::slice::operator[](std::size_t index) const {
+        return row_view(_result, _first + index);
     }
 
-    inline result_set statement::query() {
-        return result_set(_db_holder, _stmt_holder);
+    inline materialized_result::slice materialized_result::slice::sub(std::size_t offset, std::size_t count) const {
+        auto first = _first + std::min(offset, size());
+        return slice(_result, first, first + std::min(count, _last - first));
     }
 
-    template<class... ArgType>
-    result_set statement::query_with_bindings(ArgType &&... bind_args) {
-        clear_bindings();
-        bind_values(std::forward<ArgType>(bind_args)...);
-        return query();
+    inline materialized_result::materialized_result() : _bytes_arena(nullptr), _size(0) {
     }
 
-    inline void statement::reset() {
-        _stmt_holder->reset();
+    inline std::size_t materialized_result::size() const {
+        return _size;
     }
 
-    template<class... ArgType>
-    void statement::bind_values(ArgType &&... bind_args) {
-        _stmt_holder->bind_values(1, std::forward<ArgType>(bind_args)...);
+    inline bool materialized_result::empty() const {
+        return _size == 0;
     }
 
-    inline void statement::bind(int index, int value) {
-        auto rc = sqlite3_bind_int(_stmt_holder->get(), index, value);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind int", rc);
+    inline materialized_result::row_view materialized_result::at(std::size_t index) const {
+        if (index >= _size) {
+            throw std::out_of_range("row index out of range: " + std::to_string(index));
         }
+        return row_view(this, index);
     }
 
-    inline void statement::bind(int index, sqlite3_int64 value) {
-        auto rc = sqlite3_bind_int64(_stmt_holder->get(), index, value);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind int64", rc);
-        }
+    inline materialized_result::row_view materialized_result::operator[](std::size_t index) const {
+        return row_view(this, index);
     }
 
-    inline void statement::bind(int index, double value) {
-        auto rc = sqlite3_bind_double(_stmt_holder->get(), index, value);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind double", rc);
-        }
+    inline materialized_result::iterator materialized_result::begin() const {
+        return iterator(this, 0);
     }
 
-    inline void statement::bind(int index, const std::string &value) {
-        auto rc = sqlite3_bind_text(_stmt_holder->get(), index, value.c_str(), static_cast<int>(value.length()),
-                                    SQLITE_TRANSIENT);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind text", rc);
-        }
+    inline materialized_result::iterator materialized_result::end() const {
+        return iterator(this, _size);
     }
 
-    inline void statement::bind(int index, const char *value) {
-        auto rc = sqlite3_bind_text(_stmt_holder->get(), index, value, static_cast<int>(std::strlen(value)),
-                                    SQLITE_TRANSIENT);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind text", rc);
-        }
+    inline materialized_result::slice materialized_result::sub(std::size_t offset, std::size_t count) const {
+        return slice(this, 0, _size).sub(offset, count);
     }
 
-    inline void statement::bind(int index, blob value) {
-        auto rc = sqlite3_bind_blob(_stmt_holder->get(), index, value.data, value.size, SQLITE_TRANSIENT);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind blob", rc);
-        }
+    inline int materialized_result::get_column_count() const {
+        return static_cast<int>(_columns.size());
     }
 
-    inline void statement::bind(int index, const std::vector<unsigned char> &value) {
-        auto rc = sqlite3_bind_blob(_stmt_holder->get(), index, value.data(), static_cast<int>(value.size()),
-                                    SQLITE_TRANSIENT);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind blob", rc);
-        }
+    inline const std::string &materialized_result::get_column_name(int column_index) const {
+        return get_column(column_index).name;
     }
 
-    inline void statement::bind(int index, const void *data, int size) {
-        auto rc = sqlite3_bind_blob(_stmt_holder->get(), index, data, size, SQLITE_TRANSIENT);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind blob", rc);
+    inline int materialized_result::get_column_index(const std::string &column_name) const {
+        for (std::size_t i = 0; i < _columns.size(); ++i) {
+            if (_columns[i].name == column_name) {
+                return static_cast<int>(i);
+            }
         }
+        return -1;
     }
 
-    inline void statement::bind(int index, std::nullptr_t) {
-        auto rc = sqlite3_bind_null(_stmt_holder->get(), index);
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to bind blob", rc);
+    inline std::size_t materialized_result::memory_size() const {
+        auto size = _arena ? _arena->get_capacity() : 0;
+        for (auto &&column : _columns) {
+            size += column.types.capacity() + column.numbers.capacity() * sizeof(number)
+                    + column.sizes.capacity() * sizeof(int) + column.texts.capacity() * sizeof(const char *);
         }
+        return size;
     }
 
-    template<class T>
-    void statement::bind(const std::string &parameter_name, T &&value) {
-        auto index = sqlite3_bind_parameter_index(_stmt_holder->get(), parameter_name.c_str());
-        if (index == 0) {
-            std::string what;
-            what.append("no matching parameter named '");
-            what.append(parameter_name);
-            what.append("' is found");
-            throw std::logic_error(what);
+    inline const materialized_result::column &materialized_result::get_column(int column_index) const {
+        if (column_index < 0 || column_index >= get_column_count()) {
+            throw std::out_of_range("column index out of range: " + std::to_string(column_index));
         }
-
-        bind(index, std::forward<T>(value));
+        return _columns[static_cast<std::size_t>(column_index)];
     }
 
-    inline void statement::clear_bindings() {
-        auto rc = sqlite3_clear_bindings(_stmt_holder->get());
-        if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to clear bindings", rc);
+    inline const char *materialized_result::get_bytes(const column &column, std::size_t index) const {
+        auto type = column.types[index];
+        switch (type) {
+            case SQLITE_TEXT:
+            case SQLITE_BLOB:
+                return column.numbers[index].bytes;
+            case SQLITE_INTEGER:
+            case SQLITE_FLOAT: {
+                // formatted on the first read, so that materialize() stores only the numbers
+                if (column.texts.empty()) {
+                    column.texts.resize(column.types.size(), nullptr);
+                }
+                auto &&text = column.texts[index];
+                if (!text) {
+                    char buffer[detail::number_text_capacity];
+                    auto &&number = column.numbers[index];
+                    auto size = detail::format_number(type, number.integer, number.real, buffer);
+                    text = _bytes_arena->copy_text(buffer, size).data;
+                }
+                return text;
+            }
+            default:
+                return nullptr;
         }
     }
 
-    inline statement::statement(const std::shared_ptr<sqlite_holder> &db_holder, const std::string &sql)
-            : _db_holder(db_holder) {
-        sqlite3_stmt *stmt;
-        auto rc = sqlite3_prepare_v2(_db_holder->get(), sql.c_str(), static_cast<int>(sql.length()), &stmt,
-                                     nullptr);
+#pragma mark ## result_set ##
+
+    inline iterator result_set::begin() {
+        _db_holder->check_thread();
+        auto rc = sqlite3_reset(_stmt_holder->get());
         if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to prepare statement, SQL: \"" + sql + "\"",
-                               rc);
+            detail::throw_step_error("failed to reset statement", rc);
         }
-        _stmt_holder = std::make_shared<sqlite_stmt_holder>(stmt);
-    }
-
-#pragma mark ## cursor ##
 
-    template<>
-    inline int cursor::get(int column_index) const {
-        return sqlite3_column_int(_stmt_holder->get(), column_index);
-    }
+        rc = sqlite3_step(_stmt_holder->get());
+        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+            detail::throw_step_error("failed to step statement", rc);
+        }
 
-    template<>
-    inline sqlite3_int64 cursor::get(int column_index) const {
-        return sqlite3_column_int64(_stmt_holder->get(), column_index);
+        return iterator(_stmt_holder, 0, rc);
     }
 
-    template<>
-    inline double cursor::get(int column_index) const {
-        return sqlite3_column_double(_stmt_holder->get(), column_index);
+    inline iterator result_set::end() {
+        return iterator();
     }
 
-    template<>
-    inline const unsigned char *cursor::get(int column_index) const {
-        return sqlite3_column_text(_stmt_holder->get(), column_index);
-    }
+    namespace detail {
+        /**
+         *  Collects small writes into a large buffer that is flushed to a sink.
+         */
+        class output_buffer {
+        public:
+            explicit output_buffer(sink &out) : _out(out), _buffer(new char[capacity]) {
+            }
 
-    template<>
-    inline const char *cursor::get(int column_index) const {
-        return reinterpret_cast<const char *>(sqlite3_column_text(_stmt_holder->get(), column_index));
-    }
+            void append(const char *data, std::size_t size) {
+                if (size > capacity - _size) {
+                    flush();
+                    if (size > capacity) {
+                        _out.write(data, size);
+                        return;
+                    }
+                }
+                std::memcpy(_buffer.get() + _size, data, size);
+                _size += size;
+            }
 
-    template<>
-    inline std::string cursor::get(int column_index) const {
-        return reinterpret_cast<const char *>(sqlite3_column_text(_stmt_holder->get(), column_index));
-    }
+            void put(char c) {
+                if (_size == capacity) {
+                    flush();
+                }
+                _buffer[_size++] = c;
+            }
 
-    template<>
-    inline const void *cursor::get(int column_index) const {
-        return sqlite3_column_blob(_stmt_holder->get(), column_index);
-    }
+            void flush() {
+                if (_size > 0) {
+                    _out.write(_buffer.get(), _size);
+                    _size = 0;
+                }
+            }
 
-    template<>
-    inline blob cursor::get(int column_index) const {
-        blob blob;
-        blob.size = sqlite3_column_bytes(_stmt_holder->get(), column_index);
-        blob.data = sqlite3_column_blob(_stmt_holder->get(), column_index);
-        return blob;
-    }
+        private:
+            static const std::size_t capacity = 256 * 1024;
 
-    template<>
-    inline std::vector<unsigned char> cursor::get(int column_index) const {
-        auto size = sqlite3_column_bytes(_stmt_holder->get(), column_index);
-        auto data = reinterpret_cast<const unsigned char *>(sqlite3_column_blob(_stmt_holder->get(), column_index));
-        std::vector<unsigned char> blob;
+            sink &_out;
+            std::unique_ptr<char[]> _buffer;
+            std::size_t _size = 0;
+        };
 
-        blob.reserve(size);
-        blob.assign(data, data + size);
-        return blob;
-    }
+        inline void append_int64(output_buffer &out, sqlite3_int64 value) {
+            char digits[24];
+            auto end = digits + sizeof(digits);
+            auto p = end;
+            // negate as unsigned, so that the minimum value does not overflow
+            auto magnitude = value < 0 ? 0 - static_cast<std::uint64_t>(value) : static_cast<std::uint64_t>(value);
+            do {
+                *--p = static_cast<char>('0' + magnitude % 10);
+                magnitude /= 10;
+            } while (magnitude != 0);
+            if (value < 0) {
+                *--p = '-';
+            }
+            out.append(p, static_cast<std::size_t>(end - p));
+        }
 
-    template<class T>
-    T cursor::get(const std::string &column_name) const {
-        auto index = get_column_index(column_name);
-        if (index == -1) {
-            std::string what;
-            what.append("column named '");
-            what.append(column_name);
-            what.append("' does not exist");
-            throw std::logic_error(what);
+        inline void append_base64(output_buffer &out, const unsigned char *data, int size) {
+            static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            int i = 0;
+            for (; i + 3 <= size; i += 3) {
+                auto bits = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+                char chars[4] = {table[(bits >> 18) & 63], table[(bits >> 12) & 63], table[(bits >> 6) & 63],
+                                 table[bits & 63]};
+                out.append(chars, 4);
+            }
+            if (i < size) {
+                auto bits = (data[i] << 16) | (i + 1 < size ? data[i + 1] << 8 : 0);
+                char chars[4] = {table[(bits >> 18) & 63], table[(bits >> 12) & 63],
+                                 i + 1 < size ? table[(bits >> 6) & 63] : '=', '='};
+                out.append(chars, 4);
+            }
         }
-        return get<T>(index);
-    }
 
-    inline bool cursor::is_null(int column_index) const {
-        return sqlite3_column_blob(_stmt_holder->get(), column_index) == nullptr;
-    }
+        inline void append_csv_text(output_buffer &out, const char *text, int size) {
+            auto needs_quote = false;
+            for (int i = 0; i < size && !needs_quote; ++i) {
+                needs_quote = text[i] == ',' || text[i] == '"' || text[i] == '\r' || text[i] == '\n';
+            }
+            if (!needs_quote) {
+                out.append(text, static_cast<std::size_t>(size));
+                return;
+            }
 
-    inline bool cursor::is_null(const std::string &column_name) const {
-        auto index = get_column_index(column_name);
-        if (index == -1) {
-            std::string what;
-            what.append("column named '");
-            what.append(column_name);
-            what.append("' does not exist");
-            throw std::logic_error(what);
+            out.put('"');
+            int begin = 0;
+            for (int i = 0; i < size; ++i) {
+                if (text[i] == '"') {
+                    // the quote is written twice
+                    out.append(text + begin, static_cast<std::size_t>(i + 1 - begin));
+                    begin = i;
+                }
+            }
+            out.append(text + begin, static_cast<std::size_t>(size - begin));
+            out.put('"');
         }
-        return is_null(index);
-    }
 
-    inline std::string cursor::get_column_name(int column_index) const {
-        return sqlite3_column_name(_stmt_holder->get(), column_index);
-    }
+        /**
+         *  Appends to a string, for the output of the append functions.
+         */
+        struct string_output {
+            std::string &value;
 
-    inline int cursor::get_column_index(const char *column_name) const {
-        for (int i = 0, n = sqlite3_column_count(_stmt_holder->get()); i < n; ++i) {
-            if (0 == std::strcmp(sqlite3_column_name(_stmt_holder->get(), i), column_name)) {
-                return i;
+            explicit string_output(std::string &value) : value(value) {
             }
-        }
-        return -1;
-    }
 
-    inline int cursor::get_column_index(const std::string &column_name) const {
-        return get_column_index(column_name.c_str());
-    }
+            void append(const char *data, std::size_t size) {
+                value.append(data, size);
+            }
 
-    inline int cursor::get_column_count() const {
-        return sqlite3_column_count(_stmt_holder->get());
-    }
+            void put(char c) {
+                value += c;
+            }
+        };
 
-    inline cursor::cursor(const std::shared_ptr<sqlite_stmt_holder> &stmt_holder)
-            : _stmt_holder(stmt_holder) {
+        template<class Output>
+        void append_json_string(Output &out, const char *text, int size) {
+            static const char hex[] = "0123456789abcdef";
+            out.put('"');
+            int begin = 0;
+            for (int i = 0; i < size; ++i) {
+                auto c = static_cast<unsigned char>(text[i]);
+                if (c >= 0x20 && c != '"' && c != '\\') {
+                    continue;
+                }
+
+                out.append(text + begin, static_cast<std::size_t>(i - begin));
+                begin = i + 1;
+                switch (c) {
+                    case '"':
+                        out.append("\\\"", 2);
+                        break;
+                    case '\\':
+                        out.append("\\\\", 2);
+                        break;
+                    case '\n':
+                        out.append("\\n", 2);
+                        break;
+                    case '\r':
+                        out.append("\\r", 2);
+                        break;
+                    case '\t':
+                        out.append("\\t", 2);
+                        break;
+                    default: {
+                        char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                        out.append(escaped, 6);
+                        break;
+                    }
+                }
+            }
+            out.append(text + begin, static_cast<std::size_t>(size - begin));
+            out.put('"');
+        }
     }
 
-#pragma mark ## iterator ##
-
-    inline iterator &iterator::operator++() {
-        auto rc = sqlite3_step(_stmt_holder->get());
+    inline std::size_t result_set::write_csv(sink &out, bool header) {
+        auto stmt = _stmt_holder->get();
+        auto rc = sqlite3_reset(stmt);
+        if (rc != SQLITE_OK) {
+            detail::throw_step_error("failed to reset statement", rc);
+        }
 
-        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
-            throw sqlite_error("failed to step statement", rc);
+        detail::output_buffer buffer(out);
+        auto columns = sqlite3_column_count(stmt);
+        if (header) {
+            for (int i = 0; i < columns; ++i) {
+                if (i > 0) {
+                    buffer.put(',');
+                }
+                auto name = sqlite3_column_name(stmt, i);
+                detail::append_csv_text(buffer, name, static_cast<int>(std::strlen(name)));
+            }
+            buffer.append("\r\n", 2);
         }
 
-        _state->rc = rc;
-        _state->row_index++;
-        return *this;
-    }
+        std::size_t rows = 0;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            for (int i = 0; i < columns; ++i) {
+                if (i > 0) {
+                    buffer.put(',');
+                }
+                switch (sqlite3_column_type(stmt, i)) {
+                    case SQLITE_INTEGER:
+                        detail::append_int64(buffer, sqlite3_column_int64(stmt, i));
+                        break;
+                    case SQLITE_FLOAT:
+                    case SQLITE_TEXT: {
+                        // REAL is formatted by SQLite, the same as CAST(x AS TEXT)
+                        auto text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, i));
+                        detail::append_csv_text(buffer, text, sqlite3_column_bytes(stmt, i));
+                        break;
+                    }
+                    case SQLITE_BLOB: {
+                        auto data = static_cast<const unsigned char *>(sqlite3_column_blob(stmt, i));
+                        detail::append_base64(buffer, data, sqlite3_column_bytes(stmt, i));
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+            buffer.append("\r\n", 2);
+            ++rows;
+        }
+        if (rc != SQLITE_DONE) {
+            detail::throw_step_error("failed to step statement", rc);
+        }
 
-    inline cursor &iterator::operator*() {
-        return _cursor;
+        buffer.flush();
+        return rows;
     }
 
-    inline cursor *iterator::operator->() {
-        return &_cursor;
+    inline materialized_result result_set::materialize() {
+        std::unique_ptr<arena> owned(new arena());
+        auto result = materialize(*owned);
+        result._arena = std::move(owned);
+        return result;
     }
 
-    inline bool iterator::operator==(const iterator &other) const {
-        if (_state->rc == SQLITE_DONE && !other._state) {
-            return true;
+    inline materialized_result result_set::materialize(arena &arena) {
+        _db_holder->check_thread();
+        auto stmt = _stmt_holder->get();
+        auto rc = sqlite3_reset(stmt);
+        if (rc != SQLITE_OK) {
+            detail::throw_step_error("failed to reset statement", rc);
         }
 
-        if (!_state && other._state->rc == SQLITE_DONE) {
-            return true;
+        materialized_result result;
+        result._bytes_arena = &arena;
+        auto columns = sqlite3_column_count(stmt);
+        result._columns.resize(static_cast<std::size_t>(columns));
+        for (int i = 0; i < columns; ++i) {
+            result._columns[i].name = sqlite3_column_name(stmt, i);
         }
 
-        return _stmt_holder == other._stmt_holder
-               && _state == other._state;
-    }
-
-    inline bool iterator::operator!=(const iterator &other) const {
-        return !operator==(other);
-    }
+        std::size_t rows = 0;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            for (int i = 0; i < columns; ++i) {
+                auto &&column = result._columns[i];
+                auto type = sqlite3_column_type(stmt, i);
+                materialized_result::number number;
+                number.integer = 0;
+                auto size = 0;
+                switch (type) {
+                    case SQLITE_INTEGER:
+                        number.integer = sqlite3_column_int64(stmt, i);
+                        break;
+                    case SQLITE_FLOAT:
+                        number.real = sqlite3_column_double(stmt, i);
+                        break;
+                    case SQLITE_TEXT: {
+                        auto text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, i));
+                        size = sqlite3_column_bytes(stmt, i);
+                        number.bytes = arena.copy_text(text, size).data;
+                        break;
+                    }
+                    case SQLITE_BLOB: {
+                        // NUL-terminated like the text, which also keeps the empty blob non-null
+                        size = sqlite3_column_bytes(stmt, i);
+                        auto copy = static_cast<char *>(arena.allocate(static_cast<std::size_t>(size) + 1, 1));
+                        if (size > 0) {
+                            std::memcpy(copy, sqlite3_column_blob(stmt, i), static_cast<std::size_t>(size));
+                        }
+                        copy[size] = '\0';
+                        number.bytes = copy;
+                        break;
+                    }
+                    default:
+                        break;
+                }
+                column.types.push_back(static_cast<unsigned char>(type));
+                column.numbers.push_back(number);
+                column.sizes.push_back(size);
+            }
+            ++rows;
+        }
 
-    inline iterator::iterator()
-            : _stmt_holder(), _cursor(nullptr), _state() {
-    }
+        // releases the read transaction of the statement at once instead of at the next use
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE) {
+            detail::throw_step_error("failed to step statement", rc);
+        }
 
-    inline iterator::iterator(const std::shared_ptr<sqlite_stmt_holder> &stmt_holder,
-                              std::uint_fast64_t row_index,
-                              int rc)
-            : _stmt_holder(stmt_holder),
-              _cursor(stmt_holder),
-              _state(std::make_shared<state>()) {
-        _state->row_index = row_index;
-        _state->rc = rc;
+        result._size = rows;
+        return result;
     }
 
-#pragma mark ## result_set ##
-
-    inline iterator result_set::begin() {
-        auto rc = sqlite3_reset(_stmt_holder->get());
+    inline std::size_t result_set::write_jsonl(sink &out) {
+        auto stmt = _stmt_holder->get();
+        auto rc = sqlite3_reset(stmt);
         if (rc != SQLITE_OK) {
-            throw sqlite_error("failed to reset statement", rc);
+            detail::throw_step_error("failed to reset statement", rc);
         }
 
-        rc = sqlite3_step(_stmt_holder->get());
-        if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
-            throw sqlite_error("failed to step statement", rc);
+        // the keys are escaped once, the separators are included
+        auto columns = sqlite3_column_count(stmt);
+        std::vector<std::string> keys(static_cast<std::size_t>(columns));
+        for (int i = 0; i < columns; ++i) {
+            detail::string_output key(keys[i]);
+            key.put(i == 0 ? '{' : ',');
+            auto name = sqlite3_column_name(stmt, i);
+            detail::append_json_string(key, name, static_cast<int>(std::strlen(name)));
+            key.put(':');
         }
 
-        return iterator(_stmt_holder, 0, rc);
-    }
+        detail::output_buffer buffer(out);
+        std::size_t rows = 0;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            for (int i = 0; i < columns; ++i) {
+                buffer.append(keys[i].data(), keys[i].size());
+                switch (sqlite3_column_type(stmt, i)) {
+                    case SQLITE_INTEGER:
+                        detail::append_int64(buffer, sqlite3_column_int64(stmt, i));
+                        break;
+                    case SQLITE_FLOAT: {
+                        auto value = sqlite3_column_double(stmt, i);
+                        if (!std::isfinite(value)) {
+                            // JSON has no representation of infinity
+                            buffer.append("null", 4);
+                            break;
+                        }
+                        auto text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, i));
+                        buffer.append(text, static_cast<std::size_t>(sqlite3_column_bytes(stmt, i)));
+                        break;
+                    }
+                    case SQLITE_TEXT: {
+                        auto text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, i));
+                        detail::append_json_string(buffer, text, sqlite3_column_bytes(stmt, i));
+                        break;
+                    }
+                    case SQLITE_BLOB: {
+                        auto data = static_cast<const unsigned char *>(sqlite3_column_blob(stmt, i));
+                        buffer.put('"');
+                        detail::append_base64(buffer, data, sqlite3_column_bytes(stmt, i));
+                        buffer.put('"');
+                        break;
+                    }
+                    default:
+                        buffer.append("null", 4);
+                        break;
+                }
+            }
+            buffer.append(columns == 0 ? "{}\n" : "}\n", columns == 0 ? 3 : 2);
+            ++rows;
+        }
+        if (rc != SQLITE_DONE) {
+            detail::throw_step_error("failed to step statement", rc);
+        }
 
-    inline iterator result_set::end() {
-        return iterator();
+        buffer.flush();
+        return rows;
     }
 
     inline result_set::result_set(
@@ -1252,6 +5057,29 @@ namespace scandium {
             : _db_holder(db_holder), _stmt_holder(stmt_holder) {
     }
 
+#ifdef SCANDIUM_HAS_FD_SINK
+
+#pragma mark ## fd_sink ##
+
+    inline fd_sink::fd_sink(int fd) : _fd(fd) {
+    }
+
+    inline void fd_sink::write(const char *data, std::size_t size) {
+        while (size > 0) {
+            auto written = ::write(_fd, data, size);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("failed to write, errno: " + std::to_string(errno));
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+    }
+
+#endif
+
 #pragma mark ## transaction ##
 
     inline transaction::~transaction() noexcept {
@@ -1291,25 +5119,114 @@ namespace scandium {
         _in_transaction = true;
     }
 
+#ifdef SQLITE_ENABLE_SESSION
+
+#pragma mark ## session ##
+
+    inline session::~session() noexcept {
+        if (_session) {
+            sqlite3session_delete(_session);
+        }
+    }
+
+    inline session::session(session &&other) noexcept
+            : _db_holder(std::move(other._db_holder)),
+              _session(other._session) {
+        other._session = nullptr;
+    }
+
+    inline session &session::operator=(session &&other) noexcept {
+        if (this != &other) {
+            if (_session) {
+                sqlite3session_delete(_session);
+            }
+            _db_holder = std::move(other._db_holder);
+            _session = other._session;
+            other._session = nullptr;
+        }
+
+        return *this;
+    }
+
+    inline void session::attach(const std::string &table_name) {
+        auto rc = sqlite3session_attach(_session, table_name.empty() ? nullptr : table_name.c_str());
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to attach table to session", rc);
+        }
+    }
+
+    inline void session::set_enabled(bool enabled) {
+        sqlite3session_enable(_session, enabled ? 1 : 0);
+    }
+
+    inline bool session::is_empty() const {
+        return sqlite3session_isempty(_session) != 0;
+    }
+
+    inline std::vector<unsigned char> session::changeset() {
+        int size = 0;
+        void *data = nullptr;
+        auto rc = sqlite3session_changeset(_session, &size, &data);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to create changeset", rc);
+        }
+
+        auto bytes = static_cast<unsigned char *>(data);
+        std::vector<unsigned char> result(bytes, bytes + size);
+        sqlite3_free(data);
+        return result;
+    }
+
+    inline std::vector<unsigned char> session::patchset() {
+        int size = 0;
+        void *data = nullptr;
+        auto rc = sqlite3session_patchset(_session, &size, &data);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to create patchset", rc);
+        }
+
+        auto bytes = static_cast<unsigned char *>(data);
+        std::vector<unsigned char> result(bytes, bytes + size);
+        sqlite3_free(data);
+        return result;
+    }
+
+    inline session::session(const std::shared_ptr<sqlite_holder> &db_holder, const std::string &database_name)
+            : _db_holder(db_holder), _session(nullptr) {
+        auto rc = sqlite3session_create(_db_holder->get(), database_name.c_str(), &_session);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to create session", rc);
+        }
+    }
+
+#endif
+
 #pragma mark ## database ##
 
     inline database::database() : database(":memory:") {
     }
 
     inline database::database(const std::string &path)
-            : _path(path), _db_holder(std::make_shared<sqlite_holder>()) {
+            : database(path, open_options()) {
+    }
+
+    inline database::database(const std::string &path, const open_options &options)
+            : _path(path), _options(options), _db_holder(std::make_shared<sqlite_holder>()) {
     }
 
     inline void database::open() {
-        _db_holder->open_path(_path);
+        _db_holder->open_path(_path, _options);
         set_busy_timeout(200);
+        apply_options();
     }
 
 #ifdef SQLITE_HAS_CODEC
 
     inline void database::open(const std::string &passphrase) {
-        open();
+        _db_holder->open_path(_path, _options);
+        set_busy_timeout(200);
         sqlite3_key(_db_holder->get(), passphrase.c_str(), static_cast<int>(passphrase.length()));
+        apply_options();
     }
 
 #endif
@@ -1322,6 +5239,51 @@ namespace scandium {
         _db_holder->exec_sql(sql);
     }
 
+    inline void database::exec_script(const std::string &sql, bool in_transaction) {
+        if (!in_transaction) {
+            _db_holder->exec_script(sql.data(), sql.length());
+            return;
+        }
+
+        auto transaction = create_transaction();
+        _db_holder->exec_script(sql.data(), sql.length());
+        transaction.commit();
+    }
+
+    inline void database::exec_script_file(const std::string &path, bool in_transaction) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("failed to open " + path);
+        }
+
+        std::unique_ptr<transaction> transaction;
+        if (in_transaction) {
+            transaction.reset(new scandium::transaction(create_transaction()));
+        }
+
+        const std::size_t chunk_size = 64 * 1024;
+        std::string buffer;
+        while (file) {
+            auto size = buffer.size();
+            buffer.resize(size + chunk_size);
+            file.read(&buffer[size], static_cast<std::streamsize>(chunk_size));
+            buffer.resize(size + static_cast<std::size_t>(file.gcount()));
+
+            // executes the statements the parser ended before the end of the chunk,
+            // and keeps the rest for the next chunk
+            auto rest = _db_holder->exec_script(buffer.data(), buffer.size(), false);
+            buffer.erase(0, static_cast<std::size_t>(rest - buffer.data()));
+        }
+        if (file.bad()) {
+            throw std::runtime_error("failed to read " + path);
+        }
+        _db_holder->exec_script(buffer.data(), buffer.size());
+
+        if (transaction) {
+            transaction->commit();
+        }
+    }
+
     template<class... ArgType>
     void database::exec_sql(const std::string &sql, ArgType &&... bind_args) {
         statement statement(_db_holder, sql);
@@ -1330,6 +5292,16 @@ namespace scandium {
         statement.finalize();
     }
 
+    template<int ParameterCount, class... ArgType>
+    void database::exec_sql(const sql_literal<ParameterCount> &sql, ArgType &&... bind_args) {
+        static_assert(sizeof...(ArgType) == ParameterCount,
+                      "the number of arguments does not match the number of parameters");
+        static_assert(detail::all_bindable<ArgType...>::value,
+                      "the arguments must be int, sqlite3_int64, double, std::string, const char *, "
+                      "std::vector<unsigned char>, scandium::blob, scandium::text_view or nullptr");
+        exec_sql(sql.str(), std::forward<ArgType>(bind_args)...);
+    }
+
     inline result_set database::query(const std::string &sql) {
         statement statement(_db_holder, sql);
         return statement.query();
@@ -1342,8 +5314,99 @@ namespace scandium {
         return statement.query();
     }
 
+    template<int ParameterCount, class... ArgType>
+    result_set database::query(const sql_literal<ParameterCount> &sql, ArgType &&... bind_args) {
+        static_assert(sizeof...(ArgType) == ParameterCount,
+                      "the number of arguments does not match the number of parameters");
+        static_assert(detail::all_bindable<ArgType...>::value,
+                      "the arguments must be int, sqlite3_int64, double, std::string, const char *, "
+                      "std::vector<unsigned char>, scandium::blob, scandium::text_view or nullptr");
+        return query(sql.str(), std::forward<ArgType>(bind_args)...);
+    }
+
     inline statement database::prepare_statement(const std::string &sql) {
-        return statement(_db_holder, sql);
+        statement statement(_db_holder, sql);
+        if (_plan_guard.mode != plan_guard_mode::off) {
+            check_plan(sql);
+        }
+        return statement;
+    }
+
+    inline std::vector<query_plan_node> database::explain(const std::string &sql) {
+        std::vector<query_plan_node> rows;
+        for (auto &&cursor : query("EXPLAIN QUERY PLAN " + sql)) {
+            query_plan_node row;
+            row.id = cursor.get<int>(0);
+            row.parent = cursor.get<int>(1);
+            row.detail = cursor.get<std::string>(3);
+            rows.push_back(std::move(row));
+        }
+
+        // the rows are ordered so that a parent precedes its children
+        std::function<std::vector<query_plan_node>(int)> children_of = [&rows, &children_of](int parent) {
+            std::vector<query_plan_node> children;
+            for (auto &&row : rows) {
+                if (row.parent == parent) {
+                    children.push_back(row);
+                    children.back().children = children_of(row.id);
+                }
+            }
+            return children;
+        };
+        return children_of(0);
+    }
+
+    inline void database::set_plan_guard(const plan_guard_options &options) {
+        _plan_guard = options;
+    }
+
+    inline const plan_guard_options &database::get_plan_guard() const {
+        return _plan_guard;
+    }
+
+    inline void database::check_plan(const std::string &sql) {
+        // the plan shows the aliases, not the tables
+        auto items = detail::parse_from_items(sql);
+        std::function<void(const std::vector<query_plan_node> &)> inspect = [this, &sql, &items, &inspect](
+                const std::vector<query_plan_node> &nodes) {
+            for (auto &&node : nodes) {
+                auto &&detail = node.detail;
+                auto violated = false;
+                if (_plan_guard.forbid_scan && detail.compare(0, 5, "SCAN ") == 0) {
+                    // "SCAN table_1", "SCAN alias_1 USING COVERING INDEX ..." and so on,
+                    // but not "SCAN CONSTANT ROW", "SCAN (subquery-1)" and the scans of aliased subqueries
+                    auto scanned = detail.substr(5);
+                    auto table = scanned.substr(0, scanned.find(' '));
+                    std::size_t matched = 0;
+                    for (auto &&item : items) {
+                        auto size = item.shown.size();
+                        if (size > matched && scanned.compare(0, size, item.shown) == 0
+                            && (scanned.size() == size || scanned[size] == ' ')) {
+                            table = item.table;
+                            matched = size;
+                        }
+                    }
+                    violated = !table.empty() && table.front() != '(' && detail != "SCAN CONSTANT ROW"
+                               && std::find(_plan_guard.scannable_tables.begin(), _plan_guard.scannable_tables.end(),
+                                            table) == _plan_guard.scannable_tables.end();
+                }
+                if (_plan_guard.forbid_temp_b_tree && detail.find("USE TEMP B-TREE FOR") != std::string::npos
+                    && detail.find("ORDER BY") != std::string::npos) {
+                    violated = true;
+                }
+
+                if (violated) {
+                    if (_plan_guard.mode == plan_guard_mode::raise) {
+                        throw query_plan_error(sql, detail);
+                    }
+                    if (_plan_guard.reporter) {
+                        _plan_guard.reporter(sql, detail);
+                    }
+                }
+                inspect(node.children);
+            }
+        };
+        inspect(explain(sql));
     }
 
     inline void database::begin_transaction(transaction_mode mode) {
@@ -1362,19 +5425,161 @@ namespace scandium {
         return !_db_holder->is_closed();
     }
 
+    inline bool database::in_transaction() const {
+        return sqlite3_get_autocommit(_db_holder->get()) == 0;
+    }
+
+    inline sqlite3_int64 database::get_total_changes() const {
+#if SQLITE_VERSION_NUMBER >= 3037000
+        return sqlite3_total_changes64(_db_holder->get());
+#else
+        return sqlite3_total_changes(_db_holder->get());
+#endif
+    }
+
+    inline std::size_t database::add_update_listener(sqlite_holder::update_listener listener) {
+        return _db_holder->add_update_listener(std::move(listener));
+    }
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+
+    inline std::size_t database::add_preupdate_listener(sqlite_holder::preupdate_listener listener) {
+        return _db_holder->add_preupdate_listener(std::move(listener));
+    }
+
+#endif
+
+    inline std::size_t database::add_commit_listener(sqlite_holder::transaction_listener listener) {
+        return _db_holder->add_commit_listener(std::move(listener));
+    }
+
+    inline std::size_t database::add_rollback_listener(sqlite_holder::transaction_listener listener) {
+        return _db_holder->add_rollback_listener(std::move(listener));
+    }
+
+    inline std::size_t database::add_authorizer(sqlite_holder::authorizer listener) {
+        return _db_holder->add_authorizer(std::move(listener));
+    }
+
+    inline void database::remove_listener(std::size_t id) {
+        _db_holder->remove_listener(id);
+    }
+
+    inline std::size_t database::add_progress_listener(sqlite_holder::progress_listener listener) {
+        return _db_holder->add_progress_listener(std::move(listener));
+    }
+
+    inline std::size_t database::add_trace_listener(sqlite_holder::trace_listener listener) {
+        return _db_holder->add_trace_listener(std::move(listener));
+    }
+
+    inline void database::claim_thread() {
+        _db_holder->claim_thread();
+    }
+
+    inline void database::release_thread() {
+        _db_holder->release_thread();
+    }
+
+    inline void database::interrupt() {
+        auto db = _db_holder->get_noexcept();
+        if (db) {
+            sqlite3_interrupt(db);
+        }
+    }
+
     inline transaction database::create_transaction(transaction_mode mode) {
         return transaction(_db_holder, mode);
     }
 
-    inline int database::get_user_version() {
-        auto &&results = query("PRAGMA user_version;");
+#ifdef SQLITE_ENABLE_SESSION
+
+    inline session database::create_session(const std::string &database_name) {
+        return session(_db_holder, database_name);
+    }
+
+    inline void database::apply_changeset(const std::vector<unsigned char> &changeset,
+                                          const conflict_handler &handler) {
+        struct context {
+            const conflict_handler *handler;
+            std::exception_ptr error;
+        } context = {&handler, nullptr};
+
+        struct callbacks {
+            static int on_conflict(void *context_pointer, int type, sqlite3_changeset_iter *iterator) {
+                auto context = static_cast<struct context *>(context_pointer);
+                if (!*context->handler) {
+                    return SQLITE_CHANGESET_ABORT;
+                }
+
+                // nothing may throw through SQLite
+                try {
+                    changeset_conflict conflict;
+                    conflict.type = type;
+                    const char *table_name = nullptr;
+                    int column_count = 0;
+                    int indirect = 0;
+                    sqlite3changeset_op(iterator, &table_name, &column_count, &conflict.operation, &indirect);
+                    if (table_name) {
+                        conflict.table_name = table_name;
+                    }
+
+                    sqlite3_value *column;
+                    if (type != SQLITE_CHANGESET_FOREIGN_KEY) {
+                        for (int i = 0; i < column_count; ++i) {
+                            if (conflict.operation != SQLITE_INSERT) {
+                                column = nullptr;
+                                sqlite3changeset_old(iterator, i, &column);
+                                conflict.old_values.emplace_back(column);
+                            }
+                            if (conflict.operation != SQLITE_DELETE) {
+                                column = nullptr;
+                                sqlite3changeset_new(iterator, i, &column);
+                                conflict.new_values.emplace_back(column);
+                            }
+                            if (type == SQLITE_CHANGESET_DATA || type == SQLITE_CHANGESET_CONFLICT) {
+                                column = nullptr;
+                                sqlite3changeset_conflict(iterator, i, &column);
+                                conflict.conflicting_values.emplace_back(column);
+                            }
+                        }
+                    }
+
+                    switch ((*context->handler)(conflict)) {
+                        case conflict_action::omit:
+                            return SQLITE_CHANGESET_OMIT;
+                        case conflict_action::replace:
+                            // SQLite answers SQLITE_MISUSE for the other conflicts
+                            if (type != SQLITE_CHANGESET_DATA && type != SQLITE_CHANGESET_CONFLICT) {
+                                throw std::logic_error("invalid conflict action, replace is allowed only "
+                                                       "for SQLITE_CHANGESET_DATA and SQLITE_CHANGESET_CONFLICT");
+                            }
+                            return SQLITE_CHANGESET_REPLACE;
+                        default:
+                            return SQLITE_CHANGESET_ABORT;
+                    }
+                } catch (...) {
+                    context->error = std::current_exception();
+                    return SQLITE_CHANGESET_ABORT;
+                }
+            }
+        };
 
-        int result = 0;
-        for (auto &&cursor : results) {
-            result = cursor.get<int>(0);
+        auto rc = sqlite3changeset_apply(_db_holder->get(), static_cast<int>(changeset.size()),
+                                         const_cast<unsigned char *>(changeset.data()), nullptr,
+                                         &callbacks::on_conflict, &context);
+        if (context.error) {
+            std::rethrow_exception(context.error);
+        }
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to apply changeset", rc);
         }
+    }
 
-        return result;
+#endif
+
+    inline int database::get_user_version() {
+        return _db_holder->get_user_version();
     }
 
     inline void database::update_user_version(int version, transaction_mode mode) {
@@ -1416,10 +5621,75 @@ namespace scandium {
         return _path;
     }
 
+    inline const open_options &database::get_options() const {
+        return _options;
+    }
+
     inline void database::set_busy_timeout(int ms) {
         auto rc = sqlite3_busy_timeout(_db_holder->get(), ms);
         if (rc != SQLITE_OK) {
             throw sqlite_error("failed to set busy timeout", rc);
         }
     }
+
+    inline void database::apply_options() {
+        if (_options.cache_size != 0) {
+            _db_holder->exec_sql("PRAGMA cache_size = " + std::to_string(_options.cache_size) + ";");
+        }
+    }
+
+    inline database_stats database::stats(bool reset) {
+        auto db = _db_holder->get();
+        auto status = [db, reset](int op, bool highwater) {
+            int current = 0;
+            int high = 0;
+            auto rc = sqlite3_db_status(db, op, &current, &high, reset ? 1 : 0);
+            if (rc != SQLITE_OK) {
+                throw sqlite_error("failed to get database status", rc);
+            }
+            return highwater ? high : current;
+        };
+
+        database_stats stats;
+        stats.cache_hit = status(SQLITE_DBSTATUS_CACHE_HIT, false);
+        stats.cache_miss = status(SQLITE_DBSTATUS_CACHE_MISS, false);
+        stats.cache_write = status(SQLITE_DBSTATUS_CACHE_WRITE, false);
+        stats.cache_spill = status(SQLITE_DBSTATUS_CACHE_SPILL, false);
+        stats.cache_used = status(SQLITE_DBSTATUS_CACHE_USED, false);
+        stats.lookaside_hit = status(SQLITE_DBSTATUS_LOOKASIDE_HIT, true);
+        stats.lookaside_miss_size = status(SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, true);
+        stats.lookaside_miss_full = status(SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, true);
+        stats.schema_used = status(SQLITE_DBSTATUS_SCHEMA_USED, false);
+        stats.stmt_used = status(SQLITE_DBSTATUS_STMT_USED, false);
+
+        // read the highwater before the current value, resetting the highwater sets it to the current value
+        stats.lookaside_highwater = status(SQLITE_DBSTATUS_LOOKASIDE_USED, true);
+        stats.lookaside_used = status(SQLITE_DBSTATUS_LOOKASIDE_USED, false);
+        return stats;
+    }
+
+#pragma mark ## statement_stats ##
+
+    inline statement_stats &statement_stats::operator+=(const statement_stats &other) {
+        fullscan_step += other.fullscan_step;
+        sort += other.sort;
+        autoindex += other.autoindex;
+        vm_step += other.vm_step;
+        reprepare += other.reprepare;
+        run += other.run;
+        memused += other.memused;
+        return *this;
+    }
+
+#pragma mark ## database_stats ##
+
+    inline double database_stats::cache_hit_rate() const {
+        auto lookups = static_cast<double>(cache_hit) + cache_miss;
+        return lookups > 0 ? cache_hit / lookups : 0;
+    }
+
+    inline double database_stats::lookaside_hit_rate() const {
+        auto allocations = static_cast<double>(lookaside_hit) + lookaside_miss_size + lookaside_miss_full;
+        return allocations > 0 ? lookaside_hit / allocations : 0;
+    }
 }
@@ -0,0 +1,180 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Daisuke Itabashi (itabashi.d@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "scandium.h"
+
+namespace scandium {
+
+    /**
+     *  Interrupts the statements of a database that run past a deadline, using the RAII idiom.
+     *  The interrupted statements throw interrupted_error.
+     *  The deadline is checked every sqlite_holder::progress_interval virtual machine instructions,
+     *  so it may be exceeded by a little.
+     */
+    class deadline_guard {
+    public:
+        /**
+         *  Constructor.
+         *  Starts checking the deadline.
+         *
+         *  @param db       the open database.
+         *  @param deadline the time after which statements are interrupted.
+         */
+        deadline_guard(const database &db, std::chrono::steady_clock::time_point deadline);
+
+        /**
+         *  Constructor.
+         *  Starts checking the deadline.
+         *
+         *  @param db      the open database.
+         *  @param timeout the duration from now after which statements are interrupted.
+         */
+        deadline_guard(const database &db, std::chrono::steady_clock::duration timeout);
+
+        /**
+         *  Destructor.
+         *  Stops checking the deadline.
+         */
+        ~deadline_guard() noexcept;
+
+        /**
+         *  Returns true if a statement was interrupted by this guard.
+         */
+        bool is_expired() const;
+
+    private:
+        deadline_guard(const deadline_guard &) = delete;
+
+        deadline_guard &operator=(const deadline_guard &) = delete;
+
+        database _db;
+        std::chrono::steady_clock::time_point _deadline;
+        bool _expired;
+        std::size_t _listener_id;
+    };
+
+    /**
+     *  Cancels the statements of a database from other threads.
+     *  Cancelling interrupts the running statement with sqlite3_interrupt(),
+     *  and the statements started until reset() throw interrupted_error
+     *  once they run sqlite_holder::progress_interval virtual machine instructions.
+     *  The token must be created and destroyed on the thread of the database.
+     */
+    class cancellation_token {
+    public:
+        /**
+         *  Constructor.
+         *
+         *  @param db the open database.
+         */
+        explicit cancellation_token(const database &db);
+
+        /**
+         *  Destructor.
+         */
+        ~cancellation_token() noexcept;
+
+        /**
+         *  Cancels the statements of the database.
+         *  Can be called from any thread, but not concurrently with closing the database.
+         */
+        void cancel();
+
+        /**
+         *  Returns true if cancelled and not reset.
+         */
+        bool is_cancelled() const;
+
+        /**
+         *  Allows statements to run again.
+         */
+        void reset();
+
+    private:
+        cancellation_token(const cancellation_token &) = delete;
+
+        cancellation_token &operator=(const cancellation_token &) = delete;
+
+        database _db;
+        std::atomic<bool> _cancelled;
+        std::size_t _listener_id;
+    };
+
+#pragma mark ## deadline_guard ##
+
+    inline deadline_guard::deadline_guard(const database &db, std::chrono::steady_clock::time_point deadline)
+            : _db(db), _deadline(deadline), _expired(false) {
+        _listener_id = _db.add_progress_listener([this] {
+            if (std::chrono::steady_clock::now() < _deadline) {
+                return false;
+            }
+            _expired = true;
+            return true;
+        });
+    }
+
+    inline deadline_guard::deadline_guard(const database &db, std::chrono::steady_clock::duration timeout)
+            : deadline_guard(db, std::chrono::steady_clock::now() + timeout) {
+    }
+
+    inline deadline_guard::~deadline_guard() noexcept {
+        _db.remove_listener(_listener_id);
+    }
+
+    inline bool deadline_guard::is_expired() const {
+        return _expired;
+    }
+
+#pragma mark ## cancellation_token ##
+
+    inline cancellation_token::cancellation_token(const database &db)
+            : _db(db), _cancelled(false) {
+        _listener_id = _db.add_progress_listener([this] {
+            return _cancelled.load(std::memory_order_relaxed);
+        });
+    }
+
+    inline cancellation_token::~cancellation_token() noexcept {
+        _db.remove_listener(_listener_id);
+    }
+
+    inline void cancellation_token::cancel() {
+        _cancelled.store(true, std::memory_order_relaxed);
+        _db.interrupt();
+    }
+
+    inline bool cancellation_token::is_cancelled() const {
+        return _cancelled.load(std::memory_order_relaxed);
+    }
+
+    inline void cancellation_token::reset() {
+        _cancelled.store(false, std::memory_order_relaxed);
+    }
+}
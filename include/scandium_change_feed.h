@@ -0,0 +1,492 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Daisuke Itabashi (itabashi.d@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "scandium.h"
+
+namespace scandium {
+
+    /**
+     *  Describes a row change captured by scandium::change_feed.
+     */
+    struct change_record {
+        /**
+         *  SQLITE_INSERT, SQLITE_UPDATE or SQLITE_DELETE.
+         */
+        int operation;
+
+        /**
+         *  The database name, "main", "temp" or the name of an attached database.
+         */
+        std::string database_name;
+
+        /**
+         *  The table name.
+         */
+        std::string table_name;
+
+        /**
+         *  The rowid of the row, the old rowid for DELETE.
+         */
+        sqlite3_int64 rowid;
+
+        /**
+         *  The rowid before the change, differs from rowid only if UPDATE changed the rowid.
+         */
+        sqlite3_int64 old_rowid;
+
+        /**
+         *  The column values before UPDATE or DELETE.
+         *  Empty if the values are not captured, see change_feed_options::capture_values.
+         */
+        std::vector<value> old_values;
+
+        /**
+         *  The column values after INSERT or UPDATE.
+         *  Empty if the values are not captured, see change_feed_options::capture_values.
+         */
+        std::vector<value> new_values;
+    };
+
+    /**
+     *  Describes the options of scandium::change_feed.
+     */
+    struct change_feed_options {
+        /**
+         *  The maximum number of committed records kept until drained.
+         *  The oldest records are dropped when exceeded.
+         */
+        std::size_t capacity = 65536;
+
+        /**
+         *  Whether to capture the old and new column values.
+         *  Requires SQLITE_ENABLE_PREUPDATE_HOOK, ignored otherwise.
+         */
+        bool capture_values = true;
+    };
+
+    /**
+     *  Captures the row changes of a database,
+     *  and publishes them in a bounded ring buffer when their transaction is committed.
+     *  Changes of a rolled back transaction or savepoint are discarded.
+     *
+     *  Records are collected with sqlite3_preupdate_hook() if SQLITE_ENABLE_PREUPDATE_HOOK is defined,
+     *  with sqlite3_update_hook() otherwise, which does not report WITHOUT ROWID tables and DELETE without WHERE.
+     *  The commit hook runs before the commit can still fail or be vetoed by another commit listener,
+     *  so the records are published only when the committing statement finishes
+     *  and the database is back in autocommit mode, see sqlite_holder::add_trace_listener().
+     *  Savepoints are tracked from the SAVEPOINT, RELEASE and ROLLBACK TO statements.
+     *  A statement that fails halfway and is rolled back alone is not reported by SQLite,
+     *  so the changes it made before failing are published with the enclosing transaction.
+     *
+     *  The feed must be used on the thread of the database, except drain() and wait() that can be called anywhere.
+     */
+    class change_feed {
+    public:
+        /**
+         *  Constructor.
+         *  Starts capturing the changes of the database.
+         *
+         *  @param db      the open database to observe.
+         *  @param options the capture options.
+         */
+        explicit change_feed(const database &db, const change_feed_options &options = change_feed_options());
+
+        /**
+         *  Destructor.
+         *  Stops capturing.
+         */
+        ~change_feed() noexcept;
+
+        /**
+         *  Removes and returns the oldest committed records.
+         *
+         *  @param max_count the maximum number of records to return.
+         *
+         *  @return records in commit order, records of one transaction are in statement order.
+         */
+        std::vector<change_record> drain(std::size_t max_count = std::numeric_limits<std::size_t>::max());
+
+        /**
+         *  Waits until committed records are available or the timeout expires.
+         *
+         *  @return true if records are available.
+         */
+        template<class Rep, class Period>
+        bool wait(const std::chrono::duration<Rep, Period> &timeout);
+
+        /**
+         *  Returns the number of committed records not drained yet.
+         */
+        std::size_t size() const;
+
+        /**
+         *  Returns the number of committed records dropped because the ring buffer was full.
+         */
+        std::uint64_t get_dropped_count() const;
+
+        /**
+         *  Returns the number of records published so far, including the dropped ones.
+         */
+        std::uint64_t get_published_count() const;
+
+    private:
+        change_feed(const change_feed &) = delete;
+
+        change_feed &operator=(const change_feed &) = delete;
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+        void on_preupdate(sqlite3 *db, int operation, const char *database_name, const char *table_name,
+                          sqlite3_int64 old_rowid, sqlite3_int64 new_rowid);
+#endif
+
+        void on_update(int operation, const char *database_name, const char *table_name, sqlite3_int64 rowid);
+
+        void on_trace(unsigned event, sqlite3_stmt *stmt);
+
+        void on_commit();
+
+        void on_rollback();
+
+        void publish();
+
+        enum class savepoint_statement {
+            none,
+            savepoint,
+            release,
+            rollback_to,
+        };
+
+        /**
+         *  Returns the kind of the savepoint statement and its savepoint name, or none for other statements.
+         */
+        static savepoint_statement parse_savepoint_statement(const char *sql, std::string &name);
+
+        /**
+         *  Returns the index of the innermost savepoint of the given name, or -1 if not found.
+         */
+        int find_savepoint(const std::string &name) const;
+
+        database _db;
+        change_feed_options _options;
+        std::vector<std::size_t> _listener_ids;
+
+        // the changes of the running transaction, and the committed ones waiting for the commit to complete
+        std::vector<change_record> _pending;
+        std::vector<change_record> _committed;
+
+        // the open savepoints and the numbers of the pending changes when they began
+        std::vector<std::pair<std::string, std::size_t>> _savepoints;
+
+        mutable std::mutex _mutex;
+        std::condition_variable _condition;
+        std::vector<change_record> _ring;
+        std::size_t _head;
+        std::size_t _size;
+        std::uint64_t _dropped_count;
+        std::uint64_t _published_count;
+    };
+
+#pragma mark ## change_feed ##
+
+    inline change_feed::change_feed(const database &db, const change_feed_options &options)
+            : _db(db), _options(options), _head(0), _size(0), _dropped_count(0), _published_count(0) {
+        if (_options.capacity == 0) {
+            throw std::logic_error("invalid capacity, must be > 0");
+        }
+        _ring.resize(_options.capacity);
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+        _listener_ids.push_back(_db.add_preupdate_listener(
+                [this](sqlite3 *db, int operation, const char *database_name, const char *table_name,
+                       sqlite3_int64 old_rowid, sqlite3_int64 new_rowid) {
+                    on_preupdate(db, operation, database_name, table_name, old_rowid, new_rowid);
+                }));
+#else
+        _listener_ids.push_back(_db.add_update_listener(
+                [this](int operation, const char *database_name, const char *table_name, sqlite3_int64 rowid) {
+                    on_update(operation, database_name, table_name, rowid);
+                }));
+#endif
+        _listener_ids.push_back(_db.add_commit_listener([this] {
+            on_commit();
+        }));
+        _listener_ids.push_back(_db.add_rollback_listener([this] {
+            on_rollback();
+        }));
+        _listener_ids.push_back(_db.add_trace_listener([this](unsigned event, sqlite3_stmt *stmt) {
+            on_trace(event, stmt);
+        }));
+    }
+
+    inline change_feed::~change_feed() noexcept {
+        for (auto &&id : _listener_ids) {
+            try {
+                _db.remove_listener(id);
+            } catch (...) {
+                // ignore
+            }
+        }
+    }
+
+    inline std::vector<change_record> change_feed::drain(std::size_t max_count) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<change_record> records;
+        records.reserve(std::min(max_count, _size));
+        while (_size > 0 && records.size() < max_count) {
+            records.push_back(std::move(_ring[_head]));
+            _head = (_head + 1) % _ring.size();
+            --_size;
+        }
+        return records;
+    }
+
+    template<class Rep, class Period>
+    bool change_feed::wait(const std::chrono::duration<Rep, Period> &timeout) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _condition.wait_for(lock, timeout, [this] { return _size > 0; });
+    }
+
+    inline std::size_t change_feed::size() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _size;
+    }
+
+    inline std::uint64_t change_feed::get_dropped_count() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _dropped_count;
+    }
+
+    inline std::uint64_t change_feed::get_published_count() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _published_count;
+    }
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+
+    inline void change_feed::on_preupdate(sqlite3 *db, int operation, const char *database_name,
+                                          const char *table_name, sqlite3_int64 old_rowid, sqlite3_int64 new_rowid) {
+        change_record record;
+        record.operation = operation;
+        record.database_name = database_name;
+        record.table_name = table_name;
+        record.rowid = operation == SQLITE_DELETE ? old_rowid : new_rowid;
+        record.old_rowid = operation == SQLITE_INSERT ? new_rowid : old_rowid;
+
+        if (_options.capture_values) {
+            int count = sqlite3_preupdate_count(db);
+            sqlite3_value *column;
+            if (operation != SQLITE_INSERT) {
+                record.old_values.reserve(count);
+                for (int i = 0; i < count; ++i) {
+                    sqlite3_preupdate_old(db, i, &column);
+                    record.old_values.emplace_back(column);
+                }
+            }
+            if (operation != SQLITE_DELETE) {
+                record.new_values.reserve(count);
+                for (int i = 0; i < count; ++i) {
+                    sqlite3_preupdate_new(db, i, &column);
+                    record.new_values.emplace_back(column);
+                }
+            }
+        }
+
+        _pending.push_back(std::move(record));
+    }
+
+#endif
+
+    inline void change_feed::on_update(int operation, const char *database_name, const char *table_name,
+                                       sqlite3_int64 rowid) {
+        change_record record;
+        record.operation = operation;
+        record.database_name = database_name;
+        record.table_name = table_name;
+        record.rowid = rowid;
+        record.old_rowid = rowid;
+        _pending.push_back(std::move(record));
+    }
+
+    inline void change_feed::on_trace(unsigned event, sqlite3_stmt *stmt) {
+        if (event == SQLITE_TRACE_PROFILE) {
+            // a failed commit leaves the transaction open, and a vetoed one is reported by the rollback hook
+            if (!_committed.empty() && sqlite3_get_autocommit(sqlite3_db_handle(stmt))) {
+                publish();
+            }
+            return;
+        }
+
+        std::string name;
+        switch (parse_savepoint_statement(sqlite3_sql(stmt), name)) {
+            case savepoint_statement::savepoint:
+                _savepoints.emplace_back(std::move(name), _pending.size());
+                break;
+            case savepoint_statement::release: {
+                auto index = find_savepoint(name);
+                if (index >= 0) {
+                    _savepoints.erase(_savepoints.begin() + index, _savepoints.end());
+                }
+                break;
+            }
+            case savepoint_statement::rollback_to: {
+                // the savepoint stays open after ROLLBACK TO
+                auto index = find_savepoint(name);
+                if (index >= 0) {
+                    _pending.erase(_pending.begin() + _savepoints[index].second, _pending.end());
+                    _savepoints.erase(_savepoints.begin() + index + 1, _savepoints.end());
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    inline void change_feed::on_commit() {
+        _committed.insert(_committed.end(), std::make_move_iterator(_pending.begin()),
+                          std::make_move_iterator(_pending.end()));
+        _pending.clear();
+        _savepoints.clear();
+    }
+
+    inline void change_feed::on_rollback() {
+        _pending.clear();
+        _committed.clear();
+        _savepoints.clear();
+    }
+
+    inline change_feed::savepoint_statement change_feed::parse_savepoint_statement(const char *sql,
+                                                                                   std::string &name) {
+        if (!sql) {
+            return savepoint_statement::none;
+        }
+
+        auto p = sql;
+        auto next_token = [&p]() {
+            while (std::isspace(static_cast<unsigned char>(*p))) {
+                ++p;
+            }
+
+            std::string token;
+            auto quote = *p == '[' ? ']' : *p;
+            if (quote == '"' || quote == '`' || quote == '\'' || quote == ']') {
+                // a quoted name, the quote is escaped by doubling it
+                for (++p; *p; ++p) {
+                    if (*p == quote) {
+                        if (quote != ']' && p[1] == quote) {
+                            ++p;
+                        } else {
+                            ++p;
+                            break;
+                        }
+                    }
+                    token.push_back(*p);
+                }
+                return token;
+            }
+            while (*p && (std::isalnum(static_cast<unsigned char>(*p)) || *p == '_' || *p == '$'
+                          || static_cast<unsigned char>(*p) >= 0x80)) {
+                token.push_back(static_cast<char>(std::toupper(static_cast<unsigned char>(*p))));
+                ++p;
+            }
+            return token;
+        };
+
+        auto keyword = next_token();
+        if (keyword == "SAVEPOINT") {
+            name = next_token();
+            return savepoint_statement::savepoint;
+        }
+        if (keyword == "RELEASE") {
+            auto token = next_token();
+            name = token == "SAVEPOINT" ? next_token() : token;
+            return savepoint_statement::release;
+        }
+        if (keyword == "ROLLBACK") {
+            auto token = next_token();
+            if (token == "TRANSACTION") {
+                token = next_token();
+            }
+            if (token != "TO") {
+                return savepoint_statement::none;
+            }
+            token = next_token();
+            name = token == "SAVEPOINT" ? next_token() : token;
+            return savepoint_statement::rollback_to;
+        }
+        return savepoint_statement::none;
+    }
+
+    inline int change_feed::find_savepoint(const std::string &name) const {
+        // savepoint names are case-insensitive
+        auto equals = [](const std::string &a, const std::string &b) {
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+                return std::toupper(static_cast<unsigned char>(x)) == std::toupper(static_cast<unsigned char>(y));
+            });
+        };
+        for (auto i = static_cast<int>(_savepoints.size()) - 1; i >= 0; --i) {
+            if (equals(_savepoints[i].first, name)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    inline void change_feed::publish() {
+        if (_committed.empty()) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto &&record : _committed) {
+                auto tail = (_head + _size) % _ring.size();
+                _ring[tail] = std::move(record);
+                if (_size < _ring.size()) {
+                    ++_size;
+                } else {
+                    // the ring was full, the record overwrote the oldest one
+                    _head = (_head + 1) % _ring.size();
+                    ++_dropped_count;
+                }
+            }
+            _published_count += _committed.size();
+        }
+        _committed.clear();
+        _condition.notify_all();
+    }
+}
@@ -0,0 +1,1283 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Daisuke Itabashi (itabashi.d@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "scandium.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SCANDIUM_COLUMNS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace scandium {
+    namespace columns {
+
+        /**
+         *  Describes the instruction sets the kernels can be dispatched to.
+         */
+        enum class isa {
+            /**
+             *  Portable C++ loops.
+             */
+            scalar,
+
+            /**
+             *  128-bit kernels using SSE4.2.
+             */
+            sse42,
+
+            /**
+             *  256-bit kernels using AVX2.
+             */
+            avx2,
+
+            /**
+             *  512-bit kernels using AVX-512F.
+             */
+            avx512,
+        };
+
+        /**
+         *  Describes the comparison used by filter().
+         */
+        enum class compare_op {
+            equal,
+            not_equal,
+            less,
+            less_equal,
+            greater,
+            greater_equal,
+        };
+
+        /**
+         *  Represents a contiguous buffer of values fetched from a column of a result set.
+         *
+         *  @tparam T sqlite3_int64 or double.
+         */
+        template<class T>
+        struct column {
+            static_assert(std::is_same<T, sqlite3_int64>::value || std::is_same<T, double>::value,
+                          "column supports sqlite3_int64 and double");
+
+            /**
+             *  The values, 0 for NULL.
+             */
+            std::vector<T> values;
+
+            /**
+             *  1 if the value is not NULL, or 0 otherwise.
+             */
+            std::vector<std::uint8_t> valid;
+
+            /**
+             *  The number of NULL values.
+             */
+            std::size_t null_count = 0;
+
+            /**
+             *  Returns the number of rows.
+             */
+            std::size_t size() const;
+
+            /**
+             *  Returns the validity buffer to pass to the kernels, or nullptr if there is no NULL value.
+             */
+            const std::uint8_t *validity() const;
+        };
+
+        /**
+         *  Fetches all values of a column from the result set.
+         *
+         *  @tparam T sqlite3_int64 or double.
+         *
+         *  @param results      the result set, which is rewound.
+         *  @param column_index the zero-based column index.
+         */
+        template<class T>
+        column<T> fetch(result_set results, int column_index);
+
+        /**
+         *  Returns the best instruction set supported by the CPU and the OS.
+         */
+        isa detect_isa();
+
+        /**
+         *  Returns the instruction set the kernels are dispatched to.
+         */
+        isa get_isa();
+
+        /**
+         *  Forces the kernels to be dispatched to the given instruction set,
+         *  or throws an exception if the CPU does not support it.
+         */
+        void set_isa(isa value);
+
+        /**
+         *  Returns the sum of the values, wrapping around on overflow.
+         *
+         *  @param values the values.
+         *  @param valid  1 if the value is not NULL or 0 otherwise, or nullptr if all the values are valid.
+         *  @param size   the number of values.
+         */
+        sqlite3_int64 sum(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size);
+
+        /**
+         *  Returns the sum of the values.
+         *  The vectorized kernels add in a different order, so the result may differ in the last bits.
+         *
+         *  @copydetails sum(const sqlite3_int64 *,const std::uint8_t *,std::size_t)
+         */
+        double sum(const double *values, const std::uint8_t *valid, std::size_t size);
+
+        /**
+         *  Returns the smallest valid value, or the largest representable value if there is no valid value.
+         *
+         *  @copydetails sum(const sqlite3_int64 *,const std::uint8_t *,std::size_t)
+         */
+        sqlite3_int64 min(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size);
+
+        /**
+         *  Returns the smallest valid value ignoring NaN, or infinity if there is no such value.
+         *
+         *  @copydetails sum(const sqlite3_int64 *,const std::uint8_t *,std::size_t)
+         */
+        double min(const double *values, const std::uint8_t *valid, std::size_t size);
+
+        /**
+         *  Returns the largest valid value, or the smallest representable value if there is no valid value.
+         *
+         *  @copydetails sum(const sqlite3_int64 *,const std::uint8_t *,std::size_t)
+         */
+        sqlite3_int64 max(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size);
+
+        /**
+         *  Returns the largest valid value ignoring NaN, or -infinity if there is no such value.
+         *
+         *  @copydetails sum(const sqlite3_int64 *,const std::uint8_t *,std::size_t)
+         */
+        double max(const double *values, const std::uint8_t *valid, std::size_t size);
+
+        /**
+         *  Returns the number of non-zero bytes in the validity buffer.
+         *
+         *  @param valid 1 if the value is not NULL or 0 otherwise.
+         *  @param size  the number of values.
+         */
+        std::size_t count_nonnull(const std::uint8_t *valid, std::size_t size);
+
+        /**
+         *  Writes the indexes of the valid values that satisfy "value op operand" to the selection vector.
+         *
+         *  @param values    the values.
+         *  @param valid     1 if the value is not NULL or 0 otherwise, or nullptr if all the values are valid.
+         *  @param size      the number of values, which must be < 2^32.
+         *  @param op        the comparison.
+         *  @param operand   the right hand side of the comparison.
+         *  @param selection the buffer that receives the indexes, which must have room for size elements.
+         *
+         *  @return the number of the selected indexes.
+         */
+        std::size_t filter(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size,
+                           compare_op op, sqlite3_int64 operand, std::uint32_t *selection);
+
+        /**
+         *  @copydoc filter(const sqlite3_int64 *,const std::uint8_t *,std::size_t,compare_op,sqlite3_int64,std::uint32_t *)
+         */
+        std::size_t filter(const double *values, const std::uint8_t *valid, std::size_t size,
+                           compare_op op, double operand, std::uint32_t *selection);
+
+        /**
+         *  Counts the valid values into buckets of equal width.
+         *  The values below the first bucket are counted into the first bucket,
+         *  and the values beyond the last bucket are counted into the last bucket.
+         *
+         *  @param values       the values.
+         *  @param valid        1 if the value is not NULL or 0 otherwise, or nullptr if all the values are valid.
+         *  @param size         the number of values.
+         *  @param lower        the lower bound of the first bucket.
+         *  @param width        the width of a bucket that must be > 0.
+         *  @param bucket_count the number of the buckets that must be > 0.
+         *  @param counts       the bucket_count counters, which are incremented.
+         */
+        void histogram(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size,
+                       sqlite3_int64 lower, sqlite3_int64 width, std::size_t bucket_count, std::uint64_t *counts);
+
+        /**
+         *  @copydoc histogram(const sqlite3_int64 *,const std::uint8_t *,std::size_t,sqlite3_int64,sqlite3_int64,std::size_t,std::uint64_t *)
+         *  NaN values are ignored.
+         */
+        void histogram(const double *values, const std::uint8_t *valid, std::size_t size,
+                       double lower, double width, std::size_t bucket_count, std::uint64_t *counts);
+
+        /**
+         *  Returns the sum of the column.
+         */
+        template<class T>
+        T sum(const column<T> &column);
+
+        /**
+         *  Returns the smallest value of the column.
+         */
+        template<class T>
+        T min(const column<T> &column);
+
+        /**
+         *  Returns the largest value of the column.
+         */
+        template<class T>
+        T max(const column<T> &column);
+
+        /**
+         *  Returns the number of non-NULL values of the column.
+         */
+        template<class T>
+        std::size_t count_nonnull(const column<T> &column);
+
+        /**
+         *  Returns the indexes of the rows that satisfy "value op operand".
+         */
+        template<class T>
+        std::vector<std::uint32_t> filter(const column<T> &column, compare_op op, T operand);
+
+        /**
+         *  Returns the bucket_count counters of the column.
+         */
+        template<class T>
+        std::vector<std::uint64_t> histogram(const column<T> &column, T lower, T width, std::size_t bucket_count);
+
+#pragma mark ## column ##
+
+        template<class T>
+        std::size_t column<T>::size() const {
+            return values.size();
+        }
+
+        template<class T>
+        const std::uint8_t *column<T>::validity() const {
+            return null_count == 0 ? nullptr : valid.data();
+        }
+
+        template<class T>
+        column<T> fetch(result_set results, int column_index) {
+            column<T> result;
+            for (auto &&cursor : results) {
+                if (cursor.get_column_type(column_index) == SQLITE_NULL) {
+                    result.values.push_back(T());
+                    result.valid.push_back(0);
+                    ++result.null_count;
+                } else {
+                    result.values.push_back(cursor.template get<T>(column_index));
+                    result.valid.push_back(1);
+                }
+            }
+            return result;
+        }
+
+#pragma mark ## dispatch ##
+
+        namespace detail {
+            inline std::atomic<int> &isa_override() {
+                static std::atomic<int> value(-1);
+                return value;
+            }
+
+            inline isa detect_isa_once() {
+#ifdef SCANDIUM_COLUMNS_X86
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx512f")) {
+                    return isa::avx512;
+                }
+                if (__builtin_cpu_supports("avx2")) {
+                    return isa::avx2;
+                }
+                if (__builtin_cpu_supports("sse4.2")) {
+                    return isa::sse42;
+                }
+#endif
+                return isa::scalar;
+            }
+        }
+
+        inline isa detect_isa() {
+            static const isa detected = detail::detect_isa_once();
+            return detected;
+        }
+
+        inline isa get_isa() {
+            auto value = detail::isa_override().load(std::memory_order_relaxed);
+            return value < 0 ? detect_isa() : static_cast<isa>(value);
+        }
+
+        inline void set_isa(isa value) {
+            if (static_cast<int>(value) > static_cast<int>(detect_isa())) {
+                throw std::logic_error("the instruction set is not supported by the CPU");
+            }
+            detail::isa_override().store(static_cast<int>(value), std::memory_order_relaxed);
+        }
+
+#pragma mark ## scalar kernels ##
+
+        namespace detail {
+            template<class T>
+            bool compare(compare_op op, T lhs, T rhs) {
+                switch (op) {
+                    case compare_op::equal:
+                        return lhs == rhs;
+                    case compare_op::not_equal:
+                        return lhs != rhs;
+                    case compare_op::less:
+                        return lhs < rhs;
+                    case compare_op::less_equal:
+                        return lhs <= rhs;
+                    case compare_op::greater:
+                        return lhs > rhs;
+                    case compare_op::greater_equal:
+                        return lhs >= rhs;
+                }
+                return false;
+            }
+
+            inline sqlite3_int64 scalar_sum(const sqlite3_int64 *values, const std::uint8_t *valid,
+                                            std::size_t begin, std::size_t end) {
+                std::uint64_t result = 0;
+                for (auto i = begin; i < end; ++i) {
+                    if (!valid || valid[i]) {
+                        result += static_cast<std::uint64_t>(values[i]);
+                    }
+                }
+                return static_cast<sqlite3_int64>(result);
+            }
+
+            inline double scalar_sum(const double *values, const std::uint8_t *valid,
+                                     std::size_t begin, std::size_t end) {
+                double result = 0;
+                for (auto i = begin; i < end; ++i) {
+                    if (!valid || valid[i]) {
+                        result += values[i];
+                    }
+                }
+                return result;
+            }
+
+            template<class T>
+            T scalar_min(const T *values, const std::uint8_t *valid, std::size_t begin, std::size_t end, T result) {
+                for (auto i = begin; i < end; ++i) {
+                    if ((!valid || valid[i]) && values[i] < result) {
+                        result = values[i];
+                    }
+                }
+                return result;
+            }
+
+            template<class T>
+            T scalar_max(const T *values, const std::uint8_t *valid, std::size_t begin, std::size_t end, T result) {
+                for (auto i = begin; i < end; ++i) {
+                    if ((!valid || valid[i]) && values[i] > result) {
+                        result = values[i];
+                    }
+                }
+                return result;
+            }
+
+            inline std::size_t scalar_count_nonnull(const std::uint8_t *valid, std::size_t begin, std::size_t end) {
+                std::size_t result = 0;
+                for (auto i = begin; i < end; ++i) {
+                    result += valid[i] != 0;
+                }
+                return result;
+            }
+
+            template<class T>
+            std::size_t scalar_filter(const T *values, const std::uint8_t *valid, std::size_t begin, std::size_t end,
+                                      compare_op op, T operand, std::uint32_t *selection) {
+                std::size_t count = 0;
+                for (auto i = begin; i < end; ++i) {
+                    selection[count] = static_cast<std::uint32_t>(i);
+                    count += (!valid || valid[i]) && compare(op, values[i], operand);
+                }
+                return count;
+            }
+
+            inline void scalar_histogram(const double *values, const std::uint8_t *valid,
+                                         std::size_t begin, std::size_t end,
+                                         double lower, double width, std::size_t bucket_count,
+                                         std::uint64_t *counts) {
+                auto last = static_cast<double>(bucket_count - 1);
+                for (auto i = begin; i < end; ++i) {
+                    auto q = (values[i] - lower) / width;
+                    if ((valid && !valid[i]) || q != q) {
+                        continue;
+                    }
+                    q = q < 0 ? 0 : q;
+                    q = q > last ? last : q;
+                    ++counts[static_cast<std::size_t>(q)];
+                }
+            }
+        }
+
+#ifdef SCANDIUM_COLUMNS_X86
+
+#pragma mark ## SSE4.2 kernels ##
+
+        namespace detail {
+            __attribute__((target("sse4.2")))
+            inline __m128i sse42_invalid_mask(const std::uint8_t *valid, std::size_t i) {
+                std::uint16_t bytes;
+                std::memcpy(&bytes, valid + i, sizeof(bytes));
+                auto wide = _mm_cvtepu8_epi64(_mm_cvtsi32_si128(bytes));
+                return _mm_cmpeq_epi64(wide, _mm_setzero_si128());
+            }
+
+            __attribute__((target("sse4.2")))
+            inline sqlite3_int64 sse42_sum(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size) {
+                auto acc = _mm_setzero_si128();
+                std::size_t i = 0;
+                for (; i + 2 <= size; i += 2) {
+                    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+                    if (valid) {
+                        v = _mm_andnot_si128(sse42_invalid_mask(valid, i), v);
+                    }
+                    acc = _mm_add_epi64(acc, v);
+                }
+                sqlite3_int64 lanes[2];
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+                return static_cast<sqlite3_int64>(static_cast<std::uint64_t>(lanes[0])
+                                                  + static_cast<std::uint64_t>(lanes[1])
+                                                  + static_cast<std::uint64_t>(scalar_sum(values, valid, i, size)));
+            }
+
+            __attribute__((target("sse4.2")))
+            inline double sse42_sum(const double *values, const std::uint8_t *valid, std::size_t size) {
+                auto acc = _mm_setzero_pd();
+                std::size_t i = 0;
+                for (; i + 2 <= size; i += 2) {
+                    auto v = _mm_loadu_pd(values + i);
+                    if (valid) {
+                        v = _mm_andnot_pd(_mm_castsi128_pd(sse42_invalid_mask(valid, i)), v);
+                    }
+                    acc = _mm_add_pd(acc, v);
+                }
+                double lanes[2];
+                _mm_storeu_pd(lanes, acc);
+                return lanes[0] + lanes[1] + scalar_sum(values, valid, i, size);
+            }
+
+            template<bool Min>
+            __attribute__((target("sse4.2")))
+            sqlite3_int64 sse42_extremum(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size) {
+                const auto identity = Min ? std::numeric_limits<sqlite3_int64>::max()
+                                          : std::numeric_limits<sqlite3_int64>::min();
+                auto fill = _mm_set1_epi64x(identity);
+                auto acc = fill;
+                std::size_t i = 0;
+                for (; i + 2 <= size; i += 2) {
+                    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+                    if (valid) {
+                        v = _mm_blendv_epi8(v, fill, sse42_invalid_mask(valid, i));
+                    }
+                    auto replace = Min ? _mm_cmpgt_epi64(acc, v) : _mm_cmpgt_epi64(v, acc);
+                    acc = _mm_blendv_epi8(acc, v, replace);
+                }
+                sqlite3_int64 lanes[2];
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+                return Min ? scalar_min(lanes, nullptr, 0, 2, scalar_min(values, valid, i, size, identity))
+                           : scalar_max(lanes, nullptr, 0, 2, scalar_max(values, valid, i, size, identity));
+            }
+
+            template<bool Min>
+            __attribute__((target("sse4.2")))
+            double sse42_extremum(const double *values, const std::uint8_t *valid, std::size_t size) {
+                const auto identity = Min ? std::numeric_limits<double>::infinity()
+                                          : -std::numeric_limits<double>::infinity();
+                auto fill = _mm_set1_pd(identity);
+                auto acc = fill;
+                std::size_t i = 0;
+                for (; i + 2 <= size; i += 2) {
+                    auto v = _mm_loadu_pd(values + i);
+                    if (valid) {
+                        v = _mm_blendv_pd(v, fill, _mm_castsi128_pd(sse42_invalid_mask(valid, i)));
+                    }
+                    // the second operand is returned when the first one is NaN
+                    acc = Min ? _mm_min_pd(v, acc) : _mm_max_pd(v, acc);
+                }
+                double lanes[2];
+                _mm_storeu_pd(lanes, acc);
+                return Min ? scalar_min(lanes, nullptr, 0, 2, scalar_min(values, valid, i, size, identity))
+                           : scalar_max(lanes, nullptr, 0, 2, scalar_max(values, valid, i, size, identity));
+            }
+
+            __attribute__((target("sse4.2")))
+            inline std::size_t sse42_count_nonnull(const std::uint8_t *valid, std::size_t size) {
+                auto ones = _mm_set1_epi8(1);
+                auto acc = _mm_setzero_si128();
+                std::size_t i = 0;
+                for (; i + 16 <= size; i += 16) {
+                    auto v = _mm_min_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(valid + i)), ones);
+                    acc = _mm_add_epi64(acc, _mm_sad_epu8(v, _mm_setzero_si128()));
+                }
+                std::uint64_t lanes[2];
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+                return static_cast<std::size_t>(lanes[0] + lanes[1]) + scalar_count_nonnull(valid, i, size);
+            }
+
+            template<compare_op Op>
+            __attribute__((target("sse4.2")))
+            __m128i sse42_compare(__m128i v, __m128i operand) {
+                auto all = _mm_set1_epi64x(-1);
+                switch (Op) {
+                    case compare_op::equal:
+                        return _mm_cmpeq_epi64(v, operand);
+                    case compare_op::not_equal:
+                        return _mm_xor_si128(_mm_cmpeq_epi64(v, operand), all);
+                    case compare_op::less:
+                        return _mm_cmpgt_epi64(operand, v);
+                    case compare_op::less_equal:
+                        return _mm_xor_si128(_mm_cmpgt_epi64(v, operand), all);
+                    case compare_op::greater:
+                        return _mm_cmpgt_epi64(v, operand);
+                    case compare_op::greater_equal:
+                        return _mm_xor_si128(_mm_cmpgt_epi64(operand, v), all);
+                }
+                return _mm_setzero_si128();
+            }
+
+            template<compare_op Op>
+            __attribute__((target("sse4.2")))
+            __m128d sse42_compare(__m128d v, __m128d operand) {
+                switch (Op) {
+                    case compare_op::equal:
+                        return _mm_cmpeq_pd(v, operand);
+                    case compare_op::not_equal:
+                        return _mm_cmpneq_pd(v, operand);
+                    case compare_op::less:
+                        return _mm_cmplt_pd(v, operand);
+                    case compare_op::less_equal:
+                        return _mm_cmple_pd(v, operand);
+                    case compare_op::greater:
+                        return _mm_cmpgt_pd(v, operand);
+                    case compare_op::greater_equal:
+                        return _mm_cmpge_pd(v, operand);
+                }
+                return _mm_setzero_pd();
+            }
+
+            template<compare_op Op>
+            __attribute__((target("sse4.2")))
+            std::size_t sse42_filter(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size,
+                                     sqlite3_int64 operand, std::uint32_t *selection) {
+                auto rhs = _mm_set1_epi64x(operand);
+                std::size_t count = 0;
+                std::size_t i = 0;
+                for (; i + 2 <= size; i += 2) {
+                    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+                    auto match = sse42_compare<Op>(v, rhs);
+                    if (valid) {
+                        match = _mm_andnot_si128(sse42_invalid_mask(valid, i), match);
+                    }
+                    auto bits = _mm_movemask_pd(_mm_castsi128_pd(match));
+                    selection[count] = static_cast<std::uint32_t>(i);
+                    count += bits & 1;
+                    selection[count] = static_cast<std::uint32_t>(i + 1);
+                    count += (bits >> 1) & 1;
+                }
+                return count + scalar_filter(values, valid, i, size, Op, operand, selection + count);
+            }
+
+            template<compare_op Op>
+            __attribute__((target("sse4.2")))
+            std::size_t sse42_filter(const double *values, const std::uint8_t *valid, std::size_t size,
+                                     double operand, std::uint32_t *selection) {
+                auto rhs = _mm_set1_pd(operand);
+                std::size_t count = 0;
+                std::size_t i = 0;
+                for (; i + 2 <= size; i += 2) {
+                    auto match = sse42_compare<Op>(_mm_loadu_pd(values + i), rhs);
+                    if (valid) {
+                        match = _mm_andnot_pd(_mm_castsi128_pd(sse42_invalid_mask(valid, i)), match);
+                    }
+                    auto bits = _mm_movemask_pd(match);
+                    selection[count] = static_cast<std::uint32_t>(i);
+                    count += bits & 1;
+                    selection[count] = static_cast<std::uint32_t>(i + 1);
+                    count += (bits >> 1) & 1;
+                }
+                return count + scalar_filter(values, valid, i, size, Op, operand, selection + count);
+            }
+
+            __attribute__((target("sse4.2")))
+            inline void sse42_histogram(const double *values, const std::uint8_t *valid, std::size_t size,
+                                        double lower, double width, std::size_t bucket_count,
+                                        std::uint64_t *counts) {
+                auto lo = _mm_set1_pd(lower);
+                auto w = _mm_set1_pd(width);
+                auto zero = _mm_setzero_pd();
+                auto last = _mm_set1_pd(static_cast<double>(bucket_count - 1));
+                std::size_t i = 0;
+                for (; i + 2 <= size; i += 2) {
+                    auto q = _mm_div_pd(_mm_sub_pd(_mm_loadu_pd(values + i), lo), w);
+                    auto take = _mm_cmpord_pd(q, q);
+                    if (valid) {
+                        take = _mm_andnot_pd(_mm_castsi128_pd(sse42_invalid_mask(valid, i)), take);
+                    }
+                    q = _mm_min_pd(_mm_max_pd(q, zero), last);
+                    std::int32_t buckets[4];
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(buckets), _mm_cvttpd_epi32(q));
+                    auto bits = _mm_movemask_pd(take);
+                    counts[buckets[0]] += bits & 1;
+                    counts[buckets[1]] += (bits >> 1) & 1;
+                }
+                scalar_histogram(values, valid, i, size, lower, width, bucket_count, counts);
+            }
+
+#pragma mark ## AVX2 kernels ##
+
+            __attribute__((target("avx2")))
+            inline __m256i avx2_invalid_mask(const std::uint8_t *valid, std::size_t i) {
+                std::int32_t bytes;
+                std::memcpy(&bytes, valid + i, sizeof(bytes));
+                auto wide = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(bytes));
+                return _mm256_cmpeq_epi64(wide, _mm256_setzero_si256());
+            }
+
+            __attribute__((target("avx2")))
+            inline sqlite3_int64 avx2_sum(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size) {
+                auto acc = _mm256_setzero_si256();
+                std::size_t i = 0;
+                for (; i + 4 <= size; i += 4) {
+                    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+                    if (valid) {
+                        v = _mm256_andnot_si256(avx2_invalid_mask(valid, i), v);
+                    }
+                    acc = _mm256_add_epi64(acc, v);
+                }
+                std::uint64_t lanes[4];
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+                return static_cast<sqlite3_int64>(lanes[0] + lanes[1] + lanes[2] + lanes[3]
+                                                  + static_cast<std::uint64_t>(scalar_sum(values, valid, i, size)));
+            }
+
+            __attribute__((target("avx2")))
+            inline double avx2_sum(const double *values, const std::uint8_t *valid, std::size_t size) {
+                auto acc = _mm256_setzero_pd();
+                std::size_t i = 0;
+                for (; i + 4 <= size; i += 4) {
+                    auto v = _mm256_loadu_pd(values + i);
+                    if (valid) {
+                        v = _mm256_andnot_pd(_mm256_castsi256_pd(avx2_invalid_mask(valid, i)), v);
+                    }
+                    acc = _mm256_add_pd(acc, v);
+                }
+                double lanes[4];
+                _mm256_storeu_pd(lanes, acc);
+                return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + scalar_sum(values, valid, i, size);
+            }
+
+            template<bool Min>
+            __attribute__((target("avx2")))
+            sqlite3_int64 avx2_extremum(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size) {
+                const auto identity = Min ? std::numeric_limits<sqlite3_int64>::max()
+                                          : std::numeric_limits<sqlite3_int64>::min();
+                auto fill = _mm256_set1_epi64x(identity);
+                auto acc = fill;
+                std::size_t i = 0;
+                for (; i + 4 <= size; i += 4) {
+                    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+                    if (valid) {
+                        v = _mm256_blendv_epi8(v, fill, avx2_invalid_mask(valid, i));
+                    }
+                    auto replace = Min ? _mm256_cmpgt_epi64(acc, v) : _mm256_cmpgt_epi64(v, acc);
+                    acc = _mm256_blendv_epi8(acc, v, replace);
+                }
+                sqlite3_int64 lanes[4];
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+                return Min ? scalar_min(lanes, nullptr, 0, 4, scalar_min(values, valid, i, size, identity))
+                           : scalar_max(lanes, nullptr, 0, 4, scalar_max(values, valid, i, size, identity));
+            }
+
+            template<bool Min>
+            __attribute__((target("avx2")))
+            double avx2_extremum(const double *values, const std::uint8_t *valid, std::size_t size) {
+                const auto identity = Min ? std::numeric_limits<double>::infinity()
+                                          : -std::numeric_limits<double>::infinity();
+                auto fill = _mm256_set1_pd(identity);
+                auto acc = fill;
+                std::size_t i = 0;
+                for (; i + 4 <= size; i += 4) {
+                    auto v = _mm256_loadu_pd(values + i);
+                    if (valid) {
+                        v = _mm256_blendv_pd(v, fill, _mm256_castsi256_pd(avx2_invalid_mask(valid, i)));
+                    }
+                    acc = Min ? _mm256_min_pd(v, acc) : _mm256_max_pd(v, acc);
+                }
+                double lanes[4];
+                _mm256_storeu_pd(lanes, acc);
+                return Min ? scalar_min(lanes, nullptr, 0, 4, scalar_min(values, valid, i, size, identity))
+                           : scalar_max(lanes, nullptr, 0, 4, scalar_max(values, valid, i, size, identity));
+            }
+
+            __attribute__((target("avx2")))
+            inline std::size_t avx2_count_nonnull(const std::uint8_t *valid, std::size_t size) {
+                auto ones = _mm256_set1_epi8(1);
+                auto acc = _mm256_setzero_si256();
+                std::size_t i = 0;
+                for (; i + 32 <= size; i += 32) {
+                    auto v = _mm256_min_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(valid + i)), ones);
+                    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, _mm256_setzero_si256()));
+                }
+                std::uint64_t lanes[4];
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+                return static_cast<std::size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3])
+                       + scalar_count_nonnull(valid, i, size);
+            }
+
+            template<compare_op Op>
+            __attribute__((target("avx2")))
+            __m256i avx2_compare(__m256i v, __m256i operand) {
+                auto all = _mm256_set1_epi64x(-1);
+                switch (Op) {
+                    case compare_op::equal:
+                        return _mm256_cmpeq_epi64(v, operand);
+                    case compare_op::not_equal:
+                        return _mm256_xor_si256(_mm256_cmpeq_epi64(v, operand), all);
+                    case compare_op::less:
+                        return _mm256_cmpgt_epi64(operand, v);
+                    case compare_op::less_equal:
+                        return _mm256_xor_si256(_mm256_cmpgt_epi64(v, operand), all);
+                    case compare_op::greater:
+                        return _mm256_cmpgt_epi64(v, operand);
+                    case compare_op::greater_equal:
+                        return _mm256_xor_si256(_mm256_cmpgt_epi64(operand, v), all);
+                }
+                return _mm256_setzero_si256();
+            }
+
+            template<compare_op Op>
+            __attribute__((target("avx2")))
+            __m256d avx2_compare(__m256d v, __m256d operand) {
+                switch (Op) {
+                    case compare_op::equal:
+                        return _mm256_cmp_pd(v, operand, _CMP_EQ_OQ);
+                    case compare_op::not_equal:
+                        return _mm256_cmp_pd(v, operand, _CMP_NEQ_UQ);
+                    case compare_op::less:
+                        return _mm256_cmp_pd(v, operand, _CMP_LT_OQ);
+                    case compare_op::less_equal:
+                        return _mm256_cmp_pd(v, operand, _CMP_LE_OQ);
+                    case compare_op::greater:
+                        return _mm256_cmp_pd(v, operand, _CMP_GT_OQ);
+                    case compare_op::greater_equal:
+                        return _mm256_cmp_pd(v, operand, _CMP_GE_OQ);
+                }
+                return _mm256_setzero_pd();
+            }
+
+            inline std::size_t append_selection(int bits, int lanes, std::size_t base,
+                                                std::uint32_t *selection, std::size_t count) {
+                for (int lane = 0; lane < lanes; ++lane) {
+                    selection[count] = static_cast<std::uint32_t>(base + lane);
+                    count += (bits >> lane) & 1;
+                }
+                return count;
+            }
+
+            template<compare_op Op>
+            __attribute__((target("avx2")))
+            std::size_t avx2_filter(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size,
+                                    sqlite3_int64 operand, std::uint32_t *selection) {
+                auto rhs = _mm256_set1_epi64x(operand);
+                std::size_t count = 0;
+                std::size_t i = 0;
+                for (; i + 4 <= size; i += 4) {
+                    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+                    auto match = avx2_compare<Op>(v, rhs);
+                    if (valid) {
+                        match = _mm256_andnot_si256(avx2_invalid_mask(valid, i), match);
+                    }
+                    count = append_selection(_mm256_movemask_pd(_mm256_castsi256_pd(match)), 4, i, selection, count);
+                }
+                return count + scalar_filter(values, valid, i, size, Op, operand, selection + count);
+            }
+
+            template<compare_op Op>
+            __attribute__((target("avx2")))
+            std::size_t avx2_filter(const double *values, const std::uint8_t *valid, std::size_t size,
+                                    double operand, std::uint32_t *selection) {
+                auto rhs = _mm256_set1_pd(operand);
+                std::size_t count = 0;
+                std::size_t i = 0;
+                for (; i + 4 <= size; i += 4) {
+                    auto match = avx2_compare<Op>(_mm256_loadu_pd(values + i), rhs);
+                    if (valid) {
+                        match = _mm256_andnot_pd(_mm256_castsi256_pd(avx2_invalid_mask(valid, i)), match);
+                    }
+                    count = append_selection(_mm256_movemask_pd(match), 4, i, selection, count);
+                }
+                return count + scalar_filter(values, valid, i, size, Op, operand, selection + count);
+            }
+
+            __attribute__((target("avx2")))
+            inline void avx2_histogram(const double *values, const std::uint8_t *valid, std::size_t size,
+                                       double lower, double width, std::size_t bucket_count,
+                                       std::uint64_t *counts) {
+                auto lo = _mm256_set1_pd(lower);
+                auto w = _mm256_set1_pd(width);
+                auto zero = _mm256_setzero_pd();
+                auto last = _mm256_set1_pd(static_cast<double>(bucket_count - 1));
+                std::size_t i = 0;
+                for (; i + 4 <= size; i += 4) {
+                    auto q = _mm256_div_pd(_mm256_sub_pd(_mm256_loadu_pd(values + i), lo), w);
+                    auto take = _mm256_cmp_pd(q, q, _CMP_ORD_Q);
+                    if (valid) {
+                        take = _mm256_andnot_pd(_mm256_castsi256_pd(avx2_invalid_mask(valid, i)), take);
+                    }
+                    q = _mm256_min_pd(_mm256_max_pd(q, zero), last);
+                    std::int32_t buckets[4];
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(buckets), _mm256_cvttpd_epi32(q));
+                    auto bits = _mm256_movemask_pd(take);
+                    for (int lane = 0; lane < 4; ++lane) {
+                        counts[buckets[lane]] += (bits >> lane) & 1;
+                    }
+                }
+                scalar_histogram(values, valid, i, size, lower, width, bucket_count, counts);
+            }
+
+#pragma mark ## AVX-512 kernels ##
+
+            __attribute__((target("avx512f")))
+            inline __mmask8 avx512_valid_mask(const std::uint8_t *valid, std::size_t i) {
+                if (!valid) {
+                    return 0xff;
+                }
+                auto wide = _mm512_cvtepu8_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(valid + i)));
+                return _mm512_test_epi64_mask(wide, wide);
+            }
+
+            __attribute__((target("avx512f")))
+            inline sqlite3_int64 avx512_sum(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size) {
+                auto acc = _mm512_setzero_si512();
+                std::size_t i = 0;
+                for (; i + 8 <= size; i += 8) {
+                    auto v = _mm512_loadu_si512(values + i);
+                    acc = _mm512_mask_add_epi64(acc, avx512_valid_mask(valid, i), acc, v);
+                }
+                return static_cast<sqlite3_int64>(static_cast<std::uint64_t>(_mm512_reduce_add_epi64(acc))
+                                                  + static_cast<std::uint64_t>(scalar_sum(values, valid, i, size)));
+            }
+
+            __attribute__((target("avx512f")))
+            inline double avx512_sum(const double *values, const std::uint8_t *valid, std::size_t size) {
+                auto acc = _mm512_setzero_pd();
+                std::size_t i = 0;
+                for (; i + 8 <= size; i += 8) {
+                    auto v = _mm512_loadu_pd(values + i);
+                    acc = _mm512_mask_add_pd(acc, avx512_valid_mask(valid, i), acc, v);
+                }
+                return _mm512_reduce_add_pd(acc) + scalar_sum(values, valid, i, size);
+            }
+
+            template<bool Min>
+            __attribute__((target("avx512f")))
+            sqlite3_int64 avx512_extremum(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size) {
+                const auto identity = Min ? std::numeric_limits<sqlite3_int64>::max()
+                                          : std::numeric_limits<sqlite3_int64>::min();
+                auto acc = _mm512_set1_epi64(identity);
+                std::size_t i = 0;
+                for (; i + 8 <= size; i += 8) {
+                    auto v = _mm512_loadu_si512(values + i);
+                    auto k = avx512_valid_mask(valid, i);
+                    acc = Min ? _mm512_mask_min_epi64(acc, k, acc, v) : _mm512_mask_max_epi64(acc, k, acc, v);
+                }
+                return Min ? scalar_min(values, valid, i, size, static_cast<sqlite3_int64>(_mm512_reduce_min_epi64(acc)))
+                           : scalar_max(values, valid, i, size, static_cast<sqlite3_int64>(_mm512_reduce_max_epi64(acc)));
+            }
+
+            template<bool Min>
+            __attribute__((target("avx512f")))
+            double avx512_extremum(const double *values, const std::uint8_t *valid, std::size_t size) {
+                const auto identity = Min ? std::numeric_limits<double>::infinity()
+                                          : -std::numeric_limits<double>::infinity();
+                auto acc = _mm512_set1_pd(identity);
+                std::size_t i = 0;
+                for (; i + 8 <= size; i += 8) {
+                    auto v = _mm512_loadu_pd(values + i);
+                    auto k = avx512_valid_mask(valid, i);
+                    acc = Min ? _mm512_mask_min_pd(acc, k, v, acc) : _mm512_mask_max_pd(acc, k, v, acc);
+                }
+                double lanes[8];
+                _mm512_storeu_pd(lanes, acc);
+                return Min ? scalar_min(lanes, nullptr, 0, 8, scalar_min(values, valid, i, size, identity))
+                           : scalar_max(lanes, nullptr, 0, 8, scalar_max(values, valid, i, size, identity));
+            }
+
+            template<compare_op Op>
+            struct avx512_predicate;
+
+            template<>
+            struct avx512_predicate<compare_op::equal> {
+                static const int integer = _MM_CMPINT_EQ;
+                static const int floating = _CMP_EQ_OQ;
+            };
+
+            template<>
+            struct avx512_predicate<compare_op::not_equal> {
+                static const int integer = _MM_CMPINT_NE;
+                static const int floating = _CMP_NEQ_UQ;
+            };
+
+            template<>
+            struct avx512_predicate<compare_op::less> {
+                static const int integer = _MM_CMPINT_LT;
+                static const int floating = _CMP_LT_OQ;
+            };
+
+            template<>
+            struct avx512_predicate<compare_op::less_equal> {
+                static const int integer = _MM_CMPINT_LE;
+                static const int floating = _CMP_LE_OQ;
+            };
+
+            template<>
+            struct avx512_predicate<compare_op::greater> {
+                static const int integer = _MM_CMPINT_NLE;
+                static const int floating = _CMP_GT_OQ;
+            };
+
+            template<>
+            struct avx512_predicate<compare_op::greater_equal> {
+                static const int integer = _MM_CMPINT_NLT;
+                static const int floating = _CMP_GE_OQ;
+            };
+
+            __attribute__((target("avx512f")))
+            inline __mmask16 avx512_valid_mask16(const std::uint8_t *valid, std::size_t i) {
+                if (!valid) {
+                    return 0xffff;
+                }
+                auto wide = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(valid + i)));
+                return _mm512_test_epi32_mask(wide, wide);
+            }
+
+            template<compare_op Op>
+            __attribute__((target("avx512f")))
+            std::size_t avx512_filter(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size,
+                                      sqlite3_int64 operand, std::uint32_t *selection) {
+                auto rhs = _mm512_set1_epi64(operand);
+                auto iota = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+                std::size_t count = 0;
+                std::size_t i = 0;
+                for (; i + 16 <= size; i += 16) {
+                    auto lo = _mm512_cmp_epi64_mask(_mm512_loadu_si512(values + i), rhs,
+                                                    avx512_predicate<Op>::integer);
+                    auto hi = _mm512_cmp_epi64_mask(_mm512_loadu_si512(values + i + 8), rhs,
+                                                    avx512_predicate<Op>::integer);
+                    auto k = static_cast<__mmask16>((lo | (hi << 8)) & avx512_valid_mask16(valid, i));
+                    auto indexes = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(i)), iota);
+                    _mm512_mask_compressstoreu_epi32(selection + count, k, indexes);
+                    count += __builtin_popcount(k);
+                }
+                return count + scalar_filter(values, valid, i, size, Op, operand, selection + count);
+            }
+
+            template<compare_op Op>
+            __attribute__((target("avx512f")))
+            std::size_t avx512_filter(const double *values, const std::uint8_t *valid, std::size_t size,
+                                      double operand, std::uint32_t *selection) {
+                auto rhs = _mm512_set1_pd(operand);
+                auto iota = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+                std::size_t count = 0;
+                std::size_t i = 0;
+                for (; i + 16 <= size; i += 16) {
+                    auto lo = _mm512_cmp_pd_mask(_mm512_loadu_pd(values + i), rhs, avx512_predicate<Op>::floating);
+                    auto hi = _mm512_cmp_pd_mask(_mm512_loadu_pd(values + i + 8), rhs, avx512_predicate<Op>::floating);
+                    auto k = static_cast<__mmask16>((lo | (hi << 8)) & avx512_valid_mask16(valid, i));
+                    auto indexes = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(i)), iota);
+                    _mm512_mask_compressstoreu_epi32(selection + count, k, indexes);
+                    count += __builtin_popcount(k);
+                }
+                return count + scalar_filter(values, valid, i, size, Op, operand, selection + count);
+            }
+
+            __attribute__((target("avx512f")))
+            inline void avx512_histogram(const double *values, const std::uint8_t *valid, std::size_t size,
+                                         double lower, double width, std::size_t bucket_count,
+                                         std::uint64_t *counts) {
+                auto lo = _mm512_set1_pd(lower);
+                auto w = _mm512_set1_pd(width);
+                auto zero = _mm512_setzero_pd();
+                auto last = _mm512_set1_pd(static_cast<double>(bucket_count - 1));
+                std::size_t i = 0;
+                for (; i + 8 <= size; i += 8) {
+                    auto q = _mm512_div_pd(_mm512_sub_pd(_mm512_loadu_pd(values + i), lo), w);
+                    auto take = _mm512_cmp_pd_mask(q, q, _CMP_ORD_Q) & avx512_valid_mask(valid, i);
+                    q = _mm512_min_pd(_mm512_max_pd(q, zero), last);
+                    std::int32_t buckets[8];
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(buckets), _mm512_cvttpd_epi32(q));
+                    for (int lane = 0; lane < 8; ++lane) {
+                        counts[buckets[lane]] += (take >> lane) & 1;
+                    }
+                }
+                scalar_histogram(values, valid, i, size, lower, width, bucket_count, counts);
+            }
+        }
+
+#endif // SCANDIUM_COLUMNS_X86
+
+#pragma mark ## kernels ##
+
+        namespace detail {
+            template<class T>
+            T sum(const T *values, const std::uint8_t *valid, std::size_t size) {
+                switch (get_isa()) {
+#ifdef SCANDIUM_COLUMNS_X86
+                    case isa::avx512:
+                        return avx512_sum(values, valid, size);
+                    case isa::avx2:
+                        return avx2_sum(values, valid, size);
+                    case isa::sse42:
+                        return sse42_sum(values, valid, size);
+#endif
+                    default:
+                        return scalar_sum(values, valid, 0, size);
+                }
+            }
+
+            template<bool Min, class T>
+            T extremum(const T *values, const std::uint8_t *valid, std::size_t size) {
+                switch (get_isa()) {
+#ifdef SCANDIUM_COLUMNS_X86
+                    case isa::avx512:
+                        return avx512_extremum<Min>(values, valid, size);
+                    case isa::avx2:
+                        return avx2_extremum<Min>(values, valid, size);
+                    case isa::sse42:
+                        return sse42_extremum<Min>(values, valid, size);
+#endif
+                    default:
+                        break;
+                }
+
+                if (Min) {
+                    auto identity = std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity()
+                                                                         : std::numeric_limits<T>::max();
+                    return scalar_min(values, valid, 0, size, identity);
+                } else {
+                    auto identity = std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity()
+                                                                         : std::numeric_limits<T>::min();
+                    return scalar_max(values, valid, 0, size, identity);
+                }
+            }
+
+            template<compare_op Op, class T>
+            std::size_t filter(const T *values, const std::uint8_t *valid, std::size_t size,
+                               T operand, std::uint32_t *selection) {
+                switch (get_isa()) {
+#ifdef SCANDIUM_COLUMNS_X86
+                    case isa::avx512:
+                        return avx512_filter<Op>(values, valid, size, operand, selection);
+                    case isa::avx2:
+                        return avx2_filter<Op>(values, valid, size, operand, selection);
+                    case isa::sse42:
+                        return sse42_filter<Op>(values, valid, size, operand, selection);
+#endif
+                    default:
+                        return scalar_filter(values, valid, 0, size, Op, operand, selection);
+                }
+            }
+
+            template<class T>
+            std::size_t filter(const T *values, const std::uint8_t *valid, std::size_t size,
+                               compare_op op, T operand, std::uint32_t *selection) {
+                switch (op) {
+                    case compare_op::equal:
+                        return filter<compare_op::equal>(values, valid, size, operand, selection);
+                    case compare_op::not_equal:
+                        return filter<compare_op::not_equal>(values, valid, size, operand, selection);
+                    case compare_op::less:
+                        return filter<compare_op::less>(values, valid, size, operand, selection);
+                    case compare_op::less_equal:
+                        return filter<compare_op::less_equal>(values, valid, size, operand, selection);
+                    case compare_op::greater:
+                        return filter<compare_op::greater>(values, valid, size, operand, selection);
+                    case compare_op::greater_equal:
+                        return filter<compare_op::greater_equal>(values, valid, size, operand, selection);
+                }
+                return 0;
+            }
+        }
+
+        inline sqlite3_int64 sum(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size) {
+            return detail::sum(values, valid, size);
+        }
+
+        inline double sum(const double *values, const std::uint8_t *valid, std::size_t size) {
+            return detail::sum(values, valid, size);
+        }
+
+        inline sqlite3_int64 min(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size) {
+            return detail::extremum<true>(values, valid, size);
+        }
+
+        inline double min(const double *values, const std::uint8_t *valid, std::size_t size) {
+            return detail::extremum<true>(values, valid, size);
+        }
+
+        inline sqlite3_int64 max(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size) {
+            return detail::extremum<false>(values, valid, size);
+        }
+
+        inline double max(const double *values, const std::uint8_t *valid, std::size_t size) {
+            return detail::extremum<false>(values, valid, size);
+        }
+
+        inline std::size_t count_nonnull(const std::uint8_t *valid, std::size_t size) {
+            switch (get_isa()) {
+#ifdef SCANDIUM_COLUMNS_X86
+                case isa::avx512:
+                case isa::avx2:
+                    return detail::avx2_count_nonnull(valid, size);
+                case isa::sse42:
+                    return detail::sse42_count_nonnull(valid, size);
+#endif
+                default:
+                    return detail::scalar_count_nonnull(valid, 0, size);
+            }
+        }
+
+        inline std::size_t filter(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size,
+                                  compare_op op, sqlite3_int64 operand, std::uint32_t *selection) {
+            return detail::filter(values, valid, size, op, operand, selection);
+        }
+
+        inline std::size_t filter(const double *values, const std::uint8_t *valid, std::size_t size,
+                                  compare_op op, double operand, std::uint32_t *selection) {
+            return detail::filter(values, valid, size, op, operand, selection);
+        }
+
+        inline void histogram(const sqlite3_int64 *values, const std::uint8_t *valid, std::size_t size,
+                              sqlite3_int64 lower, sqlite3_int64 width, std::size_t bucket_count,
+                              std::uint64_t *counts) {
+            if (width <= 0 || bucket_count == 0) {
+                throw std::logic_error("invalid histogram, width and bucket_count must be > 0");
+            }
+
+            // there is no vector integer division, so unroll over independent counters instead
+            std::vector<std::uint64_t> partial(bucket_count * 4);
+            auto last = static_cast<std::uint64_t>(bucket_count - 1);
+            auto bucket_of = [&](sqlite3_int64 value) -> std::size_t {
+                if (value < lower) {
+                    return 0;
+                }
+                auto q = (static_cast<std::uint64_t>(value) - static_cast<std::uint64_t>(lower))
+                         / static_cast<std::uint64_t>(width);
+                return static_cast<std::size_t>(q > last ? last : q);
+            };
+
+            std::size_t i = 0;
+            for (; i + 4 <= size; i += 4) {
+                for (std::size_t lane = 0; lane < 4; ++lane) {
+                    partial[lane * bucket_count + bucket_of(values[i + lane])] += !valid || valid[i + lane];
+                }
+            }
+            for (; i < size; ++i) {
+                partial[bucket_of(values[i])] += !valid || valid[i];
+            }
+
+            for (std::size_t b = 0; b < bucket_count; ++b) {
+                counts[b] += partial[b] + partial[bucket_count + b]
+                             + partial[2 * bucket_count + b] + partial[3 * bucket_count + b];
+            }
+        }
+
+        inline void histogram(const double *values, const std::uint8_t *valid, std::size_t size,
+                              double lower, double width, std::size_t bucket_count, std::uint64_t *counts) {
+            if (!(width > 0) || bucket_count == 0) {
+                throw std::logic_error("invalid histogram, width and bucket_count must be > 0");
+            }
+
+            switch (get_isa()) {
+#ifdef SCANDIUM_COLUMNS_X86
+                case isa::avx512:
+                    detail::avx512_histogram(values, valid, size, lower, width, bucket_count, counts);
+                    break;
+                case isa::avx2:
+                    detail::avx2_histogram(values, valid, size, lower, width, bucket_count, counts);
+                    break;
+                case isa::sse42:
+                    detail::sse42_histogram(values, valid, size, lower, width, bucket_count, counts);
+                    break;
+#endif
+                default:
+                    detail::scalar_histogram(values, valid, 0, size, lower, width, bucket_count, counts);
+                    break;
+            }
+        }
+
+#pragma mark ## column kernels ##
+
+        template<class T>
+        T sum(const column<T> &column) {
+            return sum(column.values.data(), column.validity(), column.size());
+        }
+
+        template<class T>
+        T min(const column<T> &column) {
+            return min(column.values.data(), column.validity(), column.size());
+        }
+
+        template<class T>
+        T max(const column<T> &column) {
+            return max(column.values.data(), column.validity(), column.size());
+        }
+
+        template<class T>
+        std::size_t count_nonnull(const column<T> &column) {
+            return column.size() - column.null_count;
+        }
+
+        template<class T>
+        std::vector<std::uint32_t> filter(const column<T> &column, compare_op op, T operand) {
+            std::vector<std::uint32_t> selection(column.size());
+            auto count = filter(column.values.data(), column.validity(), column.size(), op, operand,
+                                selection.data());
+            selection.resize(count);
+            return selection;
+        }
+
+        template<class T>
+        std::vector<std::uint64_t> histogram(const column<T> &column, T lower, T width, std::size_t bucket_count) {
+            std::vector<std::uint64_t> counts(bucket_count);
+            histogram(column.values.data(), column.validity(), column.size(), lower, width, bucket_count,
+                      counts.data());
+            return counts;
+        }
+    }
+}
@@ -0,0 +1,762 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Daisuke Itabashi (itabashi.d@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#pragma once
+
+#if __cplusplus >= 202002L
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "scandium.h"
+
+namespace scandium {
+
+    template<class T>
+    class task;
+
+    namespace detail {
+        template<class T>
+        struct task_promise;
+
+        struct task_promise_base {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr error;
+
+            struct final_awaiter {
+                bool await_ready() const noexcept {
+                    return false;
+                }
+
+                template<class Promise>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                    auto continuation = handle.promise().continuation;
+                    return continuation ? continuation : std::noop_coroutine();
+                }
+
+                void await_resume() noexcept {
+                }
+            };
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            final_awaiter final_suspend() noexcept {
+                return {};
+            }
+
+            void unhandled_exception() noexcept {
+                error = std::current_exception();
+            }
+        };
+
+        template<class T>
+        struct task_promise : task_promise_base {
+            std::optional<T> result;
+
+            task<T> get_return_object() noexcept;
+
+            template<class U>
+            void return_value(U &&value) {
+                result.emplace(std::forward<U>(value));
+            }
+
+            T take() {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+                return std::move(*result);
+            }
+        };
+
+        template<>
+        struct task_promise<void> : task_promise_base {
+            task<void> get_return_object() noexcept;
+
+            void return_void() noexcept {
+            }
+
+            void take() {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+        };
+    }
+
+    /**
+     *  Represents a lazy coroutine that starts when awaited, and resumes the awaiting coroutine when completed.
+     *
+     *  @tparam T the result type, or void.
+     */
+    template<class T = void>
+    class task {
+    public:
+        typedef detail::task_promise<T> promise_type;
+
+        /**
+         *  Move constructor.
+         */
+        task(task &&other) noexcept;
+
+        /**
+         *  Move assignment operator.
+         */
+        task &operator=(task &&other) noexcept;
+
+        /**
+         *  Destructor.
+         *  Destroys the coroutine.
+         */
+        ~task() noexcept;
+
+        /**
+         *  Starts the coroutine, and resumes the awaiting coroutine with the result or the exception.
+         */
+        auto operator co_await() &&noexcept;
+
+    private:
+        explicit task(std::coroutine_handle<promise_type> handle) noexcept;
+
+        task(const task &) = delete;
+
+        task &operator=(const task &) = delete;
+
+        std::coroutine_handle<promise_type> _handle;
+
+        friend struct detail::task_promise<T>;
+    };
+
+    /**
+     *  Represents a coroutine that produces values asynchronously, each one awaited with next().
+     *
+     *  @tparam T the value type.
+     */
+    template<class T>
+    class async_generator {
+    public:
+        struct promise_type {
+            std::optional<T> current;
+            std::coroutine_handle<> consumer;
+            std::exception_ptr error;
+
+            struct yield_awaiter {
+                bool await_ready() const noexcept {
+                    return false;
+                }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                    return handle.promise().consumer;
+                }
+
+                void await_resume() noexcept {
+                }
+            };
+
+            async_generator get_return_object() noexcept {
+                return async_generator(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            yield_awaiter final_suspend() noexcept {
+                return {};
+            }
+
+            yield_awaiter yield_value(T value) {
+                current.emplace(std::move(value));
+                return {};
+            }
+
+            void return_void() noexcept {
+            }
+
+            void unhandled_exception() noexcept {
+                error = std::current_exception();
+            }
+        };
+
+        /**
+         *  Move constructor.
+         */
+        async_generator(async_generator &&other) noexcept;
+
+        /**
+         *  Move assignment operator.
+         */
+        async_generator &operator=(async_generator &&other) noexcept;
+
+        /**
+         *  Destructor.
+         *  Destroys the coroutine, that must not be running.
+         */
+        ~async_generator() noexcept;
+
+        /**
+         *  Resumes the coroutine until it yields the next value.
+         *
+         *  @return the awaitable of the next value, or std::nullopt if the coroutine finished.
+         */
+        auto next();
+
+    private:
+        explicit async_generator(std::coroutine_handle<promise_type> handle) noexcept;
+
+        async_generator(const async_generator &) = delete;
+
+        async_generator &operator=(const async_generator &) = delete;
+
+        std::coroutine_handle<promise_type> _handle;
+    };
+
+    /**
+     *  Owns a database on a dedicated thread, and executes the operations awaited by coroutines on it,
+     *  so that many coroutines share one connection without blocking their threads.
+     *  The awaiting coroutines are resumed on the database thread,
+     *  so long computations after co_await should move to another executor.
+     *  The coroutines must complete before the async_database is destroyed.
+     */
+    class async_database {
+    public:
+        /**
+         *  Constructor.
+         *  Opens the database on the database thread.
+         *
+         *  @param path    the path of the SQLite database file to open and/or create.
+         *  @param options the options to open the database.
+         */
+        explicit async_database(const std::string &path, const open_options &options = open_options());
+
+        /**
+         *  Destructor.
+         *  Executes the operations already awaited, closes the database and stops the thread.
+         */
+        ~async_database() noexcept;
+
+        /**
+         *  Executes a function on the database thread.
+         *
+         *  @tparam Function R(*)(database &db)
+         *
+         *  @return the awaitable of the result of the function.
+         */
+        template<class Function>
+        auto run(Function function);
+
+        /**
+         *  Executes the SQL statement that does not return data.
+         *
+         *  @param sql       the single SQL statement.
+         *  @param bind_args the values to bind to the placeholders such as ?
+         */
+        template<class... ArgType>
+        task<void> exec_sql(std::string sql, ArgType... bind_args);
+
+        /**
+         *  Executes the SQL query, and returns all the rows.
+         *
+         *  @param sql       the single SQL statement.
+         *  @param bind_args the values to bind to the placeholders such as ?
+         */
+        template<class... ArgType>
+        task<std::vector<std::vector<value>>> query(std::string sql, ArgType... bind_args);
+
+        /**
+         *  Executes the SQL query, and yields the rows in batches,
+         *  so that a large result is not kept in memory and other operations run between the batches.
+         *  The statement is finalized on the database thread, also when the generator is destroyed
+         *  before the rows are exhausted.
+         *
+         *  @param sql        the single SQL statement.
+         *  @param batch_size the maximum number of rows of a batch.
+         *  @param bind_args  the values to bind to the placeholders such as ?
+         */
+        template<class... ArgType>
+        async_generator<std::vector<std::vector<value>>>
+        query_batches(std::string sql, std::size_t batch_size, ArgType... bind_args);
+
+        /**
+         *  Executes the operations already awaited, closes the database and stops the thread.
+         *  Awaiting after stopping throws an exception.
+         */
+        void stop();
+
+    private:
+        async_database(const async_database &) = delete;
+
+        async_database &operator=(const async_database &) = delete;
+
+        template<class Function>
+        class run_awaiter;
+
+        void post(std::function<void(database &)> job);
+
+        /**
+         *  Deletes an object using the connection on the database thread,
+         *  or at once if called there or after the database is closed.
+         */
+        template<class T>
+        void dispose(T *object) noexcept;
+
+        void run_thread(std::promise<void> opened);
+
+        database _db;
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        std::deque<std::function<void(database &)>> _jobs;
+        bool _stopping;
+        bool _closed;
+        std::thread::id _thread_id;
+        std::thread _thread;
+    };
+
+    /**
+     *  Starts a task on the calling thread, and blocks until it completes.
+     *
+     *  @return the result of the task, or throws its exception.
+     */
+    template<class T>
+    T sync_wait(task<T> task);
+
+#pragma mark ## task ##
+
+    namespace detail {
+        template<class T>
+        task<T> task_promise<T>::get_return_object() noexcept {
+            return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+        }
+
+        inline task<void> task_promise<void>::get_return_object() noexcept {
+            return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+        }
+    }
+
+    template<class T>
+    task<T>::task(std::coroutine_handle<promise_type> handle) noexcept : _handle(handle) {
+    }
+
+    template<class T>
+    task<T>::task(task &&other) noexcept : _handle(std::exchange(other._handle, nullptr)) {
+    }
+
+    template<class T>
+    task<T> &task<T>::operator=(task &&other) noexcept {
+        if (this != &other) {
+            if (_handle) {
+                _handle.destroy();
+            }
+            _handle = std::exchange(other._handle, nullptr);
+        }
+        return *this;
+    }
+
+    template<class T>
+    task<T>::~task() noexcept {
+        if (_handle) {
+            _handle.destroy();
+        }
+    }
+
+    template<class T>
+    auto task<T>::operator co_await() &&noexcept {
+        struct awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
+                handle.promise().continuation = continuation;
+                return handle;
+            }
+
+            T await_resume() {
+                return handle.promise().take();
+            }
+        };
+        return awaiter{_handle};
+    }
+
+#pragma mark ## async_generator ##
+
+    template<class T>
+    async_generator<T>::async_generator(std::coroutine_handle<promise_type> handle) noexcept : _handle(handle) {
+    }
+
+    template<class T>
+    async_generator<T>::async_generator(async_generator &&other) noexcept
+            : _handle(std::exchange(other._handle, nullptr)) {
+    }
+
+    template<class T>
+    async_generator<T> &async_generator<T>::operator=(async_generator &&other) noexcept {
+        if (this != &other) {
+            if (_handle) {
+                _handle.destroy();
+            }
+            _handle = std::exchange(other._handle, nullptr);
+        }
+        return *this;
+    }
+
+    template<class T>
+    async_generator<T>::~async_generator() noexcept {
+        if (_handle) {
+            _handle.destroy();
+        }
+    }
+
+    template<class T>
+    auto async_generator<T>::next() {
+        struct awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept {
+                return !handle || handle.done();
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) noexcept {
+                handle.promise().consumer = consumer;
+                handle.promise().current.reset();
+                return handle;
+            }
+
+            std::optional<T> await_resume() {
+                if (!handle) {
+                    return std::nullopt;
+                }
+                auto &&promise = handle.promise();
+                if (promise.error) {
+                    std::rethrow_exception(std::exchange(promise.error, nullptr));
+                }
+                if (handle.done()) {
+                    return std::nullopt;
+                }
+                return std::move(promise.current);
+            }
+        };
+        return awaiter{_handle};
+    }
+
+#pragma mark ## async_database ##
+
+    template<class Function>
+    class async_database::run_awaiter {
+    public:
+        typedef std::decay_t<std::invoke_result_t<Function &, database &>> result_type;
+
+        run_awaiter(async_database *owner, Function function)
+                : _owner(owner), _function(std::move(function)) {
+        }
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            _owner->post([this, handle](database &db) {
+                try {
+                    if constexpr (std::is_void_v<result_type>) {
+                        _function(db);
+                    } else {
+                        _result.emplace(_function(db));
+                    }
+                } catch (...) {
+                    _error = std::current_exception();
+                }
+                handle.resume();
+            });
+        }
+
+        result_type await_resume() {
+            if (_error) {
+                std::rethrow_exception(_error);
+            }
+            if constexpr (!std::is_void_v<result_type>) {
+                return std::move(*_result);
+            }
+        }
+
+    private:
+        struct empty {
+        };
+
+        async_database *_owner;
+        Function _function;
+        std::conditional_t<std::is_void_v<result_type>, empty, std::optional<result_type>> _result;
+        std::exception_ptr _error;
+    };
+
+    inline async_database::async_database(const std::string &path, const open_options &options)
+            : _db(path, options), _stopping(false), _closed(false) {
+        std::promise<void> opened;
+        auto future = opened.get_future();
+        _thread = std::thread(&async_database::run_thread, this, std::move(opened));
+        try {
+            future.get();
+        } catch (...) {
+            _thread.join();
+            throw;
+        }
+    }
+
+    inline async_database::~async_database() noexcept {
+        stop();
+    }
+
+    template<class Function>
+    auto async_database::run(Function function) {
+        return run_awaiter<Function>(this, std::move(function));
+    }
+
+    template<class... ArgType>
+    task<void> async_database::exec_sql(std::string sql, ArgType... bind_args) {
+        co_await run([&](database &db) {
+            db.exec_sql(sql, bind_args...);
+        });
+    }
+
+    template<class... ArgType>
+    task<std::vector<std::vector<value>>> async_database::query(std::string sql, ArgType... bind_args) {
+        co_return co_await run([&](database &db) {
+            std::vector<std::vector<value>> rows;
+            for (auto &&row : db.query(sql, bind_args...)) {
+                std::vector<value> values;
+                auto columns = row.get_column_count();
+                values.reserve(columns);
+                for (int i = 0; i < columns; ++i) {
+                    values.push_back(row.template get<value>(i));
+                }
+                rows.push_back(std::move(values));
+            }
+            return rows;
+        });
+    }
+
+    template<class... ArgType>
+    async_generator<std::vector<std::vector<value>>>
+    async_database::query_batches(std::string sql, std::size_t batch_size, ArgType... bind_args) {
+        if (batch_size == 0) {
+            throw std::logic_error("invalid batch_size, must be > 0");
+        }
+
+        struct state {
+            scandium::statement prepared;
+            result_set results;
+            iterator it;
+            iterator end;
+        };
+        auto cursor = co_await run([&](database &db) {
+            auto statement = db.prepare_statement(sql);
+            statement.bind_values(bind_args...);
+            auto results = statement.query();
+            auto it = results.begin();
+            auto end = results.end();
+            // the generator may be destroyed on any thread, but the statement is finalized on the database thread
+            return std::shared_ptr<state>(new state{std::move(statement), std::move(results), it, end},
+                                          [this](state *released) {
+                                              dispose(released);
+                                          });
+        });
+
+        for (;;) {
+            auto batch = co_await run([&](database &) {
+                std::vector<std::vector<value>> rows;
+                for (; rows.size() < batch_size && cursor->it != cursor->end; ++cursor->it) {
+                    auto &&row = *cursor->it;
+                    std::vector<value> values;
+                    auto columns = row.get_column_count();
+                    values.reserve(columns);
+                    for (int i = 0; i < columns; ++i) {
+                        values.push_back(row.template get<value>(i));
+                    }
+                    rows.push_back(std::move(values));
+                }
+                if (rows.size() < batch_size) {
+                    cursor.reset();
+                }
+                return rows;
+            });
+            if (!batch.empty()) {
+                co_yield std::move(batch);
+            }
+            if (!cursor) {
+                co_return;
+            }
+        }
+    }
+
+    inline void async_database::stop() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _condition.notify_one();
+
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+    inline void async_database::post(std::function<void(database &)> job) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stopping) {
+                throw std::logic_error("async database is stopped");
+            }
+            _jobs.push_back(std::move(job));
+        }
+        _condition.notify_one();
+    }
+
+    template<class T>
+    void async_database::dispose(T *object) noexcept {
+        if (std::this_thread::get_id() != _thread_id) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_closed) {
+                try {
+                    _jobs.push_back([object](database &) {
+                        delete object;
+                    });
+                    _condition.notify_one();
+                } catch (...) {
+                    // leaked rather than released concurrently with the database thread
+                }
+                return;
+            }
+        }
+        delete object;
+    }
+
+    inline void async_database::run_thread(std::promise<void> opened) {
+        _thread_id = std::this_thread::get_id();
+        try {
+            _db.open();
+        } catch (...) {
+            opened.set_exception(std::current_exception());
+            return;
+        }
+        opened.set_value();
+
+        for (;;) {
+            std::function<void(database &)> job;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _condition.wait(lock, [this] { return _stopping || !_jobs.empty(); });
+                if (_jobs.empty()) {
+                    // closes under the lock, so that dispose() either queues before or deletes after
+                    _closed = true;
+                    _db.close();
+                    break;
+                }
+                job = std::move(_jobs.front());
+                _jobs.pop_front();
+            }
+            job(_db);
+        }
+    }
+
+#pragma mark ## sync_wait ##
+
+    namespace detail {
+        struct detached_task {
+            struct promise_type {
+                detached_task get_return_object() noexcept {
+                    return {};
+                }
+
+                std::suspend_never initial_suspend() noexcept {
+                    return {};
+                }
+
+                std::suspend_never final_suspend() noexcept {
+                    return {};
+                }
+
+                void return_void() noexcept {
+                }
+
+                void unhandled_exception() noexcept {
+                    std::terminate();
+                }
+            };
+        };
+
+        template<class T, class Result>
+        detached_task run_and_signal(task<T> task, Result &result, std::exception_ptr &error,
+                                     std::mutex &mutex, std::condition_variable &condition, bool &done) {
+            try {
+                if constexpr (std::is_void_v<T>) {
+                    co_await std::move(task);
+                } else {
+                    result.emplace(co_await std::move(task));
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            // notifies under the lock, the waiter destroys the condition variable as soon as it returns
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            condition.notify_one();
+        }
+    }
+
+    template<class T>
+    T sync_wait(task<T> task) {
+        std::conditional_t<std::is_void_v<T>, bool, std::optional<T>> result{};
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool done = false;
+
+        detail::run_and_signal(std::move(task), result, error, mutex, condition, done);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [&done] { return done; });
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*result);
+        }
+    }
+}
+
+#endif
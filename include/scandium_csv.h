@@ -0,0 +1,521 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Daisuke Itabashi (itabashi.d@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "scandium.h"
+
+namespace scandium {
+
+    /**
+     *  Describes the options of scandium::import_csv().
+     */
+    struct csv_options {
+        char delimiter = ',';
+
+        char quote = '"';
+
+        /**
+         *  true if the first row holds the column names, which are used as the columns to insert into.
+         */
+        bool header = true;
+
+        /**
+         *  true to insert NULL for empty fields that are not quoted, or false to insert empty texts.
+         */
+        bool empty_as_null = false;
+
+        /**
+         *  The number of rows committed in one transaction.
+         */
+        std::size_t batch_size = 100000;
+
+        /**
+         *  true to parse in another thread while inserting the rows already parsed.
+         */
+        bool pipelined = false;
+
+        /**
+         *  The transaction mode of the batches.
+         */
+        transaction_mode mode = transaction_mode::immediate;
+    };
+
+    /**
+     *  Represents an exception that is thrown when a CSV file is malformed.
+     */
+    class csv_error : public std::runtime_error {
+    public:
+        /*
+         *  Constructor.
+         */
+        csv_error(const std::string &what, std::size_t row);
+
+        /**
+         *  Returns the one-based row number where the error occurred.
+         */
+        std::size_t get_row() const;
+
+    private:
+        const std::size_t _row;
+    };
+
+    /**
+     *  Inserts the rows of a CSV file (RFC 4180) into a table.
+     *  The file is memory-mapped, and the fields are bound without copying except quoted fields with escaped quotes.
+     *  The rows are inserted by one prepared statement in transactions of options.batch_size rows,
+     *  so the rows of the batches already committed remain if an error occurred.
+     *  All fields are bound as texts, and converted by the column affinities.
+     *
+     *  @param db      the open database.
+     *  @param path    the path of the CSV file.
+     *  @param table   the name of the table to insert into.
+     *  @param options the import options.
+     *
+     *  @return the number of rows inserted.
+     */
+    std::size_t import_csv(database &db, const std::string &path, const std::string &table,
+                           const csv_options &options = csv_options());
+
+#pragma mark ## csv_error ##
+
+    inline csv_error::csv_error(const std::string &what, std::size_t row)
+            : std::runtime_error(what + ", row: " + std::to_string(row)), _row(row) {
+    }
+
+    inline std::size_t csv_error::get_row() const {
+        return _row;
+    }
+
+#pragma mark ## import_csv ##
+
+    namespace detail {
+        /**
+         *  A read-only memory mapping of a file using the RAII idiom.
+         */
+        class mapped_file {
+        public:
+            explicit mapped_file(const std::string &path) {
+                _fd = ::open(path.c_str(), O_RDONLY);
+                if (_fd < 0) {
+                    throw std::runtime_error("failed to open " + path);
+                }
+
+                struct stat st;
+                if (fstat(_fd, &st) != 0) {
+                    ::close(_fd);
+                    throw std::runtime_error("failed to stat " + path);
+                }
+
+                _size = static_cast<std::size_t>(st.st_size);
+                if (_size > 0) {
+                    auto data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+                    if (data == MAP_FAILED) {
+                        ::close(_fd);
+                        throw std::runtime_error("failed to map " + path);
+                    }
+                    madvise(data, _size, MADV_SEQUENTIAL);
+                    _data = static_cast<const char *>(data);
+                }
+            }
+
+            ~mapped_file() noexcept {
+                if (_data) {
+                    munmap(const_cast<char *>(_data), _size);
+                }
+                ::close(_fd);
+            }
+
+            const char *begin() const {
+                return _data;
+            }
+
+            const char *end() const {
+                return _data + _size;
+            }
+
+        private:
+            mapped_file(const mapped_file &) = delete;
+
+            mapped_file &operator=(const mapped_file &) = delete;
+
+            int _fd = -1;
+            const char *_data = nullptr;
+            std::size_t _size = 0;
+        };
+
+        /**
+         *  The fields of consecutive rows, padded to the number of columns.
+         *  The unescaped copies of quoted fields are kept until the batch is cleared.
+         */
+        struct csv_batch {
+            std::vector<text_view> fields;
+            std::deque<std::string> unescaped;
+            std::size_t rows = 0;
+
+            void clear() {
+                fields.clear();
+                unescaped.clear();
+                rows = 0;
+            }
+        };
+
+        class csv_parser {
+        public:
+            csv_parser(const char *begin, const char *end, const csv_options &options)
+                    : _p(begin), _end(end), _delimiter(options.delimiter), _quote(options.quote),
+                      _empty_as_null(options.empty_as_null) {
+            }
+
+            /**
+             *  Appends the fields of the next row, and returns false if no rows remain.
+             */
+            bool parse_row(std::vector<text_view> &fields, std::deque<std::string> &unescaped) {
+                while (_p < _end && (*_p == '\n' || *_p == '\r')) {
+                    ++_p;
+                }
+                if (_p >= _end) {
+                    return false;
+                }
+
+                ++_row;
+                for (;;) {
+                    if (*_p == _quote) {
+                        parse_quoted(fields, unescaped);
+                    } else {
+                        auto end = find_unquoted_end(_p);
+                        fields.push_back(end == _p && _empty_as_null ? text_view{nullptr, 0}
+                                                                     : text_view{_p, static_cast<int>(end - _p)});
+                        _p = end;
+                    }
+
+                    if (_p >= _end) {
+                        return true;
+                    }
+                    if (*_p == _delimiter) {
+                        if (++_p >= _end) {
+                            fields.push_back(_empty_as_null ? text_view{nullptr, 0} : text_view{_p, 0});
+                            return true;
+                        }
+                        continue;
+                    }
+                    if (*_p == '\r') {
+                        if (++_p < _end && *_p == '\n') {
+                            ++_p;
+                        }
+                        return true;
+                    }
+                    if (*_p == '\n') {
+                        ++_p;
+                        return true;
+                    }
+                    throw csv_error("unexpected character after a quoted field", _row);
+                }
+            }
+
+            std::size_t get_row() const {
+                return _row;
+            }
+
+        private:
+            const char *_p;
+            const char *const _end;
+            const char _delimiter;
+            const char _quote;
+            const bool _empty_as_null;
+            std::size_t _row = 0;
+
+            void parse_quoted(std::vector<text_view> &fields, std::deque<std::string> &unescaped) {
+                auto begin = ++_p;
+                std::string *copy = nullptr;
+                for (;;) {
+                    auto quote = static_cast<const char *>(std::memchr(_p, _quote, static_cast<std::size_t>(_end - _p)));
+                    if (!quote) {
+                        throw csv_error("unterminated quoted field", _row);
+                    }
+
+                    if (quote + 1 < _end && quote[1] == _quote) {
+                        // an escaped quote, the field is copied without the escapes
+                        if (!copy) {
+                            unescaped.emplace_back();
+                            copy = &unescaped.back();
+                        }
+                        copy->append(_p, quote + 1);
+                        _p = quote + 2;
+                        continue;
+                    }
+
+                    if (copy) {
+                        copy->append(_p, quote);
+                        fields.push_back(text_view{copy->data(), static_cast<int>(copy->size())});
+                    } else {
+                        fields.push_back(text_view{begin, static_cast<int>(quote - begin)});
+                    }
+                    _p = quote + 1;
+                    return;
+                }
+            }
+
+            /**
+             *  Returns the position of the next delimiter or line break.
+             */
+            const char *find_unquoted_end(const char *p) const {
+#ifdef __SSE2__
+                auto delimiter = _mm_set1_epi8(_delimiter);
+                auto lf = _mm_set1_epi8('\n');
+                auto cr = _mm_set1_epi8('\r');
+                while (_end - p >= 16) {
+                    auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                    auto matches = _mm_or_si128(_mm_cmpeq_epi8(chunk, delimiter),
+                                                _mm_or_si128(_mm_cmpeq_epi8(chunk, lf), _mm_cmpeq_epi8(chunk, cr)));
+                    auto mask = _mm_movemask_epi8(matches);
+                    if (mask != 0) {
+                        return p + __builtin_ctz(static_cast<unsigned>(mask));
+                    }
+                    p += 16;
+                }
+#endif
+                while (p < _end && *p != _delimiter && *p != '\n' && *p != '\r') {
+                    ++p;
+                }
+                return p;
+            }
+        };
+
+        /**
+         *  A bounded queue of parsed batches between the parse thread and the insert thread,
+         *  recycling the batches to avoid allocations.
+         */
+        class csv_batch_queue {
+        public:
+            explicit csv_batch_queue(std::size_t capacity) {
+                for (std::size_t i = 0; i < capacity; ++i) {
+                    _free.emplace_back(new csv_batch());
+                }
+            }
+
+            std::unique_ptr<csv_batch> acquire() {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _condition.wait(lock, [this] { return !_free.empty() || _aborted; });
+                if (_aborted) {
+                    return nullptr;
+                }
+                auto batch = std::move(_free.front());
+                _free.pop_front();
+                return batch;
+            }
+
+            void push(std::unique_ptr<csv_batch> batch) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _ready.push_back(std::move(batch));
+                _condition.notify_all();
+            }
+
+            /**
+             *  Returns the next parsed batch, or nullptr if the parser finished.
+             *  Rethrows the exception of the parser.
+             */
+            std::unique_ptr<csv_batch> pop() {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _condition.wait(lock, [this] { return !_ready.empty() || _finished; });
+                if (_ready.empty()) {
+                    if (_error) {
+                        std::rethrow_exception(_error);
+                    }
+                    return nullptr;
+                }
+                auto batch = std::move(_ready.front());
+                _ready.pop_front();
+                return batch;
+            }
+
+            void recycle(std::unique_ptr<csv_batch> batch) {
+                batch->clear();
+                std::lock_guard<std::mutex> lock(_mutex);
+                _free.push_back(std::move(batch));
+                _condition.notify_all();
+            }
+
+            void finish(std::exception_ptr error) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _finished = true;
+                _error = error;
+                _condition.notify_all();
+            }
+
+            void abort() {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _aborted = true;
+                _condition.notify_all();
+            }
+
+        private:
+            std::mutex _mutex;
+            std::condition_variable _condition;
+            std::deque<std::unique_ptr<csv_batch>> _free;
+            std::deque<std::unique_ptr<csv_batch>> _ready;
+            bool _finished = false;
+            bool _aborted = false;
+            std::exception_ptr _error;
+        };
+
+        /**
+         *  Parses up to max_rows rows into the batch, and returns false if no rows remain.
+         */
+        inline bool parse_batch(csv_parser &parser, csv_batch &batch, std::size_t columns, std::size_t max_rows) {
+            while (batch.rows < max_rows) {
+                auto offset = batch.fields.size();
+                if (!parser.parse_row(batch.fields, batch.unescaped)) {
+                    return false;
+                }
+                auto count = batch.fields.size() - offset;
+                if (count > columns) {
+                    throw csv_error("too many fields, expected " + std::to_string(columns), parser.get_row());
+                }
+                batch.fields.resize(offset + columns, text_view{nullptr, 0});
+                ++batch.rows;
+            }
+            return true;
+        }
+
+        static const std::size_t csv_rows_per_parse = 4096;
+    }
+
+    inline std::size_t import_csv(database &db, const std::string &path, const std::string &table,
+                                  const csv_options &options) {
+        detail::mapped_file file(path);
+        detail::csv_parser parser(file.begin(), file.end(), options);
+
+        std::vector<text_view> first_row;
+        std::deque<std::string> unescaped;
+        if (!parser.parse_row(first_row, unescaped)) {
+            return 0;
+        }
+
+        auto columns = first_row.size();
+        std::string sql = "INSERT INTO " + detail::quote_identifier(table);
+        if (options.header) {
+            sql += "(";
+            for (std::size_t i = 0; i < columns; ++i) {
+                sql += (i == 0 ? "" : ", ");
+                sql += detail::quote_identifier(std::string(first_row[i].data ? first_row[i].data : "",
+                                                            static_cast<std::size_t>(first_row[i].size)));
+            }
+            sql += ")";
+        }
+        sql += " VALUES(";
+        for (std::size_t i = 0; i < columns; ++i) {
+            sql += (i == 0 ? "?" : ", ?");
+        }
+        sql += ");";
+        auto statement = db.prepare_statement(sql);
+
+        std::size_t inserted = 0;
+        std::size_t uncommitted = 0;
+        auto transaction = db.create_transaction(options.mode);
+        auto insert = [&](const detail::csv_batch &batch) {
+            auto field = batch.fields.data();
+            for (std::size_t row = 0; row < batch.rows; ++row) {
+                for (std::size_t column = 0; column < columns; ++column) {
+                    statement.bind(static_cast<int>(column + 1), *field++);
+                }
+                statement.exec();
+
+                ++inserted;
+                if (++uncommitted >= options.batch_size) {
+                    transaction.commit();
+                    transaction = db.create_transaction(options.mode);
+                    uncommitted = 0;
+                }
+            }
+        };
+
+        if (!options.header) {
+            detail::csv_batch batch;
+            batch.fields = first_row;
+            batch.rows = 1;
+            insert(batch);
+        }
+
+        if (!options.pipelined) {
+            detail::csv_batch batch;
+            for (auto more = true; more;) {
+                more = detail::parse_batch(parser, batch, columns, detail::csv_rows_per_parse);
+                insert(batch);
+                batch.clear();
+            }
+        } else {
+            detail::csv_batch_queue queue(4);
+            std::thread parse_thread([&parser, &queue, columns] {
+                try {
+                    for (auto more = true; more;) {
+                        auto batch = queue.acquire();
+                        if (!batch) {
+                            break;
+                        }
+                        more = detail::parse_batch(parser, *batch, columns, detail::csv_rows_per_parse);
+                        queue.push(std::move(batch));
+                    }
+                    queue.finish(nullptr);
+                } catch (...) {
+                    queue.finish(std::current_exception());
+                }
+            });
+
+            try {
+                while (auto batch = queue.pop()) {
+                    insert(*batch);
+                    queue.recycle(std::move(batch));
+                }
+            } catch (...) {
+                queue.abort();
+                parse_thread.join();
+                throw;
+            }
+            parse_thread.join();
+        }
+
+        transaction.commit();
+        return inserted;
+    }
+}
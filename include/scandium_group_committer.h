@@ -0,0 +1,266 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Daisuke Itabashi (itabashi.d@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "scandium.h"
+
+namespace scandium {
+
+    /**
+     *  Describes the options of scandium::group_committer.
+     */
+    struct group_commit_options {
+        /**
+         *  The maximum number of writes committed in one transaction.
+         */
+        std::size_t max_batch_size = 256;
+
+        /**
+         *  The maximum time to wait for more writes after the first write of a batch arrived.
+         */
+        std::chrono::microseconds max_delay = std::chrono::microseconds(1000);
+
+        /**
+         *  The transaction mode of the batches.
+         */
+        transaction_mode mode = transaction_mode::immediate;
+    };
+
+    /**
+     *  Collects writes submitted from many threads, and executes them in one transaction per batch,
+     *  so that a batch costs one commit and one fsync.
+     *  Each write runs in its own savepoint, so a failing write is rolled back alone.
+     *  The database must not be used by other threads while the committer is running.
+     */
+    class group_committer {
+    public:
+        /**
+         *  Constructor.
+         *  Starts the thread that executes the writes.
+         *
+         *  @param db      the open database to write.
+         *  @param options the batching options.
+         */
+        explicit group_committer(const database &db, const group_commit_options &options = group_commit_options());
+
+        /**
+         *  Destructor.
+         *  Commits the writes already submitted and stops the thread.
+         */
+        ~group_committer() noexcept;
+
+        /**
+         *  Submits a write.
+         *
+         *  @tparam Write void(*)(database &db)
+         *
+         *  @param write the write to execute in the next batch.
+         *
+         *  @return the future that becomes ready when the batch containing the write is committed,
+         *          or holds the exception thrown by the write or the commit.
+         */
+        template<class Write>
+        std::future<void> submit(Write &&write);
+
+        /**
+         *  Commits the writes already submitted and stops the thread.
+         *  Submitting after stopping throws an exception.
+         */
+        void stop();
+
+        /**
+         *  Returns the number of committed batches.
+         */
+        std::uint64_t get_batch_count() const;
+
+        /**
+         *  Returns the number of committed writes.
+         */
+        std::uint64_t get_write_count() const;
+
+    private:
+        group_committer(const group_committer &) = delete;
+
+        group_committer &operator=(const group_committer &) = delete;
+
+        struct request {
+            std::function<void(database &)> write;
+            std::promise<void> promise;
+        };
+
+        void run();
+
+        void commit_batch(std::vector<request> &batch);
+
+        database _db;
+        group_commit_options _options;
+        mutable std::mutex _mutex;
+        std::condition_variable _condition;
+        std::deque<request> _queue;
+        bool _stopping;
+        std::uint64_t _batch_count;
+        std::uint64_t _write_count;
+        std::thread _thread;
+    };
+
+#pragma mark ## group_committer ##
+
+    inline group_committer::group_committer(const database &db, const group_commit_options &options)
+            : _db(db), _options(options), _stopping(false), _batch_count(0), _write_count(0) {
+        if (_options.max_batch_size == 0) {
+            throw std::logic_error("invalid max_batch_size, must be > 0");
+        }
+        _thread = std::thread(&group_committer::run, this);
+    }
+
+    inline group_committer::~group_committer() noexcept {
+        stop();
+    }
+
+    template<class Write>
+    std::future<void> group_committer::submit(Write &&write) {
+        request request;
+        request.write = std::forward<Write>(write);
+        auto future = request.promise.get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stopping) {
+                throw std::logic_error("group committer is stopped");
+            }
+            _queue.push_back(std::move(request));
+        }
+        _condition.notify_one();
+
+        return future;
+    }
+
+    inline void group_committer::stop() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _condition.notify_one();
+
+        if (_thread.joinable()) {
+            _thread.join();
+            _db.claim_thread();
+        }
+    }
+
+    inline std::uint64_t group_committer::get_batch_count() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _batch_count;
+    }
+
+    inline std::uint64_t group_committer::get_write_count() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _write_count;
+    }
+
+    inline void group_committer::run() {
+        // the database is used only by this thread until stopped
+        _db.claim_thread();
+
+        std::vector<request> batch;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _condition.wait(lock, [this] { return _stopping || !_queue.empty(); });
+                if (_queue.empty()) {
+                    return;
+                }
+
+                // trade a little latency of the first write for the writes arriving just after it
+                auto deadline = std::chrono::steady_clock::now() + _options.max_delay;
+                _condition.wait_until(lock, deadline, [this] {
+                    return _stopping || _queue.size() >= _options.max_batch_size;
+                });
+
+                while (!_queue.empty() && batch.size() < _options.max_batch_size) {
+                    batch.push_back(std::move(_queue.front()));
+                    _queue.pop_front();
+                }
+            }
+
+            commit_batch(batch);
+            batch.clear();
+        }
+    }
+
+    inline void group_committer::commit_batch(std::vector<request> &batch) {
+        std::vector<std::exception_ptr> errors(batch.size());
+        try {
+            auto transaction = _db.create_transaction(_options.mode);
+            for (std::size_t i = 0; i < batch.size(); ++i) {
+                _db.exec_sql("SAVEPOINT scandium_group_commit;");
+                try {
+                    batch[i].write(_db);
+                    _db.exec_sql("RELEASE scandium_group_commit;");
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                    _db.exec_sql("ROLLBACK TO scandium_group_commit;");
+                    _db.exec_sql("RELEASE scandium_group_commit;");
+                }
+            }
+            transaction.commit();
+        } catch (...) {
+            auto error = std::current_exception();
+            for (auto &&request : batch) {
+                request.promise.set_exception(error);
+            }
+            return;
+        }
+
+        std::uint64_t succeeded = 0;
+        for (auto &&error : errors) {
+            succeeded += error ? 0 : 1;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ++_batch_count;
+            _write_count += succeeded;
+        }
+
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            if (errors[i]) {
+                batch[i].promise.set_exception(errors[i]);
+            } else {
+                batch[i].promise.set_value();
+            }
+        }
+    }
+}
@@ -0,0 +1,604 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Daisuke Itabashi (itabashi.d@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define SCANDIUM_MEMORY_MMAP 1
+#endif
+
+#include "scandium.h"
+
+namespace scandium {
+    namespace memory {
+
+        /**
+         *  Describes the options of the pool allocator.
+         */
+        struct pool_options {
+            /**
+             *  The size of the chunks reserved from the OS, which are never returned.
+             */
+            std::size_t chunk_size = 2 * 1024 * 1024;
+
+            /**
+             *  true to ask the OS to back the chunks with transparent huge pages.
+             */
+            bool use_hugepages = false;
+
+            /**
+             *  true to turn off SQLite's own memory statistics (SQLITE_CONFIG_MEMSTATUS),
+             *  which take a global mutex on every allocation.
+             */
+            bool disable_memstatus = true;
+        };
+
+        /**
+         *  Represents the counters of a size class.
+         */
+        struct size_class_stats {
+            /**
+             *  The largest allocation served by the size class.
+             */
+            std::size_t size;
+
+            std::uint64_t allocations;
+
+            std::uint64_t frees;
+        };
+
+        /**
+         *  Represents the counters of the pool allocator.
+         */
+        struct allocator_stats {
+            /**
+             *  The bytes currently allocated by SQLite.
+             */
+            std::int64_t live_bytes;
+
+            /**
+             *  The largest value live_bytes has reached.
+             */
+            std::int64_t peak_bytes;
+
+            /**
+             *  The bytes of the chunks reserved from the OS.
+             */
+            std::uint64_t reserved_bytes;
+
+            /**
+             *  The number of allocations too large for the size classes, which are served by malloc().
+             */
+            std::uint64_t large_allocations;
+
+            std::vector<size_class_stats> size_classes;
+        };
+
+        /**
+         *  Installs the thread-caching size-class pool allocator as the SQLite allocator
+         *  through sqlite3_config(SQLITE_CONFIG_MALLOC).
+         *  SQLite is shut down and initialized again, so no database may be open,
+         *  and no memory allocated by SQLite may be held.
+         *
+         *  @param options the options of the allocator.
+         */
+        void install_pool_allocator(const pool_options &options = pool_options());
+
+        /**
+         *  Restores the allocator that was used before install_pool_allocator().
+         *  No database may be open, and no memory allocated by SQLite may be held.
+         */
+        void uninstall_pool_allocator();
+
+        /**
+         *  Returns true if the pool allocator is installed, or false otherwise.
+         */
+        bool is_pool_allocator_installed();
+
+        /**
+         *  Returns the counters of the pool allocator.
+         */
+        allocator_stats get_pool_allocator_stats();
+
+#pragma mark ## pool ##
+
+        namespace detail {
+            static const int header_size = 8;
+            static const int small_class_count = 8;
+            static const int class_count = small_class_count + 4 * 9;
+            static const std::uint32_t large_class = 0xffffffffu;
+
+            struct header {
+                std::uint32_t size_class;
+                std::uint32_t size;
+            };
+
+            struct free_block {
+                free_block *next;
+            };
+
+            /**
+             *  Returns the size of the blocks of a size class including the header.
+             *  The classes are 16-byte steps up to 128, then four steps per power of two up to 64 KiB.
+             */
+            inline std::size_t class_size(int size_class) {
+                if (size_class < small_class_count) {
+                    return static_cast<std::size_t>(size_class + 1) * 16;
+                }
+                auto base = std::size_t(128) << ((size_class - small_class_count) / 4);
+                return base + (base / 4) * ((size_class - small_class_count) % 4 + 1);
+            }
+
+            inline int class_of(std::size_t size) {
+                if (size <= 128) {
+                    return size == 0 ? 0 : static_cast<int>((size + 15) / 16) - 1;
+                }
+                int bits = 7;
+                while ((std::size_t(2) << bits) < size) {
+                    ++bits;
+                }
+                auto base = std::size_t(1) << bits;
+                auto step = base / 4;
+                auto sub = static_cast<int>((size - base + step - 1) / step);
+                auto result = small_class_count + (bits - 7) * 4 + sub - 1;
+                return result < class_count ? result : -1;
+            }
+
+            inline int batch_size(int size_class) {
+                auto count = static_cast<int>(32768 / class_size(size_class));
+                return count < 1 ? 1 : (count > 32 ? 32 : count);
+            }
+
+            struct central_list {
+                std::mutex mutex;
+                free_block *head = nullptr;
+                char *span = nullptr;
+                char *span_end = nullptr;
+            };
+
+            struct thread_cache {
+                free_block *heads[class_count];
+                int counts[class_count];
+                std::atomic<std::uint64_t> allocations[class_count];
+                std::atomic<std::uint64_t> frees[class_count];
+
+                thread_cache();
+
+                ~thread_cache() noexcept;
+            };
+
+            struct pool {
+                pool_options options;
+                sqlite3_mem_methods previous;
+                bool installed = false;
+
+                central_list lists[class_count];
+
+                std::mutex chunk_mutex;
+                char *chunk = nullptr;
+                char *chunk_end = nullptr;
+                std::atomic<std::uint64_t> reserved_bytes{0};
+
+                std::atomic<std::int64_t> live_bytes{0};
+                std::atomic<std::int64_t> peak_bytes{0};
+                std::atomic<std::uint64_t> large_allocations{0};
+
+                std::mutex registry_mutex;
+                std::vector<thread_cache *> caches;
+                std::uint64_t retired_allocations[class_count] = {};
+                std::uint64_t retired_frees[class_count] = {};
+            };
+
+            inline pool &global() {
+                // never destroyed, SQLite may free memory while the static objects are destroyed
+                static pool *value = new pool();
+                return *value;
+            }
+
+            inline char *reserve(std::size_t size) {
+                auto &&p = global();
+                std::lock_guard<std::mutex> lock(p.chunk_mutex);
+                if (static_cast<std::size_t>(p.chunk_end - p.chunk) < size) {
+                    auto chunk_size = p.options.chunk_size < size ? size : p.options.chunk_size;
+#ifdef SCANDIUM_MEMORY_MMAP
+                    auto chunk = mmap(nullptr, chunk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                    if (chunk == MAP_FAILED) {
+                        return nullptr;
+                    }
+#ifdef MADV_HUGEPAGE
+                    if (p.options.use_hugepages) {
+                        madvise(chunk, chunk_size, MADV_HUGEPAGE);
+                    }
+#endif
+#else
+                    auto chunk = std::malloc(chunk_size);
+                    if (!chunk) {
+                        return nullptr;
+                    }
+#endif
+                    p.chunk = static_cast<char *>(chunk);
+                    p.chunk_end = p.chunk + chunk_size;
+                    p.reserved_bytes.fetch_add(chunk_size, std::memory_order_relaxed);
+                }
+
+                auto result = p.chunk;
+                p.chunk += size;
+                return result;
+            }
+
+            /**
+             *  Moves up to count blocks of the size class from the central list to the list of head.
+             */
+            inline int refill(int size_class, int count, free_block **head) {
+                auto &&list = global().lists[size_class];
+                auto size = class_size(size_class);
+                std::lock_guard<std::mutex> lock(list.mutex);
+
+                int moved = 0;
+                while (moved < count && list.head) {
+                    auto block = list.head;
+                    list.head = block->next;
+                    block->next = *head;
+                    *head = block;
+                    ++moved;
+                }
+
+                while (moved < count) {
+                    if (static_cast<std::size_t>(list.span_end - list.span) < size) {
+                        auto span_size = size * static_cast<std::size_t>(batch_size(size_class)) * 8;
+                        list.span = reserve(span_size);
+                        if (!list.span) {
+                            list.span_end = nullptr;
+                            break;
+                        }
+                        list.span_end = list.span + span_size;
+                    }
+                    auto block = reinterpret_cast<free_block *>(list.span);
+                    list.span += size;
+                    block->next = *head;
+                    *head = block;
+                    ++moved;
+                }
+                return moved;
+            }
+
+            inline void release(int size_class, int count, free_block **head) {
+                auto &&list = global().lists[size_class];
+                std::lock_guard<std::mutex> lock(list.mutex);
+                while (count-- > 0 && *head) {
+                    auto block = *head;
+                    *head = block->next;
+                    block->next = list.head;
+                    list.head = block;
+                }
+            }
+
+            inline thread_cache::thread_cache() {
+                for (int i = 0; i < class_count; ++i) {
+                    heads[i] = nullptr;
+                    counts[i] = 0;
+                    allocations[i].store(0, std::memory_order_relaxed);
+                    frees[i].store(0, std::memory_order_relaxed);
+                }
+                auto &&p = global();
+                std::lock_guard<std::mutex> lock(p.registry_mutex);
+                p.caches.push_back(this);
+            }
+
+            // 0: not created, 1: alive, 2: destroyed; trivially destructible, so readable at any time
+            inline int &thread_cache_state() {
+                static thread_local int state = 0;
+                return state;
+            }
+
+            inline thread_cache::~thread_cache() noexcept {
+                thread_cache_state() = 2;
+                auto &&p = global();
+                for (int i = 0; i < class_count; ++i) {
+                    release(i, counts[i], &heads[i]);
+                }
+
+                std::lock_guard<std::mutex> lock(p.registry_mutex);
+                for (int i = 0; i < class_count; ++i) {
+                    p.retired_allocations[i] += allocations[i].load(std::memory_order_relaxed);
+                    p.retired_frees[i] += frees[i].load(std::memory_order_relaxed);
+                }
+                for (auto it = p.caches.begin(); it != p.caches.end(); ++it) {
+                    if (*it == this) {
+                        p.caches.erase(it);
+                        break;
+                    }
+                }
+            }
+
+            inline thread_cache *current_cache() {
+                auto &&state = thread_cache_state();
+                if (state == 2) {
+                    return nullptr;
+                }
+                static thread_local thread_cache cache;
+                state = 1;
+                return &cache;
+            }
+
+            inline void account(std::int64_t bytes) {
+                auto &&p = global();
+                auto live = p.live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+                auto peak = p.peak_bytes.load(std::memory_order_relaxed);
+                while (live > peak && !p.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+                }
+            }
+
+            inline void *allocate(int n) {
+                if (n <= 0) {
+                    return nullptr;
+                }
+
+                auto size_class = class_of(static_cast<std::size_t>(n) + header_size);
+                header *block;
+                if (size_class < 0) {
+                    block = static_cast<header *>(std::malloc(static_cast<std::size_t>(n) + header_size));
+                    if (!block) {
+                        return nullptr;
+                    }
+                    block->size_class = large_class;
+                    block->size = static_cast<std::uint32_t>(n);
+                    global().large_allocations.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    auto cache = current_cache();
+                    free_block *head = nullptr;
+                    if (!cache) {
+                        if (refill(size_class, 1, &head) == 0) {
+                            return nullptr;
+                        }
+                    } else {
+                        if (!cache->heads[size_class]) {
+                            cache->counts[size_class] += refill(size_class, batch_size(size_class),
+                                                                &cache->heads[size_class]);
+                            if (!cache->heads[size_class]) {
+                                return nullptr;
+                            }
+                        }
+                        head = cache->heads[size_class];
+                        cache->heads[size_class] = head->next;
+                        --cache->counts[size_class];
+                        cache->allocations[size_class].fetch_add(1, std::memory_order_relaxed);
+                    }
+                    block = reinterpret_cast<header *>(head);
+                    block->size_class = static_cast<std::uint32_t>(size_class);
+                    block->size = static_cast<std::uint32_t>(class_size(size_class) - header_size);
+                }
+
+                account(block->size);
+                return reinterpret_cast<char *>(block) + header_size;
+            }
+
+            inline header *header_of(void *p) {
+                return reinterpret_cast<header *>(static_cast<char *>(p) - header_size);
+            }
+
+            inline void deallocate(void *p) {
+                if (!p) {
+                    return;
+                }
+
+                auto block = header_of(p);
+                account(-static_cast<std::int64_t>(block->size));
+                if (block->size_class == large_class) {
+                    std::free(block);
+                    return;
+                }
+
+                auto size_class = static_cast<int>(block->size_class);
+                auto node = reinterpret_cast<free_block *>(block);
+                node->next = nullptr;
+                auto cache = current_cache();
+                if (!cache) {
+                    release(size_class, 1, &node);
+                    return;
+                }
+
+                node->next = cache->heads[size_class];
+                cache->heads[size_class] = node;
+                cache->frees[size_class].fetch_add(1, std::memory_order_relaxed);
+
+                // bound the blocks kept by a thread, so that frees on other threads find their way back
+                auto limit = batch_size(size_class) * 2;
+                if (++cache->counts[size_class] > limit) {
+                    auto count = limit / 2;
+                    release(size_class, count, &cache->heads[size_class]);
+                    cache->counts[size_class] -= count;
+                }
+            }
+
+            inline int usable_size(void *p) {
+                return p ? static_cast<int>(header_of(p)->size) : 0;
+            }
+
+            inline void *reallocate(void *p, int n) {
+                if (!p) {
+                    return allocate(n);
+                }
+                auto size = usable_size(p);
+                auto block = header_of(p);
+                if (block->size_class != large_class && n <= size
+                    && class_of(static_cast<std::size_t>(n) + header_size) == static_cast<int>(block->size_class)) {
+                    return p;
+                }
+
+                auto result = allocate(n);
+                if (result) {
+                    std::memcpy(result, p, static_cast<std::size_t>(size < n ? size : n));
+                    deallocate(p);
+                }
+                return result;
+            }
+
+            inline int roundup(int n) {
+                auto size_class = class_of(static_cast<std::size_t>(n) + header_size);
+                if (size_class < 0) {
+                    return (n + 7) & ~7;
+                }
+                return static_cast<int>(class_size(size_class)) - header_size;
+            }
+
+            inline const sqlite3_mem_methods *methods() {
+                struct callbacks {
+                    static void *x_malloc(int n) {
+                        return allocate(n);
+                    }
+
+                    static void x_free(void *p) {
+                        deallocate(p);
+                    }
+
+                    static void *x_realloc(void *p, int n) {
+                        return reallocate(p, n);
+                    }
+
+                    static int x_size(void *p) {
+                        return usable_size(p);
+                    }
+
+                    static int x_roundup(int n) {
+                        return roundup(n);
+                    }
+
+                    static int x_init(void *) {
+                        return SQLITE_OK;
+                    }
+
+                    static void x_shutdown(void *) {
+                    }
+                };
+
+                static const sqlite3_mem_methods value = {
+                        &callbacks::x_malloc,
+                        &callbacks::x_free,
+                        &callbacks::x_realloc,
+                        &callbacks::x_size,
+                        &callbacks::x_roundup,
+                        &callbacks::x_init,
+                        &callbacks::x_shutdown,
+                        nullptr,
+                };
+                return &value;
+            }
+        }
+
+        inline void install_pool_allocator(const pool_options &options) {
+            auto &&p = detail::global();
+            if (p.installed) {
+                throw std::logic_error("pool allocator is already installed");
+            }
+
+            auto rc = sqlite3_shutdown();
+            if (rc != SQLITE_OK) {
+                throw sqlite_error("failed to shutdown sqlite", rc);
+            }
+
+            rc = sqlite3_config(SQLITE_CONFIG_GETMALLOC, &p.previous);
+            if (rc != SQLITE_OK) {
+                throw sqlite_error("failed to get the allocator", rc);
+            }
+
+            p.options = options;
+            rc = sqlite3_config(SQLITE_CONFIG_MALLOC, detail::methods());
+            if (rc != SQLITE_OK) {
+                throw sqlite_error("failed to install the allocator", rc);
+            }
+            if (options.disable_memstatus) {
+                sqlite3_config(SQLITE_CONFIG_MEMSTATUS, 0);
+            }
+            p.installed = true;
+
+            rc = sqlite3_initialize();
+            if (rc != SQLITE_OK) {
+                throw sqlite_error("failed to initialize sqlite", rc);
+            }
+        }
+
+        inline void uninstall_pool_allocator() {
+            auto &&p = detail::global();
+            if (!p.installed) {
+                return;
+            }
+
+            auto rc = sqlite3_shutdown();
+            if (rc != SQLITE_OK) {
+                throw sqlite_error("failed to shutdown sqlite", rc);
+            }
+
+            rc = sqlite3_config(SQLITE_CONFIG_MALLOC, &p.previous);
+            if (rc != SQLITE_OK) {
+                throw sqlite_error("failed to restore the allocator", rc);
+            }
+            if (p.options.disable_memstatus) {
+                sqlite3_config(SQLITE_CONFIG_MEMSTATUS, 1);
+            }
+            p.installed = false;
+
+            rc = sqlite3_initialize();
+            if (rc != SQLITE_OK) {
+                throw sqlite_error("failed to initialize sqlite", rc);
+            }
+        }
+
+        inline bool is_pool_allocator_installed() {
+            return detail::global().installed;
+        }
+
+        inline allocator_stats get_pool_allocator_stats() {
+            auto &&p = detail::global();
+            allocator_stats stats;
+            stats.live_bytes = p.live_bytes.load(std::memory_order_relaxed);
+            stats.peak_bytes = p.peak_bytes.load(std::memory_order_relaxed);
+            stats.reserved_bytes = p.reserved_bytes.load(std::memory_order_relaxed);
+            stats.large_allocations = p.large_allocations.load(std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lock(p.registry_mutex);
+            for (int i = 0; i < detail::class_count; ++i) {
+                size_class_stats size_class;
+                size_class.size = detail::class_size(i) - detail::header_size;
+                size_class.allocations = p.retired_allocations[i];
+                size_class.frees = p.retired_frees[i];
+                for (auto &&cache : p.caches) {
+                    size_class.allocations += cache->allocations[i].load(std::memory_order_relaxed);
+                    size_class.frees += cache->frees[i].load(std::memory_order_relaxed);
+                }
+                stats.size_classes.push_back(size_class);
+            }
+            return stats;
+        }
+    }
+}
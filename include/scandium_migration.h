@@ -0,0 +1,248 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Daisuke Itabashi (itabashi.d@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "scandium.h"
+
+namespace scandium {
+
+    /**
+     *  Describes the options of scandium::migrator.
+     */
+    struct migration_options {
+        /**
+         *  The transaction mode of the steps and the chunks.
+         */
+        transaction_mode mode = transaction_mode::immediate;
+
+        /**
+         *  The table persisting the progress of incremental steps, created when needed.
+         */
+        std::string progress_table = "scandium_migration_progress";
+
+        /**
+         *  The time to sleep between the chunks of incremental steps, to let other connections write.
+         */
+        std::chrono::milliseconds chunk_pause = std::chrono::milliseconds(0);
+    };
+
+    /**
+     *  Upgrades the user version of a database with registered steps,
+     *  running each step in its own transaction that also updates the user version,
+     *  so that an interrupted upgrade resumes from the last committed step.
+     *  The version is checked again in each transaction, so that processes upgrading at once run each step once.
+     *
+     *  Incremental steps run in many short transactions instead,
+     *  each processing a bounded chunk and persisting the position reached,
+     *  so that readers and writers are not blocked during large backfills.
+     *  The database must stay usable by the current code while an incremental step is partially applied.
+     *
+     *  The user version is written directly, so the callbacks of database::set_before_upgrade_user_version()
+     *  are not called. Downgrades are not supported.
+     */
+    class migrator {
+    public:
+        /**
+         *  Constructor.
+         *
+         *  @param db      the open database to upgrade.
+         *  @param options the migration options.
+         */
+        explicit migrator(const database &db, const migration_options &options = migration_options());
+
+        /**
+         *  Registers a step.
+         *
+         *  @tparam Step void(*)(database &db)
+         *
+         *  @param version the user version after the step, must be > 0 and unique.
+         *  @param step    the step executed in a transaction.
+         */
+        template<class Step>
+        void add_step(int version, Step &&step);
+
+        /**
+         *  Registers an incremental step.
+         *
+         *  @tparam Chunk bool(*)(database &db, sqlite3_int64 &position)
+         *
+         *  @param version the user version after the step, must be > 0 and unique.
+         *  @param chunk   the chunk executed in a transaction repeatedly,
+         *                 that processes a bounded amount of rows after the position, advances the position,
+         *                 and returns true when the step is complete.
+         *                 The position is 0 at first, and is restored when resuming the step.
+         */
+        template<class Chunk>
+        void add_incremental_step(int version, Chunk &&chunk);
+
+        /**
+         *  Returns the version of the last registered step, or 0 if no steps.
+         */
+        int get_latest_version() const;
+
+        /**
+         *  Runs the steps after the current user version up to the target version.
+         *
+         *  @param target_version the version to upgrade to, or 0 to upgrade to the latest version.
+         *
+         *  @return the user version after the upgrade, that may be past the target if another process upgraded it.
+         */
+        int migrate(int target_version = 0);
+
+    private:
+        struct step {
+            std::function<void(database &)> run;
+            std::function<bool(database &, sqlite3_int64 &)> run_chunk;
+        };
+
+        void add(int version, step step);
+
+        void run_step(int version, const step &step);
+
+        void run_incremental_step(int version, const step &step);
+
+        void set_user_version(int version);
+
+        database _db;
+        migration_options _options;
+        std::map<int, step> _steps;
+    };
+
+#pragma mark ## migrator ##
+
+    inline migrator::migrator(const database &db, const migration_options &options)
+            : _db(db), _options(options) {
+    }
+
+    template<class Step>
+    void migrator::add_step(int version, Step &&step) {
+        migrator::step entry;
+        entry.run = std::forward<Step>(step);
+        add(version, std::move(entry));
+    }
+
+    template<class Chunk>
+    void migrator::add_incremental_step(int version, Chunk &&chunk) {
+        migrator::step entry;
+        entry.run_chunk = std::forward<Chunk>(chunk);
+        add(version, std::move(entry));
+    }
+
+    inline int migrator::get_latest_version() const {
+        return _steps.empty() ? 0 : _steps.rbegin()->first;
+    }
+
+    inline int migrator::migrate(int target_version) {
+        if (target_version == 0) {
+            target_version = get_latest_version();
+        }
+
+        // the steps check the version again in their transactions, another process may be upgrading too
+        auto version = _db.get_user_version();
+        for (auto it = _steps.upper_bound(version); it != _steps.end() && it->first <= target_version; ++it) {
+            if (it->second.run) {
+                run_step(it->first, it->second);
+            } else {
+                run_incremental_step(it->first, it->second);
+            }
+        }
+
+        // another process may have upgraded further
+        return _db.get_user_version();
+    }
+
+    inline void migrator::add(int version, step step) {
+        if (version < 1) {
+            throw std::logic_error("invalid version, must be > 0");
+        }
+        if (!_steps.emplace(version, std::move(step)).second) {
+            throw std::logic_error("duplicate version: " + std::to_string(version));
+        }
+    }
+
+    inline void migrator::run_step(int version, const step &step) {
+        auto transaction = _db.create_transaction(_options.mode);
+        if (_db.get_user_version() >= version) {
+            return;
+        }
+        step.run(_db);
+        set_user_version(version);
+        transaction.commit();
+    }
+
+    inline void migrator::run_incremental_step(int version, const step &step) {
+        auto table = detail::quote_identifier(_options.progress_table);
+        _db.exec_sql("CREATE TABLE IF NOT EXISTS " + table + "(version INTEGER PRIMARY KEY, position INTEGER NOT NULL);");
+        auto select_sql = "SELECT position FROM " + table + " WHERE version = ?;";
+        auto save_sql = "INSERT OR REPLACE INTO " + table + "(version, position) VALUES(?, ?);";
+        auto delete_sql = "DELETE FROM " + table + " WHERE version = ?;";
+
+        for (;;) {
+            // the version and the position are read in the transaction of each chunk,
+            // so that the chunks committed by another process are not run again
+            auto transaction = _db.create_transaction(_options.mode);
+            if (_db.get_user_version() >= version) {
+                return;
+            }
+            sqlite3_int64 position = 0;
+            {
+                auto &&results = _db.query(select_sql, version);
+                for (auto &&cursor : results) {
+                    position = cursor.get<sqlite3_int64>(0);
+                }
+            }
+
+            auto completed = step.run_chunk(_db, position);
+            if (completed) {
+                _db.exec_sql(delete_sql, version);
+                set_user_version(version);
+            } else {
+                _db.exec_sql(save_sql, version, position);
+            }
+            transaction.commit();
+
+            if (completed) {
+                return;
+            }
+            if (_options.chunk_pause.count() > 0) {
+                std::this_thread::sleep_for(_options.chunk_pause);
+            }
+        }
+    }
+
+    inline void migrator::set_user_version(int version) {
+        std::stringstream ss;
+        ss << "PRAGMA user_version = " << version << ";";
+        _db.exec_sql(ss.str());
+    }
+}
@@ -0,0 +1,470 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Daisuke Itabashi (itabashi.d@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "scandium.h"
+
+namespace scandium {
+
+    /**
+     *  Describes the options of scandium::result_cache.
+     */
+    struct result_cache_options {
+        /**
+         *  The maximum bytes of the cached results, the least recently used results are evicted beyond it.
+         */
+        std::size_t memory_budget = 16 * 1024 * 1024;
+    };
+
+    /**
+     *  Represents the counters of scandium::result_cache.
+     */
+    struct result_cache_stats {
+        std::uint64_t hits;
+
+        std::uint64_t misses;
+
+        /**
+         *  The number of results removed because their tables were changed.
+         */
+        std::uint64_t invalidations;
+
+        /**
+         *  The number of results removed to keep the memory budget.
+         */
+        std::uint64_t evictions;
+
+        /**
+         *  The number of cached results.
+         */
+        std::size_t entries;
+
+        /**
+         *  The approximate bytes of the cached results.
+         */
+        std::size_t memory_size;
+
+        /**
+         *  Returns the ratio of hits to lookups, or 0 if no lookups.
+         */
+        double hit_rate() const;
+    };
+
+    /**
+     *  Represents the rows of a cached query.
+     */
+    struct cached_result {
+        std::vector<std::string> columns;
+
+        std::vector<std::vector<value>> rows;
+    };
+
+    /**
+     *  Caches the results of queries on a database, keyed by the SQL statement and the bound values.
+     *
+     *  The tables read by a query are recorded by an authorizer while the query is prepared,
+     *  and the results are invalidated per table by the update hook on writes of the same connection.
+     *  The tables are matched by name in any schema, because SQLite gives no schema for reads of no column,
+     *  such as count(*); a query with a FROM clause but no table recorded, such as over a subquery of constants,
+     *  is not cached.
+     *  Writes that the update hook does not report, such as to WITHOUT ROWID tables or DELETE without WHERE,
+     *  are detected by the total number of changes before each lookup and invalidate all the results,
+     *  as do schema changes and commits of other connections (PRAGMA schema_version and data_version).
+     *  Results computed inside a transaction are not cached, because the transaction may be rolled back.
+     *  Attached databases are not watched for commits of other connections.
+     *
+     *  The queries must be deterministic, for example must not use random() or the current time.
+     *  The cache must be created after the database is opened, and destroyed before the database is closed.
+     */
+    class result_cache {
+    public:
+        /**
+         *  Constructor.
+         *
+         *  @param db      the open database to cache the queries of.
+         *  @param options the cache options.
+         */
+        explicit result_cache(database &db, const result_cache_options &options = result_cache_options());
+
+        /**
+         *  Destructor.
+         *  Removes the listeners from the database.
+         */
+        ~result_cache() noexcept;
+
+        /**
+         *  Returns the cached rows of the query, or runs the query and caches the rows.
+         *
+         *  @param sql       the single SQL statement.
+         *  @param bind_args the values to bind to the placeholders such as ?
+         */
+        template<class... ArgType>
+        std::shared_ptr<const cached_result> query(const std::string &sql, ArgType &&... bind_args);
+
+        /**
+         *  Removes all the cached results.
+         */
+        void clear();
+
+        /**
+         *  Returns the counters.
+         */
+        result_cache_stats get_stats() const;
+
+    private:
+        result_cache(const result_cache &) = delete;
+
+        result_cache &operator=(const result_cache &) = delete;
+
+        struct entry {
+            std::string key;
+            std::shared_ptr<const cached_result> result;
+            std::vector<std::string> tables;
+            std::size_t memory_size;
+        };
+
+        /**
+         *  Removes all the results if the database may have been changed without the update hook.
+         */
+        void validate();
+
+        void invalidate_table(const std::string &table);
+
+        static std::string table_key(const char *table_name);
+
+        static bool has_from_clause(const std::string &sql);
+
+        void remove(std::list<entry>::iterator it);
+
+        void store(const std::string &key, std::shared_ptr<const cached_result> result);
+
+        static void append_key(std::string &) {
+        }
+
+        template<class First, class... Rest>
+        static void append_key(std::string &key, const First &first, const Rest &... rest);
+
+        static void append_value(std::string &key, const value &v);
+
+        database &_db;
+        result_cache_options _options;
+        std::vector<std::size_t> _listener_ids;
+        statement _data_version;
+        statement _schema_version;
+        sqlite3_int64 _last_data_version;
+        sqlite3_int64 _last_schema_version;
+        sqlite3_int64 _last_total_changes;
+        sqlite3_int64 _hooked_changes = 0;
+
+        bool _collecting = false;
+        std::vector<std::string> _collected_tables;
+
+        // most recently used first
+        std::list<entry> _entries;
+        std::unordered_map<std::string, std::list<entry>::iterator> _index;
+        std::unordered_map<std::string, std::unordered_set<entry *>> _table_index;
+        std::size_t _memory_size = 0;
+
+        std::uint64_t _hits = 0;
+        std::uint64_t _misses = 0;
+        std::uint64_t _invalidations = 0;
+        std::uint64_t _evictions = 0;
+    };
+
+#pragma mark ## result_cache_stats ##
+
+    inline double result_cache_stats::hit_rate() const {
+        auto lookups = static_cast<double>(hits) + misses;
+        return lookups > 0 ? hits / lookups : 0;
+    }
+
+#pragma mark ## result_cache ##
+
+    inline result_cache::result_cache(database &db, const result_cache_options &options)
+            : _db(db), _options(options),
+              _data_version(db.prepare_statement("PRAGMA data_version;")),
+              _schema_version(db.prepare_statement("PRAGMA schema_version;")),
+              _last_data_version(_data_version.query().begin()->get<sqlite3_int64>(0)),
+              _last_schema_version(_schema_version.query().begin()->get<sqlite3_int64>(0)),
+              _last_total_changes(db.get_total_changes()) {
+        _data_version.reset();
+        _schema_version.reset();
+
+        _listener_ids.push_back(_db.add_update_listener(
+                [this](int, const char *, const char *table_name, sqlite3_int64) {
+                    ++_hooked_changes;
+                    invalidate_table(table_key(table_name));
+                }));
+        _listener_ids.push_back(_db.add_authorizer(
+                [this](int action, const char *table_name, const char *, const char *, const char *) {
+                    // the database name is null for a read of no column
+                    if (_collecting && action == SQLITE_READ && table_name) {
+                        _collected_tables.push_back(table_key(table_name));
+                    }
+                    return SQLITE_OK;
+                }));
+    }
+
+    inline result_cache::~result_cache() noexcept {
+        for (auto &&id : _listener_ids) {
+            try {
+                _db.remove_listener(id);
+            } catch (...) {
+                // ignore
+            }
+        }
+    }
+
+    template<class... ArgType>
+    std::shared_ptr<const cached_result> result_cache::query(const std::string &sql, ArgType &&... bind_args) {
+        validate();
+
+        auto data_version = _data_version.query().begin()->get<sqlite3_int64>(0);
+        auto schema_version = _schema_version.query().begin()->get<sqlite3_int64>(0);
+        _data_version.reset();
+        _schema_version.reset();
+        if (data_version != _last_data_version || schema_version != _last_schema_version) {
+            clear();
+            _last_data_version = data_version;
+            _last_schema_version = schema_version;
+        }
+
+        std::string key = sql;
+        append_key(key, bind_args...);
+        auto found = _index.find(key);
+        if (found != _index.end()) {
+            ++_hits;
+            _entries.splice(_entries.begin(), _entries, found->second);
+            return found->second->result;
+        }
+        ++_misses;
+
+        struct collecting_scope {
+            result_cache &cache;
+
+            explicit collecting_scope(result_cache &cache) : cache(cache) {
+                cache._collected_tables.clear();
+                cache._collecting = true;
+            }
+
+            ~collecting_scope() {
+                cache._collecting = false;
+            }
+        };
+
+        std::shared_ptr<cached_result> result(new cached_result());
+        {
+            collecting_scope scope(*this);
+            auto rows = _db.query(sql, std::forward<ArgType>(bind_args)...);
+            scope.cache._collecting = false;
+            for (auto &&row : rows) {
+                if (result->columns.empty()) {
+                    for (int i = 0; i < row.get_column_count(); ++i) {
+                        result->columns.push_back(row.get_column_name(i));
+                    }
+                }
+                std::vector<value> values;
+                values.reserve(result->columns.size());
+                for (int i = 0; i < row.get_column_count(); ++i) {
+                    values.push_back(row.template get<value>(i));
+                }
+                result->rows.push_back(std::move(values));
+            }
+        }
+
+        // a query that reads a table the authorizer does not report could never be invalidated
+        if (!_db.in_transaction() && (!_collected_tables.empty() || !has_from_clause(sql))) {
+            store(key, result);
+        }
+        return result;
+    }
+
+    inline void result_cache::clear() {
+        _invalidations += _entries.size();
+        _entries.clear();
+        _index.clear();
+        _table_index.clear();
+        _memory_size = 0;
+    }
+
+    inline result_cache_stats result_cache::get_stats() const {
+        result_cache_stats stats;
+        stats.hits = _hits;
+        stats.misses = _misses;
+        stats.invalidations = _invalidations;
+        stats.evictions = _evictions;
+        stats.entries = _entries.size();
+        stats.memory_size = _memory_size;
+        return stats;
+    }
+
+    inline void result_cache::validate() {
+        // every change reported by the update hook is counted, so a difference means unreported writes,
+        // or rows of an aborted statement that were reported but not counted
+        auto total_changes = _db.get_total_changes();
+        if (total_changes - _last_total_changes != _hooked_changes) {
+            clear();
+        }
+        _last_total_changes = total_changes;
+        _hooked_changes = 0;
+    }
+
+    inline void result_cache::invalidate_table(const std::string &table) {
+        auto found = _table_index.find(table);
+        if (found == _table_index.end()) {
+            return;
+        }
+
+        auto entries = std::move(found->second);
+        _table_index.erase(found);
+        for (auto &&e : entries) {
+            ++_invalidations;
+            remove(_index[e->key]);
+        }
+    }
+
+    inline std::string result_cache::table_key(const char *table_name) {
+        // the table names of SQLite are case-insensitive for ASCII
+        std::string key = table_name;
+        for (auto &&c : key) {
+            if (c >= 'A' && c <= 'Z') {
+                c = static_cast<char>(c - 'A' + 'a');
+            }
+        }
+        return key;
+    }
+
+    inline bool result_cache::has_from_clause(const std::string &sql) {
+        // finds the keyword outside the literals; a false positive only leaves the result uncached
+        for (std::size_t i = 0; i < sql.size();) {
+            auto c = sql[i];
+            if (c == '\'' || c == '"' || c == '`' || c == '[') {
+                auto end = sql.find(c == '[' ? ']' : c, i + 1);
+                i = end == std::string::npos ? sql.size() : end + 1;
+            } else if (std::isalnum(static_cast<unsigned char>(c)) || c == '_') {
+                auto begin = i;
+                while (i < sql.size() && (std::isalnum(static_cast<unsigned char>(sql[i])) || sql[i] == '_')) {
+                    ++i;
+                }
+                if (i - begin == 4 && sqlite3_strnicmp(sql.data() + begin, "from", 4) == 0) {
+                    return true;
+                }
+            } else {
+                ++i;
+            }
+        }
+        return false;
+    }
+
+    inline void result_cache::remove(std::list<entry>::iterator it) {
+        for (auto &&table : it->tables) {
+            auto found = _table_index.find(table);
+            if (found != _table_index.end()) {
+                found->second.erase(&*it);
+                if (found->second.empty()) {
+                    _table_index.erase(found);
+                }
+            }
+        }
+        _memory_size -= it->memory_size;
+        _index.erase(it->key);
+        _entries.erase(it);
+    }
+
+    inline void result_cache::store(const std::string &key, std::shared_ptr<const cached_result> result) {
+        auto memory_size = sizeof(entry) + key.size() * 2;
+        for (auto &&column : result->columns) {
+            memory_size += sizeof(std::string) + column.size();
+        }
+        for (auto &&row : result->rows) {
+            memory_size += sizeof(row);
+            for (auto &&v : row) {
+                memory_size += v.memory_size();
+            }
+        }
+        if (memory_size > _options.memory_budget) {
+            return;
+        }
+
+        while (_memory_size + memory_size > _options.memory_budget && !_entries.empty()) {
+            ++_evictions;
+            remove(std::prev(_entries.end()));
+        }
+
+        entry e;
+        e.key = key;
+        e.result = std::move(result);
+        e.tables = _collected_tables;
+        e.memory_size = memory_size;
+        _entries.push_front(std::move(e));
+        _index[key] = _entries.begin();
+        for (auto &&table : _entries.front().tables) {
+            _table_index[table].insert(&_entries.front());
+        }
+        _memory_size += memory_size;
+    }
+
+    template<class First, class... Rest>
+    void result_cache::append_key(std::string &key, const First &first, const Rest &... rest) {
+        append_value(key, value(first));
+        append_key(key, rest...);
+    }
+
+    inline void result_cache::append_value(std::string &key, const value &v) {
+        // the type and the length prefix the bytes, so that different values never make the same key
+        key += '\0';
+        key += static_cast<char>(v.get_type());
+        switch (v.get_type()) {
+            case SQLITE_INTEGER: {
+                auto integer = v.get_int64();
+                key.append(reinterpret_cast<const char *>(&integer), sizeof(integer));
+                break;
+            }
+            case SQLITE_FLOAT: {
+                auto real = v.get_double();
+                key.append(reinterpret_cast<const char *>(&real), sizeof(real));
+                break;
+            }
+            case SQLITE_TEXT:
+            case SQLITE_BLOB: {
+                auto size = static_cast<std::uint64_t>(v.get_text().size());
+                key.append(reinterpret_cast<const char *>(&size), sizeof(size));
+                key += v.get_text();
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
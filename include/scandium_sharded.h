@@ -0,0 +1,463 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Daisuke Itabashi (itabashi.d@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "scandium.h"
+
+namespace scandium {
+
+    namespace detail {
+        /**
+         *  A fixed-size pool of threads running tasks in FIFO order.
+         */
+        class thread_pool {
+        public:
+            explicit thread_pool(std::size_t threads);
+
+            ~thread_pool() noexcept;
+
+            template<class Task>
+            std::future<typename std::result_of<Task()>::type> submit(Task &&task);
+
+        private:
+            thread_pool(const thread_pool &) = delete;
+
+            thread_pool &operator=(const thread_pool &) = delete;
+
+            void run();
+
+            std::mutex _mutex;
+            std::condition_variable _condition;
+            std::deque<std::function<void()>> _tasks;
+            bool _stopping = false;
+            std::vector<std::thread> _threads;
+        };
+    }
+
+    /**
+     *  Represents a set of databases, called shards, that are written by key and read all at once.
+     *  A key is hashed to choose the shard that stores it, so writes to different shards run in parallel.
+     *  Queries are fanned out to all the shards on a thread pool, and the results are merged.
+     *  A statement runs on one shard, so there are no transactions across shards.
+     *  Each shard is used by one thread at a time.
+     */
+    class sharded_database {
+    public:
+        /**
+         *  Constructor.
+         *
+         *  @param paths   the paths of the SQLite database files of the shards.
+         *  @param options the options to open the shards.
+         *  @param threads the number of threads to run queries, or 0 to use one thread per shard.
+         */
+        explicit sharded_database(const std::vector<std::string> &paths,
+                                  const open_options &options = open_options(),
+                                  std::size_t threads = 0);
+
+        /**
+         *  Destructor.
+         *  Stops the threads.
+         */
+        ~sharded_database() noexcept;
+
+        /**
+         *  Opens all the shards.
+         */
+        void open();
+
+        /**
+         *  Closes all the shards.
+         */
+        void close();
+
+        /**
+         *  Returns the number of shards.
+         */
+        std::size_t get_shard_count() const;
+
+        /**
+         *  Returns the index of the shard that stores the given key.
+         *
+         *  @tparam Key a type hashable by std::hash.
+         */
+        template<class Key>
+        std::size_t shard_of(const Key &key) const;
+
+        /**
+         *  Executes the SQL statement that does not return data on the shard of the given key.
+         *
+         *  @param key       the key choosing the shard.
+         *  @param sql       the single SQL statement.
+         *  @param bind_args the values to bind to the placeholders such as ?
+         */
+        template<class Key, class... ArgType>
+        void exec_sql(const Key &key, const std::string &sql, ArgType &&... bind_args);
+
+        /**
+         *  Executes the SQL statement that does not return data on all the shards in parallel, such as CREATE TABLE.
+         *
+         *  @param sql       the single SQL statement.
+         *  @param bind_args the values to bind to the placeholders such as ?
+         */
+        template<class... ArgType>
+        void exec_sql_all(const std::string &sql, ArgType &&... bind_args);
+
+        /**
+         *  Calls the function with the shard of the given key, for transactions and queries on one shard.
+         *
+         *  @tparam Function R(*)(database &db)
+         *
+         *  @param key      the key choosing the shard.
+         *  @param function the function to call while the shard is locked.
+         *
+         *  @return the value returned by the function.
+         */
+        template<class Key, class Function>
+        typename std::result_of<Function(database &)>::type with_shard(const Key &key, Function &&function);
+
+        /**
+         *  Runs the query on all the shards in parallel, and returns the rows of each shard.
+         *
+         *  @tparam Mapper T(*)(cursor &row)
+         *
+         *  @param sql       the single SQL statement.
+         *  @param mapper    the function converting a row to a value, called on the threads of the pool.
+         *  @param bind_args the values to bind to the placeholders such as ?
+         *
+         *  @return the values of the rows of each shard, in the order of the shards.
+         */
+        template<class Mapper, class... ArgType>
+        std::vector<std::vector<typename std::result_of<Mapper(cursor &)>::type>>
+        query_shards(const std::string &sql, Mapper &&mapper, ArgType &&... bind_args);
+
+        /**
+         *  Runs the query on all the shards in parallel, and concatenates the rows in the order of the shards.
+         *
+         *  @tparam Mapper T(*)(cursor &row)
+         */
+        template<class Mapper, class... ArgType>
+        std::vector<typename std::result_of<Mapper(cursor &)>::type>
+        query_concat(const std::string &sql, Mapper &&mapper, ArgType &&... bind_args);
+
+        /**
+         *  Runs the query on all the shards in parallel, and merges the sorted rows of the shards.
+         *  The query must sort the rows in the order of less, such as ORDER BY, and a LIMIT applies per shard.
+         *
+         *  @tparam Mapper T(*)(cursor &row)
+         *  @tparam Less   bool(*)(const T &a, const T &b)
+         */
+        template<class Mapper, class Less, class... ArgType>
+        std::vector<typename std::result_of<Mapper(cursor &)>::type>
+        query_merge(const std::string &sql, Mapper &&mapper, Less less, ArgType &&... bind_args);
+
+        /**
+         *  Runs the query computing partial aggregates on all the shards in parallel, and combines them,
+         *  such as the sums of "SELECT count(*), sum(x) FROM t".
+         *
+         *  @tparam Mapper  T(*)(cursor &row)
+         *  @tparam Combine T(*)(const T &accumulated, const T &partial)
+         *
+         *  @param sql       the single SQL statement.
+         *  @param mapper    the function converting a row to a partial aggregate.
+         *  @param initial   the initial value of the aggregate.
+         *  @param combine   the function combining a partial aggregate into the accumulated value.
+         *  @param bind_args the values to bind to the placeholders such as ?
+         */
+        template<class Mapper, class Combine, class... ArgType>
+        typename std::result_of<Mapper(cursor &)>::type
+        query_reduce(const std::string &sql, Mapper &&mapper,
+                     typename std::result_of<Mapper(cursor &)>::type initial, Combine combine,
+                     ArgType &&... bind_args);
+
+    private:
+        sharded_database(const sharded_database &) = delete;
+
+        sharded_database &operator=(const sharded_database &) = delete;
+
+        struct shard {
+            std::mutex mutex;
+            std::unique_ptr<database> db;
+        };
+
+        /**
+         *  Calls the function with each shard on the thread pool, and waits for all.
+         *  The first exception is rethrown after all the calls finished.
+         */
+        template<class Function>
+        std::vector<typename std::result_of<Function(database &)>::type> for_each_shard(Function &&function);
+
+        std::vector<std::unique_ptr<shard>> _shards;
+        detail::thread_pool _pool;
+    };
+
+#pragma mark ## thread_pool ##
+
+    namespace detail {
+        inline thread_pool::thread_pool(std::size_t threads) {
+            for (std::size_t i = 0; i < threads; ++i) {
+                _threads.emplace_back(&thread_pool::run, this);
+            }
+        }
+
+        inline thread_pool::~thread_pool() noexcept {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stopping = true;
+            }
+            _condition.notify_all();
+            for (auto &&thread : _threads) {
+                thread.join();
+            }
+        }
+
+        template<class Task>
+        std::future<typename std::result_of<Task()>::type> thread_pool::submit(Task &&task) {
+            typedef typename std::result_of<Task()>::type result_type;
+            auto packaged = std::make_shared<std::packaged_task<result_type()>>(std::forward<Task>(task));
+            auto future = packaged->get_future();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _tasks.emplace_back([packaged] {
+                    (*packaged)();
+                });
+            }
+            _condition.notify_one();
+            return future;
+        }
+
+        inline void thread_pool::run() {
+            for (;;) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _condition.wait(lock, [this] { return _stopping || !_tasks.empty(); });
+                    if (_tasks.empty()) {
+                        return;
+                    }
+                    task = std::move(_tasks.front());
+                    _tasks.pop_front();
+                }
+                task();
+            }
+        }
+    }
+
+#pragma mark ## sharded_database ##
+
+    inline sharded_database::sharded_database(const std::vector<std::string> &paths,
+                                              const open_options &options,
+                                              std::size_t threads)
+            : _pool(threads == 0 ? paths.size() : threads) {
+        if (paths.empty()) {
+            throw std::logic_error("no shards");
+        }
+        for (auto &&path : paths) {
+            std::unique_ptr<shard> s(new shard());
+            s->db.reset(new database(path, options));
+            _shards.push_back(std::move(s));
+        }
+    }
+
+    inline sharded_database::~sharded_database() noexcept {
+    }
+
+    inline void sharded_database::open() {
+        for (auto &&s : _shards) {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            s->db->open();
+        }
+    }
+
+    inline void sharded_database::close() {
+        for (auto &&s : _shards) {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            s->db->close();
+        }
+    }
+
+    inline std::size_t sharded_database::get_shard_count() const {
+        return _shards.size();
+    }
+
+    template<class Key>
+    std::size_t sharded_database::shard_of(const Key &key) const {
+        // std::hash of integers may be the identity, so the bits are mixed (the finalizer of MurmurHash3)
+        auto hash = static_cast<std::uint64_t>(std::hash<Key>()(key));
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return static_cast<std::size_t>(hash % _shards.size());
+    }
+
+    template<class Key, class... ArgType>
+    void sharded_database::exec_sql(const Key &key, const std::string &sql, ArgType &&... bind_args) {
+        auto &&s = _shards[shard_of(key)];
+        std::lock_guard<std::mutex> lock(s->mutex);
+        s->db->claim_thread();
+        s->db->exec_sql(sql, std::forward<ArgType>(bind_args)...);
+    }
+
+    template<class... ArgType>
+    void sharded_database::exec_sql_all(const std::string &sql, ArgType &&... bind_args) {
+        for_each_shard([&](database &db) {
+            db.exec_sql(sql, bind_args...);
+            return 0;
+        });
+    }
+
+    template<class Key, class Function>
+    typename std::result_of<Function(database &)>::type
+    sharded_database::with_shard(const Key &key, Function &&function) {
+        auto &&s = _shards[shard_of(key)];
+        std::lock_guard<std::mutex> lock(s->mutex);
+        s->db->claim_thread();
+        return function(*s->db);
+    }
+
+    template<class Mapper, class... ArgType>
+    std::vector<std::vector<typename std::result_of<Mapper(cursor &)>::type>>
+    sharded_database::query_shards(const std::string &sql, Mapper &&mapper, ArgType &&... bind_args) {
+        typedef typename std::result_of<Mapper(cursor &)>::type value_type;
+        return for_each_shard([&](database &db) {
+            std::vector<value_type> values;
+            for (auto &&row : db.query(sql, bind_args...)) {
+                values.push_back(mapper(row));
+            }
+            return values;
+        });
+    }
+
+    template<class Mapper, class... ArgType>
+    std::vector<typename std::result_of<Mapper(cursor &)>::type>
+    sharded_database::query_concat(const std::string &sql, Mapper &&mapper, ArgType &&... bind_args) {
+        auto shards = query_shards(sql, std::forward<Mapper>(mapper), std::forward<ArgType>(bind_args)...);
+        std::size_t size = 0;
+        for (auto &&values : shards) {
+            size += values.size();
+        }
+
+        std::vector<typename std::result_of<Mapper(cursor &)>::type> merged;
+        merged.reserve(size);
+        for (auto &&values : shards) {
+            std::move(values.begin(), values.end(), std::back_inserter(merged));
+        }
+        return merged;
+    }
+
+    template<class Mapper, class Less, class... ArgType>
+    std::vector<typename std::result_of<Mapper(cursor &)>::type>
+    sharded_database::query_merge(const std::string &sql, Mapper &&mapper, Less less, ArgType &&... bind_args) {
+        auto shards = query_shards(sql, std::forward<Mapper>(mapper), std::forward<ArgType>(bind_args)...);
+        std::size_t size = 0;
+        for (auto &&values : shards) {
+            size += values.size();
+        }
+
+        // a min-heap of the positions of the heads of the shards, the earlier shard wins ties
+        typedef std::pair<std::size_t, std::size_t> position;
+        auto greater = [&shards, &less](const position &a, const position &b) {
+            auto &&x = shards[a.first][a.second];
+            auto &&y = shards[b.first][b.second];
+            return less(y, x) || (!less(x, y) && b.first < a.first);
+        };
+        std::vector<position> heap;
+        for (std::size_t i = 0; i < shards.size(); ++i) {
+            if (!shards[i].empty()) {
+                heap.push_back(position(i, 0));
+            }
+        }
+        std::make_heap(heap.begin(), heap.end(), greater);
+
+        std::vector<typename std::result_of<Mapper(cursor &)>::type> merged;
+        merged.reserve(size);
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            auto &&head = heap.back();
+            merged.push_back(std::move(shards[head.first][head.second]));
+            if (++head.second < shards[head.first].size()) {
+                std::push_heap(heap.begin(), heap.end(), greater);
+            } else {
+                heap.pop_back();
+            }
+        }
+        return merged;
+    }
+
+    template<class Mapper, class Combine, class... ArgType>
+    typename std::result_of<Mapper(cursor &)>::type
+    sharded_database::query_reduce(const std::string &sql, Mapper &&mapper,
+                                   typename std::result_of<Mapper(cursor &)>::type initial, Combine combine,
+                                   ArgType &&... bind_args) {
+        auto shards = query_shards(sql, std::forward<Mapper>(mapper), std::forward<ArgType>(bind_args)...);
+        for (auto &&values : shards) {
+            for (auto &&value : values) {
+                initial = combine(initial, value);
+            }
+        }
+        return initial;
+    }
+
+    template<class Function>
+    std::vector<typename std::result_of<Function(database &)>::type>
+    sharded_database::for_each_shard(Function &&function) {
+        typedef typename std::result_of<Function(database &)>::type result_type;
+        std::vector<std::future<result_type>> futures;
+        for (auto &&s : _shards) {
+            auto raw = s.get();
+            futures.push_back(_pool.submit([raw, &function] {
+                std::lock_guard<std::mutex> lock(raw->mutex);
+                raw->db->claim_thread();
+                return function(*raw->db);
+            }));
+        }
+
+        // wait for all, the function is referenced by the tasks
+        for (auto &&future : futures) {
+            future.wait();
+        }
+
+        std::vector<result_type> results;
+        for (auto &&future : futures) {
+            results.push_back(future.get());
+        }
+        return results;
+    }
+}
@@ -0,0 +1,661 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Daisuke Itabashi (itabashi.d@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SCANDIUM_HAS_IO_URING 1
+#endif
+#endif
+
+#ifdef SCANDIUM_HAS_IO_URING
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "scandium_vfs.h"
+
+namespace scandium {
+
+    /**
+     *  Describes the options of scandium::uring_vfs.
+     */
+    struct uring_options {
+        /**
+         *  The number of pages read ahead once a sequential scan is detected.
+         */
+        unsigned prefetch_pages = 32;
+
+        /**
+         *  The number of consecutive page reads that start a read-ahead.
+         */
+        unsigned sequential_threshold = 2;
+
+        /**
+         *  true to register the read-ahead buffers with the kernel to save the page mapping per read.
+         */
+        bool register_buffers = true;
+    };
+
+    /**
+     *  A VFS for Linux that reads the main database file ahead with io_uring
+     *  when it detects sequential page reads such as table scans.
+     *  Writes, locks and all the other files are forwarded to the underlying VFS.
+     *  Falls back to the underlying VFS entirely if the kernel does not support io_uring.
+     */
+    class uring_vfs : public vfs {
+    public:
+        /**
+         *  Constructor.
+         *
+         *  @param name      the name to register the VFS as.
+         *  @param options   the read-ahead options.
+         *  @param base_name the name of the underlying VFS, or empty to use the default VFS.
+         */
+        explicit uring_vfs(const std::string &name = "io_uring",
+                           const uring_options &options = uring_options(),
+                           const std::string &base_name = std::string());
+
+        /**
+         *  Returns true if the kernel supports io_uring, or false otherwise.
+         */
+        static bool is_supported();
+
+        /**
+         *  Returns the number of page reads submitted to io_uring.
+         */
+        std::uint64_t get_submitted_reads() const;
+
+        /**
+         *  Returns the number of page reads served from the read-ahead buffers.
+         */
+        std::uint64_t get_prefetch_hits() const;
+
+    protected:
+        std::unique_ptr<vfs_file> create_file(const char *path, int flags) override;
+
+    private:
+        class uring_file;
+
+        uring_options _options;
+        std::atomic<std::uint64_t> _submitted_reads;
+        std::atomic<std::uint64_t> _prefetch_hits;
+    };
+
+#pragma mark ## uring ##
+
+    namespace detail {
+
+        /**
+         *  A minimal io_uring instance using the raw system calls.
+         */
+        class uring {
+        public:
+            uring() = default;
+
+            ~uring() noexcept;
+
+            bool init(unsigned entries);
+
+            /**
+             *  Tears down the ring, which cancels the requests in flight.
+             */
+            void exit();
+
+            bool is_initialized() const;
+
+            bool register_buffer(void *data, std::size_t size);
+
+            void unregister_buffers();
+
+            io_uring_sqe *get_sqe();
+
+            bool submit(unsigned wait_count);
+
+            bool pop(io_uring_cqe *cqe);
+
+        private:
+            uring(const uring &) = delete;
+
+            uring &operator=(const uring &) = delete;
+
+            int _fd = -1;
+            void *_sq_ring = nullptr;
+            std::size_t _sq_ring_size = 0;
+            void *_cq_ring = nullptr;
+            std::size_t _cq_ring_size = 0;
+            io_uring_sqe *_sqes = nullptr;
+            std::size_t _sqes_size = 0;
+
+            unsigned *_sq_head = nullptr;
+            unsigned *_sq_tail = nullptr;
+            unsigned *_sq_mask = nullptr;
+            unsigned *_sq_entries = nullptr;
+            unsigned *_sq_array = nullptr;
+            unsigned *_cq_head = nullptr;
+            unsigned *_cq_tail = nullptr;
+            unsigned *_cq_mask = nullptr;
+            io_uring_cqe *_cqes = nullptr;
+
+            unsigned _pending = 0;
+            bool _registered = false;
+        };
+
+        inline uring::~uring() noexcept {
+            exit();
+        }
+
+        inline bool uring::init(unsigned entries) {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+
+            _fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            if (_fd < 0) {
+                return false;
+            }
+
+            _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            _cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            auto single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single_mmap) {
+                _sq_ring_size = _cq_ring_size = _sq_ring_size > _cq_ring_size ? _sq_ring_size : _cq_ring_size;
+            }
+
+            _sq_ring = mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            _fd, IORING_OFF_SQ_RING);
+            if (_sq_ring == MAP_FAILED) {
+                _sq_ring = nullptr;
+                return false;
+            }
+
+            if (single_mmap) {
+                _cq_ring = _sq_ring;
+            } else {
+                _cq_ring = mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                _fd, IORING_OFF_CQ_RING);
+                if (_cq_ring == MAP_FAILED) {
+                    _cq_ring = nullptr;
+                    return false;
+                }
+            }
+
+            _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+            auto sqes = mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             _fd, IORING_OFF_SQES);
+            if (sqes == MAP_FAILED) {
+                return false;
+            }
+            _sqes = static_cast<io_uring_sqe *>(sqes);
+
+            auto sq = static_cast<char *>(_sq_ring);
+            _sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+            _sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+            _sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+            _sq_entries = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+            _sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+            auto cq = static_cast<char *>(_cq_ring);
+            _cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+            _cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+            _cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+            _cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+            return true;
+        }
+
+        inline void uring::exit() {
+            if (_sqes) {
+                munmap(_sqes, _sqes_size);
+            }
+            if (_cq_ring && _cq_ring != _sq_ring) {
+                munmap(_cq_ring, _cq_ring_size);
+            }
+            if (_sq_ring) {
+                munmap(_sq_ring, _sq_ring_size);
+            }
+            if (_fd >= 0) {
+                ::close(_fd);
+            }
+            _fd = -1;
+            _sq_ring = _cq_ring = nullptr;
+            _sqes = nullptr;
+            _cqes = nullptr;
+            _pending = 0;
+            _registered = false;
+        }
+
+        inline bool uring::is_initialized() const {
+            return _cqes != nullptr;
+        }
+
+        inline bool uring::register_buffer(void *data, std::size_t size) {
+            iovec iov;
+            iov.iov_base = data;
+            iov.iov_len = size;
+            _registered = syscall(__NR_io_uring_register, _fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+            return _registered;
+        }
+
+        inline void uring::unregister_buffers() {
+            if (_registered) {
+                syscall(__NR_io_uring_register, _fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+                _registered = false;
+            }
+        }
+
+        inline io_uring_sqe *uring::get_sqe() {
+            auto head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+            auto tail = *_sq_tail + _pending;
+            if (tail - head >= *_sq_entries) {
+                return nullptr;
+            }
+
+            auto index = tail & *_sq_mask;
+            _sq_array[index] = index;
+            ++_pending;
+
+            auto sqe = &_sqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            return sqe;
+        }
+
+        inline bool uring::submit(unsigned wait_count) {
+            auto count = _pending;
+            if (count > 0) {
+                __atomic_store_n(_sq_tail, *_sq_tail + count, __ATOMIC_RELEASE);
+                _pending = 0;
+            }
+
+            if (count == 0 && wait_count == 0) {
+                return true;
+            }
+
+            for (;;) {
+                auto rc = syscall(__NR_io_uring_enter, _fd, count, wait_count,
+                                  wait_count > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+                if (rc >= 0) {
+                    return true;
+                }
+                if (errno != EINTR) {
+                    return false;
+                }
+                // the submission has been consumed if interrupted while waiting
+                count = 0;
+            }
+        }
+
+        inline bool uring::pop(io_uring_cqe *cqe) {
+            auto head = *_cq_head;
+            if (head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) {
+                return false;
+            }
+
+            *cqe = _cqes[head & *_cq_mask];
+            __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+    }
+
+#pragma mark ## uring_vfs ##
+
+    class uring_vfs::uring_file : public vfs_file {
+    public:
+        uring_file(uring_vfs *owner, const uring_options &options)
+                : _owner(owner), _options(options), _slots(options.prefetch_pages) {
+        }
+
+        ~uring_file() noexcept override {
+            release();
+        }
+
+        int close() override {
+            release();
+            return vfs_file::close();
+        }
+
+        int read(void *buffer, int amount, sqlite3_int64 offset) override {
+            if (!prepare() || amount < 512 || offset % amount != 0) {
+                return vfs_file::read(buffer, amount, offset);
+            }
+
+            reap(false);
+
+            auto slot = find_slot(offset, amount);
+            if (slot) {
+                if (slot->state == slot_state::in_flight) {
+                    wait_for(slot);
+                }
+                if (slot->state == slot_state::ready && slot->result == amount) {
+                    std::memcpy(buffer, slot_data(slot), static_cast<std::size_t>(amount));
+                    slot->state = slot_state::free;
+                    _owner->_prefetch_hits.fetch_add(1, std::memory_order_relaxed);
+                    track(amount, offset);
+                    read_ahead(amount, offset);
+                    return SQLITE_OK;
+                }
+                slot->state = slot_state::free;
+            }
+
+            track(amount, offset);
+            read_ahead(amount, offset);
+            return vfs_file::read(buffer, amount, offset);
+        }
+
+        int write(const void *buffer, int amount, sqlite3_int64 offset) override {
+            invalidate();
+            auto rc = vfs_file::write(buffer, amount, offset);
+            if (rc == SQLITE_OK && _file_size >= 0 && offset + amount > _file_size) {
+                _file_size = offset + amount;
+            }
+            return rc;
+        }
+
+        int truncate(sqlite3_int64 size) override {
+            invalidate();
+            auto rc = vfs_file::truncate(size);
+            _file_size = rc == SQLITE_OK ? size : -1;
+            return rc;
+        }
+
+        int lock(int level) override {
+            // another process may have changed the file while no lock was held
+            if (level == SQLITE_LOCK_SHARED) {
+                invalidate();
+                _file_size = -1;
+            }
+            return vfs_file::lock(level);
+        }
+
+        int shm_lock(int offset, int n, int flags) override {
+            // a new WAL snapshot may see pages checkpointed by other connections
+            invalidate();
+            _file_size = -1;
+            return vfs_file::shm_lock(offset, n, flags);
+        }
+
+    private:
+        enum class slot_state {
+            free,
+            in_flight,
+            ready,
+        };
+
+        struct slot {
+            slot_state state = slot_state::free;
+            bool stale = false;
+            sqlite3_int64 offset = 0;
+            int result = 0;
+        };
+
+        bool prepare() {
+            if (_fd == -2) {
+                return false;
+            }
+            if (_fd >= 0) {
+                return true;
+            }
+
+            _fd = -2;
+            if (get_path().empty() || _slots.empty() || !_ring.init(static_cast<unsigned>(_slots.size()))) {
+                return false;
+            }
+            auto fd = ::open(get_path().c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return false;
+            }
+            _fd = fd;
+            return true;
+        }
+
+        void release() {
+            if (_fd >= 0) {
+                drain();
+            }
+            if (_fd >= 0) {
+                _ring.unregister_buffers();
+                ::close(_fd);
+            }
+            _fd = -2;
+            std::free(_buffer);
+            _buffer = nullptr;
+        }
+
+        char *slot_data(slot *slot) {
+            return _buffer + (slot - _slots.data()) * static_cast<std::size_t>(_slot_size);
+        }
+
+        slot *find_slot(sqlite3_int64 offset, int amount) {
+            if (amount != _slot_size) {
+                return nullptr;
+            }
+            for (auto &&slot : _slots) {
+                if (slot.state != slot_state::free && !slot.stale && slot.offset == offset) {
+                    return &slot;
+                }
+            }
+            return nullptr;
+        }
+
+        void track(int amount, sqlite3_int64 offset) {
+            _run = offset == _last_offset + amount ? _run + 1 : 0;
+            _last_offset = offset;
+        }
+
+        bool ensure_buffers(int amount) {
+            if (_buffer && _slot_size == amount) {
+                return true;
+            }
+
+            drain();
+            if (_fd < 0) {
+                return false;
+            }
+            _ring.unregister_buffers();
+            std::free(_buffer);
+            _buffer = nullptr;
+
+            void *buffer = nullptr;
+            auto size = _slots.size() * static_cast<std::size_t>(amount);
+            if (posix_memalign(&buffer, 4096, size) != 0) {
+                return false;
+            }
+            _buffer = static_cast<char *>(buffer);
+            _slot_size = amount;
+            _fixed = _options.register_buffers && _ring.register_buffer(_buffer, size);
+            _next_offset = 0;
+            return true;
+        }
+
+        void read_ahead(int amount, sqlite3_int64 offset) {
+            if (_fd < 0 || _run < _options.sequential_threshold || !ensure_buffers(amount)) {
+                return;
+            }
+
+            // the size is cached, so that a sequential scan costs no syscall per page
+            if (_file_size < 0) {
+                struct stat st;
+                if (fstat(_fd, &st) != 0) {
+                    return;
+                }
+                _file_size = st.st_size;
+            }
+
+            // keep the window ahead of the reader, and recycle pages behind it
+            for (auto &&slot : _slots) {
+                if (slot.state == slot_state::ready && slot.offset <= offset) {
+                    slot.state = slot_state::free;
+                }
+            }
+            if (_next_offset <= offset) {
+                _next_offset = offset + amount;
+            }
+
+            unsigned submitted = 0;
+            for (auto &&slot : _slots) {
+                if (_next_offset + amount > _file_size) {
+                    break;
+                }
+                if (slot.state != slot_state::free) {
+                    continue;
+                }
+
+                auto sqe = _ring.get_sqe();
+                if (!sqe) {
+                    break;
+                }
+                sqe->opcode = _fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+                sqe->fd = _fd;
+                sqe->off = static_cast<std::uint64_t>(_next_offset);
+                sqe->addr = reinterpret_cast<std::uint64_t>(slot_data(&slot));
+                sqe->len = static_cast<std::uint32_t>(amount);
+                sqe->buf_index = 0;
+                sqe->user_data = static_cast<std::uint64_t>(&slot - _slots.data());
+
+                slot.state = slot_state::in_flight;
+                slot.stale = false;
+                slot.offset = _next_offset;
+                _next_offset += amount;
+                ++submitted;
+            }
+
+            if (submitted > 0) {
+                _ring.submit(0);
+                _owner->_submitted_reads.fetch_add(submitted, std::memory_order_relaxed);
+            }
+        }
+
+        void reap(bool wait) {
+            io_uring_cqe cqe;
+            if (wait && !_ring.submit(1)) {
+                // give up the reads in flight rather than spinning on a broken ring
+                abandon();
+                return;
+            }
+
+            while (_ring.pop(&cqe)) {
+                auto &&slot = _slots[static_cast<std::size_t>(cqe.user_data)];
+                slot.result = cqe.res;
+                slot.state = slot.stale ? slot_state::free : slot_state::ready;
+                slot.stale = false;
+            }
+        }
+
+        void wait_for(slot *slot) {
+            while (slot->state == slot_state::in_flight) {
+                reap(true);
+            }
+        }
+
+        void drain() {
+            for (auto &&slot : _slots) {
+                wait_for(&slot);
+                slot.state = slot_state::free;
+            }
+        }
+
+        void abandon() {
+            auto in_flight = false;
+            for (auto &&slot : _slots) {
+                in_flight = in_flight || slot.state == slot_state::in_flight;
+                slot.state = slot_state::free;
+                slot.stale = false;
+            }
+
+            // the kernel may still complete the reads in flight into the buffer, so it is leaked, never reused
+            _ring.exit();
+            if (in_flight) {
+                _buffer = nullptr;
+            }
+            ::close(_fd);
+            _fd = -2;
+        }
+
+        void invalidate() {
+            for (auto &&slot : _slots) {
+                if (slot.state == slot_state::in_flight) {
+                    slot.stale = true;
+                } else {
+                    slot.state = slot_state::free;
+                }
+            }
+            _run = 0;
+            _next_offset = 0;
+        }
+
+        uring_vfs *_owner;
+        uring_options _options;
+        detail::uring _ring;
+        std::vector<slot> _slots;
+        char *_buffer = nullptr;
+        int _slot_size = 0;
+        bool _fixed = false;
+        int _fd = -1;
+        unsigned _run = 0;
+        sqlite3_int64 _last_offset = -1;
+        sqlite3_int64 _next_offset = 0;
+        sqlite3_int64 _file_size = -1;
+    };
+
+    inline uring_vfs::uring_vfs(const std::string &name, const uring_options &options, const std::string &base_name)
+            : vfs(name, base_name), _options(options), _submitted_reads(0), _prefetch_hits(0) {
+    }
+
+    inline bool uring_vfs::is_supported() {
+        static const bool supported = [] {
+            detail::uring ring;
+            return ring.init(1);
+        }();
+        return supported;
+    }
+
+    inline std::uint64_t uring_vfs::get_submitted_reads() const {
+        return _submitted_reads.load(std::memory_order_relaxed);
+    }
+
+    inline std::uint64_t uring_vfs::get_prefetch_hits() const {
+        return _prefetch_hits.load(std::memory_order_relaxed);
+    }
+
+    inline std::unique_ptr<vfs_file> uring_vfs::create_file(const char *path, int flags) {
+        if (!path || !(flags & SQLITE_OPEN_MAIN_DB) || !is_supported()) {
+            return vfs::create_file(path, flags);
+        }
+        return std::unique_ptr<vfs_file>(new uring_file(this, _options));
+    }
+}
+
+#endif // SCANDIUM_HAS_IO_URING
@@ -0,0 +1,872 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Daisuke Itabashi (itabashi.d@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "scandium.h"
+
+namespace scandium {
+
+    class vfs;
+
+    /**
+     *  Represents a file opened by a scandium::vfs.
+     *  Every method forwards to the file opened by the underlying VFS,
+     *  and returns an SQLite result code.
+     */
+    class vfs_file {
+    public:
+        /**
+         *  Constructor.
+         */
+        vfs_file();
+
+        /**
+         *  Destructor.
+         */
+        virtual ~vfs_file() noexcept;
+
+        virtual int close();
+
+        virtual int read(void *buffer, int amount, sqlite3_int64 offset);
+
+        virtual int write(const void *buffer, int amount, sqlite3_int64 offset);
+
+        virtual int truncate(sqlite3_int64 size);
+
+        virtual int sync(int flags);
+
+        virtual int file_size(sqlite3_int64 *size);
+
+        virtual int lock(int level);
+
+        virtual int unlock(int level);
+
+        virtual int check_reserved_lock(int *result);
+
+        virtual int file_control(int op, void *arg);
+
+        virtual int sector_size();
+
+        virtual int device_characteristics();
+
+        virtual int shm_map(int page, int page_size, int extend, void volatile **address);
+
+        virtual int shm_lock(int offset, int n, int flags);
+
+        virtual void shm_barrier();
+
+        virtual int shm_unmap(int delete_flag);
+
+        virtual int fetch(sqlite3_int64 offset, int amount, void **address);
+
+        virtual int unfetch(sqlite3_int64 offset, void *address);
+
+        /**
+         *  Returns the path of the file, or an empty string if the file is a temporary file.
+         */
+        const std::string &get_path() const;
+
+        /**
+         *  Returns the SQLITE_OPEN_* flags the file was opened with.
+         */
+        int get_flags() const;
+
+    protected:
+        /**
+         *  Returns the file opened by the underlying VFS.
+         */
+        sqlite3_file *base() const;
+
+    private:
+        vfs_file(const vfs_file &) = delete;
+
+        vfs_file &operator=(const vfs_file &) = delete;
+
+        sqlite3_file *_base;
+        std::string _path;
+        int _flags;
+
+        friend class vfs;
+    };
+
+    /**
+     *  A base class to implement an SQLite VFS in C++.
+     *  Every method forwards to the underlying VFS unless overridden.
+     *  The VFS must outlive all the databases opened with it.
+     */
+    class vfs {
+    public:
+        /**
+         *  Constructor.
+         *
+         *  @param name      the name to register the VFS as.
+         *  @param base_name the name of the underlying VFS, or empty to use the default VFS.
+         */
+        explicit vfs(const std::string &name, const std::string &base_name = std::string());
+
+        /**
+         *  Destructor.
+         *  Unregisters the VFS if registered.
+         */
+        virtual ~vfs() noexcept;
+
+        /**
+         *  Registers the VFS, so that open_options::vfs can select it by the name.
+         *
+         *  @param make_default true to make the VFS the default VFS.
+         */
+        void register_vfs(bool make_default = false);
+
+        /**
+         *  Unregisters the VFS.
+         */
+        void unregister_vfs();
+
+        /**
+         *  Returns true if the VFS is registered, or false otherwise.
+         */
+        bool is_registered() const;
+
+        /**
+         *  Returns the name of the VFS.
+         */
+        const std::string &get_name() const;
+
+        /**
+         *  Returns the underlying VFS.
+         */
+        sqlite3_vfs *get_base() const;
+
+    protected:
+        /**
+         *  Creates the file object for a file being opened.
+         *  The file opened by the underlying VFS is attached after this returns.
+         *
+         *  @param path  the path of the file, or nullptr if the file is a temporary file.
+         *  @param flags the SQLITE_OPEN_* flags.
+         */
+        virtual std::unique_ptr<vfs_file> create_file(const char *path, int flags);
+
+        virtual int delete_file(const char *path, int sync_dir);
+
+        virtual int access(const char *path, int flags, int *result);
+
+        virtual int full_pathname(const char *path, int size, char *output);
+
+    private:
+        vfs(const vfs &) = delete;
+
+        vfs &operator=(const vfs &) = delete;
+
+        struct file_handle {
+            sqlite3_file file;
+            vfs_file *impl;
+        };
+
+        static sqlite3_file *base_of(sqlite3_file *file);
+
+        static vfs_file *impl_of(sqlite3_file *file);
+
+        static const sqlite3_io_methods *io_methods();
+
+        static int x_open(sqlite3_vfs *pvfs, const char *name, sqlite3_file *file, int flags, int *out_flags);
+
+        static int x_delete(sqlite3_vfs *pvfs, const char *name, int sync_dir);
+
+        static int x_access(sqlite3_vfs *pvfs, const char *name, int flags, int *result);
+
+        static int x_full_pathname(sqlite3_vfs *pvfs, const char *name, int size, char *output);
+
+        std::string _name;
+        sqlite3_vfs *_base;
+        sqlite3_vfs _vfs;
+        bool _registered;
+    };
+
+    /**
+     *  Represents the statistics of one kind of I/O operation.
+     */
+    struct io_op_stats {
+        /**
+         *  The number of latency buckets, the bucket i counts latencies in [2^i, 2^(i+1)) nanoseconds.
+         */
+        static const int latency_bucket_count = 40;
+
+        std::uint64_t count;
+        std::uint64_t bytes;
+        std::uint64_t total_nanoseconds;
+        std::array<std::uint64_t, latency_bucket_count> latency;
+    };
+
+    /**
+     *  Represents the I/O statistics of a file.
+     */
+    struct io_stats {
+        io_op_stats read;
+        io_op_stats write;
+        io_op_stats sync;
+        io_op_stats truncate;
+    };
+
+    /**
+     *  A VFS that counts bytes, operations, syncs and latencies per file.
+     *  Pages accessed through memory mapping (PRAGMA mmap_size) are not counted.
+     */
+    class stats_vfs : public vfs {
+    public:
+        /**
+         *  @copydoc vfs::vfs(const std::string &,const std::string &)
+         */
+        explicit stats_vfs(const std::string &name = "stats", const std::string &base_name = std::string());
+
+        /**
+         *  Returns the statistics of the file, or zeros if the file has not been opened.
+         *
+         *  @param path the full path of the file, such as the result of sqlite3_db_filename().
+         */
+        io_stats get_stats(const std::string &path) const;
+
+        /**
+         *  Returns the statistics of all the files opened, keyed by the full path.
+         */
+        std::map<std::string, io_stats> get_all_stats() const;
+
+        /**
+         *  Clears all the statistics.
+         */
+        void reset_stats();
+
+    protected:
+        std::unique_ptr<vfs_file> create_file(const char *path, int flags) override;
+
+    private:
+        struct op_counters {
+            std::atomic<std::uint64_t> count;
+            std::atomic<std::uint64_t> bytes;
+            std::atomic<std::uint64_t> total_nanoseconds;
+            std::array<std::atomic<std::uint64_t>, io_op_stats::latency_bucket_count> latency;
+
+            op_counters();
+
+            void record(std::uint64_t bytes, std::chrono::steady_clock::duration elapsed);
+
+            void clear();
+
+            io_op_stats snapshot() const;
+        };
+
+        struct file_counters {
+            op_counters read;
+            op_counters write;
+            op_counters sync;
+            op_counters truncate;
+
+            io_stats snapshot() const;
+        };
+
+        class stats_file;
+
+        mutable std::mutex _mutex;
+        std::map<std::string, std::shared_ptr<file_counters>> _counters;
+    };
+
+#pragma mark ## vfs_file ##
+
+    inline vfs_file::vfs_file()
+            : _base(nullptr), _flags(0) {
+    }
+
+    inline vfs_file::~vfs_file() noexcept {
+    }
+
+    inline int vfs_file::close() {
+        return _base->pMethods->xClose(_base);
+    }
+
+    inline int vfs_file::read(void *buffer, int amount, sqlite3_int64 offset) {
+        return _base->pMethods->xRead(_base, buffer, amount, offset);
+    }
+
+    inline int vfs_file::write(const void *buffer, int amount, sqlite3_int64 offset) {
+        return _base->pMethods->xWrite(_base, buffer, amount, offset);
+    }
+
+    inline int vfs_file::truncate(sqlite3_int64 size) {
+        return _base->pMethods->xTruncate(_base, size);
+    }
+
+    inline int vfs_file::sync(int flags) {
+        return _base->pMethods->xSync(_base, flags);
+    }
+
+    inline int vfs_file::file_size(sqlite3_int64 *size) {
+        return _base->pMethods->xFileSize(_base, size);
+    }
+
+    inline int vfs_file::lock(int level) {
+        return _base->pMethods->xLock(_base, level);
+    }
+
+    inline int vfs_file::unlock(int level) {
+        return _base->pMethods->xUnlock(_base, level);
+    }
+
+    inline int vfs_file::check_reserved_lock(int *result) {
+        return _base->pMethods->xCheckReservedLock(_base, result);
+    }
+
+    inline int vfs_file::file_control(int op, void *arg) {
+        return _base->pMethods->xFileControl(_base, op, arg);
+    }
+
+    inline int vfs_file::sector_size() {
+        return _base->pMethods->xSectorSize(_base);
+    }
+
+    inline int vfs_file::device_characteristics() {
+        return _base->pMethods->xDeviceCharacteristics(_base);
+    }
+
+    inline int vfs_file::shm_map(int page, int page_size, int extend, void volatile **address) {
+        if (_base->pMethods->iVersion < 2) {
+            return SQLITE_IOERR_SHMMAP;
+        }
+        return _base->pMethods->xShmMap(_base, page, page_size, extend, address);
+    }
+
+    inline int vfs_file::shm_lock(int offset, int n, int flags) {
+        if (_base->pMethods->iVersion < 2) {
+            return SQLITE_IOERR_SHMLOCK;
+        }
+        return _base->pMethods->xShmLock(_base, offset, n, flags);
+    }
+
+    inline void vfs_file::shm_barrier() {
+        if (_base->pMethods->iVersion >= 2) {
+            _base->pMethods->xShmBarrier(_base);
+        }
+    }
+
+    inline int vfs_file::shm_unmap(int delete_flag) {
+        if (_base->pMethods->iVersion < 2) {
+            return SQLITE_OK;
+        }
+        return _base->pMethods->xShmUnmap(_base, delete_flag);
+    }
+
+    inline int vfs_file::fetch(sqlite3_int64 offset, int amount, void **address) {
+        if (_base->pMethods->iVersion < 3) {
+            *address = nullptr;
+            return SQLITE_OK;
+        }
+        return _base->pMethods->xFetch(_base, offset, amount, address);
+    }
+
+    inline int vfs_file::unfetch(sqlite3_int64 offset, void *address) {
+        if (_base->pMethods->iVersion < 3) {
+            return SQLITE_OK;
+        }
+        return _base->pMethods->xUnfetch(_base, offset, address);
+    }
+
+    inline const std::string &vfs_file::get_path() const {
+        return _path;
+    }
+
+    inline int vfs_file::get_flags() const {
+        return _flags;
+    }
+
+    inline sqlite3_file *vfs_file::base() const {
+        return _base;
+    }
+
+#pragma mark ## vfs ##
+
+    inline vfs::vfs(const std::string &name, const std::string &base_name)
+            : _name(name), _base(sqlite3_vfs_find(base_name.empty() ? nullptr : base_name.c_str())), _vfs(),
+              _registered(false) {
+        if (!_base) {
+            throw std::logic_error("no VFS named '" + base_name + "' is found");
+        }
+
+        _vfs.iVersion = _base->iVersion < 3 ? _base->iVersion : 3;
+        _vfs.szOsFile = static_cast<int>(sizeof(file_handle)) + _base->szOsFile;
+        _vfs.mxPathname = _base->mxPathname;
+        _vfs.zName = _name.c_str();
+        _vfs.pAppData = this;
+        _vfs.xOpen = &vfs::x_open;
+        _vfs.xDelete = &vfs::x_delete;
+        _vfs.xAccess = &vfs::x_access;
+        _vfs.xFullPathname = &vfs::x_full_pathname;
+
+        // the remaining methods do not depend on the VFS instance, so they are forwarded as they are
+        _vfs.xDlOpen = _base->xDlOpen;
+        _vfs.xDlError = _base->xDlError;
+        _vfs.xDlSym = _base->xDlSym;
+        _vfs.xDlClose = _base->xDlClose;
+        _vfs.xRandomness = _base->xRandomness;
+        _vfs.xSleep = _base->xSleep;
+        _vfs.xCurrentTime = _base->xCurrentTime;
+        _vfs.xGetLastError = _base->xGetLastError;
+        if (_vfs.iVersion >= 2) {
+            _vfs.xCurrentTimeInt64 = _base->xCurrentTimeInt64;
+        }
+        if (_vfs.iVersion >= 3) {
+            _vfs.xSetSystemCall = _base->xSetSystemCall;
+            _vfs.xGetSystemCall = _base->xGetSystemCall;
+            _vfs.xNextSystemCall = _base->xNextSystemCall;
+        }
+    }
+
+    inline vfs::~vfs() noexcept {
+        if (_registered) {
+            sqlite3_vfs_unregister(&_vfs);
+        }
+    }
+
+    inline void vfs::register_vfs(bool make_default) {
+        auto rc = sqlite3_vfs_register(&_vfs, make_default ? 1 : 0);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to register vfs", rc);
+        }
+        _registered = true;
+    }
+
+    inline void vfs::unregister_vfs() {
+        if (!_registered) {
+            return;
+        }
+
+        auto rc = sqlite3_vfs_unregister(&_vfs);
+        if (rc != SQLITE_OK) {
+            throw sqlite_error("failed to unregister vfs", rc);
+        }
+        _registered = false;
+    }
+
+    inline bool vfs::is_registered() const {
+        return _registered;
+    }
+
+    inline const std::string &vfs::get_name() const {
+        return _name;
+    }
+
+    inline sqlite3_vfs *vfs::get_base() const {
+        return _base;
+    }
+
+    inline std::unique_ptr<vfs_file> vfs::create_file(const char *, int) {
+        return std::unique_ptr<vfs_file>(new vfs_file());
+    }
+
+    inline int vfs::delete_file(const char *path, int sync_dir) {
+        return _base->xDelete(_base, path, sync_dir);
+    }
+
+    inline int vfs::access(const char *path, int flags, int *result) {
+        return _base->xAccess(_base, path, flags, result);
+    }
+
+    inline int vfs::full_pathname(const char *path, int size, char *output) {
+        return _base->xFullPathname(_base, path, size, output);
+    }
+
+    inline sqlite3_file *vfs::base_of(sqlite3_file *file) {
+        return reinterpret_cast<sqlite3_file *>(reinterpret_cast<char *>(file) + sizeof(file_handle));
+    }
+
+    inline vfs_file *vfs::impl_of(sqlite3_file *file) {
+        return reinterpret_cast<file_handle *>(file)->impl;
+    }
+
+    inline const sqlite3_io_methods *vfs::io_methods() {
+        // SQLite calls these from C, so no exception may escape
+        struct methods {
+            static int x_close(sqlite3_file *file) {
+                auto impl = impl_of(file);
+                int rc;
+                try {
+                    rc = impl->close();
+                } catch (...) {
+                    rc = SQLITE_IOERR_CLOSE;
+                }
+                delete impl;
+                return rc;
+            }
+
+            static int x_read(sqlite3_file *file, void *buffer, int amount, sqlite3_int64 offset) {
+                try {
+                    return impl_of(file)->read(buffer, amount, offset);
+                } catch (...) {
+                    return SQLITE_IOERR_READ;
+                }
+            }
+
+            static int x_write(sqlite3_file *file, const void *buffer, int amount, sqlite3_int64 offset) {
+                try {
+                    return impl_of(file)->write(buffer, amount, offset);
+                } catch (...) {
+                    return SQLITE_IOERR_WRITE;
+                }
+            }
+
+            static int x_truncate(sqlite3_file *file, sqlite3_int64 size) {
+                try {
+                    return impl_of(file)->truncate(size);
+                } catch (...) {
+                    return SQLITE_IOERR_TRUNCATE;
+                }
+            }
+
+            static int x_sync(sqlite3_file *file, int flags) {
+                try {
+                    return impl_of(file)->sync(flags);
+                } catch (...) {
+                    return SQLITE_IOERR_FSYNC;
+                }
+            }
+
+            static int x_file_size(sqlite3_file *file, sqlite3_int64 *size) {
+                try {
+                    return impl_of(file)->file_size(size);
+                } catch (...) {
+                    return SQLITE_IOERR_FSTAT;
+                }
+            }
+
+            static int x_lock(sqlite3_file *file, int level) {
+                try {
+                    return impl_of(file)->lock(level);
+                } catch (...) {
+                    return SQLITE_IOERR_LOCK;
+                }
+            }
+
+            static int x_unlock(sqlite3_file *file, int level) {
+                try {
+                    return impl_of(file)->unlock(level);
+                } catch (...) {
+                    return SQLITE_IOERR_UNLOCK;
+                }
+            }
+
+            static int x_check_reserved_lock(sqlite3_file *file, int *result) {
+                try {
+                    return impl_of(file)->check_reserved_lock(result);
+                } catch (...) {
+                    return SQLITE_IOERR_CHECKRESERVEDLOCK;
+                }
+            }
+
+            static int x_file_control(sqlite3_file *file, int op, void *arg) {
+                try {
+                    return impl_of(file)->file_control(op, arg);
+                } catch (...) {
+                    return SQLITE_IOERR;
+                }
+            }
+
+            static int x_sector_size(sqlite3_file *file) {
+                try {
+                    return impl_of(file)->sector_size();
+                } catch (...) {
+                    return 4096;
+                }
+            }
+
+            static int x_device_characteristics(sqlite3_file *file) {
+                try {
+                    return impl_of(file)->device_characteristics();
+                } catch (...) {
+                    return 0;
+                }
+            }
+
+            static int x_shm_map(sqlite3_file *file, int page, int page_size, int extend, void volatile **address) {
+                try {
+                    return impl_of(file)->shm_map(page, page_size, extend, address);
+                } catch (...) {
+                    return SQLITE_IOERR_SHMMAP;
+                }
+            }
+
+            static int x_shm_lock(sqlite3_file *file, int offset, int n, int flags) {
+                try {
+                    return impl_of(file)->shm_lock(offset, n, flags);
+                } catch (...) {
+                    return SQLITE_IOERR_SHMLOCK;
+                }
+            }
+
+            static void x_shm_barrier(sqlite3_file *file) {
+                try {
+                    impl_of(file)->shm_barrier();
+                } catch (...) {
+                    // ignore
+                }
+            }
+
+            static int x_shm_unmap(sqlite3_file *file, int delete_flag) {
+                try {
+                    return impl_of(file)->shm_unmap(delete_flag);
+                } catch (...) {
+                    return SQLITE_IOERR;
+                }
+            }
+
+            static int x_fetch(sqlite3_file *file, sqlite3_int64 offset, int amount, void **address) {
+                try {
+                    return impl_of(file)->fetch(offset, amount, address);
+                } catch (...) {
+                    *address = nullptr;
+                    return SQLITE_OK;
+                }
+            }
+
+            static int x_unfetch(sqlite3_file *file, sqlite3_int64 offset, void *address) {
+                try {
+                    return impl_of(file)->unfetch(offset, address);
+                } catch (...) {
+                    return SQLITE_IOERR;
+                }
+            }
+        };
+
+        static const sqlite3_io_methods value = {
+                3,
+                &methods::x_close,
+                &methods::x_read,
+                &methods::x_write,
+                &methods::x_truncate,
+                &methods::x_sync,
+                &methods::x_file_size,
+                &methods::x_lock,
+                &methods::x_unlock,
+                &methods::x_check_reserved_lock,
+                &methods::x_file_control,
+                &methods::x_sector_size,
+                &methods::x_device_characteristics,
+                &methods::x_shm_map,
+                &methods::x_shm_lock,
+                &methods::x_shm_barrier,
+                &methods::x_shm_unmap,
+                &methods::x_fetch,
+                &methods::x_unfetch,
+        };
+        return &value;
+    }
+
+    inline int vfs::x_open(sqlite3_vfs *pvfs, const char *name, sqlite3_file *file, int flags, int *out_flags) {
+        auto self = static_cast<vfs *>(pvfs->pAppData);
+        auto handle = reinterpret_cast<file_handle *>(file);
+        handle->file.pMethods = nullptr;
+        handle->impl = nullptr;
+
+        std::unique_ptr<vfs_file> impl;
+        try {
+            impl = self->create_file(name, flags);
+        } catch (...) {
+            return SQLITE_CANTOPEN;
+        }
+
+        auto base = base_of(file);
+        auto rc = self->_base->xOpen(self->_base, name, base, flags, out_flags);
+        if (rc != SQLITE_OK) {
+            if (base->pMethods) {
+                base->pMethods->xClose(base);
+            }
+            return rc;
+        }
+
+        impl->_base = base;
+        impl->_path = name ? name : "";
+        impl->_flags = flags;
+        handle->impl = impl.release();
+        handle->file.pMethods = io_methods();
+        return SQLITE_OK;
+    }
+
+    inline int vfs::x_delete(sqlite3_vfs *pvfs, const char *name, int sync_dir) {
+        try {
+            return static_cast<vfs *>(pvfs->pAppData)->delete_file(name, sync_dir);
+        } catch (...) {
+            return SQLITE_IOERR_DELETE;
+        }
+    }
+
+    inline int vfs::x_access(sqlite3_vfs *pvfs, const char *name, int flags, int *result) {
+        try {
+            return static_cast<vfs *>(pvfs->pAppData)->access(name, flags, result);
+        } catch (...) {
+            return SQLITE_IOERR_ACCESS;
+        }
+    }
+
+    inline int vfs::x_full_pathname(sqlite3_vfs *pvfs, const char *name, int size, char *output) {
+        try {
+            return static_cast<vfs *>(pvfs->pAppData)->full_pathname(name, size, output);
+        } catch (...) {
+            return SQLITE_CANTOPEN;
+        }
+    }
+
+#pragma mark ## stats_vfs ##
+
+    class stats_vfs::stats_file : public vfs_file {
+    public:
+        explicit stats_file(const std::shared_ptr<file_counters> &counters)
+                : _counters(counters) {
+        }
+
+        int read(void *buffer, int amount, sqlite3_int64 offset) override {
+            auto start = std::chrono::steady_clock::now();
+            auto rc = vfs_file::read(buffer, amount, offset);
+            _counters->read.record(static_cast<std::uint64_t>(amount), std::chrono::steady_clock::now() - start);
+            return rc;
+        }
+
+        int write(const void *buffer, int amount, sqlite3_int64 offset) override {
+            auto start = std::chrono::steady_clock::now();
+            auto rc = vfs_file::write(buffer, amount, offset);
+            _counters->write.record(static_cast<std::uint64_t>(amount), std::chrono::steady_clock::now() - start);
+            return rc;
+        }
+
+        int truncate(sqlite3_int64 size) override {
+            auto start = std::chrono::steady_clock::now();
+            auto rc = vfs_file::truncate(size);
+            _counters->truncate.record(0, std::chrono::steady_clock::now() - start);
+            return rc;
+        }
+
+        int sync(int flags) override {
+            auto start = std::chrono::steady_clock::now();
+            auto rc = vfs_file::sync(flags);
+            _counters->sync.record(0, std::chrono::steady_clock::now() - start);
+            return rc;
+        }
+
+    private:
+        std::shared_ptr<file_counters> _counters;
+    };
+
+    inline stats_vfs::op_counters::op_counters() {
+        clear();
+    }
+
+    inline void stats_vfs::op_counters::record(std::uint64_t size, std::chrono::steady_clock::duration elapsed) {
+        auto ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        int bucket = 0;
+        while (bucket + 1 < io_op_stats::latency_bucket_count && (ns >> (bucket + 1)) != 0) {
+            ++bucket;
+        }
+
+        count.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        total_nanoseconds.fetch_add(ns, std::memory_order_relaxed);
+        latency[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline void stats_vfs::op_counters::clear() {
+        count.store(0, std::memory_order_relaxed);
+        bytes.store(0, std::memory_order_relaxed);
+        total_nanoseconds.store(0, std::memory_order_relaxed);
+        for (auto &&bucket : latency) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    inline io_op_stats stats_vfs::op_counters::snapshot() const {
+        io_op_stats result;
+        result.count = count.load(std::memory_order_relaxed);
+        result.bytes = bytes.load(std::memory_order_relaxed);
+        result.total_nanoseconds = total_nanoseconds.load(std::memory_order_relaxed);
+        for (int i = 0; i < io_op_stats::latency_bucket_count; ++i) {
+            result.latency[i] = latency[i].load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    inline io_stats stats_vfs::file_counters::snapshot() const {
+        io_stats result;
+        result.read = read.snapshot();
+        result.write = write.snapshot();
+        result.sync = sync.snapshot();
+        result.truncate = truncate.snapshot();
+        return result;
+    }
+
+    inline stats_vfs::stats_vfs(const std::string &name, const std::string &base_name)
+            : vfs(name, base_name) {
+    }
+
+    inline io_stats stats_vfs::get_stats(const std::string &path) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _counters.find(path);
+        if (it == _counters.end()) {
+            return file_counters().snapshot();
+        }
+        return it->second->snapshot();
+    }
+
+    inline std::map<std::string, io_stats> stats_vfs::get_all_stats() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::map<std::string, io_stats> result;
+        for (auto &&pair : _counters) {
+            result[pair.first] = pair.second->snapshot();
+        }
+        return result;
+    }
+
+    inline void stats_vfs::reset_stats() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto &&pair : _counters) {
+            pair.second->read.clear();
+            pair.second->write.clear();
+            pair.second->sync.clear();
+            pair.second->truncate.clear();
+        }
+    }
+
+    inline std::unique_ptr<vfs_file> stats_vfs::create_file(const char *path, int) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto &&counters = _counters[path ? path : ""];
+        if (!counters) {
+            counters = std::make_shared<file_counters>();
+        }
+        return std::unique_ptr<vfs_file>(new stats_file(counters));
+    }
+}
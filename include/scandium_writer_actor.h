@@ -0,0 +1,424 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2016 Daisuke Itabashi (itabashi.d@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "scandium.h"
+
+namespace scandium {
+
+    /**
+     *  Describes the options of scandium::writer_actor.
+     */
+    struct writer_options {
+        /**
+         *  The queue depth from which the queued writes are coalesced into one transaction.
+         */
+        std::size_t coalesce_threshold = 2;
+
+        /**
+         *  The maximum number of writes coalesced into one transaction.
+         */
+        std::size_t max_batch_size = 256;
+
+        /**
+         *  The transaction mode of the writes.
+         */
+        transaction_mode mode = transaction_mode::immediate;
+    };
+
+    /**
+     *  Represents the metrics of scandium::writer_actor.
+     */
+    struct writer_metrics {
+        /**
+         *  The number of writes queued and not yet executed.
+         */
+        std::uint64_t queue_depth;
+
+        std::uint64_t submitted;
+
+        std::uint64_t completed;
+
+        /**
+         *  The number of transactions executed.
+         */
+        std::uint64_t transactions;
+
+        /**
+         *  The sum of the times from the submission to the commit of the writes.
+         */
+        std::chrono::nanoseconds total_latency;
+
+        std::chrono::nanoseconds max_latency;
+    };
+
+    /**
+     *  Owns the write connection of a database on a dedicated thread,
+     *  and executes the write closures submitted through a lock-free multi-producer single-consumer queue.
+     *  Each transaction runs one write, or the queued writes coalesced when the queue is deep;
+     *  each write runs in its own savepoint, so a failing write is rolled back alone.
+     *  The writes must not begin or commit transactions themselves.
+     */
+    class writer_actor {
+    public:
+        /**
+         *  Constructor.
+         *  Opens the database on the writer thread.
+         *
+         *  @param path         the path of the SQLite database file to open and/or create.
+         *  @param options      the options of the writer.
+         *  @param open_options the options to open the database.
+         */
+        explicit writer_actor(const std::string &path,
+                              const writer_options &options = writer_options(),
+                              const open_options &open_options = scandium::open_options());
+
+        /**
+         *  Destructor.
+         *  Executes the writes already submitted, closes the database and stops the thread.
+         */
+        ~writer_actor() noexcept;
+
+        /**
+         *  Submits a write. Never blocks on other producers.
+         *
+         *  @tparam Write void(*)(database &db)
+         *
+         *  @return the future that becomes ready when the write is committed,
+         *          or holds the exception thrown by the write or the commit.
+         */
+        template<class Write>
+        std::future<void> submit(Write &&write);
+
+        /**
+         *  Executes the writes already submitted, closes the database and stops the thread.
+         */
+        void stop();
+
+        /**
+         *  Returns the metrics.
+         */
+        writer_metrics get_metrics() const;
+
+    private:
+        writer_actor(const writer_actor &) = delete;
+
+        writer_actor &operator=(const writer_actor &) = delete;
+
+        struct node {
+            std::atomic<node *> next;
+            std::function<void(database &)> write;
+            std::promise<void> promise;
+            std::chrono::steady_clock::time_point submitted_at;
+        };
+
+        void push(node *node);
+
+        node *pop();
+
+        void run(std::promise<void> opened);
+
+        void wait_for_work();
+
+        void execute(database &db, std::vector<node *> &batch);
+
+        void record(const std::vector<node *> &batch);
+
+        std::string _path;
+        writer_options _options;
+        scandium::open_options _open_options;
+
+        // Vyukov's intrusive MPSC queue, producers exchange _head and the writer thread owns _tail
+        std::atomic<node *> _head;
+        node *_tail;
+        node _stub;
+
+        std::atomic<bool> _stopping;
+        std::atomic<bool> _sleeping;
+        std::mutex _mutex;
+        std::condition_variable _condition;
+
+        std::atomic<std::uint64_t> _depth;
+        std::atomic<std::uint64_t> _submitted;
+        std::atomic<std::uint64_t> _completed;
+        std::atomic<std::uint64_t> _transactions;
+        std::atomic<std::int64_t> _total_latency;
+        std::atomic<std::int64_t> _max_latency;
+
+        std::thread _thread;
+    };
+
+#pragma mark ## writer_actor ##
+
+    inline writer_actor::writer_actor(const std::string &path,
+                                      const writer_options &options,
+                                      const scandium::open_options &open_options)
+            : _path(path), _options(options), _open_options(open_options),
+              _head(&_stub), _tail(&_stub),
+              _stopping(false), _sleeping(false),
+              _depth(0), _submitted(0), _completed(0), _transactions(0), _total_latency(0), _max_latency(0) {
+        if (_options.max_batch_size == 0) {
+            throw std::logic_error("invalid max_batch_size, must be > 0");
+        }
+        _stub.next.store(nullptr, std::memory_order_relaxed);
+
+        std::promise<void> opened;
+        auto future = opened.get_future();
+        _thread = std::thread(&writer_actor::run, this, std::move(opened));
+        try {
+            future.get();
+        } catch (...) {
+            _thread.join();
+            throw;
+        }
+    }
+
+    inline writer_actor::~writer_actor() noexcept {
+        stop();
+    }
+
+    template<class Write>
+    std::future<void> writer_actor::submit(Write &&write) {
+        if (_stopping.load()) {
+            throw std::logic_error("writer is stopped");
+        }
+
+        std::unique_ptr<node> request(new node());
+        request->write = std::forward<Write>(write);
+        request->submitted_at = std::chrono::steady_clock::now();
+        auto future = request->promise.get_future();
+
+        // counts the write before checking _stopping again, so the writer thread does not stop while it is pushed
+        _depth.fetch_add(1);
+        if (_stopping.load()) {
+            _depth.fetch_sub(1);
+            throw std::logic_error("writer is stopped");
+        }
+        _submitted.fetch_add(1, std::memory_order_relaxed);
+        push(request.release());
+
+        if (_sleeping.load()) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _sleeping.store(false);
+            _condition.notify_one();
+        }
+        return future;
+    }
+
+    inline void writer_actor::stop() {
+        if (_stopping.exchange(true)) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _sleeping.store(false);
+        }
+        _condition.notify_one();
+
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+    inline writer_metrics writer_actor::get_metrics() const {
+        writer_metrics metrics;
+        metrics.queue_depth = _depth.load(std::memory_order_relaxed);
+        metrics.submitted = _submitted.load(std::memory_order_relaxed);
+        metrics.completed = _completed.load(std::memory_order_relaxed);
+        metrics.transactions = _transactions.load(std::memory_order_relaxed);
+        metrics.total_latency = std::chrono::nanoseconds(_total_latency.load(std::memory_order_relaxed));
+        metrics.max_latency = std::chrono::nanoseconds(_max_latency.load(std::memory_order_relaxed));
+        return metrics;
+    }
+
+    inline void writer_actor::push(node *node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        auto prev = _head.exchange(node);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    inline writer_actor::node *writer_actor::pop() {
+        auto tail = _tail;
+        auto next = tail->next.load(std::memory_order_acquire);
+        if (tail == &_stub) {
+            if (!next) {
+                return nullptr;
+            }
+            _tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next) {
+            _tail = next;
+            return tail;
+        }
+
+        // a producer has exchanged _head but not linked its node yet
+        if (tail != _head.load()) {
+            return nullptr;
+        }
+
+        push(&_stub);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next) {
+            _tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    inline void writer_actor::run(std::promise<void> opened) {
+        database db(_path, _open_options);
+        try {
+            db.open();
+        } catch (...) {
+            opened.set_exception(std::current_exception());
+            return;
+        }
+        opened.set_value();
+
+        std::vector<node *> batch;
+        for (;;) {
+            auto depth = _depth.load();
+            if (depth == 0) {
+                // checks the depth again after _stopping, the order submit() relies on
+                if (_stopping.load() && _depth.load() == 0) {
+                    break;
+                }
+                wait_for_work();
+                continue;
+            }
+
+            auto limit = depth >= _options.coalesce_threshold ? _options.max_batch_size : 1;
+            while (batch.size() < limit) {
+                auto request = pop();
+                if (!request) {
+                    break;
+                }
+                batch.push_back(request);
+            }
+
+            if (batch.empty()) {
+                // the producer is between the exchange and the link
+                std::this_thread::yield();
+                continue;
+            }
+
+            _depth.fetch_sub(batch.size());
+            execute(db, batch);
+
+            for (auto &&request : batch) {
+                delete request;
+            }
+            batch.clear();
+        }
+
+        // no write is left after stopping, but never leave a future unready
+        while (auto request = pop()) {
+            request->promise.set_exception(std::make_exception_ptr(std::logic_error("writer is stopped")));
+            delete request;
+        }
+
+        try {
+            db.close();
+        } catch (...) {
+            // ignore
+        }
+    }
+
+    inline void writer_actor::wait_for_work() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _sleeping.store(true);
+
+        // the producers check _sleeping after queueing, so either they see it or it sees their work
+        if (_depth.load() != 0 || _stopping.load()) {
+            _sleeping.store(false);
+            return;
+        }
+        _condition.wait(lock, [this] { return !_sleeping.load(); });
+    }
+
+    inline void writer_actor::execute(database &db, std::vector<node *> &batch) {
+        std::vector<std::exception_ptr> errors(batch.size());
+        try {
+            auto transaction = db.create_transaction(_options.mode);
+            for (std::size_t i = 0; i < batch.size(); ++i) {
+                db.exec_sql("SAVEPOINT scandium_writer;");
+                try {
+                    batch[i]->write(db);
+                    db.exec_sql("RELEASE scandium_writer;");
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                    db.exec_sql("ROLLBACK TO scandium_writer;");
+                    db.exec_sql("RELEASE scandium_writer;");
+                }
+            }
+            transaction.commit();
+        } catch (...) {
+            record(batch);
+            auto error = std::current_exception();
+            for (auto &&request : batch) {
+                request->promise.set_exception(error);
+            }
+            return;
+        }
+
+        record(batch);
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            if (errors[i]) {
+                batch[i]->promise.set_exception(errors[i]);
+            } else {
+                batch[i]->promise.set_value();
+            }
+        }
+    }
+
+    inline void writer_actor::record(const std::vector<node *> &batch) {
+        auto now = std::chrono::steady_clock::now();
+        for (auto &&request : batch) {
+            auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(now - request->submitted_at).count();
+            _total_latency.fetch_add(latency, std::memory_order_relaxed);
+            auto max = _max_latency.load(std::memory_order_relaxed);
+            while (latency > max && !_max_latency.compare_exchange_weak(max, latency)) {
+            }
+        }
+        _completed.fetch_add(batch.size(), std::memory_order_relaxed);
+        _transactions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
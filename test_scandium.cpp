@@ -2,20 +2,73 @@
 #define BOOST_TEST_NO_MAIN
 #define BOOST_TEST_MODULE test_scandium
 
+#include <cstdlib>
+#include <fstream>
+#include <dirent.h>
+#include <unistd.h>
 #include <boost/lexical_cast.hpp>
 #include <boost/test/included/unit_test.hpp>
 #include <boost/uuid/random_generator.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include "scandium.h"
+#include "scandium_cancellation.h"
+#include "scandium_change_feed.h"
+#include "scandium_columns.h"
+#include "scandium_csv.h"
+#include "scandium_group_committer.h"
+#include "scandium_memory.h"
+#include "scandium_migration.h"
+#include "scandium_result_cache.h"
+#include "scandium_sharded.h"
+#include "scandium_uring_vfs.h"
+#include "scandium_vfs.h"
+#include "scandium_writer_actor.h"
 
 namespace {
-    std::string db_root_path = "./";
+    // empty until the fixture creates a temporary directory, unless a root is given to test_scandium()
+    std::string db_root_path;
     std::string create_random_name() {
         boost::uuids::random_generator gen;
         return db_root_path + boost::lexical_cast<std::string>(gen());
     }
+
+    // keeps the databases, their journals and the CSV files of the tests out of the working directory
+    struct temporary_directory {
+        std::string path;
+
+        temporary_directory() {
+            if (!db_root_path.empty()) {
+                return;
+            }
+            auto tmpdir = std::getenv("TMPDIR");
+            std::string pattern = std::string(tmpdir && *tmpdir ? tmpdir : "/tmp") + "/test_scandium.XXXXXX";
+            if (!mkdtemp(&pattern[0])) {
+                throw std::runtime_error("failed to create the temporary directory " + pattern);
+            }
+            path = pattern;
+            db_root_path = path + "/";
+        }
+
+        ~temporary_directory() {
+            if (path.empty()) {
+                return;
+            }
+            if (auto dir = opendir(path.c_str())) {
+                while (auto entry = readdir(dir)) {
+                    std::string name = entry->d_name;
+                    if (name != "." && name != "..") {
+                        unlink((path + "/" + name).c_str());
+                    }
+                }
+                closedir(dir);
+            }
+            rmdir(path.c_str());
+        }
+    };
 }
 
+BOOST_GLOBAL_FIXTURE(temporary_directory);
+
 int test_scandium(int argc, char **argv) {
     extern ::boost::unit_test::test_suite *init_unit_test_suite(int, char **);
 
@@ -373,6 +426,1547 @@ BOOST_AUTO_TEST_CASE(statement) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(sql_literal) {
+    static_assert(decltype(SCANDIUM_SQL(""))::get_parameter_count() == 0, "");
+    static_assert(decltype(SCANDIUM_SQL("SELECT ?, ?;"))::get_parameter_count() == 2, "");
+    static_assert(decltype(SCANDIUM_SQL("SELECT ?3, ?;"))::get_parameter_count() == 4, "");
+    static_assert(decltype(SCANDIUM_SQL("SELECT ?, ?1;"))::get_parameter_count() == 1, "");
+    static_assert(decltype(SCANDIUM_SQL("SELECT :a, :b, :a, @a, $a;"))::get_parameter_count() == 4, "");
+    static_assert(decltype(SCANDIUM_SQL("SELECT 'it''s ?', \"?\", [?], `?` -- ?\n, /* ? */ ?;"))
+                          ::get_parameter_count() == 1, "");
+    static_assert(decltype(SCANDIUM_SQL("SELECT ':a', /*/ :a */ :a, x$a FROM t;"))::get_parameter_count() == 1, "");
+    static_assert(scandium::is_bindable<const std::string &>::value, "");
+    static_assert(!scandium::is_bindable<bool>::value, "");
+
+    constexpr auto sql = SCANDIUM_SQL("INSERT INTO table_1 VALUES(:id, :name);");
+    static_assert(sql.length() == 39, "");
+    BOOST_CHECK_EQUAL(sql.str(), "INSERT INTO table_1 VALUES(:id, :name);");
+
+    scandium::database db;
+    db.open();
+    db.exec_sql(SCANDIUM_SQL("CREATE TABLE table_1(id INTEGER, name TEXT);"));
+    db.exec_sql(sql, 1, "name_1");
+    db.exec_sql(sql, 2, std::string("name_2"));
+    db.exec_sql(SCANDIUM_SQL("INSERT INTO table_1 VALUES(?, ?);"), 3, nullptr);
+
+    auto result = db.query(SCANDIUM_SQL("SELECT name FROM table_1 WHERE id >= ?2 AND id < ?1 ORDER BY id;"), 3, 1);
+    std::vector<std::string> names;
+    for (auto &&cursor : result) {
+        names.push_back(cursor.get<std::string>(0));
+    }
+    BOOST_REQUIRE_EQUAL(names.size(), 2);
+    BOOST_CHECK_EQUAL(names[0], "name_1");
+    BOOST_CHECK_EQUAL(names[1], "name_2");
+}
+
+BOOST_AUTO_TEST_CASE(statement_stats) {
+    scandium::database db;
+    db.open();
+    db.exec_sql("CREATE TABLE table_1(id INTEGER, name TEXT);");
+    auto transaction = db.create_transaction();
+    for (int i = 0; i < 100; ++i) {
+        db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", i, "name");
+    }
+    transaction.commit();
+
+    auto statement = db.prepare_statement("SELECT name FROM table_1 WHERE id = ? ORDER BY name;");
+    for (int i = 0; i < 3; ++i) {
+        auto result = statement.query_with_bindings(i);
+        BOOST_CHECK_EQUAL(result.begin()->get<std::string>(0), "name");
+        statement.reset();
+    }
+
+    auto stats = statement.stats();
+    BOOST_CHECK_GE(stats.fullscan_step, 3 * 99);
+    BOOST_CHECK_EQUAL(stats.sort, 3);
+    BOOST_CHECK_GT(stats.vm_step, 0);
+    BOOST_CHECK_EQUAL(stats.run, 3);
+    BOOST_CHECK_GT(stats.memused, 0);
+
+    auto total = stats;
+    total += stats;
+    BOOST_CHECK_EQUAL(total.run, 6);
+    BOOST_CHECK_EQUAL(total.fullscan_step, stats.fullscan_step * 2);
+
+    statement.stats(true);
+    stats = statement.stats();
+    BOOST_CHECK_EQUAL(stats.fullscan_step, 0);
+    BOOST_CHECK_EQUAL(stats.run, 0);
+    BOOST_CHECK_GT(stats.memused, 0);
+
+    db.exec_sql("CREATE INDEX index_1 ON table_1(id);");
+    auto result = statement.query_with_bindings(50);
+    BOOST_CHECK_EQUAL(result.begin()->get<std::string>(0), "name");
+    statement.reset();
+    stats = statement.stats();
+    BOOST_CHECK_EQUAL(stats.fullscan_step, 0);
+    BOOST_CHECK_EQUAL(stats.reprepare, 1);
+}
+
+BOOST_AUTO_TEST_CASE(query_plan) {
+    scandium::database db;
+    db.open();
+    db.exec_sql("CREATE TABLE table_1(id INTEGER, name TEXT);");
+    db.exec_sql("CREATE TABLE table_2(id INTEGER, name TEXT);");
+
+    auto plan = db.explain("SELECT name FROM table_1 WHERE id = ?;");
+    BOOST_REQUIRE_EQUAL(plan.size(), 1);
+    BOOST_CHECK_EQUAL(plan[0].detail, "SCAN table_1");
+
+    plan = db.explain("SELECT name FROM table_1 WHERE id IN (SELECT id FROM table_2) ORDER BY name;");
+    BOOST_REQUIRE_GE(plan.size(), 2);
+    auto has_children = false;
+    for (auto &&node : plan) {
+        has_children = has_children || !node.children.empty();
+    }
+    BOOST_CHECK(has_children);
+
+    scandium::plan_guard_options options;
+    options.mode = scandium::plan_guard_mode::raise;
+    db.set_plan_guard(options);
+    BOOST_CHECK_THROW(db.prepare_statement("SELECT name FROM table_1 WHERE id = ?;"), scandium::query_plan_error);
+    db.prepare_statement("SELECT 1;");
+    db.prepare_statement("INSERT INTO table_1 VALUES(?, ?);");
+
+    db.exec_sql("CREATE INDEX index_1 ON table_1(id);");
+    db.prepare_statement("SELECT name FROM table_1 WHERE id = ?;");
+    try {
+        db.prepare_statement("SELECT name FROM table_1 WHERE id = ? ORDER BY name;");
+        BOOST_ERROR("query_plan_error is not thrown");
+    } catch (const scandium::query_plan_error &e) {
+        BOOST_CHECK_EQUAL(e.get_detail(), "USE TEMP B-TREE FOR ORDER BY");
+        BOOST_CHECK_EQUAL(e.get_sql(), "SELECT name FROM table_1 WHERE id = ? ORDER BY name;");
+    }
+
+    options.mode = scandium::plan_guard_mode::report;
+    options.forbid_temp_b_tree = false;
+    options.scannable_tables.push_back("table_2");
+    std::vector<std::string> details;
+    options.reporter = [&details](const std::string &, const std::string &detail) {
+        details.push_back(detail);
+    };
+    db.set_plan_guard(options);
+    db.prepare_statement("SELECT name FROM table_2 ORDER BY name;");
+    BOOST_CHECK(details.empty());
+    db.prepare_statement("SELECT name FROM table_1 ORDER BY name;");
+    BOOST_REQUIRE_EQUAL(details.size(), 1);
+    BOOST_CHECK_EQUAL(details[0], "SCAN table_1");
+
+    // the plan shows the aliases, which are mapped back to the tables
+    details.clear();
+    db.prepare_statement("SELECT x.name FROM table_2 AS x;");
+    db.prepare_statement("SELECT \"my x\".name FROM main.table_2 \"my x\", table_1 WHERE table_1.id = \"my x\".id;");
+    db.prepare_statement("SELECT * FROM (SELECT name FROM table_2 LIMIT 3) AS s;");
+    BOOST_CHECK(details.empty());
+    db.prepare_statement("SELECT table_2.name FROM table_1 table_2;");
+    BOOST_REQUIRE_EQUAL(details.size(), 1);
+    BOOST_CHECK_EQUAL(details[0], "SCAN table_2");
+}
+
+BOOST_AUTO_TEST_CASE(database_stats) {
+    auto path = create_random_name();
+    scandium::open_options options;
+    options.lookaside_slot_size = 128;
+    options.lookaside_slot_count = 256;
+    options.cache_size = 16;
+    scandium::database db(path, options);
+    db.open();
+
+    auto result = db.query("PRAGMA cache_size;");
+    BOOST_CHECK_EQUAL(result.begin()->get<int>(0), 16);
+
+    db.exec_sql("CREATE TABLE table_1(id INTEGER, name TEXT);");
+    auto transaction = db.create_transaction();
+    auto statement = db.prepare_statement("INSERT INTO table_1 VALUES(?, ?);");
+    for (int i = 0; i < 5000; ++i) {
+        statement.exec_with_bindings(i, std::string(100, 'a'));
+    }
+    transaction.commit();
+
+    for (int i = 0; i < 2; ++i) {
+        auto count = db.query("SELECT count(*) FROM table_1;");
+        BOOST_CHECK_EQUAL(count.begin()->get<int>(0), 5000);
+    }
+
+    scandium::database_stats empty;
+    BOOST_CHECK_EQUAL(empty.cache_hit, 0);
+    BOOST_CHECK_EQUAL(empty.stmt_used, 0);
+    BOOST_CHECK_EQUAL(empty.cache_hit_rate(), 0);
+    BOOST_CHECK_EQUAL(empty.lookaside_hit_rate(), 0);
+
+    auto stats = db.stats();
+    BOOST_CHECK_GT(stats.cache_hit, 0);
+    BOOST_CHECK_GT(stats.cache_spill, 0);
+    BOOST_CHECK_GT(stats.cache_write, 0);
+    BOOST_CHECK_GT(stats.cache_used, 0);
+    BOOST_CHECK_GT(stats.schema_used, 0);
+    BOOST_CHECK_GE(stats.lookaside_highwater, stats.lookaside_used);
+    BOOST_CHECK_LE(stats.lookaside_highwater, 256);
+    BOOST_CHECK_GT(stats.cache_hit_rate(), 0);
+    BOOST_CHECK_LE(stats.cache_hit_rate(), 1);
+
+    db.stats(true);
+    stats = db.stats();
+    BOOST_CHECK_EQUAL(stats.cache_hit, 0);
+    BOOST_CHECK_EQUAL(stats.cache_miss, 0);
+    BOOST_CHECK_EQUAL(stats.lookaside_hit, 0);
+}
+
+BOOST_AUTO_TEST_CASE(write_csv_jsonl) {
+    struct string_sink : public scandium::sink {
+        std::string value;
+
+        void write(const char *data, std::size_t size) override {
+            value.append(data, size);
+        }
+    };
+
+    scandium::database db;
+    db.open();
+    db.exec_sql("CREATE TABLE table_1(id INTEGER, name TEXT, score REAL, data BLOB);");
+    db.exec_sql("INSERT INTO table_1 VALUES(?, ?, ?, ?);", -9223372036854775807LL - 1, "a,\"b\"\nc", 1.5,
+                std::vector<unsigned char>{'a', 'b', 'c', 'd'});
+    db.exec_sql("INSERT INTO table_1 VALUES(?, ?, ?, ?);", 0, "tab\tq\\\x01",
+                std::numeric_limits<double>::infinity(), nullptr);
+    db.exec_sql("INSERT INTO table_1 VALUES(?, ?, ?, ?);", 42, nullptr, nullptr, std::vector<unsigned char>{0xff});
+
+    auto result = db.query("SELECT id, name, score, data AS \"da\"\"ta\" FROM table_1 ORDER BY rowid;");
+    string_sink csv;
+    BOOST_CHECK_EQUAL(result.write_csv(csv), 3u);
+    BOOST_CHECK_EQUAL(csv.value, "id,name,score,\"da\"\"ta\"\r\n"
+                                 "-9223372036854775808,\"a,\"\"b\"\"\nc\",1.5,YWJjZA==\r\n"
+                                 "0,tab\tq\\\x01,Inf,\r\n"
+                                 "42,,,/w==\r\n");
+
+    string_sink jsonl;
+    BOOST_CHECK_EQUAL(result.write_jsonl(jsonl), 3u);
+    BOOST_CHECK_EQUAL(jsonl.value,
+                      "{\"id\":-9223372036854775808,\"name\":\"a,\\\"b\\\"\\nc\",\"score\":1.5,"
+                      "\"da\\\"ta\":\"YWJjZA==\"}\n"
+                      "{\"id\":0,\"name\":\"tab\\tq\\\\\\u0001\",\"score\":null,\"da\\\"ta\":null}\n"
+                      "{\"id\":42,\"name\":null,\"score\":null,\"da\\\"ta\":\"/w==\"}\n");
+
+    string_sink large;
+    auto large_result = db.query("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 100000) "
+                                 "SELECT i FROM n;");
+    BOOST_CHECK_EQUAL(large_result.write_csv(large, false), 100000u);
+    BOOST_CHECK_EQUAL(std::count(large.value.begin(), large.value.end(), '\n'), 100000);
+    BOOST_CHECK_EQUAL(large.value.substr(large.value.size() - 8), "100000\r\n");
+
+#ifdef SCANDIUM_HAS_FD_SINK
+    auto path = create_random_name() + ".csv";
+    auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    BOOST_REQUIRE_GE(fd, 0);
+    scandium::fd_sink file(fd);
+    result.write_csv(file);
+    ::close(fd);
+    std::ifstream in(path, std::ios::binary);
+    std::string written((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    BOOST_CHECK_EQUAL(written, csv.value);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(import_csv) {
+    auto csv_path = create_random_name() + ".csv";
+    {
+        std::ofstream csv(csv_path, std::ios::binary);
+        csv << "id,name,note\r\n";
+        csv << "1,\"a, b\",\"say \"\"hi\"\"\"\r\n";
+        csv << "2,\"multi\nline\",\n";
+        csv << "3,,x\n";
+        csv << "4\n";
+        for (int i = 5; i <= 20000; ++i) {
+            csv << i << ",name_" << i << ",\"note\"\n";
+        }
+    }
+
+    for (int pipelined = 0; pipelined < 2; ++pipelined) {
+        scandium::database db;
+        db.open();
+        db.exec_sql("CREATE TABLE table_1(id INTEGER, name TEXT, note TEXT);");
+
+        scandium::csv_options options;
+        options.batch_size = 1000;
+        options.empty_as_null = true;
+        options.pipelined = pipelined != 0;
+        BOOST_CHECK_EQUAL(scandium::import_csv(db, csv_path, "table_1", options), 20000u);
+
+        auto result = db.query("SELECT count(*), sum(id) FROM table_1;");
+        auto cursor = result.begin();
+        BOOST_CHECK_EQUAL(cursor->get<int>(0), 20000);
+        BOOST_CHECK_EQUAL(cursor->get<sqlite3_int64>(1), 20000LL * 20001 / 2);
+
+        std::vector<std::string> rows;
+        auto sql = "SELECT typeof(id), quote(name), quote(note) FROM table_1 WHERE id <= 5 ORDER BY id;";
+        for (auto &&row : db.query(sql)) {
+            rows.push_back(row.get<std::string>(0) + "|" + row.get<std::string>(1) + "|" + row.get<std::string>(2));
+        }
+        BOOST_REQUIRE_EQUAL(rows.size(), 5);
+        BOOST_CHECK_EQUAL(rows[0], "integer|'a, b'|'say \"hi\"'");
+        BOOST_CHECK_EQUAL(rows[1], "integer|'multi\nline'|NULL");
+        BOOST_CHECK_EQUAL(rows[2], "integer|NULL|'x'");
+        BOOST_CHECK_EQUAL(rows[3], "integer|NULL|NULL");
+        BOOST_CHECK_EQUAL(rows[4], "integer|'name_5'|'note'");
+    }
+
+    auto bad_path = create_random_name() + ".csv";
+    {
+        std::ofstream csv(bad_path, std::ios::binary);
+        csv << "1,2\n3,4,5\n";
+    }
+    for (int pipelined = 0; pipelined < 2; ++pipelined) {
+        scandium::database db;
+        db.open();
+        db.exec_sql("CREATE TABLE table_1(a, b);");
+        scandium::csv_options options;
+        options.header = false;
+        options.pipelined = pipelined != 0;
+        try {
+            scandium::import_csv(db, bad_path, "table_1", options);
+            BOOST_ERROR("csv_error is not thrown");
+        } catch (const scandium::csv_error &e) {
+            BOOST_CHECK_EQUAL(e.get_row(), 2u);
+        }
+        auto result = db.query("SELECT count(*) FROM table_1;");
+        BOOST_CHECK_EQUAL(result.begin()->get<int>(0), 0);
+    }
+
+    {
+        std::ofstream csv(bad_path, std::ios::binary | std::ios::trunc);
+        csv << "a\n\"unterminated\n";
+    }
+    scandium::database db;
+    db.open();
+    db.exec_sql("CREATE TABLE table_1(a);");
+    BOOST_CHECK_THROW(scandium::import_csv(db, bad_path, "table_1"), scandium::csv_error);
+}
+
+BOOST_AUTO_TEST_CASE(columns) {
+    scandium::database db;
+    db.open();
+    db.exec_sql("CREATE TABLE table_1(id INTEGER, value REAL);");
+
+    {
+        auto transaction = db.create_transaction();
+        auto statement = db.prepare_statement("INSERT INTO table_1 VALUES(?, ?);");
+        for (int i = 0; i < 1003; ++i) {
+            if (i % 7 == 0) {
+                statement.exec_with_bindings(nullptr, nullptr);
+            } else {
+                statement.exec_with_bindings(static_cast<sqlite3_int64>((i * 7919) % 1000 - 500), i * 0.25 - 100);
+            }
+        }
+        transaction.commit();
+    }
+
+    auto ids = scandium::columns::fetch<sqlite3_int64>(db.query("SELECT id FROM table_1;"), 0);
+    auto values = scandium::columns::fetch<double>(db.query("SELECT value FROM table_1;"), 0);
+    BOOST_CHECK_EQUAL(ids.size(), 1003);
+    BOOST_CHECK_EQUAL(ids.null_count, 144);
+    BOOST_CHECK_EQUAL(scandium::columns::count_nonnull(ids), 859);
+
+    auto expected_sum = db.query("SELECT sum(id), min(id), max(id), sum(value), min(value), max(value) FROM table_1;");
+    auto expected = expected_sum.begin();
+
+    auto isas = {
+            scandium::columns::isa::scalar,
+            scandium::columns::isa::sse42,
+            scandium::columns::isa::avx2,
+            scandium::columns::isa::avx512,
+    };
+
+    for (auto &&isa : isas) {
+        if (static_cast<int>(isa) > static_cast<int>(scandium::columns::detect_isa())) {
+            BOOST_CHECK_THROW(scandium::columns::set_isa(isa), std::logic_error);
+            continue;
+        }
+        scandium::columns::set_isa(isa);
+
+        BOOST_CHECK_EQUAL(scandium::columns::sum(ids), expected->get<sqlite3_int64>(0));
+        BOOST_CHECK_EQUAL(scandium::columns::min(ids), expected->get<sqlite3_int64>(1));
+        BOOST_CHECK_EQUAL(scandium::columns::max(ids), expected->get<sqlite3_int64>(2));
+        BOOST_CHECK_CLOSE(scandium::columns::sum(values), expected->get<double>(3), 1e-9);
+        BOOST_CHECK_EQUAL(scandium::columns::min(values), expected->get<double>(4));
+        BOOST_CHECK_EQUAL(scandium::columns::max(values), expected->get<double>(5));
+        BOOST_CHECK_EQUAL(scandium::columns::count_nonnull(ids.valid.data(), ids.size()), 859);
+
+        auto selection = scandium::columns::filter(ids, scandium::columns::compare_op::greater_equal,
+                                                   static_cast<sqlite3_int64>(100));
+        std::vector<std::uint32_t> expected_selection;
+        for (std::uint32_t i = 0; i < ids.size(); ++i) {
+            if (ids.valid[i] && ids.values[i] >= 100) {
+                expected_selection.push_back(i);
+            }
+        }
+        BOOST_CHECK_EQUAL_COLLECTIONS(selection.begin(), selection.end(),
+                                      expected_selection.begin(), expected_selection.end());
+
+        selection = scandium::columns::filter(values, scandium::columns::compare_op::less, 0.0);
+        BOOST_CHECK_EQUAL(selection.size(), 400 - 58);
+
+        auto counts = scandium::columns::histogram(values, -100.0, 50.0, 4);
+        std::uint64_t total = 0;
+        for (auto &&count : counts) {
+            total += count;
+        }
+        BOOST_CHECK_EQUAL(total, 859);
+        BOOST_CHECK_EQUAL(counts[0], 200 - 29);
+
+        auto id_counts = scandium::columns::histogram(ids, static_cast<sqlite3_int64>(-500),
+                                                      static_cast<sqlite3_int64>(250), 4);
+        BOOST_CHECK_EQUAL(id_counts[0] + id_counts[1] + id_counts[2] + id_counts[3], 859);
+    }
+
+    scandium::columns::set_isa(scandium::columns::detect_isa());
+}
+
+BOOST_AUTO_TEST_CASE(stats_vfs) {
+    scandium::stats_vfs vfs("test_stats");
+    vfs.register_vfs();
+    BOOST_CHECK_EQUAL(vfs.is_registered(), true);
+
+    auto path = create_random_name();
+    scandium::open_options options;
+    options.vfs = "test_stats";
+    scandium::database db(path, options);
+    db.open();
+    db.exec_sql("CREATE TABLE table_1(id INTEGER, name TEXT);");
+    for (int i = 0; i < 10; ++i) {
+        db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", i, "name");
+    }
+    db.close();
+
+    db.open();
+    int count = 0;
+    for (auto &&cursor : db.query("SELECT id FROM table_1;")) {
+        BOOST_CHECK_EQUAL(cursor.get<int>(0), count);
+        ++count;
+    }
+    BOOST_CHECK_EQUAL(count, 10);
+    db.close();
+
+    auto all_stats = vfs.get_all_stats();
+    scandium::io_stats main_stats{};
+    for (auto &&pair : all_stats) {
+        auto &&name = pair.first;
+        if (name.size() >= path.size() - 2 && name.compare(name.size() - (path.size() - 2), path.size() - 2,
+                                                           path.substr(2)) == 0) {
+            main_stats = pair.second;
+        }
+    }
+    BOOST_CHECK_GT(main_stats.write.count, 0);
+    BOOST_CHECK_GT(main_stats.write.bytes, 0);
+    BOOST_CHECK_GT(main_stats.read.count, 0);
+    BOOST_CHECK_GT(main_stats.sync.count, 0);
+
+    std::uint64_t latency_count = 0;
+    for (auto &&bucket : main_stats.write.latency) {
+        latency_count += bucket;
+    }
+    BOOST_CHECK_EQUAL(latency_count, main_stats.write.count);
+
+    vfs.reset_stats();
+    BOOST_CHECK_EQUAL(vfs.get_stats(all_stats.begin()->first).write.count, 0);
+
+    vfs.unregister_vfs();
+    BOOST_CHECK_EQUAL(vfs.is_registered(), false);
+    BOOST_CHECK_THROW(db.open(), scandium::sqlite_error);
+}
+
+BOOST_AUTO_TEST_CASE(group_committer) {
+    scandium::database db(create_random_name());
+    db.open();
+    db.exec_sql("CREATE TABLE table_1(id INTEGER PRIMARY KEY, name TEXT);");
+
+    {
+        scandium::group_commit_options options;
+        options.max_batch_size = 64;
+        options.max_delay = std::chrono::milliseconds(5);
+        scandium::group_committer committer(db, options);
+
+        std::vector<std::thread> threads;
+        std::vector<std::future<void>> futures[8];
+        for (int t = 0; t < 8; ++t) {
+            threads.emplace_back([&committer, &futures, t] {
+                for (int i = 0; i < 50; ++i) {
+                    auto id = t * 50 + i;
+                    futures[t].push_back(committer.submit([id](scandium::database &db) {
+                        db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", id, "name");
+                    }));
+                }
+            });
+        }
+        for (auto &&thread : threads) {
+            thread.join();
+        }
+        for (auto &&thread_futures : futures) {
+            for (auto &&future : thread_futures) {
+                future.get();
+            }
+        }
+
+        auto duplicate = committer.submit([](scandium::database &db) {
+            db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", 0, "duplicate");
+        });
+        auto fine = committer.submit([](scandium::database &db) {
+            db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", 400, "name");
+        });
+        BOOST_CHECK_THROW(duplicate.get(), scandium::sqlite_error);
+        fine.get();
+
+        BOOST_CHECK_EQUAL(committer.get_write_count(), 401);
+        BOOST_CHECK_LT(committer.get_batch_count(), 401);
+
+        committer.stop();
+        BOOST_CHECK_THROW(committer.submit([](scandium::database &) {}), std::logic_error);
+    }
+
+    auto result = db.query("SELECT count(*) FROM table_1;");
+    BOOST_CHECK_EQUAL(result.begin()->get<int>(0), 401);
+}
+
+BOOST_AUTO_TEST_CASE(writer_actor) {
+    auto path = create_random_name();
+    {
+        scandium::database db(path);
+        db.open();
+        db.exec_sql("CREATE TABLE table_1(id INTEGER PRIMARY KEY, name TEXT);");
+    }
+
+    {
+        scandium::writer_actor writer(path);
+
+        std::vector<std::thread> threads;
+        std::vector<std::future<void>> futures[8];
+        for (int t = 0; t < 8; ++t) {
+            threads.emplace_back([&writer, &futures, t] {
+                for (int i = 0; i < 200; ++i) {
+                    auto id = t * 200 + i;
+                    futures[t].push_back(writer.submit([id](scandium::database &db) {
+                        db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", id, "name");
+                    }));
+                }
+            });
+        }
+        for (auto &&thread : threads) {
+            thread.join();
+        }
+        for (auto &&thread_futures : futures) {
+            for (auto &&future : thread_futures) {
+                future.get();
+            }
+        }
+
+        auto duplicate = writer.submit([](scandium::database &db) {
+            db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", 0, "duplicate");
+        });
+        BOOST_CHECK_THROW(duplicate.get(), scandium::sqlite_error);
+
+        auto metrics = writer.get_metrics();
+        BOOST_CHECK_EQUAL(metrics.queue_depth, 0);
+        BOOST_CHECK_EQUAL(metrics.submitted, 1601);
+        BOOST_CHECK_EQUAL(metrics.completed, 1601);
+        BOOST_CHECK_LE(metrics.transactions, 1601);
+        BOOST_CHECK_GE(metrics.max_latency.count(), 0);
+
+        writer.stop();
+        BOOST_CHECK_THROW(writer.submit([](scandium::database &) {}), std::logic_error);
+    }
+
+    // stopping while other threads submit leaves no future unready
+    {
+        scandium::writer_actor writer(path);
+
+        std::atomic<bool> started(false);
+        std::vector<std::thread> threads;
+        std::vector<std::future<void>> futures[4];
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&writer, &futures, &started, t] {
+                for (;;) {
+                    try {
+                        futures[t].push_back(writer.submit([](scandium::database &) {}));
+                        started.store(true);
+                    } catch (const std::logic_error &) {
+                        return;
+                    }
+                }
+            });
+        }
+        while (!started.load()) {
+            std::this_thread::yield();
+        }
+        writer.stop();
+        for (auto &&thread : threads) {
+            thread.join();
+        }
+
+        std::uint64_t count = 0;
+        for (auto &&thread_futures : futures) {
+            for (auto &&future : thread_futures) {
+                BOOST_REQUIRE(future.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+                ++count;
+            }
+        }
+        auto metrics = writer.get_metrics();
+        BOOST_CHECK_EQUAL(metrics.submitted, count);
+        BOOST_CHECK_EQUAL(metrics.completed, count);
+        BOOST_CHECK_EQUAL(metrics.queue_depth, 0);
+    }
+
+    scandium::database db(path);
+    db.open();
+    auto result = db.query("SELECT count(*) FROM table_1;");
+    BOOST_CHECK_EQUAL(result.begin()->get<int>(0), 1600);
+}
+
+BOOST_AUTO_TEST_CASE(sharded_database) {
+    std::vector<std::string> paths;
+    for (int i = 0; i < 4; ++i) {
+        paths.push_back(create_random_name());
+    }
+    scandium::sharded_database db(paths, scandium::open_options(), 2);
+    db.open();
+    BOOST_CHECK_EQUAL(db.get_shard_count(), 4u);
+    db.exec_sql_all("CREATE TABLE table_1(id INTEGER PRIMARY KEY, value INTEGER);");
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&db, t] {
+            for (int i = t * 250; i < (t + 1) * 250; ++i) {
+                db.exec_sql(i, "INSERT INTO table_1 VALUES(?, ?);", i, i % 10);
+            }
+        });
+    }
+    for (auto &&thread : threads) {
+        thread.join();
+    }
+
+    auto counts = db.query_shards("SELECT count(*) FROM table_1;", [](scandium::cursor &row) {
+        return row.get<int>(0);
+    });
+    BOOST_REQUIRE_EQUAL(counts.size(), 4u);
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+        BOOST_CHECK_GT(counts[i][0], 0);
+    }
+    BOOST_CHECK_EQUAL(db.with_shard(7, [](scandium::database &shard) {
+        return shard.query("SELECT count(*) FROM table_1 WHERE id = 7;").begin()->get<int>(0);
+    }), 1);
+
+    auto ids = db.query_concat("SELECT id FROM table_1 WHERE value = ?;", [](scandium::cursor &row) {
+        return row.get<int>(0);
+    }, 3);
+    BOOST_CHECK_EQUAL(ids.size(), 100u);
+
+    auto sorted = db.query_merge("SELECT id FROM table_1 ORDER BY id;", [](scandium::cursor &row) {
+        return row.get<int>(0);
+    }, std::less<int>());
+    BOOST_REQUIRE_EQUAL(sorted.size(), 1000u);
+    for (int i = 0; i < 1000; ++i) {
+        BOOST_CHECK_EQUAL(sorted[i], i);
+    }
+
+    typedef std::pair<sqlite3_int64, sqlite3_int64> count_sum;
+    auto total = db.query_reduce("SELECT count(*), sum(value) FROM table_1;", [](scandium::cursor &row) {
+        return count_sum(row.get<sqlite3_int64>(0), row.get<sqlite3_int64>(1));
+    }, count_sum(0, 0), [](const count_sum &a, const count_sum &b) {
+        return count_sum(a.first + b.first, a.second + b.second);
+    });
+    BOOST_CHECK_EQUAL(total.first, 1000);
+    BOOST_CHECK_EQUAL(total.second, 4500);
+
+    BOOST_CHECK_THROW(db.exec_sql_all("INSERT INTO table_1 VALUES(0, 0);"), scandium::sqlite_error);
+}
+
+BOOST_AUTO_TEST_CASE(change_feed) {
+    scandium::database db(create_random_name());
+    db.open();
+    db.exec_sql("CREATE TABLE table_1(id INTEGER PRIMARY KEY, name TEXT);");
+
+    scandium::change_feed_options options;
+    options.capacity = 4;
+    scandium::change_feed feed(db, options);
+
+    db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", 1, "a");
+    BOOST_CHECK(feed.wait(std::chrono::milliseconds(0)));
+    auto records = feed.drain();
+    BOOST_REQUIRE_EQUAL(records.size(), 1u);
+    BOOST_CHECK_EQUAL(records[0].operation, SQLITE_INSERT);
+    BOOST_CHECK_EQUAL(records[0].database_name, "main");
+    BOOST_CHECK_EQUAL(records[0].table_name, "table_1");
+    BOOST_CHECK_EQUAL(records[0].rowid, 1);
+
+    // published only on commit
+    {
+        auto transaction = db.create_transaction();
+        db.exec_sql("UPDATE table_1 SET name = ? WHERE id = ?;", "b", 1);
+        db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", 2, "c");
+        BOOST_CHECK_EQUAL(feed.size(), 0u);
+        transaction.commit();
+    }
+    records = feed.drain();
+    BOOST_REQUIRE_EQUAL(records.size(), 2u);
+    BOOST_CHECK_EQUAL(records[0].operation, SQLITE_UPDATE);
+    BOOST_CHECK_EQUAL(records[1].operation, SQLITE_INSERT);
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+    BOOST_REQUIRE_EQUAL(records[0].old_values.size(), 2u);
+    BOOST_CHECK(records[0].old_values[1] == scandium::value("a"));
+    BOOST_CHECK(records[0].new_values[1] == scandium::value("b"));
+    BOOST_CHECK(records[1].old_values.empty());
+#endif
+
+    // discarded on rollback
+    {
+        auto transaction = db.create_transaction();
+        db.exec_sql("DELETE FROM table_1 WHERE id = ?;", 1);
+    }
+    BOOST_CHECK_EQUAL(feed.size(), 0u);
+    BOOST_CHECK(!feed.wait(std::chrono::milliseconds(1)));
+
+    // changes rolled back to a savepoint are discarded
+    {
+        auto transaction = db.create_transaction();
+        db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", 3, "e");
+        db.exec_sql("SAVEPOINT \"Write\";");
+        db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", 4, "f");
+        db.exec_sql("SAVEPOINT inner_1;");
+        db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", 5, "g");
+        db.exec_sql("ROLLBACK TRANSACTION TO write;");
+        db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", 6, "h");
+        db.exec_sql("RELEASE SAVEPOINT write;");
+        transaction.commit();
+    }
+    records = feed.drain();
+    BOOST_REQUIRE_EQUAL(records.size(), 2u);
+    BOOST_CHECK_EQUAL(records[0].rowid, 3);
+    BOOST_CHECK_EQUAL(records[1].rowid, 6);
+
+    // a commit vetoed by a commit listener added later is not published
+    auto veto = db.add_commit_listener([] {
+        throw std::runtime_error("veto");
+    });
+    BOOST_CHECK_THROW(db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", 7, "i"), scandium::sqlite_error);
+    db.remove_listener(veto);
+    BOOST_CHECK_EQUAL(feed.size(), 0u);
+
+    // the oldest records are dropped when the ring is full
+    {
+        auto transaction = db.create_transaction();
+        for (int i = 10; i < 16; ++i) {
+            db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", i, "d");
+        }
+        transaction.commit();
+    }
+    BOOST_CHECK_EQUAL(feed.size(), 4u);
+    BOOST_CHECK_EQUAL(feed.get_dropped_count(), 2u);
+    BOOST_CHECK_EQUAL(feed.get_published_count(), 11u);
+    records = feed.drain(3);
+    BOOST_REQUIRE_EQUAL(records.size(), 3u);
+    BOOST_CHECK_EQUAL(records[0].rowid, 12);
+    BOOST_CHECK_EQUAL(feed.drain().size(), 1u);
+}
+
+#ifdef SQLITE_ENABLE_SESSION
+
+BOOST_AUTO_TEST_CASE(session) {
+    scandium::database leader;
+    scandium::database follower;
+    leader.open();
+    follower.open();
+    for (auto db : {&leader, &follower}) {
+        db->exec_sql("CREATE TABLE table_1(id INTEGER PRIMARY KEY, name TEXT);");
+        db->exec_sql("INSERT INTO table_1 VALUES(1, 'a'), (2, 'b'), (3, 'c');");
+    }
+
+    auto session = leader.create_session();
+    session.attach();
+    BOOST_CHECK(session.is_empty());
+    {
+        auto transaction = leader.create_transaction();
+        leader.exec_sql("INSERT INTO table_1 VALUES(?, ?);", 4, "d");
+        leader.exec_sql("UPDATE table_1 SET name = ? WHERE id = ?;", "x", 1);
+        leader.exec_sql("DELETE FROM table_1 WHERE id = ?;", 2);
+        transaction.commit();
+    }
+    BOOST_CHECK(!session.is_empty());
+    auto changeset = session.changeset();
+    BOOST_CHECK(!changeset.empty());
+    BOOST_CHECK_LE(session.patchset().size(), changeset.size());
+
+    auto dump = [](scandium::database &db) {
+        std::string result;
+        auto &&results = db.query("SELECT id, name FROM table_1 ORDER BY id;");
+        for (auto &&row : results) {
+            result += std::to_string(row.get<int>(0)) + row.get<std::string>(1);
+        }
+        return result;
+    };
+    follower.apply_changeset(changeset);
+    BOOST_CHECK_EQUAL(dump(follower), "1x3c4d");
+
+    // conflicts
+    auto session_2 = leader.create_session();
+    session_2.attach("table_1");
+    leader.exec_sql("UPDATE table_1 SET name = ? WHERE id = ?;", "y", 3);
+    leader.exec_sql("UPDATE table_1 SET name = ? WHERE id = ?;", "z", 4);
+    follower.exec_sql("UPDATE table_1 SET name = ? WHERE id = ?;", "local", 3);
+    changeset = session_2.changeset();
+
+    BOOST_CHECK_THROW(follower.apply_changeset(changeset), scandium::sqlite_error);
+    BOOST_CHECK_EQUAL(dump(follower), "1x3local4d");
+
+    std::vector<scandium::changeset_conflict> conflicts;
+    follower.apply_changeset(changeset, [&conflicts](const scandium::changeset_conflict &conflict) {
+        conflicts.push_back(conflict);
+        return scandium::conflict_action::omit;
+    });
+    BOOST_CHECK_EQUAL(dump(follower), "1x3local4z");
+    BOOST_REQUIRE_EQUAL(conflicts.size(), 1u);
+    BOOST_CHECK_EQUAL(conflicts[0].type, SQLITE_CHANGESET_DATA);
+    BOOST_CHECK_EQUAL(conflicts[0].table_name, "table_1");
+    BOOST_CHECK_EQUAL(conflicts[0].operation, SQLITE_UPDATE);
+    BOOST_CHECK(conflicts[0].old_values[1] == scandium::value("c"));
+    BOOST_CHECK(conflicts[0].new_values[1] == scandium::value("y"));
+    BOOST_CHECK(conflicts[0].conflicting_values[1] == scandium::value("local"));
+
+    follower.apply_changeset(changeset, [](const scandium::changeset_conflict &) {
+        return scandium::conflict_action::replace;
+    });
+    BOOST_CHECK_EQUAL(dump(follower), "1x3y4z");
+
+    // replace is rejected for the conflicts SQLite cannot replace, and nothing is applied
+    follower.exec_sql("DELETE FROM table_1 WHERE id = ?;", 4);
+    BOOST_CHECK_THROW(follower.apply_changeset(changeset, [](const scandium::changeset_conflict &) {
+        return scandium::conflict_action::replace;
+    }), std::logic_error);
+    BOOST_CHECK_EQUAL(dump(follower), "1x3y");
+}
+
+#endif
+
+BOOST_AUTO_TEST_CASE(deadline_and_cancellation) {
+    scandium::database db;
+    db.open();
+    const std::string slow_sql = "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) "
+            "SELECT count(*) FROM c;";
+
+    {
+        scandium::deadline_guard guard(db, std::chrono::milliseconds(20));
+        auto started = std::chrono::steady_clock::now();
+        BOOST_CHECK_THROW(db.exec_sql(slow_sql), scandium::interrupted_error);
+        BOOST_CHECK(guard.is_expired());
+        BOOST_CHECK(std::chrono::steady_clock::now() - started < std::chrono::seconds(5));
+    }
+    {
+        scandium::deadline_guard guard(db, std::chrono::seconds(60));
+        BOOST_CHECK_EQUAL(db.query("SELECT 1;").begin()->get<int>(0), 1);
+        BOOST_CHECK(!guard.is_expired());
+    }
+
+    scandium::cancellation_token token(db);
+    std::thread canceller([&token] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        token.cancel();
+    });
+    try {
+        db.exec_sql(slow_sql);
+        BOOST_ERROR("not interrupted");
+    } catch (const scandium::interrupted_error &e) {
+        BOOST_CHECK_EQUAL(e.result_code(), SQLITE_INTERRUPT);
+    }
+    canceller.join();
+    BOOST_CHECK(token.is_cancelled());
+    BOOST_CHECK_THROW(db.exec_sql("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c LIMIT 100000) "
+                                          "SELECT count(*) FROM c;"), scandium::interrupted_error);
+    token.reset();
+    BOOST_CHECK_EQUAL(db.query("SELECT 1;").begin()->get<int>(0), 1);
+}
+
+BOOST_AUTO_TEST_CASE(exec_script) {
+    scandium::database db;
+    db.open();
+    db.exec_script("CREATE TABLE table_1(id INTEGER PRIMARY KEY, name TEXT);\n"
+                           "-- a comment;\n"
+                           "INSERT INTO table_1 VALUES(1, 'a;b');\n"
+                           "SELECT * FROM table_1;\n"
+                           "INSERT INTO table_1 VALUES(2, 'c')");
+    auto count = [&db] {
+        return db.query("SELECT count(*) FROM table_1;").begin()->get<int>(0);
+    };
+    BOOST_CHECK_EQUAL(count(), 2);
+
+    // rolled back as a whole in a transaction
+    BOOST_CHECK_THROW(db.exec_script("INSERT INTO table_1 VALUES(3, 'd'); INSERT INTO table_1 VALUES(1, 'e');", true),
+                      scandium::sqlite_error);
+    BOOST_CHECK_EQUAL(count(), 2);
+    BOOST_CHECK_THROW(db.exec_script("INSERT INTO table_1 VALUES(3, 'd'); INSERT INTO table_1 VALUES(1, 'e');"),
+                      scandium::sqlite_error);
+    BOOST_CHECK_EQUAL(count(), 3);
+
+    // a file larger than a chunk, with statements, literals and triggers across the chunk boundaries
+    auto path = create_random_name();
+    {
+        std::ofstream file(path);
+        file << "CREATE TABLE table_2(id INTEGER PRIMARY KEY, name TEXT);\n";
+        file << "CREATE TABLE table_3(id INTEGER PRIMARY KEY);\n";
+        file << "CREATE TRIGGER trigger_1 AFTER INSERT ON table_2 BEGIN\n"
+                "  INSERT INTO table_3 VALUES(new.id);\n"
+                "END;\n";
+        for (int i = 0; i < 5000; ++i) {
+            file << "INSERT INTO table_2 VALUES(" << i << ", '" << std::string(static_cast<std::size_t>(i % 50), ';')
+                 << "');\n";
+        }
+    }
+    db.exec_script_file(path, true);
+    BOOST_CHECK_EQUAL(db.query("SELECT count(*) FROM table_3;").begin()->get<int>(0), 5000);
+    BOOST_CHECK_EQUAL(db.query("SELECT name FROM table_2 WHERE id = 49;").begin()->get<std::string>(0),
+                      std::string(49, ';'));
+    std::remove(path.c_str());
+
+    // the last semicolon of the first chunk is in a comment that goes on in the next chunk
+    {
+        std::string script = "CREATE TABLE table_4(id INTEGER PRIMARY KEY);\n";
+        for (int i = 0; script.size() < 60000; ++i) {
+            script += "INSERT INTO table_4 VALUES(" + std::to_string(i) + ");\n";
+        }
+        script.resize(64 * 1024 - 15, ' ');
+        script += "-- a comment; with words across the chunk boundary\n";
+        script += "INSERT INTO table_4 VALUES(-1);\n";
+        std::ofstream file(path);
+        file << script;
+    }
+    db.exec_script_file(path);
+    BOOST_CHECK_EQUAL(db.query("SELECT count(*) FROM table_4 WHERE id = -1;").begin()->get<int>(0), 1);
+    std::remove(path.c_str());
+
+    BOOST_CHECK_THROW(db.exec_script_file(path), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(migrator) {
+    auto path = create_random_name();
+    scandium::database db(path);
+    db.open();
+
+    auto register_steps = [](scandium::migrator &migrator, int &chunks, int fail_at_chunk) {
+        migrator.add_step(1, [](scandium::database &db) {
+            db.exec_sql("CREATE TABLE table_1(id INTEGER PRIMARY KEY, name TEXT);");
+            db.exec_sql("INSERT INTO table_1(name) SELECT 'name' FROM "
+                                "(WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c LIMIT 95) SELECT x FROM c);");
+        });
+        migrator.add_step(2, [](scandium::database &db) {
+            db.exec_sql("ALTER TABLE table_1 ADD COLUMN upper_name TEXT;");
+        });
+        migrator.add_incremental_step(4, [&chunks, fail_at_chunk](scandium::database &db, sqlite3_int64 &position) {
+            if (++chunks == fail_at_chunk) {
+                throw std::runtime_error("interrupted");
+            }
+            db.exec_sql("UPDATE table_1 SET upper_name = upper(name) WHERE id > ? AND id <= ?;",
+                        position, position + 10);
+            position += 10;
+            return position >= 95;
+        });
+    };
+
+    int chunks = 0;
+    scandium::migrator migrator(db);
+    register_steps(migrator, chunks, 4);
+    BOOST_CHECK_EQUAL(migrator.get_latest_version(), 4);
+    BOOST_CHECK_THROW(migrator.add_step(2, [](scandium::database &) {}), std::logic_error);
+
+    BOOST_CHECK_EQUAL(migrator.migrate(1), 1);
+    BOOST_CHECK_EQUAL(db.get_user_version(), 1);
+
+    // the failed chunk is rolled back, and the committed chunks are kept
+    BOOST_CHECK_THROW(migrator.migrate(), std::runtime_error);
+    BOOST_CHECK_EQUAL(db.get_user_version(), 2);
+    BOOST_CHECK_EQUAL(db.query("SELECT count(upper_name) FROM table_1;").begin()->get<int>(0), 30);
+    BOOST_CHECK_EQUAL(db.query("SELECT position FROM scandium_migration_progress;").begin()->get<int>(0), 30);
+
+    // resumes from the persisted position
+    chunks = 0;
+    scandium::migrator resumed(db);
+    register_steps(resumed, chunks, 0);
+    BOOST_CHECK_EQUAL(resumed.migrate(), 4);
+    BOOST_CHECK_EQUAL(chunks, 7);
+    BOOST_CHECK_EQUAL(db.get_user_version(), 4);
+    BOOST_CHECK_EQUAL(db.query("SELECT count(upper_name) FROM table_1;").begin()->get<int>(0), 95);
+    BOOST_CHECK_EQUAL(db.query("SELECT count(*) FROM scandium_migration_progress;").begin()->get<int>(0), 0);
+    BOOST_CHECK_EQUAL(resumed.migrate(), 4);
+
+    // the progress table name is quoted
+    scandium::migration_options options;
+    options.progress_table = "migration \"progress\"";
+    scandium::migrator quoted(db, options);
+    quoted.add_incremental_step(5, [](scandium::database &, sqlite3_int64 &position) {
+        if (++position == 2) {
+            throw std::runtime_error("interrupted");
+        }
+        return false;
+    });
+    BOOST_CHECK_THROW(quoted.migrate(), std::runtime_error);
+    BOOST_CHECK_EQUAL(db.query("SELECT position FROM \"migration \"\"progress\"\"\";").begin()->get<int>(0), 1);
+
+    // two connections upgrading at once run each step and each chunk once
+    std::atomic<int> runs(0);
+    auto upgrade = [&path, &runs] {
+        scandium::database connection(path);
+        connection.open();
+        scandium::migrator concurrent(connection);
+        concurrent.add_step(6, [&runs](scandium::database &db) {
+            ++runs;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            db.exec_sql("CREATE TABLE table_6(id INTEGER PRIMARY KEY);");
+        });
+        concurrent.add_incremental_step(7, [&runs](scandium::database &db, sqlite3_int64 &position) {
+            ++runs;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            db.exec_sql("INSERT INTO table_6 VALUES(?);", ++position);
+            return position == 5;
+        });
+        BOOST_CHECK_EQUAL(concurrent.migrate(), 7);
+    };
+    db.exec_sql("PRAGMA user_version = 5;");
+    std::thread other([&upgrade] {
+        try {
+            upgrade();
+        } catch (const std::exception &e) {
+            BOOST_ERROR(e.what());
+        }
+    });
+    upgrade();
+    other.join();
+    BOOST_CHECK_EQUAL(runs.load(), 6);
+    BOOST_CHECK_EQUAL(db.query("SELECT count(*) FROM table_6;").begin()->get<int>(0), 5);
+}
+
+BOOST_AUTO_TEST_CASE(thread_check) {
+    scandium::open_options options;
+    options.flags |= SQLITE_OPEN_NOMUTEX;
+    options.thread_check.mode = scandium::thread_check_mode::raise;
+    scandium::database db(create_random_name(), options);
+    db.open();
+    db.exec_sql("CREATE TABLE table_1(id INTEGER PRIMARY KEY);");
+
+    auto copy = db;
+    std::thread([&copy] {
+        BOOST_CHECK_THROW(copy.exec_sql("INSERT INTO table_1 VALUES(1);"), scandium::thread_affinity_error);
+    }).join();
+
+    // transfers the database to another thread, and back
+    db.release_thread();
+    std::thread([&copy] {
+        copy.exec_sql("INSERT INTO table_1 VALUES(2);");
+    }).join();
+    BOOST_CHECK_THROW(db.query("SELECT count(*) FROM table_1;"), scandium::thread_affinity_error);
+    db.claim_thread();
+    BOOST_CHECK_EQUAL(db.query("SELECT count(*) FROM table_1;").begin()->get<int>(0), 1);
+
+    // a statement prepared by the owner and executed by another thread
+    auto statement = db.prepare_statement("INSERT INTO table_1 VALUES(3);");
+    std::thread([&statement] {
+        BOOST_CHECK_THROW(statement.exec(), scandium::thread_affinity_error);
+    }).join();
+
+    // report mode executes the operations
+    options.thread_check.mode = scandium::thread_check_mode::report;
+    std::vector<std::thread::id> reported;
+    options.thread_check.reporter = [&reported](std::thread::id, std::thread::id current) {
+        reported.push_back(current);
+    };
+    scandium::database reporting(create_random_name(), options);
+    reporting.open();
+    std::thread::id other;
+    std::thread([&reporting, &other] {
+        other = std::this_thread::get_id();
+        reporting.exec_sql("CREATE TABLE table_1(id INTEGER PRIMARY KEY);");
+    }).join();
+    BOOST_CHECK_EQUAL(reported.size(), 1u);
+    BOOST_CHECK(reported[0] == other);
+    BOOST_CHECK_EQUAL(reporting.query("SELECT count(*) FROM table_1;").begin()->get<int>(0), 0);
+}
+
+BOOST_AUTO_TEST_CASE(cached_transaction_statements) {
+    auto path = create_random_name();
+    scandium::database db(path);
+    db.open();
+    db.exec_sql("CREATE TABLE table_1(id INTEGER PRIMARY KEY);");
+
+    auto run_transaction = [&db](int id) {
+        auto transaction = db.create_transaction(scandium::transaction_mode::immediate);
+        db.exec_sql("INSERT INTO table_1 VALUES(?);", id);
+        transaction.commit();
+    };
+    run_transaction(0);
+    auto stmt_used = db.stats().stmt_used;
+    BOOST_CHECK_GT(stmt_used, 0);
+    for (int i = 1; i < 100; ++i) {
+        run_transaction(i);
+    }
+    BOOST_CHECK_EQUAL(db.stats().stmt_used, stmt_used);
+
+    // a failed statement is reset, and can run again
+    BOOST_CHECK_THROW(db.commit_transaction(), scandium::sqlite_error);
+    {
+        auto transaction = db.create_transaction();
+        db.exec_sql("INSERT INTO table_1 VALUES(?);", 100);
+    }
+    run_transaction(101);
+    BOOST_CHECK_EQUAL(db.query("SELECT count(*) FROM table_1;").begin()->get<int>(0), 101);
+
+    db.update_user_version(3);
+    BOOST_CHECK_EQUAL(db.get_user_version(), 3);
+
+    // the cached statements are finalized on close, and prepared again after reopening
+    db.close();
+    db.open();
+    BOOST_CHECK_EQUAL(db.get_user_version(), 3);
+    run_transaction(102);
+}
+
+BOOST_AUTO_TEST_CASE(row_snapshot) {
+    scandium::database db;
+    db.open();
+    db.exec_sql("CREATE TABLE table_1(id INTEGER PRIMARY KEY, name TEXT, score REAL, data BLOB, note TEXT);");
+    db.exec_sql("INSERT INTO table_1 VALUES(?, ?, ?, ?, ?);", 1, "a", 1.5, std::vector<unsigned char>{1, 2, 3}, nullptr);
+    db.exec_sql("INSERT INTO table_1 VALUES(?, ?, ?, ?, ?);", 2, std::string(1000, 'b'), 2.5,
+                std::vector<unsigned char>(), "12");
+
+    std::vector<scandium::row> rows;
+    for (auto &&cursor : db.query("SELECT * FROM table_1 ORDER BY id;")) {
+        rows.push_back(cursor.snapshot());
+    }
+    BOOST_REQUIRE_EQUAL(rows.size(), 2u);
+
+    auto &&small = rows[0];
+    BOOST_CHECK_EQUAL(small.get_column_count(), 5);
+    BOOST_CHECK_EQUAL(small.heap_size(), 0u);
+    BOOST_CHECK_EQUAL(small.get<int>(0), 1);
+    BOOST_CHECK_EQUAL(small.get<std::string>(1), "a");
+    BOOST_CHECK_EQUAL(std::string(small.get<const char *>(1)), "a");
+    BOOST_CHECK_EQUAL(small.get<double>(2), 1.5);
+    BOOST_CHECK((small.get<std::vector<unsigned char>>(3) == std::vector<unsigned char>{1, 2, 3}));
+    BOOST_CHECK_EQUAL(small.get<scandium::blob>(3).size, 3);
+    BOOST_CHECK(small.is_null(4));
+    BOOST_CHECK(small.get<const char *>(4) == nullptr);
+    BOOST_CHECK_EQUAL(small.get_column_type(3), SQLITE_BLOB);
+    BOOST_CHECK_THROW(small.get<int>(5), std::out_of_range);
+
+    auto &&large = rows[1];
+    BOOST_CHECK_GT(large.heap_size(), 1000u);
+    BOOST_CHECK_EQUAL(large.get<scandium::text_view>(1).size, 1000);
+    BOOST_CHECK_EQUAL(large.get<std::string>(1), std::string(1000, 'b'));
+    BOOST_CHECK(large.get<std::vector<unsigned char>>(3).empty());
+    BOOST_CHECK_EQUAL(large.get<int>(4), 12);
+    BOOST_CHECK(large.get<scandium::value>(4) == scandium::value("12"));
+
+    // copies and moves keep the values
+    scandium::row copy = large;
+    scandium::row moved = std::move(rows[0]);
+    BOOST_CHECK_EQUAL(copy.get<std::string>(1), std::string(1000, 'b'));
+    BOOST_CHECK_EQUAL(moved.get<std::string>(1), "a");
+    BOOST_CHECK_EQUAL(rows[0].get_column_count(), 0);
+    copy = moved;
+    BOOST_CHECK_EQUAL(copy.heap_size(), 0u);
+    BOOST_CHECK_EQUAL(copy.get<double>(2), 1.5);
+
+    // the values are converted like the cursor converts them
+    const char *sql = "SELECT 12, 1.5, 1e20, -3, x'31323334', ' 7 text';";
+    for (auto &&cursor : db.query(sql)) {
+        auto snapshot = cursor.snapshot();
+        for (int i = 0; i < cursor.get_column_count(); ++i) {
+            BOOST_CHECK_EQUAL(snapshot.get<std::string>(i), cursor.get<std::string>(i));
+            BOOST_CHECK_EQUAL(std::string(snapshot.get<const char *>(i)), cursor.get<std::string>(i));
+            BOOST_CHECK_EQUAL(snapshot.get<scandium::text_view>(i).size, cursor.get<scandium::blob>(i).size);
+            BOOST_CHECK_EQUAL(snapshot.get<sqlite3_int64>(i), cursor.get<sqlite3_int64>(i));
+            BOOST_CHECK_EQUAL(snapshot.get<double>(i), cursor.get<double>(i));
+        }
+        BOOST_CHECK_EQUAL(snapshot.get_column_type(0), SQLITE_INTEGER);
+        BOOST_CHECK_EQUAL(snapshot.get_column_type(1), SQLITE_FLOAT);
+        BOOST_CHECK_EQUAL(snapshot.get_column_type(4), SQLITE_BLOB);
+        BOOST_CHECK_EQUAL(snapshot.get<std::string>(2), "1.0e+20");
+    }
+
+    // the numbers are stored inline as numbers, and formatted once when read as pointers
+    for (auto &&cursor : db.query("SELECT 1, 2, 3, 4, 5, 6, 7, 1.5;")) {
+        auto snapshot = cursor.snapshot();
+        BOOST_CHECK_EQUAL(snapshot.heap_size(), 0u);
+        auto text = snapshot.get<const char *>(7);
+        BOOST_CHECK_EQUAL(std::string(text), "1.5");
+        BOOST_CHECK_EQUAL(snapshot.get<scandium::text_view>(7).data, text);
+        BOOST_CHECK_EQUAL(snapshot.get<scandium::text_view>(7).size, 3);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(materialize) {
+    scandium::database db;
+    db.open();
+    db.exec_sql("CREATE TABLE table_1(id INTEGER PRIMARY KEY, name TEXT, data BLOB, score REAL);");
+    {
+        auto transaction = db.create_transaction();
+        for (int i = 0; i < 100; ++i) {
+            db.exec_sql("INSERT INTO table_1 VALUES(?, ?, ?, ?);", i, "name_" + std::to_string(i),
+                        std::vector<unsigned char>(static_cast<std::size_t>(i % 4), 7), i * 0.5);
+        }
+        db.exec_sql("UPDATE table_1 SET score = NULL WHERE id % 10 = 0;");
+        transaction.commit();
+    }
+
+    auto result = db.query("SELECT id, name, data, score FROM table_1 ORDER BY id;").materialize();
+    BOOST_REQUIRE_EQUAL(result.size(), 100u);
+    BOOST_CHECK_EQUAL(result.get_column_count(), 4);
+    BOOST_CHECK_EQUAL(result.get_column_name(1), "name");
+    BOOST_CHECK_EQUAL(result.get_column_index("score"), 3);
+    BOOST_CHECK_EQUAL(result.get_column_index("missing"), -1);
+    BOOST_CHECK_GT(result.memory_size(), 0u);
+
+    // random access
+    BOOST_CHECK_EQUAL(result[42].get<int>(0), 42);
+    BOOST_CHECK_EQUAL(std::string(result[42].get<const char *>(1)), "name_42");
+    BOOST_CHECK_EQUAL(result[43].get<scandium::blob>(2).size, 3);
+    BOOST_CHECK((result[43].get<std::vector<unsigned char>>(2) == std::vector<unsigned char>(3, 7)));
+    BOOST_CHECK(result[40].get<std::vector<unsigned char>>(2).empty());
+    BOOST_CHECK(result[40].is_null(3));
+    BOOST_CHECK_EQUAL(result[41].get<double>(3), 20.5);
+    BOOST_CHECK(result[41].get<scandium::value>(1) == scandium::value("name_41"));
+    BOOST_CHECK_THROW(result.at(100), std::out_of_range);
+    BOOST_CHECK_THROW(result[0].get<int>(4), std::out_of_range);
+
+    // many passes and the iterator arithmetic
+    sqlite3_int64 sum = 0;
+    for (auto &&row : result) {
+        sum += row.get<sqlite3_int64>(0);
+    }
+    for (auto &&row : result) {
+        sum += row.get<sqlite3_int64>(0);
+    }
+    BOOST_CHECK_EQUAL(sum, 2 * 4950);
+    BOOST_CHECK_EQUAL(result.end() - result.begin(), 100);
+    BOOST_CHECK_EQUAL((*(result.begin() + 10)).get_index(), 10u);
+    BOOST_CHECK_EQUAL(result.begin()[99].get<int>(0), 99);
+    auto found = std::lower_bound(result.begin(), result.end(), 77,
+                                  [](const scandium::materialized_result::row_view &row, int id) {
+                                      return row.get<int>(0) < id;
+                                  });
+    BOOST_CHECK_EQUAL((*found).get<int>(0), 77);
+
+    // slices are clamped and do not copy
+    auto page = result.sub(90, 20);
+    BOOST_CHECK_EQUAL(page.size(), 10u);
+    BOOST_CHECK_EQUAL(page[0].get<int>(0), 90);
+    BOOST_CHECK_EQUAL(page.sub(5, 2)[1].get<int>(0), 96);
+    BOOST_CHECK(result.sub(200, 1).empty());
+
+    // the statement is released, so the table can be changed right away
+    db.exec_sql("DROP TABLE table_1;");
+    BOOST_CHECK_EQUAL(result[99].get<std::string>(1), "name_99");
+
+    auto empty = db.query("SELECT 1 WHERE 0;").materialize();
+    BOOST_CHECK(empty.empty());
+    BOOST_CHECK(empty.begin() == empty.end());
+
+    // the values are converted like the cursor converts them
+    const char *sql = "SELECT 12, 1.5, 1e20, -3, x'31323334', ' 7 text';";
+    auto values = db.query(sql).materialize();
+    BOOST_REQUIRE_EQUAL(values.size(), 1u);
+    for (auto &&cursor : db.query(sql)) {
+        for (int i = 0; i < cursor.get_column_count(); ++i) {
+            BOOST_CHECK_EQUAL(values[0].get<std::string>(i), cursor.get<std::string>(i));
+            BOOST_CHECK_EQUAL(std::string(values[0].get<const char *>(i)), cursor.get<std::string>(i));
+            BOOST_CHECK_EQUAL(values[0].get<scandium::text_view>(i).size, cursor.get<scandium::blob>(i).size);
+            BOOST_CHECK_EQUAL(values[0].get<sqlite3_int64>(i), cursor.get<sqlite3_int64>(i));
+            BOOST_CHECK_EQUAL(values[0].get<double>(i), cursor.get<double>(i));
+        }
+    }
+    BOOST_CHECK_EQUAL(values[0].get_column_type(0), SQLITE_INTEGER);
+    BOOST_CHECK_EQUAL(values[0].get_column_type(1), SQLITE_FLOAT);
+    BOOST_CHECK_EQUAL(values[0].get_column_type(4), SQLITE_BLOB);
+    BOOST_CHECK_EQUAL(values[0].get<std::string>(2), "1.0e+20");
+
+    // the numbers are formatted into the arena only when read as pointers, once per cell
+    scandium::arena numbers;
+    auto formatted = db.query("SELECT 12, 1.5;").materialize(numbers);
+    BOOST_CHECK_EQUAL(numbers.get_used_size(), 0u);
+    BOOST_CHECK_EQUAL(formatted[0].get<std::string>(1), "1.5");
+    BOOST_CHECK_EQUAL(numbers.get_used_size(), 0u);
+    auto text = formatted[0].get<const char *>(0);
+    BOOST_CHECK_EQUAL(std::string(text), "12");
+    BOOST_CHECK_EQUAL(formatted[0].get<scandium::text_view>(0).data, text);
+}
+
+BOOST_AUTO_TEST_CASE(arena) {
+    scandium::arena arena(256);
+    BOOST_CHECK_EQUAL(arena.get_capacity(), 0u);
+
+    auto aligned = arena.allocate(10, 8);
+    BOOST_CHECK_EQUAL(reinterpret_cast<std::uintptr_t>(aligned) % 8, 0u);
+    BOOST_CHECK(arena.allocate(0) != nullptr);
+    BOOST_CHECK_THROW(arena.allocate(1, 3), std::logic_error);
+
+    // a large allocation gets a chunk of its own
+    arena.allocate(1000);
+    BOOST_CHECK_EQUAL(arena.get_capacity(), 256u + 1000u);
+
+    // reset recycles the chunks
+    arena.reset();
+    BOOST_CHECK_EQUAL(arena.get_used_size(), 0u);
+    arena.allocate(200);
+    arena.allocate(900);
+    BOOST_CHECK_EQUAL(arena.get_capacity(), 256u + 1000u);
+
+    scandium::database db;
+    db.open();
+    db.exec_sql("CREATE TABLE table_1(id INTEGER PRIMARY KEY, name TEXT, data BLOB);");
+    db.exec_sql("INSERT INTO table_1 VALUES(?, ?, ?);", 1, "alpha", std::vector<unsigned char>{1, 2, 3});
+    db.exec_sql("INSERT INTO table_1 VALUES(?, ?, ?);", 2, nullptr, nullptr);
+    db.exec_sql("INSERT INTO table_1 VALUES(3, '', X'');");
+
+    // the views are alive after the cursor moves
+    arena.reset();
+    std::vector<scandium::text_view> names;
+    std::vector<scandium::blob> blobs;
+    for (auto &&cursor : db.query("SELECT name, data FROM table_1 ORDER BY id;")) {
+        names.push_back(cursor.get<scandium::text_view>(0, arena));
+        blobs.push_back(cursor.get<scandium::blob>("data", arena));
+    }
+    BOOST_REQUIRE_EQUAL(names.size(), 3u);
+    BOOST_CHECK_EQUAL(std::string(names[0].data), "alpha");
+    BOOST_CHECK_EQUAL(names[0].size, 5);
+    BOOST_CHECK_EQUAL(blobs[0].size, 3);
+    BOOST_CHECK_EQUAL(static_cast<const unsigned char *>(blobs[0].data)[2], 3);
+    BOOST_CHECK(names[1].data == nullptr);
+    BOOST_CHECK(blobs[1].data == nullptr);
+    BOOST_CHECK_EQUAL(std::string(names[2].data), "");
+    BOOST_CHECK_GT(arena.get_used_size(), 0u);
+
+    // many results share the arena and are freed together with it
+    arena.reset();
+    auto first = db.query("SELECT name, data FROM table_1 ORDER BY id;").materialize(arena);
+    auto second = db.query("SELECT name FROM table_1 WHERE id = 1;").materialize(arena);
+    BOOST_CHECK_EQUAL(first[0].get<std::string>(0), "alpha");
+    BOOST_CHECK((first[0].get<std::vector<unsigned char>>(1) == std::vector<unsigned char>{1, 2, 3}));
+    BOOST_CHECK(first[1].is_null(0));
+    BOOST_CHECK(first[2].get<const void *>(1) != nullptr);
+    BOOST_CHECK_EQUAL(std::string(second[0].get<const char *>(0)), "alpha");
+    BOOST_CHECK_LT(second.memory_size(), arena.get_capacity());
+
+    // the arena can be moved without invalidating the results
+    scandium::arena moved(std::move(arena));
+    BOOST_CHECK_EQUAL(arena.get_capacity(), 0u);
+    BOOST_CHECK_EQUAL(first[0].get<std::string>(0), "alpha");
+    moved.release();
+    BOOST_CHECK_EQUAL(moved.get_capacity(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(result_cache) {
+    auto path = create_random_name();
+    scandium::database db(path);
+    db.open();
+    db.exec_sql("CREATE TABLE table_1(id INTEGER PRIMARY KEY, name TEXT);");
+    db.exec_sql("CREATE TABLE table_2(id INTEGER PRIMARY KEY, name TEXT);");
+    db.exec_sql("CREATE TABLE table_3(id INTEGER PRIMARY KEY, name TEXT) WITHOUT ROWID;");
+    db.exec_sql("CREATE VIEW view_1 AS SELECT name FROM table_1;");
+    for (int i = 0; i < 10; ++i) {
+        db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", i, "name");
+        db.exec_sql("INSERT INTO table_2 VALUES(?, ?);", i, "name");
+    }
+
+    scandium::result_cache cache(db);
+    auto count_1 = [&cache](int max_id) {
+        return cache.query("SELECT count(*) FROM table_1 WHERE id < ?;", max_id)->rows[0][0].get_int64();
+    };
+
+    BOOST_CHECK_EQUAL(count_1(5), 5);
+    BOOST_CHECK_EQUAL(count_1(5), 5);
+    BOOST_CHECK_EQUAL(count_1(8), 8);
+    auto stats = cache.get_stats();
+    BOOST_CHECK_EQUAL(stats.hits, 1u);
+    BOOST_CHECK_EQUAL(stats.misses, 2u);
+    BOOST_CHECK_EQUAL(stats.entries, 2u);
+
+    auto rows = cache.query("SELECT id, name, NULL AS n FROM table_2 WHERE id = ?;", 3);
+    BOOST_CHECK_EQUAL(rows->columns.size(), 3u);
+    BOOST_CHECK_EQUAL(rows->columns[1], "name");
+    BOOST_CHECK(rows->rows[0][1] == scandium::value("name"));
+    BOOST_CHECK(rows->rows[0][2].is_null());
+    cache.query("SELECT count(*) FROM view_1;");
+
+    // a write to table_1 invalidates only the queries reading table_1
+    db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", 100, "name");
+    stats = cache.get_stats();
+    BOOST_CHECK_EQUAL(stats.entries, 1u);
+    BOOST_CHECK_EQUAL(count_1(1000), 11);
+    BOOST_CHECK_EQUAL(cache.query("SELECT count(*) FROM view_1;")->rows[0][0].get_int64(), 11);
+    cache.query("SELECT id, name, NULL AS n FROM table_2 WHERE id = ?;", 3);
+    BOOST_CHECK_EQUAL(cache.get_stats().hits, 2u);
+
+    // not cached inside a transaction, and the rollback leaves no stale rows
+    {
+        auto transaction = db.create_transaction();
+        db.exec_sql("DELETE FROM table_1 WHERE id = 100;");
+        BOOST_CHECK_EQUAL(count_1(1000), 10);
+    }
+    BOOST_CHECK_EQUAL(count_1(1000), 11);
+
+    // DELETE without WHERE and WITHOUT ROWID tables are not reported by the update hook
+    BOOST_CHECK_EQUAL(cache.query("SELECT count(*) FROM table_2;")->rows[0][0].get_int64(), 10);
+    db.exec_sql("DELETE FROM table_2;");
+    BOOST_CHECK_EQUAL(cache.query("SELECT count(*) FROM table_2;")->rows[0][0].get_int64(), 0);
+    BOOST_CHECK_EQUAL(cache.query("SELECT count(*) FROM table_3;")->rows[0][0].get_int64(), 0);
+    db.exec_sql("INSERT INTO table_3 VALUES(1, 'name');");
+    BOOST_CHECK_EQUAL(cache.query("SELECT count(*) FROM table_3;")->rows[0][0].get_int64(), 1);
+
+    // commits of other connections
+    BOOST_CHECK_EQUAL(count_1(1000), 11);
+    {
+        scandium::database other(path);
+        other.open();
+        other.exec_sql("INSERT INTO table_1 VALUES(?, ?);", 200, "name");
+    }
+    BOOST_CHECK_EQUAL(count_1(1000), 12);
+
+    // the authorizer gives no database name for a read of no column
+    auto count_all = [&cache](const std::string &sql) {
+        return cache.query(sql)->rows[0][0].get_int64();
+    };
+    BOOST_CHECK_EQUAL(count_all("SELECT count(*) FROM table_1;"), 12);
+    BOOST_CHECK_EQUAL(count_all("SELECT count(*) FROM table_1 a, table_1 b;"), 144);
+    db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", 300, "name");
+    BOOST_CHECK_EQUAL(count_all("SELECT count(*) FROM table_1;"), 13);
+    BOOST_CHECK_EQUAL(count_all("SELECT count(*) FROM table_1 a, table_1 b;"), 169);
+
+    // a FROM clause without a table recorded is not cached
+    auto entries = cache.get_stats().entries;
+    BOOST_CHECK_EQUAL(count_all("SELECT count(*) FROM (SELECT 1);"), 1);
+    BOOST_CHECK_EQUAL(cache.get_stats().entries, entries);
+
+    // LRU eviction within the memory budget
+    scandium::result_cache_options options;
+    options.memory_budget = 4096;
+    scandium::result_cache small(db, options);
+    for (int i = 0; i < 100; ++i) {
+        small.query("SELECT ?;", i);
+    }
+    stats = small.get_stats();
+    BOOST_CHECK_GT(stats.evictions, 0u);
+    BOOST_CHECK_LE(stats.memory_size, 4096u);
+    small.query("SELECT ?;", 99);
+    BOOST_CHECK_EQUAL(small.get_stats().hits, 1u);
+    BOOST_CHECK_GT(small.get_stats().hit_rate(), 0);
+
+    // other listeners coming and going do not reset the authorizer, that would expire the prepared statements
+    int authorizations = 0;
+    auto authorizer = db.add_authorizer([&authorizations](int, const char *, const char *, const char *,
+                                                          const char *) {
+        ++authorizations;
+        return SQLITE_OK;
+    });
+    auto statement = db.prepare_statement("SELECT count(*) FROM table_1;");
+    statement.exec();
+    auto prepared = authorizations;
+    BOOST_CHECK_GT(prepared, 0);
+    for (int i = 0; i < 3; ++i) {
+        db.remove_listener(db.add_commit_listener([] {}));
+        db.remove_listener(db.add_progress_listener([] { return false; }));
+    }
+    statement.exec();
+    BOOST_CHECK_EQUAL(authorizations, prepared);
+    db.remove_listener(authorizer);
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocator) {
+    scandium::memory::install_pool_allocator();
+    BOOST_CHECK(scandium::memory::is_pool_allocator_installed());
+    BOOST_CHECK_THROW(scandium::memory::install_pool_allocator(), std::logic_error);
+
+    {
+        auto path = create_random_name();
+        scandium::database db(path);
+        db.open();
+        db.exec_sql("CREATE TABLE table_1(id INTEGER, name TEXT, data BLOB);");
+        auto transaction = db.create_transaction();
+        auto statement = db.prepare_statement("INSERT INTO table_1 VALUES(?, ?, ?);");
+        for (int i = 0; i < 1000; ++i) {
+            statement.exec_with_bindings(i, std::string(i % 300, 'a'), std::vector<unsigned char>(i * 100, 0xbb));
+        }
+        transaction.commit();
+
+        std::thread thread([&path] {
+            scandium::database db(path);
+            db.open();
+            auto result = db.query("SELECT count(*), sum(length(data)) FROM table_1;");
+            auto cursor = result.begin();
+            BOOST_CHECK_EQUAL(cursor->get<int>(0), 1000);
+            BOOST_CHECK_EQUAL(cursor->get<sqlite3_int64>(1), 999LL * 1000 / 2 * 100);
+        });
+        thread.join();
+
+        auto stats = scandium::memory::get_pool_allocator_stats();
+        BOOST_CHECK_GT(stats.live_bytes, 0);
+        BOOST_CHECK_GE(stats.peak_bytes, stats.live_bytes);
+        BOOST_CHECK_GT(stats.reserved_bytes, 0u);
+        BOOST_CHECK_GT(stats.large_allocations, 0u);
+
+        std::uint64_t allocations = 0;
+        std::size_t previous_size = 0;
+        for (auto &&size_class : stats.size_classes) {
+            BOOST_CHECK_GT(size_class.size, previous_size);
+            previous_size = size_class.size;
+            allocations += size_class.allocations;
+        }
+        BOOST_CHECK_GT(allocations, 0u);
+    }
+
+    scandium::memory::uninstall_pool_allocator();
+    BOOST_CHECK(!scandium::memory::is_pool_allocator_installed());
+    BOOST_CHECK_EQUAL(scandium::memory::get_pool_allocator_stats().live_bytes, 0);
+}
+
+#ifdef SCANDIUM_HAS_IO_URING
+BOOST_AUTO_TEST_CASE(uring_vfs) {
+    auto path = create_random_name();
+    {
+        scandium::database db(path);
+        db.open();
+        db.exec_sql("CREATE TABLE table_1(id INTEGER, name TEXT);");
+        auto transaction = db.create_transaction();
+        auto statement = db.prepare_statement("INSERT INTO table_1 VALUES(?, ?);");
+        for (int i = 0; i < 20000; ++i) {
+            statement.exec_with_bindings(i, std::string(100, 'a' + i % 26));
+        }
+        transaction.commit();
+    }
+
+    scandium::uring_vfs vfs("test_uring");
+    vfs.register_vfs();
+
+    scandium::open_options options;
+    options.vfs = "test_uring";
+    scandium::database db(path, options);
+    db.open();
+
+    for (int pass = 0; pass < 2; ++pass) {
+        sqlite3_int64 sum = 0;
+        int count = 0;
+        for (auto &&cursor : db.query("SELECT id, name FROM table_1;")) {
+            sum += cursor.get<int>(0);
+            BOOST_CHECK_EQUAL(cursor.get<std::string>(1), std::string(100, 'a' + count % 26));
+            ++count;
+        }
+        BOOST_CHECK_EQUAL(count, 20000);
+        BOOST_CHECK_EQUAL(sum, 19999LL * 20000 / 2);
+    }
+
+    db.exec_sql("UPDATE table_1 SET name = 'x' WHERE id = 10000;");
+    auto result = db.query("SELECT name FROM table_1 WHERE id = 10000;");
+    BOOST_CHECK_EQUAL(result.begin()->get<std::string>(0), std::string("x"));
+    db.close();
+
+    if (scandium::uring_vfs::is_supported()) {
+        BOOST_CHECK_GT(vfs.get_submitted_reads(), 0);
+        BOOST_CHECK_GT(vfs.get_prefetch_hits(), 0);
+    }
+}
+#endif
+
 #ifdef SQLITE_HAS_CODEC
 BOOST_AUTO_TEST_CASE(sqlcipher) {
     auto path = create_random_name();
@@ -0,0 +1,90 @@
+#include <boost/test/unit_test.hpp>
+#include "scandium_coro.h"
+
+#if __cplusplus >= 202002L
+
+namespace {
+    scandium::task<int> count_rows(scandium::async_database &db) {
+        auto rows = co_await db.query("SELECT count(*) FROM table_1;");
+        co_return static_cast<int>(rows[0][0].get_int64());
+    }
+
+    scandium::task<std::vector<std::size_t>> read_batches(scandium::async_database &db) {
+        std::vector<std::size_t> sizes;
+        auto batches = db.query_batches("SELECT id, name FROM table_1 WHERE id > ? ORDER BY id;", 4, 0);
+        while (auto batch = co_await batches.next()) {
+            sizes.push_back(batch->size());
+        }
+        co_return sizes;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(coroutines) {
+    scandium::async_database db(":memory:");
+
+    scandium::sync_wait([](scandium::async_database &db) -> scandium::task<> {
+        co_await db.exec_sql("CREATE TABLE table_1(id INTEGER PRIMARY KEY, name TEXT);");
+        for (int i = 1; i <= 10; ++i) {
+            co_await db.exec_sql("INSERT INTO table_1 VALUES(?, ?);", i, "name");
+        }
+    }(db));
+    BOOST_CHECK_EQUAL(scandium::sync_wait(count_rows(db)), 10);
+
+    auto rows = scandium::sync_wait(db.query("SELECT id, name FROM table_1 WHERE id = ?;", 3));
+    BOOST_REQUIRE_EQUAL(rows.size(), 1u);
+    BOOST_CHECK(rows[0][1] == scandium::value("name"));
+
+    auto sizes = scandium::sync_wait(read_batches(db));
+    BOOST_CHECK((sizes == std::vector<std::size_t>{4, 4, 2}));
+
+    // a generator destroyed early on this thread, while the database thread is busy,
+    // leaves the statement to the database thread
+    {
+        std::optional<scandium::async_generator<std::vector<std::vector<scandium::value>>>> batches(
+                db.query_batches("SELECT id FROM table_1 ORDER BY id;", 4));
+        auto first = scandium::sync_wait([](auto &batches) -> scandium::task<std::size_t> {
+            co_return (co_await batches.next())->size();
+        }(*batches));
+        BOOST_CHECK_EQUAL(first, 4u);
+
+        std::promise<void> release;
+        auto released = release.get_future().share();
+        std::promise<void> blocked;
+        auto busy = std::async(std::launch::async, [&db, released, &blocked] {
+            scandium::sync_wait([](scandium::async_database &db, std::shared_future<void> released,
+                                   std::promise<void> &blocked) -> scandium::task<> {
+                co_await db.run([&](scandium::database &) {
+                    blocked.set_value();
+                    released.wait();
+                });
+            }(db, released, blocked));
+        });
+        blocked.get_future().wait();
+        batches.reset();
+        release.set_value();
+        busy.get();
+    }
+    BOOST_CHECK_EQUAL(scandium::sync_wait(count_rows(db)), 10);
+
+    // runs on the database thread, and rethrows in the awaiting coroutine
+    auto thread = scandium::sync_wait([](scandium::async_database &db) -> scandium::task<std::thread::id> {
+        co_return co_await db.run([](scandium::database &) {
+            return std::this_thread::get_id();
+        });
+    }(db));
+    BOOST_CHECK(thread != std::this_thread::get_id());
+    BOOST_CHECK_THROW(scandium::sync_wait(db.exec_sql("INSERT INTO table_2 VALUES(1);")), scandium::sqlite_error);
+
+    // many coroutines share the connection
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < 8; ++i) {
+        futures.push_back(std::async(std::launch::async, [&db] {
+            return scandium::sync_wait(count_rows(db));
+        }));
+    }
+    for (auto &&future : futures) {
+        BOOST_CHECK_EQUAL(future.get(), 10);
+    }
+}
+
+#endif